@@ -0,0 +1,587 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "../src/kf128.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if KF_X86_SIMD
+#include <x86intrin.h>
+#endif
+
+/*
+ * every benchmark is a function that performs count operations. it is first
+ * calibrated so one run lasts at least MIN_RUN_NS, then run a few times to
+ * warm up, and then timed for the requested number of runs. percentiles are
+ * taken over the runs.
+ *
+ * cycles are read from the time-stamp counter, which ticks at a fixed rate
+ * on current x86 CPUs rather than at the core clock. on other CPUs only the
+ * wall-clock figures are reported.
+ */
+
+#define MAX_RUNS 1000
+#define MAX_RESULTS 64
+#define MIN_RUN_NS 20000000.0
+#define BLOCK_N_BLOCKS 4096
+#define FILE_CHUNK (1 << 20)
+#define XTS_SECTOR 4096
+#define XTS_SECTORS (BLOCK_N_BLOCKS * BLOCK_SIZE / XTS_SECTOR)
+#define MULTI_MSGS 256
+#define MULTI_MSG 64
+
+typedef struct {
+  char name[64];
+  const char *kernel;
+  double bytes;
+  size_t ops;
+  size_t runs;
+  double ns[MAX_RUNS];
+  double cycles[MAX_RUNS];
+} result;
+
+typedef struct {
+  const char *passphrase;
+  const char *infile;
+  const char *outfile;
+  const kf_kernel *kernel;
+  kf_opts opts;
+  kf_ctx ctx;
+  kf_xctx x;
+  kf_key key;
+  kf_xts xts;
+  kf_jit *jit;
+  kf_msg msgs[MULTI_MSGS];
+  uint32_t *buf;
+} bench_arg;
+
+typedef void (*bench_fn)(bench_arg *arg, size_t count);
+
+static result results[MAX_RESULTS];
+static size_t nresults;
+
+static size_t runs = 15;
+static size_t warmup = 3;
+
+static int has_cycles(void) { return KF_X86_SIMD; }
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double now_cycles(void) {
+#if KF_X86_SIMD
+  return (double)__rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static int compare_double(const void *a, const void *b) {
+  const double x = *(const double *)a;
+  const double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* the nearest-rank percentile of n sorted values */
+static double percentile(const double *sorted, size_t n, double p) {
+  size_t rank = (size_t)(p / 100.0 * n + 0.999999);
+  if (rank < 1)
+    rank = 1;
+  if (rank > n)
+    rank = n;
+  return sorted[rank - 1];
+}
+
+/* calibrate, warm up, and time fn, and store the result */
+static void run(const char *name, const char *kernel, bench_fn fn,
+                bench_arg *arg, double bytes, int calibrate) {
+
+  if (nresults == MAX_RESULTS)
+    return;
+
+  result *res = &results[nresults++];
+  size_t count = 1;
+
+  snprintf(res->name, sizeof(res->name), "%s", name);
+  res->kernel = kernel;
+  res->bytes = bytes;
+
+  while (calibrate) {
+    const double start = now_ns();
+    fn(arg, count);
+    if (now_ns() - start >= MIN_RUN_NS)
+      break;
+    count *= 2;
+  }
+
+  for (size_t i = 0; i < warmup; i++) {
+    fn(arg, count);
+  }
+
+  res->ops = count;
+  res->runs = runs;
+
+  for (size_t i = 0; i < runs; i++) {
+    const double c0 = now_cycles();
+    const double t0 = now_ns();
+
+    fn(arg, count);
+
+    const double t1 = now_ns();
+    const double c1 = now_cycles();
+
+    res->ns[i] = (t1 - t0) / count;
+    res->cycles[i] = (c1 - c0) / count;
+  }
+}
+
+static void bench_block(bench_arg *arg, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    kf_block(arg->buf, arg->buf, &arg->ctx);
+  }
+}
+
+static void bench_block_n(bench_arg *arg, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    arg->kernel->block_n_k(arg->buf, arg->buf, BLOCK_N_BLOCKS, &arg->x,
+                           &arg->x.sched);
+  }
+}
+
+static void bench_block_n_jit(bench_arg *arg, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    kf_jit_block_n(arg->jit, arg->buf, arg->buf, BLOCK_N_BLOCKS);
+  }
+}
+
+static void bench_xts_sector(bench_arg *arg, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    kf_xts_sectors(&arg->xts, i, 1, (uint8_t *)arg->buf, (uint8_t *)arg->buf,
+                   1);
+  }
+}
+
+static void bench_xts_sectors(bench_arg *arg, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    kf_xts_sectors(&arg->xts, i * XTS_SECTORS, XTS_SECTORS,
+                   (uint8_t *)arg->buf, (uint8_t *)arg->buf, 1);
+  }
+}
+
+static void bench_ctr_each(bench_arg *arg, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    for (size_t m = 0; m < MULTI_MSGS; m++)
+      kf_ctr_x(arg->msgs[m].in, arg->msgs[m].out, MULTI_MSG, arg->msgs[m].iv,
+               0, arg->msgs[m].x);
+  }
+}
+
+static void bench_ctr_multi(bench_arg *arg, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    kf_ctr_multi(arg->msgs, MULTI_MSGS);
+  }
+}
+
+static void bench_expand(bench_arg *arg, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    kf_expand_passphrase(arg->passphrase, &arg->ctx);
+  }
+}
+
+static void bench_invert(bench_arg *arg, size_t count) {
+  kf_ctx inv;
+  for (size_t i = 0; i < count; i++) {
+    kf_invert_ctx(&arg->ctx, &inv);
+  }
+}
+
+static void check(const int status) {
+  if (status != KF_OK) {
+    printf("Error: %s\n", kf_strerror(status));
+    exit(1);
+  }
+}
+
+static void bench_cbc_encrypt(bench_arg *arg, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    check(kf_encrypt_file_cbc_ex(arg->infile, arg->outfile, arg->passphrase,
+                                 "ABCDabcd1234EFGH", "vdslsilvfdkvlfdn",
+                                 &arg->opts));
+  }
+}
+
+static void bench_cbc_decrypt(bench_arg *arg, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    check(kf_decrypt_file_cbc_ex(arg->infile, arg->outfile, arg->passphrase,
+                                 &arg->opts));
+  }
+}
+
+static void bench_ctr_encrypt(bench_arg *arg, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    check(kf_encrypt_file_ctr_ex(arg->infile, arg->outfile, arg->passphrase,
+                                 "ABCDabcd1234EFGH", &arg->opts));
+  }
+}
+
+static void bench_ctr_decrypt(bench_arg *arg, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    check(kf_decrypt_file_ctr_ex(arg->infile, arg->outfile, arg->passphrase,
+                                 &arg->opts));
+  }
+}
+
+/* write size pseudo-random bytes to name */
+static void make_file(const char *name, const unsigned long long size) {
+  FILE *f = fopen(name, "wb");
+  if (!f) {
+    printf("Error: %s\n", kf_strerror(KF_ERR_OPEN));
+    exit(1);
+  }
+
+  uint8_t *chunk = malloc(FILE_CHUNK);
+  if (!chunk)
+    check(KF_ERR_MEMORY);
+
+  for (size_t i = 0; i < FILE_CHUNK; i++) {
+    chunk[i] = (uint8_t)rand();
+  }
+
+  for (unsigned long long left = size; left > 0;) {
+    const size_t n = left < FILE_CHUNK ? (size_t)left : FILE_CHUNK;
+    if (fwrite(chunk, 1, n, f) != n)
+      check(KF_ERR_WRITE);
+    left -= n;
+  }
+
+  free(chunk);
+  fclose(f);
+}
+
+static void format_size(char *buf, size_t len, unsigned long long size) {
+  if (size >= 1ULL << 30)
+    snprintf(buf, len, "%lluG", size >> 30);
+  else if (size >= 1ULL << 20)
+    snprintf(buf, len, "%lluM", size >> 20);
+  else
+    snprintf(buf, len, "%lluK", size >> 10);
+}
+
+/* time every file mode on an input of the given size */
+static void bench_files(bench_arg *arg, const char *dir,
+                        const unsigned long long size) {
+
+  char plain[512], enc[512], dec[512], label[16], name[64];
+
+  snprintf(plain, sizeof(plain), "%s/kf_bench_plain", dir);
+  snprintf(enc, sizeof(enc), "%s/kf_bench_enc", dir);
+  snprintf(dec, sizeof(dec), "%s/kf_bench_dec", dir);
+  format_size(label, sizeof(label), size);
+
+  make_file(plain, size);
+
+  /* big files are too slow to warm up and time many times */
+  const size_t saved_runs = runs, saved_warmup = warmup;
+  if (size >= 1ULL << 30) {
+    runs = runs < 3 ? runs : 3;
+    warmup = 0;
+  }
+
+  const char *kernel = kf_kernel_get()->name;
+
+  arg->infile = plain;
+  arg->outfile = enc;
+  snprintf(name, sizeof(name), "file_cbc_encrypt/%s", label);
+  run(name, kernel, bench_cbc_encrypt, arg, (double)size, size < 1ULL << 30);
+
+  arg->infile = enc;
+  arg->outfile = dec;
+  snprintf(name, sizeof(name), "file_cbc_decrypt/%s", label);
+  run(name, kernel, bench_cbc_decrypt, arg, (double)size, size < 1ULL << 30);
+
+  arg->infile = plain;
+  arg->outfile = enc;
+  snprintf(name, sizeof(name), "file_ctr_encrypt/%s", label);
+  run(name, kernel, bench_ctr_encrypt, arg, (double)size, size < 1ULL << 30);
+
+  arg->infile = enc;
+  arg->outfile = dec;
+  snprintf(name, sizeof(name), "file_ctr_decrypt/%s", label);
+  run(name, kernel, bench_ctr_decrypt, arg, (double)size, size < 1ULL << 30);
+
+  runs = saved_runs;
+  warmup = saved_warmup;
+
+  remove(plain);
+  remove(enc);
+  remove(dec);
+}
+
+static void print_text(void) {
+
+  printf("%-26s %-7s %12s %12s %10s %12s %12s\n", "benchmark", "kernel",
+         "ns/op p50", "cyc/B p50", "GB/s p50", "ns/op p90", "ns/op p99");
+
+  for (size_t i = 0; i < nresults; i++) {
+    result *r = &results[i];
+    double ns[MAX_RUNS], cyc[MAX_RUNS];
+
+    memcpy(ns, r->ns, r->runs * sizeof(double));
+    memcpy(cyc, r->cycles, r->runs * sizeof(double));
+    qsort(ns, r->runs, sizeof(double), compare_double);
+    qsort(cyc, r->runs, sizeof(double), compare_double);
+
+    const double p50 = percentile(ns, r->runs, 50);
+
+    printf("%-26s %-7s %12.1f ", r->name, r->kernel, p50);
+
+    if (r->bytes > 0 && has_cycles())
+      printf("%12.2f ", percentile(cyc, r->runs, 50) / r->bytes);
+    else
+      printf("%12s ", "-");
+
+    if (r->bytes > 0)
+      printf("%10.3f ", r->bytes / p50);
+    else
+      printf("%10s ", "-");
+
+    printf("%12.1f %12.1f\n", percentile(ns, r->runs, 90),
+           percentile(ns, r->runs, 99));
+  }
+}
+
+/* print the min, percentiles and max of n values, each multiplied by scale */
+static void print_stats(FILE *f, const char *key, const double *values,
+                        size_t n, double scale, int invert) {
+  double v[MAX_RUNS];
+
+  for (size_t i = 0; i < n; i++) {
+    v[i] = invert ? scale / values[i] : values[i] * scale;
+  }
+
+  qsort(v, n, sizeof(double), compare_double);
+
+  fprintf(f,
+          "\"%s\": {\"min\": %.6g, \"p50\": %.6g, \"p90\": %.6g, "
+          "\"p99\": %.6g, \"max\": %.6g}",
+          key, v[0], percentile(v, n, 50), percentile(v, n, 90),
+          percentile(v, n, 99), v[n - 1]);
+}
+
+static void print_json(FILE *f) {
+
+  fprintf(f, "{\n  \"runs\": %zu,\n  \"warmup\": %zu,\n", runs, warmup);
+  fprintf(f, "  \"cycles\": \"%s\",\n", has_cycles() ? "tsc" : "none");
+  fprintf(f, "  \"results\": [\n");
+
+  for (size_t i = 0; i < nresults; i++) {
+    result *r = &results[i];
+
+    fprintf(f,
+            "    {\"name\": \"%s\", \"kernel\": \"%s\", \"bytes\": %.0f, "
+            "\"ops\": %zu, \"runs\": %zu,\n     ",
+            r->name, r->kernel, r->bytes, r->ops, r->runs);
+    print_stats(f, "ns_per_op", r->ns, r->runs, 1, 0);
+
+    if (has_cycles()) {
+      fprintf(f, ",\n     ");
+      print_stats(f, "cycles_per_op", r->cycles, r->runs, 1, 0);
+    }
+
+    if (r->bytes > 0) {
+      if (has_cycles()) {
+        fprintf(f, ",\n     ");
+        print_stats(f, "cycles_per_byte", r->cycles, r->runs, 1 / r->bytes,
+                    0);
+      }
+      fprintf(f, ",\n     ");
+      print_stats(f, "gb_per_s", r->ns, r->runs, r->bytes, 1);
+    }
+
+    fprintf(f, "}%s\n", i + 1 < nresults ? "," : "");
+  }
+
+  fprintf(f, "  ]\n}\n");
+}
+
+static unsigned long long parse_size(const char *s) {
+  char *end;
+  unsigned long long size = strtoull(s, &end, 10);
+
+  if (*end == 'k' || *end == 'K')
+    size <<= 10;
+  else if (*end == 'm' || *end == 'M')
+    size <<= 20;
+  else if (*end == 'g' || *end == 'G')
+    size <<= 30;
+
+  return size;
+}
+
+void usage(void) {
+  printf("Usage: ./kf_bench [options]\n\n");
+  printf("-r\t--runs    \t-Timed runs per benchmark (default 15).\n");
+  printf("-w\t--warmup  \t-Untimed runs per benchmark (default 3).\n");
+  printf("-s\t--max-size\t-Largest file size, k, m or g suffix allowed "
+         "(default 64m, up to 10g).\n");
+  printf("-d\t--dir     \t-Directory for the file benchmarks (default .).\n");
+  printf("-K\t--kernel  \t-Only benchmark this kernel.\n");
+  printf("-J\t--json    \t-Also write the results as JSON to this file, or - "
+         "for stdout.\n");
+  printf("-h\t--help    \t-Show help.\n");
+  printf("\n");
+}
+
+int main(int argc, char **argv) {
+
+  static const unsigned long long sizes[] = {
+      1ULL << 10, 64ULL << 10, 1ULL << 20, 64ULL << 20, 1ULL << 30, 10ULL << 30};
+
+  unsigned long long max_size = 64ULL << 20;
+  const char *dir = ".";
+  const char *only = NULL;
+  const char *json = NULL;
+
+  static struct option long_options[] = {
+      {"runs", required_argument, 0, 'r'},
+      {"warmup", required_argument, 0, 'w'},
+      {"max-size", required_argument, 0, 's'},
+      {"dir", required_argument, 0, 'd'},
+      {"kernel", required_argument, 0, 'K'},
+      {"json", required_argument, 0, 'J'},
+      {"help", no_argument, 0, 'h'},
+      {0, 0, 0, 0}};
+
+  int c;
+  while ((c = getopt_long(argc, argv, "r:w:s:d:K:J:h", long_options, NULL)) !=
+         -1) {
+    switch (c) {
+    case 'r':
+      runs = strtoul(optarg, NULL, 10);
+      if (runs < 1 || runs > MAX_RUNS) {
+        printf("Error: runs must be between 1 and %d.\n", MAX_RUNS);
+        return 1;
+      }
+      break;
+    case 'w':
+      warmup = strtoul(optarg, NULL, 10);
+      break;
+    case 's':
+      max_size = parse_size(optarg);
+      break;
+    case 'd':
+      dir = optarg;
+      break;
+    case 'K':
+      only = optarg;
+      if (kf_kernel_select(only) != 0) {
+        printf("Error: unknown or unsupported kernel: %s\n", only);
+        return 1;
+      }
+      break;
+    case 'J':
+      json = optarg;
+      break;
+    case 'h':
+      usage();
+      return 0;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  static bench_arg arg;
+
+  arg.passphrase = "this is my benchmark password";
+  arg.opts.threads = 1;
+  arg.opts.buffer_size = KF_BUFFER_SIZE;
+  arg.opts.backend = KF_BACKEND_AUTO;
+
+  arg.buf = calloc(BLOCK_N_BLOCKS * 4, sizeof(uint32_t));
+  if (!arg.buf)
+    check(KF_ERR_MEMORY);
+
+  kf_expand_passphrase(arg.passphrase, &arg.ctx);
+  kf_expand_passphrase_x(arg.passphrase, &arg.x);
+  kf_key_init(&arg.key, arg.passphrase);
+  kf_xts_init(&arg.xts, &arg.key, XTS_SECTOR);
+
+  /* short messages under two keys taken in turn */
+  for (size_t m = 0; m < MULTI_MSGS; m++) {
+    uint8_t *msg = (uint8_t *)arg.buf + m * MULTI_MSG;
+
+    arg.msgs[m].x = m % 2 ? &arg.key.x : &arg.x;
+    arg.msgs[m].iv = arg.passphrase;
+    arg.msgs[m].in = msg;
+    arg.msgs[m].out = msg;
+    arg.msgs[m].len = MULTI_MSG;
+  }
+
+  run("block", "-", bench_block, &arg, BLOCK_SIZE, 1);
+
+  size_t count;
+  const kf_kernel *kernels = kf_kernel_list(&count);
+
+  for (size_t i = 0; i < count; i++) {
+    if (!kernels[i].supported() || (only && strcmp(only, kernels[i].name)))
+      continue;
+
+    arg.kernel = &kernels[i];
+    run("block_n", kernels[i].name, bench_block_n, &arg,
+        (double)BLOCK_N_BLOCKS * BLOCK_SIZE, 1);
+  }
+
+  arg.jit = kf_jit_create(&arg.x, &arg.x.sched);
+  if (!arg.jit)
+    check(KF_ERR_MEMORY);
+  if (kf_jit_native(arg.jit))
+    run("block_n", "jit", bench_block_n_jit, &arg,
+        (double)BLOCK_N_BLOCKS * BLOCK_SIZE, 1);
+  kf_jit_destroy(arg.jit);
+
+  run("xts_sector/4k", "-", bench_xts_sector, &arg, XTS_SECTOR, 1);
+  run("xts_sectors/64k", "-", bench_xts_sectors, &arg,
+      (double)XTS_SECTORS * XTS_SECTOR, 1);
+
+  run("ctr_each/256x64", "-", bench_ctr_each, &arg,
+      (double)MULTI_MSGS * MULTI_MSG, 1);
+  run("ctr_multi/256x64", "-", bench_ctr_multi, &arg,
+      (double)MULTI_MSGS * MULTI_MSG, 1);
+
+  run("expand_passphrase", "-", bench_expand, &arg, 0, 1);
+  run("invert_ctx", "-", bench_invert, &arg, 0, 1);
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    if (sizes[i] <= max_size)
+      bench_files(&arg, dir, sizes[i]);
+  }
+
+  free(arg.buf);
+
+  print_text();
+
+  if (json) {
+    FILE *f = strcmp(json, "-") == 0 ? stdout : fopen(json, "w");
+    if (!f) {
+      printf("Error: %s\n", kf_strerror(KF_ERR_OPEN));
+      return 1;
+    }
+    print_json(f);
+    if (f != stdout)
+      fclose(f);
+  }
+
+  return 0;
+}
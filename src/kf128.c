@@ -7,6 +7,49 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef __unix__
+#include <pthread.h>
+#endif
+
+/**
+ * @brief a range of cbc ciphertext blocks for one decryption thread
+ *
+ */
+typedef struct {
+  const uint32_t *in;
+  uint32_t *out;
+  size_t nblocks;
+  const kf_key *key;
+} kf_cbc_job;
+
+/*
+ * the cbc pool keeps its workers for a whole file. the caller bumps the
+ * round and takes the first range itself, every worker takes the range of
+ * its own index, and the last one to finish wakes the caller.
+ */
+#ifdef __unix__
+
+typedef struct {
+  kf_cbc_pool *pool;
+  size_t index;
+} kf_cbc_worker;
+
+struct kf_cbc_pool {
+  kf_cbc_job jobs[KF_MAX_THREADS];
+  kf_cbc_worker slots[KF_MAX_THREADS];
+  pthread_t workers[KF_MAX_THREADS];
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  size_t threads;
+  size_t active;
+  size_t pending;
+  uint64_t round;
+  int stop;
+};
+
+#endif
+
 /**
  * @brief linear feedback shift register
  *
@@ -24,6 +67,39 @@ void kf_lfsr(uint32_t *shift_register) {
                     (*shift_register >> 1);
 }
 
+/**
+ * @brief advance the lfsr by up to KF_LFSR_LEAP steps at once
+ *
+ * step t feeds back bits t, t + 1, t + 2, t + 4 and t + 6 of the starting
+ * register, xored with the bit fed back by step t - 1, which sits in bit 31
+ * by then; step 0 uses the starting bit 31 instead. while t + 6 stays below
+ * 32 every one of those bits is still a bit of the starting register, so all
+ * of the feedback bits are a prefix xor of one word and are shifted in
+ * together.
+ *
+ * @param state the 32-bit shift register
+ * @param steps the number of steps, between 1 and KF_LFSR_LEAP
+ * @return uint32_t the shift register after the steps
+ */
+static inline uint32_t kf_lfsr_leap(const uint32_t state,
+                                    const unsigned steps) {
+
+  uint32_t taps = state ^ (state >> 1) ^ (state >> 2) ^ (state >> 4) ^
+                  (state >> 6);
+
+  taps ^= taps << 1;
+  taps ^= taps << 2;
+  taps ^= taps << 4;
+  taps ^= taps << 8;
+  taps ^= taps << 16;
+
+  taps ^= 0U - (state >> 31);
+
+  const uint32_t fed = taps & ((1U << steps) - 1);
+
+  return (state >> steps) | (fed << (32 - steps));
+}
+
 /**
  * @brief use the lfsr to generate a byte
  *
@@ -32,12 +108,33 @@ void kf_lfsr(uint32_t *shift_register) {
  */
 uint8_t kf_lfsr_byte(uint32_t *shift_register) {
 
-  for (int i = 0; i < 8; i++)
-    kf_lfsr(shift_register);
+  *shift_register = kf_lfsr_leap(*shift_register, 8);
 
   return *shift_register & 0x000000FF;
 }
 
+/**
+ * @brief advance the lfsr by any number of steps
+ *
+ * the result is identical to calling kf_lfsr steps times, but takes one leap
+ * per KF_LFSR_LEAP steps.
+ *
+ * @param shift_register the 32-bit shift register
+ * @param steps the number of steps
+ */
+void kf_lfsr_n(uint32_t *shift_register, size_t steps) {
+
+  uint32_t state = *shift_register;
+
+  for (; steps >= KF_LFSR_LEAP; steps -= KF_LFSR_LEAP)
+    state = kf_lfsr_leap(state, KF_LFSR_LEAP);
+
+  if (steps > 0)
+    state = kf_lfsr_leap(state, (unsigned)steps);
+
+  *shift_register = state;
+}
+
 /**
  * @brief perform a 32-bit pseudo-Hadamard transform
  *
@@ -85,30 +182,84 @@ void kf_invert_ctx(const kf_ctx *key, kf_ctx *inv) {
 }
 
 /**
- * @brief initialize an sbox
+ * @brief copy the key schedule of a ctx object
  *
- * initialize an sbox with pseudorandom data derived from key material.
+ * @param ctx a pointer to the ctx object
+ * @param k a pointer to the schedule object
+ */
+void kf_sched_ctx(const kf_ctx *ctx, kf_sched *k) {
+
+  memcpy(k->skey, ctx->skey, sizeof(k->skey));
+  memcpy(k->wkey, ctx->wkey, sizeof(k->wkey));
+}
+
+/**
+ * @brief build the decryption key schedule of a ctx object
  *
- * @param s the sbox array
+ * the schedule holds the round keys in reverse order and the white keys
+ * swapped, exactly as kf_invert_ctx leaves them, so a ctx can be used in
+ * both directions without a second copy of its S-boxes and P-box.
+ *
+ * @param ctx a pointer to the ctx object
+ * @param inv a pointer to the inverted schedule object
+ */
+void kf_invert_sched(const kf_ctx *ctx, kf_sched *inv) {
+
+  for (int i = 0; i < ROUNDS; i++) {
+    inv->skey[i][0] = ctx->skey[ROUNDS - i - 1][0];
+    inv->skey[i][1] = ctx->skey[ROUNDS - i - 1][1];
+  }
+
+  for (int i = 0; i < 4; i++) {
+    inv->wkey[0][i] = ctx->wkey[1][i];
+    inv->wkey[1][i] = ctx->wkey[0][i];
+  }
+}
+
+/**
+ * @brief initialize a pseudorandom permutation
+ *
+ * every step picks the k-th of the values not picked yet, k taken from the
+ * lfsr, and removes it from the list of remaining values. the permutations
+ * are at most SBOX_SIZE long, so the removal is a short memmove, which is
+ * cheaper than keeping an order-statistic tree up to date; the lfsr
+ * dominates the cost either way.
+ *
+ * @param p the permutation array
+ * @param n the number of values, at most SBOX_SIZE
  * @param seed the pseudorandom seed
  */
-void kf_init_sbox(uint8_t s[SBOX_SIZE], const uint32_t seed) {
+static inline void kf_init_perm(uint8_t *p, const unsigned n,
+                                const uint32_t seed) {
 
   uint8_t indexes[SBOX_SIZE];
 
   uint32_t seed_copy = seed;
 
-  for (size_t i = 0; i < SBOX_SIZE; i++) {
+  for (unsigned i = 0; i < n; i++) {
     indexes[i] = (uint8_t)i;
   }
 
-  for (int i = 0; i < SBOX_SIZE; i++) {
-    const size_t index = kf_lfsr_byte(&seed_copy) % (SBOX_SIZE - i);
-    s[i] = indexes[index];
-    memmove(indexes + index, indexes + index + 1, SBOX_SIZE - index - 1);
+  for (unsigned i = 0; i < n; i++) {
+    const unsigned index = kf_lfsr_byte(&seed_copy) % (n - i);
+    p[i] = indexes[index];
+    memmove(indexes + index, indexes + index + 1, n - index - 1);
   }
 }
 
+/**
+ * @brief initialize an sbox
+ *
+ * initialize an sbox with pseudorandom data derived from key material.
+ *
+ * @param s the sbox array
+ * @param seed the pseudorandom seed
+ */
+void kf_init_sbox(uint8_t s[SBOX_SIZE], const uint32_t seed) {
+
+  kf_init_perm(s, SBOX_SIZE, seed);
+}
+
 /**
  * @brief initialize a pbox
  *
@@ -119,19 +270,7 @@ void kf_init_sbox(uint8_t s[SBOX_SIZE], const uint32_t seed) {
  */
 void kf_init_pbox(uint8_t p[PBOX_SIZE], const uint32_t seed) {
 
-  uint8_t indexes[PBOX_SIZE];
-
-  uint32_t seed_copy = seed;
-
-  for (size_t i = 0; i < PBOX_SIZE; i++) {
-    indexes[i] = (uint8_t)i;
-  }
-
-  for (int i = 0; i < PBOX_SIZE; i++) {
-    const size_t index = kf_lfsr_byte(&seed_copy) % (PBOX_SIZE - i);
-    p[i] = indexes[index];
-    memmove(indexes + index, indexes + index + 1, PBOX_SIZE - index - 1);
-  }
+  kf_init_perm(p, PBOX_SIZE, seed);
 }
 
 /**
@@ -159,8 +298,7 @@ void kf_expand_passphrase(const char *passphrase, kf_ctx *ctx) {
     for (int j = 0; j < KEY_SIZE; j++) {
       key[j] ^= shift_register;
 
-      for (int k = 0; k < 32; k++)
-        kf_lfsr(&shift_register);
+      kf_lfsr_n(&shift_register, 32);
     }
   }
 
@@ -176,8 +314,7 @@ void kf_expand_passphrase(const char *passphrase, kf_ctx *ctx) {
   for (int i = 0; i < KEY_SIZE; i++) {
     key[i] ^= shift_register;
 
-    for (int j = 0; j < 32; j++)
-      kf_lfsr(&shift_register);
+    kf_lfsr_n(&shift_register, 32);
   }
 
   int count = 0;
@@ -214,7 +351,8 @@ void kf_expand_passphrase(const char *passphrase, kf_ctx *ctx) {
  * @param round the round index
  * @param ctx the ctx object
  */
-void kf_f(const uint32_t *in, uint32_t *out, const size_t round, kf_ctx *ctx) {
+void kf_f(const uint32_t *in, uint32_t *out, const size_t round,
+          const kf_ctx *ctx) {
 
   const uint8_t *in8 = (const uint8_t *)in;
 
@@ -244,7 +382,7 @@ void kf_f(const uint32_t *in, uint32_t *out, const size_t round, kf_ctx *ctx) {
  * @param ctx a pointer to the ctx object
  */
 void kf_round(const uint32_t *in, uint32_t *out, const size_t round,
-              kf_ctx *ctx) {
+              const kf_ctx *ctx) {
 
   uint32_t tmp[2];
 
@@ -262,6 +400,50 @@ void kf_round(const uint32_t *in, uint32_t *out, const size_t round,
   }
 }
 
+/*
+ * one round of kf_block with the halves named by the caller: the left half
+ * (l0, l1) takes the F function of the right half (r0, r1). the halves swap
+ * by passing them in the other order to the next round, so nothing is
+ * copied. sh holds the bit position each S-box output lands at after the
+ * P-box.
+ */
+#define KF_ROUND(l0, l1, r0, r1, r)                                            \
+  do {                                                                         \
+    const uint64_t v_ = (uint64_t)ctx->sbox[0][KF_BYTE(r0, 0)] << sh[0] |      \
+                        (uint64_t)ctx->sbox[1][KF_BYTE(r0, 1)] << sh[1] |      \
+                        (uint64_t)ctx->sbox[2][KF_BYTE(r0, 2)] << sh[2] |      \
+                        (uint64_t)ctx->sbox[3][KF_BYTE(r0, 3)] << sh[3] |      \
+                        (uint64_t)ctx->sbox[4][KF_BYTE(r1, 0)] << sh[4] |      \
+                        (uint64_t)ctx->sbox[5][KF_BYTE(r1, 1)] << sh[5] |      \
+                        (uint64_t)ctx->sbox[6][KF_BYTE(r1, 2)] << sh[6] |      \
+                        (uint64_t)ctx->sbox[7][KF_BYTE(r1, 3)] << sh[7];       \
+    const uint32_t lo_ = (uint32_t)v_;                                         \
+    const uint32_t hi_ = (uint32_t)(v_ >> 32);                                 \
+    uint32_t a_, b_;                                                           \
+    kf_pht(&lo_, &hi_, &a_, &b_);                                              \
+    l0 ^= a_ ^ ctx->skey[r][0];                                                \
+    l1 ^= b_ ^ ctx->skey[r][1];                                                \
+  } while (0)
+
+#define KF_ROUND_PAIR(r)                                                       \
+  KF_ROUND(l0, l1, r0, r1, (r));                                               \
+  KF_ROUND(r0, r1, l0, l1, (r) + 1);
+
+/* the rounds of kf_block, two at a time */
+#if ROUNDS == 16
+#define KF_ROUNDS()                                                            \
+  KF_ROUND_PAIR(0)                                                             \
+  KF_ROUND_PAIR(2)                                                             \
+  KF_ROUND_PAIR(4)                                                             \
+  KF_ROUND_PAIR(6)                                                             \
+  KF_ROUND_PAIR(8)                                                             \
+  KF_ROUND_PAIR(10)                                                            \
+  KF_ROUND_PAIR(12)                                                            \
+  KF_ROUND_PAIR(14)
+#else
+#error "KF_ROUNDS needs a list of round pairs for this ROUNDS"
+#endif
+
 /**
  * @brief the block function
  *
@@ -269,149 +451,2130 @@ void kf_round(const uint32_t *in, uint32_t *out, const size_t round,
  * 16 iterations of the round function, and a final key whitening step, before
  * returning the result as output.
  *
+ * the rounds are unrolled at compile time and the block stays in four locals
+ * whose halves swap by renaming, so leaving out the swap of the last round
+ * only means storing the halves the other way round. the output is identical
+ * to running kf_round ROUNDS times between the whitening steps.
+ *
  * @param in the input block
  * @param out the output block
  * @param ctx a pointer to the ctx object
  */
-void kf_block(const uint32_t *in, uint32_t *out, kf_ctx *ctx) {
+void kf_block(const uint32_t *in, uint32_t *out, const kf_ctx *ctx) {
+
+  unsigned sh[PBOX_SIZE];
+
+  for (int i = 0; i < PBOX_SIZE; i++) {
+    sh[i] = KF_SHIFT(ctx->pbox[i]);
+  }
+
+  uint32_t l0 = in[0] ^ ctx->wkey[0][0];
+  uint32_t l1 = in[1] ^ ctx->wkey[0][1];
+  uint32_t r0 = in[2] ^ ctx->wkey[0][2];
+  uint32_t r1 = in[3] ^ ctx->wkey[0][3];
+
+  KF_ROUNDS()
+
+  out[0] = r0 ^ ctx->wkey[1][0];
+  out[1] = r1 ^ ctx->wkey[1][1];
+  out[2] = l0 ^ ctx->wkey[1][2];
+  out[3] = l1 ^ ctx->wkey[1][3];
+}
+
+/**
+ * @brief run KF_LANES independent blocks through the cipher together
+ *
+ * the state of every lane is kept in a local array, and each round computes
+ * the F function for all lanes before any of them is combined with its left
+ * half. the S-box lookups of different lanes do not depend on each other, so
+ * the CPU can keep them in flight at the same time.
+ *
+ * @param in KF_LANES input blocks
+ * @param out KF_LANES output blocks
+ * @param ctx a pointer to the ctx object
+ * @param k a pointer to the schedule object
+ */
+static void kf_block_lanes(const uint32_t *in, uint32_t *out,
+                           const kf_ctx *ctx, const kf_sched *k) {
+
+  uint32_t s[KF_LANES][4];
+  uint32_t t[KF_LANES][2];
+
+  for (int l = 0; l < KF_LANES; l++) {
+    s[l][0] = in[4 * l + 0] ^ k->wkey[0][0];
+    s[l][1] = in[4 * l + 1] ^ k->wkey[0][1];
+    s[l][2] = in[4 * l + 2] ^ k->wkey[0][2];
+    s[l][3] = in[4 * l + 3] ^ k->wkey[0][3];
+  }
+
+  for (size_t r = 0; r < ROUNDS; r++) {
 
-  memcpy(out, in, sizeof(uint32_t) * 4);
+    for (int l = 0; l < KF_LANES; l++) {
+      const uint8_t *in8 = (const uint8_t *)&s[l][2];
+      uint8_t *out8 = (uint8_t *)t[l];
 
-  out[0] ^= ctx->wkey[0][0];
-  out[1] ^= ctx->wkey[0][1];
-  out[2] ^= ctx->wkey[0][2];
-  out[3] ^= ctx->wkey[0][3];
+      for (int i = 0; i < SBOX_COUNT; i++) {
+        out8[ctx->pbox[i]] = ctx->sbox[i][in8[i]];
+      }
+    }
 
-  for (size_t i = 0; i < ROUNDS; i++) {
-    kf_round(out, out, i, ctx);
+    for (int l = 0; l < KF_LANES; l++) {
+      kf_pht(&t[l][0], &t[l][1], &t[l][0], &t[l][1]);
+
+      t[l][0] ^= k->skey[r][0] ^ s[l][0];
+      t[l][1] ^= k->skey[r][1] ^ s[l][1];
+
+      if (r != ROUNDS - 1) {
+        s[l][0] = s[l][2];
+        s[l][1] = s[l][3];
+        s[l][2] = t[l][0];
+        s[l][3] = t[l][1];
+      } else {
+        s[l][0] = t[l][0];
+        s[l][1] = t[l][1];
+      }
+    }
   }
 
-  out[0] ^= ctx->wkey[1][0];
-  out[1] ^= ctx->wkey[1][1];
-  out[2] ^= ctx->wkey[1][2];
-  out[3] ^= ctx->wkey[1][3];
+  for (int l = 0; l < KF_LANES; l++) {
+    out[4 * l + 0] = s[l][0] ^ k->wkey[1][0];
+    out[4 * l + 1] = s[l][1] ^ k->wkey[1][1];
+    out[4 * l + 2] = s[l][2] ^ k->wkey[1][2];
+    out[4 * l + 3] = s[l][3] ^ k->wkey[1][3];
+  }
 }
 
 /**
- * @brief encrypt a file with knifefish in cipher-block-chaining mode.
+ * @brief the scalar multi-block function
  *
- * @param infile the name of the input file
- * @param outfile the name of the output file
- * @param passphrase the plaintext passphrase
- * @param iv the initialization vector
- * @param padding random padding
+ * the scalar multi-block function runs nblocks independent 128-bit blocks
+ * through the block function. blocks are processed KF_LANES at a time so
+ * that the S-box lookups of different blocks overlap, and any remaining
+ * blocks go through the same code padded to KF_LANES. the output is
+ * identical to calling kf_block on every block. in and out may point to the
+ * same buffer.
+ *
+ * @param in the input blocks
+ * @param out the output blocks
+ * @param nblocks the number of 128-bit blocks
+ * @param ctx a pointer to the ctx object
  */
-void kf_encrypt_file_cbc(const char *infile, const char *outfile,
-                         const char *passphrase, const char *iv,
-                         const char *padding) {
+void kf_block_n_scalar(const uint32_t *in, uint32_t *out, size_t nblocks,
+                       const kf_ctx *ctx) {
 
-  kf_ctx ctx;
-  kf_expand_passphrase(passphrase, &ctx);
+  kf_sched k;
 
-  FILE *in = fopen(infile, "rb");
-  FILE *out = fopen(outfile, "wb");
+  kf_sched_ctx(ctx, &k);
+  kf_block_n_scalar_k(in, out, nblocks, ctx, &k);
+}
+
+/**
+ * @brief the scalar multi-block function with an explicit key schedule
+ *
+ * the S-boxes and the P-box come from ctx and the keys from k, so the
+ * inverted schedule of a ctx decrypts with the same tables.
+ *
+ * @param in the input blocks
+ * @param out the output blocks
+ * @param nblocks the number of 128-bit blocks
+ * @param ctx a pointer to the ctx object
+ * @param k a pointer to the schedule object
+ */
+void kf_block_n_scalar_k(const uint32_t *in, uint32_t *out, size_t nblocks,
+                         const kf_ctx *ctx, const kf_sched *k) {
 
-  fwrite(iv, sizeof(char), BLOCK_SIZE, out);
+  size_t i = 0;
 
-  fseek(in, 0L, SEEK_END);
-  const long input_size = ftell(in);
-  rewind(in);
+  for (; i + KF_LANES <= nblocks; i += KF_LANES) {
+    kf_block_lanes(in + 4 * i, out + 4 * i, ctx, k);
+  }
 
-  const long remaining = input_size % BLOCK_SIZE;
-  const long block_count = input_size / BLOCK_SIZE + (remaining > 0);
+  if (i < nblocks) {
+    uint32_t tail[KF_LANES * 4] = {0};
 
-  uint32_t block[4], key[4], tmp[4];
+    memcpy(tail, in + 4 * i, (nblocks - i) * BLOCK_SIZE);
+    kf_block_lanes(tail, tail, ctx, k);
+    memcpy(out + 4 * i, tail, (nblocks - i) * BLOCK_SIZE);
+  }
+}
 
-  memcpy(key, iv, sizeof(uint32_t) * 4);
+/**
+ * @brief build the fused S-box/P-box tables
+ *
+ * the P-box is fixed for the life of a key, so the output of every S-box can
+ * be stored already moved into the byte lane the P-box sends it to. entry v
+ * of table i holds sbox[i][v] in byte pbox[i] of the F output, with the
+ * first output word in the low 32 bits and the second in the high 32 bits.
+ *
+ * @param ctx a pointer to the ctx object
+ * @param x a pointer to the expanded ctx object
+ */
+void kf_fuse_ctx(const kf_ctx *ctx, kf_xctx *x) {
 
-  for (int i = 0; i < block_count; i++) {
+  if (&x->ctx != ctx)
+    memcpy(&x->ctx, ctx, sizeof(kf_ctx));
 
-    if (i == block_count - 1 && remaining != 0) {
-      memcpy(block, padding, sizeof(uint32_t) * 4);
-      fread(block, sizeof(uint8_t), remaining, in);
-      ((uint8_t *)block)[BLOCK_SIZE - 1] = (uint8_t)remaining;
-    } else {
-      fread(block, sizeof(uint32_t), 4, in);
+  for (int i = 0; i < SBOX_COUNT; i++) {
+    for (int v = 0; v < SBOX_SIZE; v++) {
+      uint32_t lane[2] = {0, 0};
+      ((uint8_t *)lane)[ctx->pbox[i]] = ctx->sbox[i][v];
+      x->spbox[i][v] = lane[0] | ((uint64_t)lane[1] << 32);
     }
+  }
+
+  kf_sched_ctx(ctx, &x->sched);
+}
 
-    block[0] ^= key[0];
-    block[1] ^= key[1];
-    block[2] ^= key[2];
-    block[3] ^= key[3];
+/**
+ * @brief use the passphrase to initalize the expanded ctx object
+ *
+ * @param passphrase the plain-text passphrase
+ * @param x a pointer to the expanded ctx object
+ */
+void kf_expand_passphrase_x(const char *passphrase, kf_xctx *x) {
+
+  kf_expand_passphrase(passphrase, &x->ctx);
+  kf_fuse_ctx(&x->ctx, x);
+}
+
+/**
+ * @brief invert the expanded ctx object
+ *
+ * @param key a pointer to the input expanded ctx
+ * @param inv a pointer to the inverted expanded ctx
+ */
+void kf_invert_xctx(const kf_xctx *key, kf_xctx *inv) {
+
+  memcpy(inv->spbox, key->spbox, sizeof(key->spbox));
+  kf_invert_ctx(&key->ctx, &inv->ctx);
+  kf_invert_sched(&key->ctx, &inv->sched);
+}
+
+/**
+ * @brief expand a passphrase into a key object
+ *
+ * the key holds the expanded ctx and the schedule that decrypts with it,
+ * ready for the file and stream modes.
+ *
+ * @param key a pointer to the key object
+ * @param passphrase the plain-text passphrase
+ */
+void kf_key_init(kf_key *key, const char *passphrase) {
+
+  KF_STATS_START(start);
+
+  kf_expand_passphrase_x(passphrase, &key->x);
+  kf_invert_sched(&key->x.ctx, &key->inv);
+
+  KF_STATS_ADD(keys, 1);
+  KF_STATS_STOP(key_ns, start);
+}
+
+/**
+ * @brief overwrite memory with zeros
+ *
+ * the stores go through a volatile pointer so they are not dropped when the
+ * memory is freed or goes out of scope right after.
+ *
+ * @param p the memory
+ * @param len the length in bytes
+ */
+void kf_wipe(void *p, size_t len) {
+
+  volatile uint8_t *v = (volatile uint8_t *)p;
+
+  while (len--)
+    *v++ = 0;
+}
+
+/**
+ * @brief the f function on the fused tables
+ *
+ * eight table loads OR'd together replace the S-box substitution and the
+ * P-box permutation, and are followed by the pseudo-hadamard transform.
+ *
+ * @param r0 the first word of the input half
+ * @param r1 the second word of the input half
+ * @param a the first output word
+ * @param b the second output word
+ * @param x a pointer to the expanded ctx object
+ */
+static inline void kf_f_x(const uint32_t r0, const uint32_t r1, uint32_t *a,
+                          uint32_t *b, const kf_xctx *x) {
+
+  const uint64_t v =
+      x->spbox[0][KF_BYTE(r0, 0)] | x->spbox[1][KF_BYTE(r0, 1)] |
+      x->spbox[2][KF_BYTE(r0, 2)] | x->spbox[3][KF_BYTE(r0, 3)] |
+      x->spbox[4][KF_BYTE(r1, 0)] | x->spbox[5][KF_BYTE(r1, 1)] |
+      x->spbox[6][KF_BYTE(r1, 2)] | x->spbox[7][KF_BYTE(r1, 3)];
+
+  const uint32_t lo = (uint32_t)v;
+  const uint32_t hi = (uint32_t)(v >> 32);
+
+  kf_pht(&lo, &hi, a, b);
+}
+
+/**
+ * @brief the block function on the fused tables
+ *
+ * the output is identical to kf_block. the four words of the block stay in
+ * locals and the halves are swapped by renaming them.
+ *
+ * @param in the input block
+ * @param out the output block
+ * @param x a pointer to the expanded ctx object
+ * @param k a pointer to the schedule object
+ */
+static inline void kf_block_xk(const uint32_t *in, uint32_t *out,
+                               const kf_xctx *x, const kf_sched *k) {
+
+  uint32_t l0 = in[0] ^ k->wkey[0][0];
+  uint32_t l1 = in[1] ^ k->wkey[0][1];
+  uint32_t r0 = in[2] ^ k->wkey[0][2];
+  uint32_t r1 = in[3] ^ k->wkey[0][3];
+
+  uint32_t a, b;
+
+  for (size_t r = 0; r < ROUNDS - 1; r++) {
+    kf_f_x(r0, r1, &a, &b, x);
+
+    a ^= k->skey[r][0] ^ l0;
+    b ^= k->skey[r][1] ^ l1;
+
+    l0 = r0;
+    l1 = r1;
+    r0 = a;
+    r1 = b;
+  }
+
+  kf_f_x(r0, r1, &a, &b, x);
+
+  l0 ^= a ^ k->skey[ROUNDS - 1][0];
+  l1 ^= b ^ k->skey[ROUNDS - 1][1];
+
+  out[0] = l0 ^ k->wkey[1][0];
+  out[1] = l1 ^ k->wkey[1][1];
+  out[2] = r0 ^ k->wkey[1][2];
+  out[3] = r1 ^ k->wkey[1][3];
+}
+
+/**
+ * @brief the block function on the fused tables
+ *
+ * @param in the input block
+ * @param out the output block
+ * @param x a pointer to the expanded ctx object
+ */
+void kf_block_x(const uint32_t *in, uint32_t *out, const kf_xctx *x) {
+
+  kf_block_xk(in, out, x, &x->sched);
+}
 
-    kf_block(block, tmp, &ctx);
+/**
+ * @brief the block function on the fused tables with an explicit schedule
+ *
+ * with the schedule from kf_invert_sched this decrypts, reading the same
+ * tables as encryption.
+ *
+ * @param in the input block
+ * @param out the output block
+ * @param x a pointer to the expanded ctx object
+ * @param k a pointer to the schedule object
+ */
+void kf_block_x_k(const uint32_t *in, uint32_t *out, const kf_xctx *x,
+                  const kf_sched *k) {
+
+  kf_block_xk(in, out, x, k);
+}
 
-    memcpy(key, tmp, sizeof(uint32_t) * 4);
+/**
+ * @brief run KF_LANES independent blocks through the fused tables together
+ *
+ * @param in KF_LANES input blocks
+ * @param out KF_LANES output blocks
+ * @param x a pointer to the expanded ctx object
+ */
+static void kf_block_lanes_x(const uint32_t *in, uint32_t *out,
+                             const kf_xctx *x, const kf_sched *k) {
+
+  uint32_t s[KF_LANES][4];
 
-    fwrite(tmp, sizeof(uint32_t), 4, out);
+  for (int l = 0; l < KF_LANES; l++) {
+    s[l][0] = in[4 * l + 0] ^ k->wkey[0][0];
+    s[l][1] = in[4 * l + 1] ^ k->wkey[0][1];
+    s[l][2] = in[4 * l + 2] ^ k->wkey[0][2];
+    s[l][3] = in[4 * l + 3] ^ k->wkey[0][3];
   }
 
-  if (remaining == 0) {
-    memset(block, 0, sizeof(uint32_t) * 4);
+  for (size_t r = 0; r < ROUNDS - 1; r++) {
+    for (int l = 0; l < KF_LANES; l++) {
+      uint32_t a, b;
+
+      kf_f_x(s[l][2], s[l][3], &a, &b, x);
+
+      a ^= k->skey[r][0] ^ s[l][0];
+      b ^= k->skey[r][1] ^ s[l][1];
+
+      s[l][0] = s[l][2];
+      s[l][1] = s[l][3];
+      s[l][2] = a;
+      s[l][3] = b;
+    }
+  }
 
-    block[0] ^= key[0];
-    block[1] ^= key[1];
-    block[2] ^= key[2];
-    block[3] ^= key[3];
+  for (int l = 0; l < KF_LANES; l++) {
+    uint32_t a, b;
 
-    kf_block(block, tmp, &ctx);
+    kf_f_x(s[l][2], s[l][3], &a, &b, x);
 
-    fwrite(tmp, sizeof(uint32_t), 4, out);
+    out[4 * l + 0] = s[l][0] ^ a ^ k->skey[ROUNDS - 1][0] ^ k->wkey[1][0];
+    out[4 * l + 1] = s[l][1] ^ b ^ k->skey[ROUNDS - 1][1] ^ k->wkey[1][1];
+    out[4 * l + 2] = s[l][2] ^ k->wkey[1][2];
+    out[4 * l + 3] = s[l][3] ^ k->wkey[1][3];
   }
+}
+
+/**
+ * @brief the multi-block function on the fused tables
+ *
+ * the output is identical to kf_block_n_scalar. in and out may point to the
+ * same buffer.
+ *
+ * @param in the input blocks
+ * @param out the output blocks
+ * @param nblocks the number of 128-bit blocks
+ * @param x a pointer to the expanded ctx object
+ */
+void kf_block_n_fused(const uint32_t *in, uint32_t *out, size_t nblocks,
+                      const kf_xctx *x) {
 
-  fclose(in);
-  fclose(out);
+  kf_block_n_fused_k(in, out, nblocks, x, &x->sched);
 }
 
 /**
- * @brief decrypt a file with knifefish in cipher-block-chaining mode.
+ * @brief the multi-block function on the fused tables with an explicit
+ * schedule
  *
- * @param infile the name of the input file
- * @param outfile the name of the output file
- * @param passphrase the plaintext passphrase
- * @param iv the initialization vector
- * @param padding random padding
+ * @param in the input blocks
+ * @param out the output blocks
+ * @param nblocks the number of 128-bit blocks
+ * @param x a pointer to the expanded ctx object
+ * @param k a pointer to the schedule object
+ */
+void kf_block_n_fused_k(const uint32_t *in, uint32_t *out, size_t nblocks,
+                        const kf_xctx *x, const kf_sched *k) {
+
+  size_t i = 0;
+
+  for (; i + KF_LANES <= nblocks; i += KF_LANES) {
+    kf_block_lanes_x(in + 4 * i, out + 4 * i, x, k);
+  }
+
+  for (; i < nblocks; i++) {
+    kf_block_xk(in + 4 * i, out + 4 * i, x, k);
+  }
+}
+
+/**
+ * @brief run up to KF_LANES blocks, each under its own key, together
+ *
+ * the lanes are laid out as in kf_block_lanes_x, but every lane reads the
+ * tables and schedule of its own expanded ctx. the lookups of different
+ * lanes are still independent, so they overlap as well as those of one key.
+ *
+ * @param blocks the blocks, encrypted in place
+ * @param x a pointer to the expanded ctx object of every block
+ * @param lanes the number of blocks, at most KF_LANES
  */
-void kf_decrypt_file_cbc(const char *infile, const char *outfile,
-                         const char *passphrase) {
+static void kf_block_lanes_multi(uint32_t *blocks, const kf_xctx *const *x,
+                                 const size_t lanes) {
 
-  kf_ctx ctx, inv;
-  kf_expand_passphrase(passphrase, &ctx);
-  kf_invert_ctx(&ctx, &inv);
+  uint32_t s[KF_LANES][4];
 
-  FILE *in = fopen(infile, "rb");
-  FILE *out = fopen(outfile, "wb");
+  for (size_t l = 0; l < lanes; l++) {
+    const kf_sched *k = &x[l]->sched;
 
-  fseek(in, 0L, SEEK_END);
-  const long input_size = ftell(in);
-  rewind(in);
+    s[l][0] = blocks[4 * l + 0] ^ k->wkey[0][0];
+    s[l][1] = blocks[4 * l + 1] ^ k->wkey[0][1];
+    s[l][2] = blocks[4 * l + 2] ^ k->wkey[0][2];
+    s[l][3] = blocks[4 * l + 3] ^ k->wkey[0][3];
+  }
 
-  uint32_t block[4], key[4], tmp[4];
+  for (size_t r = 0; r < ROUNDS - 1; r++) {
+    for (size_t l = 0; l < lanes; l++) {
+      const kf_sched *k = &x[l]->sched;
+      uint32_t a, b;
 
-  fread(key, sizeof(uint32_t), 4, in);
+      kf_f_x(s[l][2], s[l][3], &a, &b, x[l]);
 
-  const long block_count = input_size / BLOCK_SIZE - 1;
+      a ^= k->skey[r][0] ^ s[l][0];
+      b ^= k->skey[r][1] ^ s[l][1];
 
-  for (int i = 0; i < block_count; i++) {
+      s[l][0] = s[l][2];
+      s[l][1] = s[l][3];
+      s[l][2] = a;
+      s[l][3] = b;
+    }
+  }
 
-    fread(block, sizeof(uint32_t), 4, in);
+  for (size_t l = 0; l < lanes; l++) {
+    const kf_sched *k = &x[l]->sched;
+    uint32_t a, b;
 
-    kf_block(block, tmp, &inv);
+    kf_f_x(s[l][2], s[l][3], &a, &b, x[l]);
 
-    tmp[0] ^= key[0];
-    tmp[1] ^= key[1];
-    tmp[2] ^= key[2];
-    tmp[3] ^= key[3];
+    blocks[4 * l + 0] = s[l][0] ^ a ^ k->skey[ROUNDS - 1][0] ^ k->wkey[1][0];
+    blocks[4 * l + 1] = s[l][1] ^ b ^ k->skey[ROUNDS - 1][1] ^ k->wkey[1][1];
+    blocks[4 * l + 2] = s[l][2] ^ k->wkey[1][2];
+    blocks[4 * l + 3] = s[l][3] ^ k->wkey[1][3];
+  }
+}
 
-    if (i != block_count - 1) {
-      fwrite(tmp, sizeof(uint32_t), 4, out);
-    } else {
-      const uint8_t remaining = ((uint8_t *)tmp)[BLOCK_SIZE - 1];
-      fwrite(tmp, sizeof(uint8_t), remaining, out);
+/**
+ * @brief sort the blocks of a window by their key, keeping their order
+ *
+ * @param x a pointer to the expanded ctx object of every block
+ * @param order the output block indices
+ * @param n the number of blocks
+ */
+static void kf_multi_sort(const kf_xctx *const *x, size_t *order,
+                          const size_t n) {
+
+  for (size_t i = 0; i < n; i++) {
+    const uintptr_t key = (uintptr_t)x[i];
+    size_t j = i;
+
+    for (; j > 0 && (uintptr_t)x[order[j - 1]] > key; j--)
+      order[j] = order[j - 1];
+
+    order[j] = i;
+  }
+}
+
+/**
+ * @brief the multi-block function with a key for every block
+ *
+ * block i is encrypted with the fused tables of xs[i], and the output is
+ * identical to calling kf_block_x on every block. the blocks are taken
+ * KF_CTR_BATCH at a time and grouped by key, which need not be distinct: a
+ * key with at least KF_LANES blocks in the group goes through kf_block_n_x
+ * while its tables are hot, and the blocks of the other keys are interleaved
+ * KF_LANES at a time. keys from a kf_key_cache can be passed as &key->x. in
+ * and out may point to the same buffer.
+ *
+ * @param xs a pointer to the expanded ctx object of every block
+ * @param in the input blocks
+ * @param out the output blocks
+ * @param nblocks the number of 128-bit blocks
+ */
+void kf_block_multi(const kf_xctx *const *xs, const uint32_t *in,
+                    uint32_t *out, const size_t nblocks) {
+
+  size_t order[KF_CTR_BATCH];
+  uint32_t run[KF_CTR_BATCH * 4];
+  uint32_t pool[KF_CTR_BATCH * 4];
+  const kf_xctx *pool_x[KF_CTR_BATCH];
+  size_t pool_at[KF_CTR_BATCH];
+
+  for (size_t w = 0; w < nblocks; w += KF_CTR_BATCH) {
+    const size_t left = nblocks - w;
+    const size_t n = left < KF_CTR_BATCH ? left : KF_CTR_BATCH;
+    const kf_xctx *const *x = xs + w;
+    const uint32_t *src = in + 4 * w;
+    uint32_t *dst = out + 4 * w;
+
+    kf_multi_sort(x, order, n);
+
+    size_t npool = 0;
+
+    for (size_t i = 0, end; i < n; i = end) {
+      for (end = i + 1; end < n && x[order[end]] == x[order[i]]; end++)
+        ;
+
+      if (end - i >= KF_LANES) {
+        for (size_t j = i; j < end; j++)
+          memcpy(run + 4 * (j - i), src + 4 * order[j], BLOCK_SIZE);
+
+        kf_block_n_x(run, run, end - i, x[order[i]]);
+
+        for (size_t j = i; j < end; j++)
+          memcpy(dst + 4 * order[j], run + 4 * (j - i), BLOCK_SIZE);
+      } else {
+        for (size_t j = i; j < end; j++, npool++) {
+          memcpy(pool + 4 * npool, src + 4 * order[j], BLOCK_SIZE);
+          pool_x[npool] = x[order[j]];
+          pool_at[npool] = order[j];
+        }
+      }
     }
-    memcpy(key, block, sizeof(uint32_t) * 4);
+
+    for (size_t i = 0; i < npool; i += KF_LANES) {
+      const size_t rest = npool - i;
+
+      kf_block_lanes_multi(pool + 4 * i, pool_x + i,
+                           rest < KF_LANES ? rest : KF_LANES);
+    }
+
+    for (size_t i = 0; i < npool; i++)
+      memcpy(dst + 4 * pool_at[i], pool + 4 * i, BLOCK_SIZE);
   }
+}
+
+/**
+ * @brief describe a status code returned by the file modes.
+ *
+ * @param status the status code
+ * @return const char* a human readable description
+ */
+const char *kf_strerror(const int status) {
+
+  switch (status) {
+  case KF_OK:
+    return "success";
+  case KF_ERR_OPEN:
+    return "cannot open file";
+  case KF_ERR_READ:
+    return "read failed";
+  case KF_ERR_WRITE:
+    return "write failed";
+  case KF_ERR_FORMAT:
+    return "input is not a valid ciphertext";
+  case KF_ERR_MEMORY:
+    return "out of memory";
+  case KF_ERR_AUTH:
+    return "authentication failed";
+  case KF_ERR_UNSUPPORTED:
+    return "not supported by this build";
+  default:
+    return "unknown error";
+  }
+}
+
+/**
+ * @brief get the number of 128-bit blocks in one file mode buffer
+ *
+ * @param opts the file mode options, or NULL for the defaults
+ * @return size_t the number of blocks, at least 1
+ */
+static size_t kf_buffer_blocks(const kf_opts *opts) {
+
+  const size_t size =
+      (opts && opts->buffer_size > 0) ? opts->buffer_size : KF_BUFFER_SIZE;
+
+  return size < BLOCK_SIZE ? 1 : size / BLOCK_SIZE;
+}
+
+/**
+ * @brief get the number of worker threads for the file modes
+ *
+ * @param opts the file mode options, or NULL for the defaults
+ * @return size_t the number of threads, between 1 and KF_MAX_THREADS
+ */
+static size_t kf_threads(const kf_opts *opts) {
+
+  const size_t threads = (opts && opts->threads > 0) ? opts->threads : 1;
+
+  return threads > KF_MAX_THREADS ? KF_MAX_THREADS : threads;
+}
+
+/**
+ * @brief open the input and output files of a file mode
+ *
+ * the name "-" stands for stdin or stdout, which are used as they are.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param in the input file
+ * @param out the output file
+ * @return int KF_OK, or KF_ERR_OPEN
+ */
+static int kf_open_files(const char *infile, const char *outfile, FILE **in,
+                         FILE **out) {
+
+  *in = strcmp(infile, "-") == 0 ? stdin : fopen(infile, "rb");
+  if (!*in)
+    return KF_ERR_OPEN;
+
+  *out = strcmp(outfile, "-") == 0 ? stdout : fopen(outfile, "wb");
+  if (!*out) {
+    if (*in != stdin)
+      fclose(*in);
+    return KF_ERR_OPEN;
+  }
+
+  return KF_OK;
+}
+
+/**
+ * @brief close the input and output files of a file mode
+ *
+ * closing the output flushes it, so a failed close is a write failure.
+ * stdin and stdout are flushed but left open.
+ *
+ * @param in the input file
+ * @param out the output file
+ * @param status the status of the file mode so far
+ * @return int the status, or KF_ERR_WRITE
+ */
+static int kf_close_files(FILE *in, FILE *out, const int status) {
+
+  const int closed = out == stdout ? fflush(out) : fclose(out);
+
+  if (in != stdin)
+    fclose(in);
+
+  return (status == KF_OK && closed != 0) ? KF_ERR_WRITE : status;
+}
+
+/**
+ * @brief read up to len bytes
+ *
+ * @param buffer the buffer
+ * @param len the number of bytes
+ * @param in the input file
+ * @return size_t the number of bytes read
+ */
+static size_t kf_fread(void *buffer, const size_t len, FILE *in) {
+
+  KF_STATS_START(start);
+
+  const size_t got = fread(buffer, sizeof(uint8_t), len, in);
+
+  KF_STATS_ADD(reads, 1);
+  KF_STATS_ADD(bytes_read, got);
+  KF_STATS_STOP(io_ns, start);
+
+  return got;
+}
+
+/**
+ * @brief write exactly len bytes
+ *
+ * @param buffer the buffer
+ * @param len the number of bytes
+ * @param out the output file
+ * @return int KF_OK, or KF_ERR_WRITE on a short write
+ */
+static int kf_write(const void *buffer, const size_t len, FILE *out) {
+
+  KF_STATS_START(start);
+
+  const size_t put = fwrite(buffer, sizeof(uint8_t), len, out);
+
+  KF_STATS_ADD(writes, 1);
+  KF_STATS_ADD(bytes_written, put);
+  KF_STATS_STOP(io_ns, start);
+
+  return put == len ? KF_OK : KF_ERR_WRITE;
+}
+
+/**
+ * @brief encrypt a buffer of blocks in cipher-block-chaining mode
+ *
+ * @param in the plaintext blocks
+ * @param out the ciphertext blocks, in and out may point to the same buffer
+ * @param nblocks the number of blocks
+ * @param key the chaining block, updated to the last ciphertext block
+ * @param x a pointer to the expanded ctx object
+ */
+void kf_cbc_encrypt_blocks(const uint32_t *in, uint32_t *out,
+                           const size_t nblocks, uint32_t key[4],
+                           const kf_xctx *x) {
+
+  for (size_t i = 0; i < nblocks; i++) {
+    uint32_t *block = out + 4 * i;
+
+    block[0] = in[4 * i] ^ key[0];
+    block[1] = in[4 * i + 1] ^ key[1];
+    block[2] = in[4 * i + 2] ^ key[2];
+    block[3] = in[4 * i + 3] ^ key[3];
+
+    kf_block_x(block, block, x);
+
+    memcpy(key, block, sizeof(uint32_t) * 4);
+  }
+}
+
+/**
+ * @brief encrypt a run of whole blocks of a stream
+ *
+ * when in and out are word aligned and apart, the blocks are passed to
+ * kf_cbc_encrypt_blocks where they are. otherwise they go through an
+ * aligned buffer, KF_CBC_RUN at a time, so in and out can have any
+ * alignment.
+ *
+ * @param s the stream object
+ * @param in the plaintext blocks
+ * @param nblocks the number of blocks
+ * @param out the ciphertext blocks
+ */
+static void kf_cbc_encrypt_run(kf_cbc_stream *s, const uint8_t *in,
+                               const size_t nblocks, uint8_t *out) {
+
+  uint32_t buffer[KF_CBC_RUN * 4];
+
+  const uintptr_t i = (uintptr_t)in;
+  const uintptr_t o = (uintptr_t)out;
+  const uintptr_t bytes = nblocks * BLOCK_SIZE;
+
+  KF_STATS_ADD(blocks, nblocks);
+
+  if ((i | o) % sizeof(uint32_t) == 0 && (o + bytes <= i || i + bytes <= o)) {
+    kf_cbc_encrypt_blocks((const uint32_t *)in, (uint32_t *)out, nblocks,
+                          s->chain, &s->key->x);
+    return;
+  }
+
+  for (size_t done = 0; done < nblocks; done += KF_CBC_RUN) {
+    const size_t left = nblocks - done;
+    const size_t n = left < KF_CBC_RUN ? left : KF_CBC_RUN;
+
+    memcpy(buffer, in + BLOCK_SIZE * done, n * BLOCK_SIZE);
+    kf_cbc_encrypt_blocks(buffer, buffer, n, s->chain, &s->key->x);
+    memcpy(out + BLOCK_SIZE * done, buffer, n * BLOCK_SIZE);
+  }
+}
+
+/**
+ * @brief start encrypting a stream in cipher-block-chaining mode.
+ *
+ * the stream produces exactly the format of kf_encrypt_file_cbc: the iv,
+ * the ciphertext, and a last block holding the remaining plaintext bytes,
+ * the padding and the number of remaining bytes.
+ *
+ * @param s the stream object
+ * @param key a pointer to the key object, which must outlive the stream
+ * @param iv the initialization vector
+ * @param padding random padding
+ */
+void kf_cbc_encrypt_init(kf_cbc_stream *s, const kf_key *key, const char *iv,
+                         const char *padding) {
+
+  memset(s, 0, sizeof(*s));
+
+  s->key = key;
+  memcpy(s->chain, iv, BLOCK_SIZE);
+  memcpy(s->padding, padding, BLOCK_SIZE);
+}
+
+/**
+ * @brief write the iv before the first block of an encrypted stream
+ *
+ * @param s the stream object
+ * @param out the output buffer
+ * @return size_t the number of bytes written
+ */
+static size_t kf_cbc_encrypt_start(kf_cbc_stream *s, uint8_t *out) {
+
+  if (s->started)
+    return 0;
+
+  s->started = 1;
+  memcpy(out, s->chain, BLOCK_SIZE);
+
+  return BLOCK_SIZE;
+}
+
+/**
+ * @brief encrypt the next part of a stream in cipher-block-chaining mode.
+ *
+ * bytes that do not fill a block are carried to the next call. once the
+ * carried block is full, whole blocks are encrypted as a run.
+ *
+ * @param s the stream object
+ * @param in the plaintext
+ * @param len the length of the plaintext in bytes
+ * @param out the ciphertext, with room for len + 2 * BLOCK_SIZE bytes
+ * @return size_t the number of bytes written to out
+ */
+size_t kf_cbc_encrypt_update(kf_cbc_stream *s, const uint8_t *in, size_t len,
+                             uint8_t *out) {
+
+  KF_STATS_START(start);
+
+  size_t written = kf_cbc_encrypt_start(s, out);
+
+  while (len > 0) {
+    if (s->partial_len == 0 && len >= BLOCK_SIZE) {
+      const size_t nblocks = len / BLOCK_SIZE;
+
+      kf_cbc_encrypt_run(s, in, nblocks, out + written);
+      written += nblocks * BLOCK_SIZE;
+      in += nblocks * BLOCK_SIZE;
+      len -= nblocks * BLOCK_SIZE;
+      continue;
+    }
+
+    size_t take = BLOCK_SIZE - s->partial_len;
+    if (take > len)
+      take = len;
+
+    memcpy((uint8_t *)s->partial + s->partial_len, in, take);
+    s->partial_len += take;
+    in += take;
+    len -= take;
+
+    if (s->partial_len == BLOCK_SIZE) {
+      kf_cbc_encrypt_blocks(s->partial, s->partial, 1, s->chain, &s->key->x);
+      memcpy(out + written, s->partial, BLOCK_SIZE);
+      written += BLOCK_SIZE;
+      s->partial_len = 0;
+      KF_STATS_ADD(blocks, 1);
+    }
+  }
+
+  KF_STATS_STOP(cipher_ns, start);
+
+  return written;
+}
+
+/**
+ * @brief encrypt the next part of a stream from a scatter-gather list.
+ *
+ * the output is identical to calling kf_cbc_encrypt_update on every buffer
+ * in turn, and the buffers may end anywhere, as a block that is not full
+ * carries over to the next.
+ *
+ * @param s the stream object
+ * @param in the plaintext buffers
+ * @param n the number of buffers
+ * @param out the ciphertext, with room for their total length +
+ * 2 * BLOCK_SIZE bytes
+ * @return size_t the number of bytes written to out
+ */
+size_t kf_cbc_encrypt_update_iov(kf_cbc_stream *s, const struct iovec *in,
+                                 const int n, uint8_t *out) {
+
+  size_t written = 0;
+
+  for (int i = 0; i < n; i++)
+    written += kf_cbc_encrypt_update(s, in[i].iov_base, in[i].iov_len,
+                                     out + written);
+
+  return written;
+}
+
+/**
+ * @brief finish encrypting a stream in cipher-block-chaining mode.
+ *
+ * @param s the stream object
+ * @param out the ciphertext, with room for 2 * BLOCK_SIZE bytes
+ * @return size_t the number of bytes written to out
+ */
+size_t kf_cbc_encrypt_final(kf_cbc_stream *s, uint8_t *out) {
+
+  size_t written = kf_cbc_encrypt_start(s, out);
+  uint8_t *last = (uint8_t *)s->partial;
+
+  if (s->partial_len != 0) {
+    memcpy(last + s->partial_len, s->padding + s->partial_len,
+           BLOCK_SIZE - s->partial_len);
+    last[BLOCK_SIZE - 1] = (uint8_t)s->partial_len;
+  } else {
+    memset(last, 0, BLOCK_SIZE);
+  }
+
+  KF_STATS_START(start);
+
+  kf_cbc_encrypt_blocks(s->partial, s->partial, 1, s->chain, &s->key->x);
+  memcpy(out + written, s->partial, BLOCK_SIZE);
+
+  KF_STATS_ADD(blocks, 1);
+  KF_STATS_STOP(cipher_ns, start);
+
+  s->partial_len = 0;
+
+  return written + BLOCK_SIZE;
+}
+
+/**
+ * @brief decrypt the held block of a stream and advance the chaining block
+ *
+ * @param s the stream object
+ * @param out the plaintext block, which does not need to be aligned
+ */
+static void kf_cbc_decrypt_chain(kf_cbc_stream *s, void *out) {
+
+  uint32_t block[4];
+
+  /* the held blocks are counted but not timed: two clock reads would cost
+   * more than the block */
+  kf_block_x_k(s->held, block, &s->key->x, &s->key->inv);
+  KF_STATS_ADD(blocks, 1);
+
+  block[0] ^= s->chain[0];
+  block[1] ^= s->chain[1];
+  block[2] ^= s->chain[2];
+  block[3] ^= s->chain[3];
+
+  memcpy(s->chain, s->held, BLOCK_SIZE);
+  memcpy(out, block, BLOCK_SIZE);
+}
+
+/**
+ * @brief decrypt a run of whole blocks of a stream and advance the chaining
+ * block
+ *
+ * when in and out are word aligned and apart, every block after the first
+ * is decrypted where it is against the ciphertext block before it, in one
+ * call of kf_cbc_decrypt_blocks. otherwise the blocks go through aligned
+ * buffers, KF_CBC_RUN at a time, with the chaining block in front of them,
+ * so in and out can have any alignment and may be the same buffer.
+ *
+ * @param s the stream object
+ * @param in the ciphertext blocks
+ * @param nblocks the number of blocks
+ * @param out the plaintext blocks
+ */
+static void kf_cbc_decrypt_run(kf_cbc_stream *s, const uint8_t *in,
+                               const size_t nblocks, uint8_t *out) {
+
+  uint32_t cipher[(KF_CBC_RUN + 1) * 4];
+  uint32_t plain[KF_CBC_RUN * 4];
+
+  const uintptr_t i = (uintptr_t)in;
+  const uintptr_t o = (uintptr_t)out;
+  const uintptr_t bytes = nblocks * BLOCK_SIZE;
+  const int direct = nblocks > 1 && (i | o) % sizeof(uint32_t) == 0 &&
+                     (o + bytes <= i || i + bytes <= o);
+  const size_t staged = direct ? 1 : nblocks;
+
+  for (size_t done = 0; done < staged; done += KF_CBC_RUN) {
+    const size_t left = staged - done;
+    const size_t n = left < KF_CBC_RUN ? left : KF_CBC_RUN;
+
+    memcpy(cipher, s->chain, BLOCK_SIZE);
+    memcpy(cipher + 4, in + BLOCK_SIZE * done, n * BLOCK_SIZE);
+    kf_cbc_decrypt_blocks(cipher + 4, plain, n, s->key, 1);
+    memcpy(s->chain, cipher + 4 * n, BLOCK_SIZE);
+    memcpy(out + BLOCK_SIZE * done, plain, n * BLOCK_SIZE);
+  }
+
+  if (direct) {
+    kf_cbc_decrypt_blocks((const uint32_t *)(in + BLOCK_SIZE),
+                          (uint32_t *)(out + BLOCK_SIZE), nblocks - 1, s->key,
+                          1);
+    memcpy(s->chain, in + (nblocks - 1) * BLOCK_SIZE, BLOCK_SIZE);
+  }
+}
+
+/**
+ * @brief start decrypting a stream in cipher-block-chaining mode.
+ *
+ * @param s the stream object
+ * @param key a pointer to the key object, which must outlive the stream
+ */
+void kf_cbc_decrypt_init(kf_cbc_stream *s, const kf_key *key) {
+
+  memset(s, 0, sizeof(*s));
+
+  s->key = key;
+}
+
+/**
+ * @brief decrypt the next part of a stream in cipher-block-chaining mode.
+ *
+ * the first block of the stream is the iv. the newest complete block is
+ * held back until the next call, since the last block of the stream holds
+ * the padding. whole blocks before it are decrypted as a run.
+ *
+ * @param s the stream object
+ * @param in the ciphertext
+ * @param len the length of the ciphertext in bytes
+ * @param out the plaintext, with room for len + BLOCK_SIZE bytes
+ * @return size_t the number of bytes written to out
+ */
+size_t kf_cbc_decrypt_update(kf_cbc_stream *s, const uint8_t *in, size_t len,
+                             uint8_t *out) {
+
+  size_t written = 0;
+
+  while (len > 0) {
+    if (s->partial_len == 0 && s->started && len >= BLOCK_SIZE) {
+      const size_t nblocks = len / BLOCK_SIZE;
+
+      if (s->held_block) {
+        kf_cbc_decrypt_chain(s, out + written);
+        written += BLOCK_SIZE;
+      }
+
+      kf_cbc_decrypt_run(s, in, nblocks - 1, out + written);
+      written += (nblocks - 1) * BLOCK_SIZE;
+
+      memcpy(s->held, in + (nblocks - 1) * BLOCK_SIZE, BLOCK_SIZE);
+      s->held_block = 1;
+      in += nblocks * BLOCK_SIZE;
+      len -= nblocks * BLOCK_SIZE;
+      continue;
+    }
+
+    size_t take = BLOCK_SIZE - s->partial_len;
+    if (take > len)
+      take = len;
+
+    memcpy((uint8_t *)s->partial + s->partial_len, in, take);
+    s->partial_len += take;
+    in += take;
+    len -= take;
+
+    if (s->partial_len < BLOCK_SIZE)
+      continue;
+
+    s->partial_len = 0;
+
+    if (!s->started) {
+      memcpy(s->chain, s->partial, BLOCK_SIZE);
+      s->started = 1;
+      continue;
+    }
+
+    if (s->held_block) {
+      kf_cbc_decrypt_chain(s, out + written);
+      written += BLOCK_SIZE;
+    }
+
+    memcpy(s->held, s->partial, BLOCK_SIZE);
+    s->held_block = 1;
+  }
+
+  return written;
+}
+
+/**
+ * @brief decrypt the next part of a stream from a scatter-gather list.
+ *
+ * the output is identical to calling kf_cbc_decrypt_update on every buffer
+ * in turn, and the buffers may end anywhere.
+ *
+ * @param s the stream object
+ * @param in the ciphertext buffers
+ * @param n the number of buffers
+ * @param out the plaintext, with room for their total length + BLOCK_SIZE
+ * bytes
+ * @return size_t the number of bytes written to out
+ */
+size_t kf_cbc_decrypt_update_iov(kf_cbc_stream *s, const struct iovec *in,
+                                 const int n, uint8_t *out) {
+
+  size_t written = 0;
+
+  for (int i = 0; i < n; i++)
+    written += kf_cbc_decrypt_update(s, in[i].iov_base, in[i].iov_len,
+                                     out + written);
+
+  return written;
+}
+
+/**
+ * @brief finish decrypting a stream in cipher-block-chaining mode.
+ *
+ * @param s the stream object
+ * @param out the plaintext, with room for BLOCK_SIZE - 1 bytes
+ * @param len the number of bytes written to out
+ * @return int KF_OK, or KF_ERR_FORMAT if the stream is not a valid ciphertext
+ */
+int kf_cbc_decrypt_final(kf_cbc_stream *s, uint8_t *out, size_t *len) {
+
+  uint32_t last[4];
+
+  *len = 0;
+
+  if (!s->held_block || s->partial_len != 0)
+    return KF_ERR_FORMAT;
+
+  KF_STATS_START(start);
+
+  kf_cbc_decrypt_chain(s, last);
+  s->held_block = 0;
+
+  KF_STATS_STOP(cipher_ns, start);
+
+  const uint8_t remaining = ((uint8_t *)last)[BLOCK_SIZE - 1];
+  if (remaining >= BLOCK_SIZE)
+    return KF_ERR_FORMAT;
+
+  memcpy(out, last, remaining);
+  *len = remaining;
+
+  return KF_OK;
+}
+
+/**
+ * @brief encrypt a file with knifefish in cipher-block-chaining mode.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param passphrase the plaintext passphrase
+ * @param iv the initialization vector
+ * @param padding random padding
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_file_cbc(const char *infile, const char *outfile,
+                        const char *passphrase, const char *iv,
+                        const char *padding) {
+
+  return kf_encrypt_file_cbc_ex(infile, outfile, passphrase, iv, padding,
+                                NULL);
+}
+
+/**
+ * @brief encrypt a file with knifefish in cipher-block-chaining mode.
+ *
+ * the passphrase is expanded on every call. use the _key variant to reuse an
+ * expanded key.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param passphrase the plaintext passphrase
+ * @param iv the initialization vector
+ * @param padding random padding
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_file_cbc_ex(const char *infile, const char *outfile,
+                           const char *passphrase, const char *iv,
+                           const char *padding, const kf_opts *opts) {
+
+  kf_key key;
+  kf_key_init(&key, passphrase);
+
+  return kf_encrypt_file_cbc_key(infile, outfile, &key, iv, padding, opts);
+}
+
+/**
+ * @brief encrypt a file with knifefish in cipher-block-chaining mode.
+ *
+ * the plaintext is read one buffer at a time and fed to a cbc stream, with
+ * a single write per buffer. the output file holds the iv followed by the
+ * ciphertext. the last block holds the remaining plaintext bytes, the
+ * padding, and the number of remaining bytes in its last byte; when there
+ * are no remaining bytes a block of zeros is added instead.
+ *
+ * @param infile the name of the input file, or "-" for stdin
+ * @param outfile the name of the output file, or "-" for stdout
+ * @param key a pointer to the key object
+ * @param iv the initialization vector
+ * @param padding random padding
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_file_cbc_key(const char *infile, const char *outfile,
+                            const kf_key *key, const char *iv,
+                            const char *padding, const kf_opts *opts) {
+
+  if (kf_mmap_wanted(infile, outfile, opts))
+    return kf_encrypt_file_cbc_mmap(infile, outfile, key, iv, padding);
+  if (kf_async_wanted(infile, outfile, opts))
+    return kf_encrypt_file_cbc_async(infile, outfile, key, iv, padding, opts);
+
+  FILE *in, *out;
+
+  int status = kf_open_files(infile, outfile, &in, &out);
+  if (status != KF_OK)
+    return status;
+
+  const size_t size = kf_buffer_blocks(opts) * BLOCK_SIZE;
+
+  uint8_t *plain = malloc(size);
+  uint8_t *cipher = malloc(size + 2 * BLOCK_SIZE);
+
+  kf_cbc_stream s;
+  kf_cbc_encrypt_init(&s, key, iv, padding);
+
+  if (!plain || !cipher)
+    status = KF_ERR_MEMORY;
+
+  size_t len = size;
+
+  while (status == KF_OK && len == size) {
+    len = kf_fread(plain, size, in);
+
+    if (len < size && ferror(in)) {
+      status = KF_ERR_READ;
+      break;
+    }
+
+    status = kf_write(cipher, kf_cbc_encrypt_update(&s, plain, len, cipher),
+                      out);
+  }
+
+  if (status == KF_OK)
+    status = kf_write(cipher, kf_cbc_encrypt_final(&s, cipher), out);
+
+  free(plain);
+  free(cipher);
+
+  return kf_close_files(in, out, status);
+}
+
+/**
+ * @brief decrypt a range of cbc ciphertext blocks
+ *
+ * every plaintext block depends only on its own ciphertext block and the one
+ * before it, so independent ranges can be decrypted at the same time. the
+ * block before the first block of the range must be readable at in - 4.
+ *
+ * @param arg a pointer to a kf_cbc_job
+ * @return void* always NULL
+ */
+static void *kf_cbc_decrypt_range(void *arg) {
+
+  kf_cbc_job *job = (kf_cbc_job *)arg;
+
+  const uint32_t *prev = job->in - 4;
+
+  kf_block_n_k(job->in, job->out, job->nblocks, &job->key->x,
+               &job->key->inv);
+
+  for (size_t i = 0; i < job->nblocks * 4; i++) {
+    job->out[i] ^= prev[i];
+  }
+
+  return NULL;
+}
+
+#ifdef __unix__
+
+/**
+ * @brief run the ranges of a cbc pool worker until the pool is stopped
+ *
+ * @param arg a pointer to a kf_cbc_worker
+ * @return void* always NULL
+ */
+static void *kf_cbc_pool_worker(void *arg) {
+
+  kf_cbc_worker *w = (kf_cbc_worker *)arg;
+  kf_cbc_pool *pool = w->pool;
+  uint64_t seen = 0;
+
+  pthread_mutex_lock(&pool->lock);
+
+  for (;;) {
+    while (!pool->stop && pool->round == seen)
+      pthread_cond_wait(&pool->work, &pool->lock);
+
+    if (pool->stop)
+      break;
+
+    seen = pool->round;
+    const int active = w->index < pool->active;
+
+    pthread_mutex_unlock(&pool->lock);
+
+    if (active)
+      kf_cbc_decrypt_range(&pool->jobs[w->index]);
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (--pool->pending == 0)
+      pthread_cond_signal(&pool->done);
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+#endif
+
+/**
+ * @brief start the worker threads of a cbc pool.
+ *
+ * the pool is created once for a file and reused for every buffer of it.
+ * NULL is returned for a single thread, or when threads are unavailable,
+ * and the buffers are then decrypted by the calling thread.
+ *
+ * @param threads the number of threads, the calling thread included
+ * @return kf_cbc_pool* the pool, or NULL
+ */
+kf_cbc_pool *kf_cbc_pool_create(size_t threads) {
+
+#ifdef __unix__
+  if (threads > KF_MAX_THREADS)
+    threads = KF_MAX_THREADS;
+  if (threads < 2)
+    return NULL;
+
+  kf_cbc_pool *pool = calloc(1, sizeof(kf_cbc_pool));
+  if (!pool)
+    return NULL;
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  /* the calling thread is the first thread of the pool */
+  pool->threads = 1;
+
+  for (; pool->threads < threads; pool->threads++) {
+    kf_cbc_worker *w = &pool->slots[pool->threads];
+
+    w->pool = pool;
+    w->index = pool->threads;
+
+    if (pthread_create(&pool->workers[pool->threads], NULL,
+                       kf_cbc_pool_worker, w) != 0)
+      break;
+  }
+
+  if (pool->threads < 2) {
+    kf_cbc_pool_destroy(pool);
+    return NULL;
+  }
+
+  return pool;
+#else
+  (void)threads;
+  return NULL;
+#endif
+}
+
+/**
+ * @brief stop the worker threads of a cbc pool and free it.
+ *
+ * @param pool a pointer to the pool, or NULL
+ */
+void kf_cbc_pool_destroy(kf_cbc_pool *pool) {
+
+#ifdef __unix__
+  if (!pool)
+    return;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (size_t t = 1; t < pool->threads; t++)
+    pthread_join(pool->workers[t], NULL);
+
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->work);
+  pthread_mutex_destroy(&pool->lock);
+
+  free(pool);
+#else
+  (void)pool;
+#endif
+}
+
+/**
+ * @brief decrypt a buffer of cbc ciphertext blocks on the threads of a pool
+ *
+ * the blocks are split into one contiguous range per thread of the pool.
+ * without a pool, or for a buffer too short to split, the blocks are
+ * decrypted by the calling thread.
+ *
+ * @param pool a pointer to the pool, or NULL
+ * @param in the ciphertext blocks, preceded by the previous ciphertext block
+ * @param out the plaintext blocks, which must not overlap the ciphertext
+ * @param nblocks the number of blocks to decrypt
+ * @param key a pointer to the key object
+ */
+void kf_cbc_decrypt_pool(kf_cbc_pool *pool, const uint32_t *in, uint32_t *out,
+                         const size_t nblocks, const kf_key *key) {
+
+  KF_STATS_START(start);
+
+#ifdef __unix__
+  const size_t threads = pool ? pool->threads : 1;
+#else
+  const size_t threads = 1;
+#endif
+
+  if (threads == 1 || nblocks < threads * KF_LANES) {
+    kf_cbc_job job = {in, out, nblocks, key};
+    kf_cbc_decrypt_range(&job);
+  } else {
+#ifdef __unix__
+    const size_t per_thread = nblocks / threads;
+
+    for (size_t t = 0; t < threads; t++) {
+      pool->jobs[t].in = in + 4 * per_thread * t;
+      pool->jobs[t].out = out + 4 * per_thread * t;
+      pool->jobs[t].nblocks = (t == threads - 1) ? nblocks - per_thread * t
+                                                 : per_thread;
+      pool->jobs[t].key = key;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->active = threads;
+    pool->pending = threads - 1;
+    pool->round++;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    kf_cbc_decrypt_range(&pool->jobs[0]);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0)
+      pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+#endif
+  }
+
+  KF_STATS_ADD(blocks, nblocks);
+  KF_STATS_STOP(cipher_ns, start);
+}
+
+/**
+ * @brief decrypt a buffer of cbc ciphertext blocks on several threads
+ *
+ * the threads are started and joined by this call, so a file mode that
+ * decrypts buffer after buffer keeps a kf_cbc_pool instead.
+ *
+ * @param in the ciphertext blocks, preceded by the previous ciphertext block
+ * @param out the plaintext blocks, which must not overlap the ciphertext
+ * @param nblocks the number of blocks to decrypt
+ * @param key a pointer to the key object
+ * @param threads the number of worker threads
+ */
+void kf_cbc_decrypt_blocks(const uint32_t *in, uint32_t *out,
+                           const size_t nblocks, const kf_key *key,
+                           size_t threads) {
+
+  kf_cbc_pool *pool = NULL;
+
+  if (threads > KF_MAX_THREADS)
+    threads = KF_MAX_THREADS;
+
+  /* a pool that would not split the buffer is not worth its threads */
+  if (nblocks >= threads * KF_LANES)
+    pool = kf_cbc_pool_create(threads);
+
+  kf_cbc_decrypt_pool(pool, in, out, nblocks, key);
+  kf_cbc_pool_destroy(pool);
+}
+
+/**
+ * @brief decrypt a file with knifefish in cipher-block-chaining mode.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param passphrase the plaintext passphrase
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_file_cbc(const char *infile, const char *outfile,
+                        const char *passphrase) {
+
+  return kf_decrypt_file_cbc_ex(infile, outfile, passphrase, NULL);
+}
+
+/**
+ * @brief decrypt a file with knifefish in cipher-block-chaining mode.
+ *
+ * the passphrase is expanded on every call. use the _key variant to reuse an
+ * expanded key.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param passphrase the plaintext passphrase
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_file_cbc_ex(const char *infile, const char *outfile,
+                           const char *passphrase, const kf_opts *opts) {
+
+  kf_key key;
+  kf_key_init(&key, passphrase);
+
+  return kf_decrypt_file_cbc_key(infile, outfile, &key, opts);
+}
+
+/**
+ * @brief decrypt a file with knifefish in cipher-block-chaining mode.
+ *
+ * the ciphertext is read one buffer per thread at a time, the buffer is
+ * split into one range per thread, the ranges are decrypted on worker
+ * threads sharing one key, and the plaintext is written back in order with
+ * a single write.
+ *
+ * the input is never seeked or measured, so it can be a pipe. one block is
+ * read ahead of the blocks being decrypted, and the block still held back
+ * when the input ends is the last block, which holds the padding. a
+ * ciphertext of the wrong length is only noticed at its end.
+ *
+ * @param infile the name of the input file, or "-" for stdin
+ * @param outfile the name of the output file, or "-" for stdout
+ * @param key a pointer to the key object
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_file_cbc_key(const char *infile, const char *outfile,
+                            const kf_key *key, const kf_opts *opts) {
+
+  if (kf_mmap_wanted(infile, outfile, opts))
+    return kf_decrypt_file_cbc_mmap(infile, outfile, key, opts);
+  if (kf_async_wanted(infile, outfile, opts))
+    return kf_decrypt_file_cbc_async(infile, outfile, key, opts);
+
+  FILE *in, *out;
+
+  int status = kf_open_files(infile, outfile, &in, &out);
+  if (status != KF_OK)
+    return status;
+
+  const size_t threads = kf_threads(opts);
+  const size_t buffer_blocks = kf_buffer_blocks(opts) * threads;
+
+  kf_cbc_pool *pool = kf_cbc_pool_create(threads);
+
+  /* the previous block, a buffer of blocks, and the block read ahead */
+  uint32_t *cipher = malloc((buffer_blocks + 2) * BLOCK_SIZE);
+  uint32_t *plain = malloc((buffer_blocks + 1) * BLOCK_SIZE);
+
+  if (!cipher || !plain)
+    status = KF_ERR_MEMORY;
+
+  if (status == KF_OK && kf_fread(cipher, BLOCK_SIZE, in) != BLOCK_SIZE)
+    status = ferror(in) ? KF_ERR_READ : KF_ERR_FORMAT;
+
+  const size_t capacity = (buffer_blocks + 1) * BLOCK_SIZE;
+  size_t have = 0;
+
+  while (status == KF_OK) {
+    const size_t len =
+        kf_fread((uint8_t *)(cipher + 4) + have, capacity - have, in);
+
+    have += len;
+
+    if (have == capacity) {
+      kf_cbc_decrypt_pool(pool, cipher + 4, plain, buffer_blocks, key);
+      status = kf_write(plain, buffer_blocks * BLOCK_SIZE, out);
+
+      /* the last decrypted block chains into the block read ahead */
+      memmove(cipher, cipher + 4 * buffer_blocks, 2 * BLOCK_SIZE);
+      have = BLOCK_SIZE;
+      continue;
+    }
+
+    if (ferror(in)) {
+      status = KF_ERR_READ;
+      break;
+    }
+
+    if (have == 0 || have % BLOCK_SIZE != 0) {
+      status = KF_ERR_FORMAT;
+      break;
+    }
+
+    const size_t nblocks = have / BLOCK_SIZE;
+
+    kf_cbc_decrypt_pool(pool, cipher + 4, plain, nblocks, key);
+
+    const uint8_t remaining = ((uint8_t *)plain)[nblocks * BLOCK_SIZE - 1];
+
+    if (remaining >= BLOCK_SIZE) {
+      status = KF_ERR_FORMAT;
+    } else {
+      status = kf_write(plain, (nblocks - 1) * BLOCK_SIZE + remaining, out);
+    }
+
+    break;
+  }
+
+  kf_cbc_pool_destroy(pool);
+
+  free(cipher);
+  free(plain);
+
+  return kf_close_files(in, out, status);
+}
+
+/**
+ * @brief build a counter block
+ *
+ * the counter block is the iv with the block counter added to its last 8
+ * bytes, which are read as a little-endian 64-bit integer.
+ *
+ * @param iv the initialization vector
+ * @param counter the block counter
+ * @param block the output counter block
+ */
+static void kf_ctr_block(const char *iv, const uint64_t counter,
+                         uint32_t *block) {
+
+  uint8_t *b8 = (uint8_t *)block;
+  uint64_t c = 0;
+
+  memcpy(block, iv, BLOCK_SIZE);
+
+  for (int i = 0; i < 8; i++)
+    c |= (uint64_t)b8[8 + i] << (8 * i);
+
+  c += counter;
+
+  for (int i = 0; i < 8; i++)
+    b8[8 + i] = (uint8_t)(c >> (8 * i));
+}
+
+/**
+ * @brief build consecutive counter blocks
+ *
+ * @param iv the initialization vector
+ * @param counter the block counter of the first block
+ * @param blocks the output counter blocks
+ * @param nblocks the number of counter blocks
+ */
+static void kf_ctr_blocks(const char *iv, const uint64_t counter,
+                          uint32_t *blocks, const size_t nblocks) {
+
+  for (size_t i = 0; i < nblocks; i++)
+    kf_ctr_block(iv, counter + i, blocks + 4 * i);
+}
+
+/**
+ * @brief xor a buffer with keystream bytes
+ *
+ * @param in the input buffer
+ * @param out the output buffer
+ * @param stream the keystream
+ * @param len the number of bytes
+ */
+static void kf_xor_stream(const uint8_t *in, uint8_t *out,
+                          const uint8_t *stream, const size_t len) {
+
+  for (size_t i = 0; i < len; i++)
+    out[i] = in[i] ^ stream[i];
+}
+
+/**
+ * @brief encrypt or decrypt a buffer with knifefish in counter mode.
+ *
+ * every keystream block depends only on the iv and its counter, so the
+ * keystream is generated KF_CTR_BATCH blocks at a time with kf_block_n.
+ * counter mode needs no padding and the same call both encrypts and
+ * decrypts. a long message can be processed in pieces by passing the block
+ * index of the first byte of each piece as the counter; every piece except
+ * the last must be a multiple of BLOCK_SIZE bytes. in and out may point to
+ * the same buffer.
+ *
+ * @param in the input buffer
+ * @param out the output buffer
+ * @param len the number of bytes to process
+ * @param iv the initialization vector
+ * @param counter the block index of the first byte of in
+ * @param ctx a pointer to the ctx object
+ */
+void kf_ctr(const uint8_t *in, uint8_t *out, const size_t len, const char *iv,
+            const uint64_t counter, const kf_ctx *ctx) {
+
+  uint32_t stream[KF_CTR_BATCH * 4];
+
+  for (size_t done = 0; done < len; done += sizeof(stream)) {
+    const size_t left = len - done;
+    const size_t bytes = left < sizeof(stream) ? left : sizeof(stream);
+    const size_t nblocks = (bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    kf_ctr_blocks(iv, counter + done / BLOCK_SIZE, stream, nblocks);
+    kf_block_n(stream, stream, nblocks, ctx);
+    kf_xor_stream(in + done, out + done, (const uint8_t *)stream, bytes);
+  }
+}
+
+/**
+ * @brief encrypt or decrypt a buffer in counter mode with the fused tables.
+ *
+ * the output is identical to kf_ctr.
+ *
+ * @param in the input buffer
+ * @param out the output buffer
+ * @param len the number of bytes to process
+ * @param iv the initialization vector
+ * @param counter the block index of the first byte of in
+ * @param x a pointer to the expanded ctx object
+ */
+void kf_ctr_x(const uint8_t *in, uint8_t *out, const size_t len,
+              const char *iv, const uint64_t counter, const kf_xctx *x) {
+
+  uint32_t stream[KF_CTR_BATCH * 4];
+
+  KF_STATS_START(start);
+
+  for (size_t done = 0; done < len; done += sizeof(stream)) {
+    const size_t left = len - done;
+    const size_t bytes = left < sizeof(stream) ? left : sizeof(stream);
+    const size_t nblocks = (bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    kf_ctr_blocks(iv, counter + done / BLOCK_SIZE, stream, nblocks);
+    kf_block_n_x(stream, stream, nblocks, x);
+    kf_xor_stream(in + done, out + done, (const uint8_t *)stream, bytes);
+  }
+
+  KF_STATS_ADD(blocks, (len + BLOCK_SIZE - 1) / BLOCK_SIZE);
+  KF_STATS_STOP(cipher_ns, start);
+}
+
+/**
+ * @brief encrypt the gathered keystream and apply it to the message pieces
+ *
+ * @param stream the counter blocks of the pieces, one after another
+ * @param xs a pointer to the expanded ctx object of every counter block
+ * @param nblocks the number of counter blocks
+ * @param pieces the pieces of messages the counter blocks belong to
+ * @param npieces the number of pieces
+ */
+static void kf_ctr_multi_flush(uint32_t *stream, const kf_xctx *const *xs,
+                               const size_t nblocks, const kf_msg *pieces,
+                               const size_t npieces) {
+
+  kf_block_multi(xs, stream, stream, nblocks);
+
+  const uint8_t *s8 = (const uint8_t *)stream;
+
+  for (size_t p = 0; p < npieces; p++) {
+    kf_xor_stream(pieces[p].in, pieces[p].out, s8, pieces[p].len);
+    s8 += (pieces[p].len + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+  }
+}
+
+/**
+ * @brief encrypt or decrypt many messages, each under its own key, in
+ * counter mode.
+ *
+ * the output of every message is identical to kf_ctr_x on it with a counter
+ * of 0. the keystream blocks of consecutive messages are gathered
+ * KF_CTR_BATCH at a time and run through kf_block_multi, so short messages
+ * under the same key share the multi-block kernel and those under different
+ * keys are interleaved. the in and out of a message may point to the same
+ * buffer, but messages may not overlap each other.
+ *
+ * @param msgs the messages
+ * @param nmsgs the number of messages
+ */
+void kf_ctr_multi(const kf_msg *msgs, const size_t nmsgs) {
+
+  uint32_t stream[KF_CTR_BATCH * 4];
+  const kf_xctx *xs[KF_CTR_BATCH];
+  kf_msg pieces[KF_CTR_BATCH];
+
+  size_t nblocks = 0, npieces = 0, total = 0;
+
+  KF_STATS_START(start);
+
+  for (size_t m = 0; m < nmsgs; m++) {
+    const kf_msg *msg = &msgs[m];
+
+    for (size_t done = 0; done < msg->len;) {
+      const size_t room = (KF_CTR_BATCH - nblocks) * BLOCK_SIZE;
+      const size_t left = msg->len - done;
+      const size_t bytes = left < room ? left : room;
+      const size_t n = (bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+      kf_ctr_blocks(msg->iv, done / BLOCK_SIZE, stream + 4 * nblocks, n);
+
+      for (size_t i = 0; i < n; i++)
+        xs[nblocks + i] = msg->x;
+
+      pieces[npieces] = *msg;
+      pieces[npieces].in = msg->in + done;
+      pieces[npieces].out = msg->out + done;
+      pieces[npieces].len = bytes;
+
+      npieces++;
+      nblocks += n;
+      done += bytes;
+
+      if (nblocks == KF_CTR_BATCH) {
+        kf_ctr_multi_flush(stream, xs, nblocks, pieces, npieces);
+        total += nblocks;
+        nblocks = npieces = 0;
+      }
+    }
+  }
+
+  if (nblocks > 0) {
+    kf_ctr_multi_flush(stream, xs, nblocks, pieces, npieces);
+    total += nblocks;
+  }
+
+  KF_STATS_ADD(blocks, total);
+  KF_STATS_STOP(cipher_ns, start);
+}
+
+/**
+ * @brief start a message in counter mode as a stream.
+ *
+ * @param s the stream object
+ * @param x a pointer to the expanded ctx object, which must outlive the
+ * stream
+ * @param iv the initialization vector
+ * @param counter the block index of the first byte of the message
+ * @param len the length of the message if it is known, or 0
+ */
+void kf_ctr_stream_init(kf_ctr_stream *s, const kf_xctx *x, const char *iv,
+                        const uint64_t counter, const uint64_t len) {
+
+  s->x = x;
+  memcpy(s->iv, iv, BLOCK_SIZE);
+  s->counter = counter;
+  s->left = len;
+  s->used = 0;
+  s->avail = 0;
+}
+
+/**
+ * @brief encrypt or decrypt the next part of a message in counter mode.
+ *
+ * the parts may be of any length, and the output of the whole message is
+ * identical to kf_ctr_x on it. keystream is made up to KF_CTR_BATCH blocks
+ * at a time, as many as the rest of the message needs when its length was
+ * given, and what a part leaves over is kept for the next. in and out may
+ * point to the same buffer.
+ *
+ * @param s the stream object
+ * @param in the input buffer
+ * @param out the output buffer
+ * @param len the number of bytes
+ */
+void kf_ctr_stream_update(kf_ctr_stream *s, const uint8_t *in, uint8_t *out,
+                          const size_t len) {
+
+  const uint8_t *stream = (const uint8_t *)s->stream;
+
+  KF_STATS_START(start);
+
+  for (size_t done = 0; done < len;) {
+    if (s->used == s->avail) {
+      const uint64_t want = len - done > s->left ? len - done : s->left;
+      const uint64_t blocks = (want + BLOCK_SIZE - 1) / BLOCK_SIZE;
+      const size_t n = blocks < KF_CTR_BATCH ? (size_t)blocks : KF_CTR_BATCH;
+
+      kf_ctr_blocks(s->iv, s->counter, s->stream, n);
+      kf_block_n_x(s->stream, s->stream, n, s->x);
+      KF_STATS_ADD(blocks, n);
+
+      s->counter += n;
+      s->used = 0;
+      s->avail = n * BLOCK_SIZE;
+    }
+
+    const size_t left = len - done;
+    const size_t room = s->avail - s->used;
+    const size_t bytes = left < room ? left : room;
+
+    kf_xor_stream(in + done, out + done, stream + s->used, bytes);
+
+    s->used += bytes;
+    s->left -= bytes < s->left ? bytes : s->left;
+    done += bytes;
+  }
+
+  KF_STATS_STOP(cipher_ns, start);
+}
+
+/**
+ * @brief encrypt or decrypt a scatter-gather list in counter mode.
+ *
+ * the buffers of in are one message, and the output is identical to
+ * kf_ctr_x on their concatenation. out[i] receives the output of in[i] and
+ * must be as long; the buffers may end anywhere, as the keystream carries
+ * over from one to the next, and out may be in itself.
+ *
+ * @param in the input buffers
+ * @param out the output buffers
+ * @param n the number of buffers
+ * @param iv the initialization vector
+ * @param counter the block index of the first byte of in
+ * @param x a pointer to the expanded ctx object
+ */
+void kf_ctr_iov(const struct iovec *in, const struct iovec *out, const int n,
+                const char *iv, const uint64_t counter, const kf_xctx *x) {
+
+  kf_ctr_stream s;
+  uint64_t len = 0;
+
+  for (int i = 0; i < n; i++)
+    len += in[i].iov_len;
+
+  kf_ctr_stream_init(&s, x, iv, counter, len);
+
+  for (int i = 0; i < n; i++)
+    kf_ctr_stream_update(&s, in[i].iov_base, out[i].iov_base, in[i].iov_len);
+
+  kf_wipe(s.stream, sizeof(s.stream));
+}
+
+/**
+ * @brief apply the counter mode keystream to the rest of a file.
+ *
+ * @param in the input file
+ * @param out the output file
+ * @param iv the initialization vector
+ * @param x a pointer to the expanded ctx object
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+static int kf_ctr_file(FILE *in, FILE *out, const char *iv, const kf_xctx *x,
+                       const kf_opts *opts) {
+
+  const size_t size = kf_buffer_blocks(opts) * BLOCK_SIZE;
+
+  uint8_t *buffer = malloc(size);
+  if (!buffer)
+    return KF_ERR_MEMORY;
+
+  int status = KF_OK;
+  uint64_t counter = 0;
+  size_t len = size;
+
+  while (status == KF_OK && len == size) {
+    len = kf_fread(buffer, size, in);
+
+    if (len < size && ferror(in)) {
+      status = KF_ERR_READ;
+      break;
+    }
+
+    kf_ctr_x(buffer, buffer, len, iv, counter, x);
+    status = kf_write(buffer, len, out);
+    counter += len / BLOCK_SIZE;
+  }
+
+  free(buffer);
+
+  return status;
+}
+
+/**
+ * @brief encrypt a file with knifefish in counter mode.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param passphrase the plaintext passphrase
+ * @param iv the initialization vector
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_file_ctr(const char *infile, const char *outfile,
+                        const char *passphrase, const char *iv) {
+
+  return kf_encrypt_file_ctr_ex(infile, outfile, passphrase, iv, NULL);
+}
+
+/**
+ * @brief encrypt a file with knifefish in counter mode.
+ *
+ * the passphrase is expanded on every call. use the _key variant to reuse an
+ * expanded key.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param passphrase the plaintext passphrase
+ * @param iv the initialization vector
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_file_ctr_ex(const char *infile, const char *outfile,
+                           const char *passphrase, const char *iv,
+                           const kf_opts *opts) {
+
+  kf_key key;
+  kf_key_init(&key, passphrase);
+
+  return kf_encrypt_file_ctr_key(infile, outfile, &key, iv, opts);
+}
+
+/**
+ * @brief encrypt a file with knifefish in counter mode.
+ *
+ * the output file holds the iv followed by a ciphertext of exactly the same
+ * length as the input file.
+ *
+ * @param infile the name of the input file, or "-" for stdin
+ * @param outfile the name of the output file, or "-" for stdout
+ * @param key a pointer to the key object
+ * @param iv the initialization vector
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_file_ctr_key(const char *infile, const char *outfile,
+                            const kf_key *key, const char *iv,
+                            const kf_opts *opts) {
+
+  if (kf_mmap_wanted(infile, outfile, opts))
+    return kf_encrypt_file_ctr_mmap(infile, outfile, key, iv);
+  if (kf_async_wanted(infile, outfile, opts))
+    return kf_encrypt_file_ctr_async(infile, outfile, key, iv, opts);
+
+  FILE *in, *out;
+
+  int status = kf_open_files(infile, outfile, &in, &out);
+  if (status != KF_OK)
+    return status;
+
+  status = kf_write(iv, BLOCK_SIZE, out);
+
+  if (status == KF_OK)
+    status = kf_ctr_file(in, out, iv, &key->x, opts);
+
+  return kf_close_files(in, out, status);
+}
+
+/**
+ * @brief decrypt a file with knifefish in counter mode.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param passphrase the plaintext passphrase
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_file_ctr(const char *infile, const char *outfile,
+                        const char *passphrase) {
+
+  return kf_decrypt_file_ctr_ex(infile, outfile, passphrase, NULL);
+}
+
+/**
+ * @brief decrypt a file with knifefish in counter mode.
+ *
+ * the passphrase is expanded on every call. use the _key variant to reuse an
+ * expanded key.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param passphrase the plaintext passphrase
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_file_ctr_ex(const char *infile, const char *outfile,
+                           const char *passphrase, const kf_opts *opts) {
+
+  kf_key key;
+  kf_key_init(&key, passphrase);
+
+  return kf_decrypt_file_ctr_key(infile, outfile, &key, opts);
+}
+
+/**
+ * @brief decrypt a file with knifefish in counter mode.
+ *
+ * @param infile the name of the input file, or "-" for stdin
+ * @param outfile the name of the output file, or "-" for stdout
+ * @param key a pointer to the key object
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_file_ctr_key(const char *infile, const char *outfile,
+                            const kf_key *key, const kf_opts *opts) {
+
+  if (kf_mmap_wanted(infile, outfile, opts))
+    return kf_decrypt_file_ctr_mmap(infile, outfile, key);
+  if (kf_async_wanted(infile, outfile, opts))
+    return kf_decrypt_file_ctr_async(infile, outfile, key, opts);
+
+  FILE *in, *out;
+
+  int status = kf_open_files(infile, outfile, &in, &out);
+  if (status != KF_OK)
+    return status;
+
+  char iv[BLOCK_SIZE];
+
+  if (kf_fread(iv, BLOCK_SIZE, in) != BLOCK_SIZE)
+    status = ferror(in) ? KF_ERR_READ : KF_ERR_FORMAT;
+
+  if (status == KF_OK)
+    status = kf_ctr_file(in, out, iv, &key->x, opts);
 
-  fclose(in);
-  fclose(out);
+  return kf_close_files(in, out, status);
 }
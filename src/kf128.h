@@ -9,6 +9,20 @@
 #include <inttypes.h>
 #include <stdlib.h>
 
+#ifdef __unix__
+#include <sys/uio.h>
+#else
+/**
+ * @brief the iovec object holds one buffer of a scatter-gather list, as in
+ * POSIX.
+ *
+ */
+struct iovec {
+  void *iov_base;
+  size_t iov_len;
+};
+#endif
+
 #define ROUNDS 16
 #define SBOX_SIZE 256
 #define SBOX_COUNT 8
@@ -19,6 +33,69 @@
 #define KEY_SIZE 49
 #define BLOCK_SIZE 16
 #define PHT_MAX 4294967296
+#define KF_LANES 8
+#define KF_LFSR_LEAP 16
+#define KF_CTR_BATCH 64
+#define KF_CBC_RUN 256
+#define KF_BUFFER_SIZE (1 << 20)
+#define KF_MMAP_THRESHOLD (64L << 20)
+#define KF_GPU_SLICE (8 << 20)
+#define KF_GPU_THRESHOLD (4L << 20)
+#define KF_DIGEST_SIZE 32
+#define KF_MAX_THREADS 64
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define KF_X86_SIMD 1
+#else
+#define KF_X86_SIMD 0
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define KF_BYTE(w, i) ((uint8_t)((w) >> (24 - 8 * (i))))
+#define KF_SHIFT(i) (32 * ((i) / 4) + 24 - 8 * ((i) % 4))
+#else
+#define KF_BYTE(w, i) ((uint8_t)((w) >> (8 * (i))))
+#define KF_SHIFT(i) (8 * (i))
+#endif
+
+/* off by default, so the cipher paths read no clock; make STATS=1 */
+#ifndef KF_STATS
+#define KF_STATS 0
+#endif
+
+#define KF_OK 0
+#define KF_ERR_OPEN -1
+#define KF_ERR_READ -2
+#define KF_ERR_WRITE -3
+#define KF_ERR_FORMAT -4
+#define KF_ERR_MEMORY -5
+#define KF_ERR_AUTH -6
+#define KF_ERR_UNSUPPORTED -7
+
+#define KF_BACKEND_AUTO 0
+#define KF_BACKEND_STDIO 1
+#define KF_BACKEND_MMAP 2
+#define KF_BACKEND_ASYNC 3
+#define KF_BACKEND_THREADS 4
+
+#define KF_ASYNC_DEPTH 3
+
+#define KF_MODE_CBC 0
+#define KF_MODE_CTR 1
+#define KF_MODE_CHUNKED 2
+#define KF_MODE_AEAD 3
+
+#define KF_CHUNK_SIZE (64 << 10)
+#define KF_CHUNKED_MAGIC "KF128CK1"
+#define KF_CHUNKED_HEADER 48
+
+#define KF_KEYFILE_MAGIC "KF128KY1"
+#define KF_KEYFILE_VERSION 1
+#define KF_KEYFILE_HEADER 64
+
+#define KF_TAG_SIZE 16
+#define KF_POLY_KEY_SIZE 32
+#define KF_POLY_BLOCK 16
 
 /**
  * @brief the ctx object holds sboxes, pboxes, and key material.
@@ -32,33 +109,610 @@ typedef struct {
 
 } kf_ctx;
 
+/**
+ * @brief the schedule object holds the round keys and white keys of one
+ * direction of a ctx.
+ *
+ */
+typedef struct {
+  uint32_t skey[ROUNDS][SKEY_SIZE];
+  uint32_t wkey[WKEY_COUNT][WKEY_SIZE];
+} kf_sched;
+
+/**
+ * @brief the expanded ctx object holds a ctx, its key schedule, and its fused
+ * S-box/P-box tables.
+ *
+ */
+typedef struct {
+  kf_ctx ctx;
+  kf_sched sched;
+  uint64_t spbox[SBOX_COUNT][SBOX_SIZE];
+} kf_xctx;
+
+/**
+ * @brief the kernel object holds one implementation of the multi-block
+ * functions.
+ *
+ */
+typedef struct {
+  const char *name;
+  int (*supported)(void);
+  void (*block_n)(const uint32_t *in, uint32_t *out, size_t nblocks,
+                  const kf_ctx *ctx);
+  void (*block_n_k)(const uint32_t *in, uint32_t *out, size_t nblocks,
+                    const kf_xctx *x, const kf_sched *k);
+} kf_kernel;
+
+/**
+ * @brief the opts object holds tuning options for the file modes.
+ *
+ * fields left at zero take their defaults: one thread, KF_BUFFER_SIZE bytes
+ * per buffer, and the mmap backend for regular files of at least
+ * KF_MMAP_THRESHOLD bytes. KF_BACKEND_ASYNC overlaps reads and writes with
+ * the cipher through io_uring, or through io threads where io_uring is not
+ * available; KF_BACKEND_THREADS always uses the io threads.
+ *
+ */
+typedef struct {
+  size_t threads;
+  size_t buffer_size;
+  int backend;
+} kf_opts;
+
+/**
+ * @brief the key object holds a passphrase expanded for both directions: one
+ * copy of the tables, and the schedule that decrypts with them.
+ *
+ */
+typedef struct {
+  kf_xctx x;
+  kf_sched inv;
+} kf_key;
+
+/**
+ * @brief the msg object holds one message of kf_ctr_multi: its key, its iv,
+ * and its input and output buffers.
+ *
+ */
+typedef struct {
+  const kf_xctx *x;
+  const char *iv;
+  const uint8_t *in;
+  uint8_t *out;
+  size_t len;
+} kf_msg;
+
+/**
+ * @brief the keyfile object holds a key object opened from a keyfile, and
+ * the memory it lives in.
+ *
+ */
+typedef struct {
+  const kf_key *key;
+  void *data;
+  size_t size;
+} kf_keyfile;
+
+/**
+ * @brief the key cache object holds expanded keys looked up by passphrase
+ * digest. it is opaque and thread-safe.
+ *
+ */
+typedef struct kf_key_cache kf_key_cache;
+
+/**
+ * @brief the cbc stream object holds the state carried between the calls of
+ * the cbc stream functions.
+ *
+ */
+typedef struct {
+  const kf_key *key;
+  uint32_t chain[4];
+  uint32_t partial[4];
+  uint32_t held[4];
+  size_t partial_len;
+  uint8_t padding[BLOCK_SIZE];
+  int started;
+  int held_block;
+} kf_cbc_stream;
+
+/**
+ * @brief the ctr stream object holds a message in counter mode between the
+ * calls of the ctr stream functions, with the unused part of a batch of
+ * keystream.
+ *
+ */
+typedef struct {
+  const kf_xctx *x;
+  char iv[BLOCK_SIZE];
+  uint64_t counter;
+  uint64_t left;
+  uint32_t stream[KF_CTR_BATCH * 4];
+  size_t used;
+  size_t avail;
+} kf_ctr_stream;
+
+/**
+ * @brief the poly1305 object holds the state of a mac between the calls of
+ * the poly1305 functions.
+ *
+ */
+typedef struct {
+  uint32_t r[5];
+  uint32_t h[5];
+  uint32_t pad[4];
+  uint8_t buffer[KF_POLY_BLOCK];
+  size_t leftover;
+} kf_poly1305;
+
+/**
+ * @brief the xts object holds the key and sector size of the sector
+ * functions.
+ *
+ */
+typedef struct {
+  const kf_key *key;
+  size_t sector_size;
+} kf_xts;
+
+/**
+ * @brief the jit object holds a block function specialised to one key. it
+ * is opaque.
+ *
+ */
+typedef struct kf_jit kf_jit;
+
+/**
+ * @brief the gpu object holds a counter mode keystream kernel on an OpenCL
+ * device, with the tables of one key. it is opaque.
+ *
+ */
+typedef struct kf_gpu kf_gpu;
+
+/**
+ * @brief the cbc pool object holds the worker threads of cbc decryption, so
+ * a file mode starts them once rather than for every buffer. it is opaque.
+ *
+ */
+typedef struct kf_cbc_pool kf_cbc_pool;
+
+/**
+ * @brief the batch job object holds one file of a batch. the caller fills in
+ * the names, and for encryption a fresh iv and padding for every file; the
+ * batch fills in the rest.
+ *
+ */
+typedef struct {
+  const char *infile;
+  const char *outfile;
+  char iv[BLOCK_SIZE];
+  char padding[BLOCK_SIZE];
+  int status;
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+} kf_batch_job;
+
+/**
+ * @brief the batch summary object holds the totals of a batch.
+ *
+ */
+typedef struct {
+  size_t files;
+  size_t failed;
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  uint64_t ns;
+} kf_batch_summary;
+
+/**
+ * @brief the stats object holds counters for the file modes, summed over the
+ * process. times are in nanoseconds of a monotonic clock.
+ *
+ */
+typedef struct {
+  uint64_t bytes_read;
+  uint64_t bytes_written;
+  uint64_t blocks;
+  uint64_t reads;
+  uint64_t writes;
+  uint64_t maps;
+  uint64_t keys;
+  uint64_t key_ns;
+  uint64_t io_ns;
+  uint64_t cipher_ns;
+  uint64_t mac_ns;
+} kf_stats;
+
+/*
+ * the instrumentation hooks used inside the library. building with
+ * -DKF_STATS=0 compiles them out, and kf_stats_get then reports zeros.
+ */
+#if KF_STATS
+
+extern kf_stats kf_stats_counters;
+
+#ifdef __GNUC__
+#define KF_STATS_ADD(field, n)                                                 \
+  __atomic_fetch_add(&kf_stats_counters.field, (uint64_t)(n), __ATOMIC_RELAXED)
+#else
+#define KF_STATS_ADD(field, n) (kf_stats_counters.field += (uint64_t)(n))
+#endif
+
+#define KF_STATS_START(t) const uint64_t t = kf_stats_now()
+#define KF_STATS_STOP(field, t) KF_STATS_ADD(field, kf_stats_now() - (t))
+
+#else
+
+#define KF_STATS_ADD(field, n) ((void)0)
+#define KF_STATS_START(t) ((void)0)
+#define KF_STATS_STOP(field, t) ((void)0)
+
+#endif
+
 void kf_lfsr(uint32_t *shift_register);
 
 uint8_t kf_lfsr_byte(uint32_t *shift_register);
 
+void kf_lfsr_n(uint32_t *shift_register, size_t steps);
+
 void kf_pht(const uint32_t *a, const uint32_t *b, uint32_t *a_prime,
             uint32_t *b_prime);
 
 void kf_invert_ctx(const kf_ctx *key, kf_ctx *inv);
 
+void kf_sched_ctx(const kf_ctx *ctx, kf_sched *k);
+
+void kf_invert_sched(const kf_ctx *ctx, kf_sched *inv);
+
 void kf_init_sbox(uint8_t s[SBOX_SIZE], const uint32_t seed);
 
 void kf_init_pbox(uint8_t p[PBOX_SIZE], const uint32_t seed);
 
 void kf_expand_passphrase(const char *passphrase, kf_ctx *ctx);
 
-void kf_f(const uint32_t *in, uint32_t *out, const size_t round, kf_ctx *ctx);
+void kf_f(const uint32_t *in, uint32_t *out, const size_t round,
+          const kf_ctx *ctx);
 
 void kf_round(const uint32_t *in, uint32_t *out, const size_t round,
-              kf_ctx *ctx);
+              const kf_ctx *ctx);
+
+void kf_block(const uint32_t *in, uint32_t *out, const kf_ctx *ctx);
+
+void kf_block_n(const uint32_t *in, uint32_t *out, size_t nblocks,
+                const kf_ctx *ctx);
+
+void kf_block_n_scalar(const uint32_t *in, uint32_t *out, size_t nblocks,
+                       const kf_ctx *ctx);
+
+void kf_block_n_scalar_k(const uint32_t *in, uint32_t *out, size_t nblocks,
+                         const kf_ctx *ctx, const kf_sched *k);
+
+void kf_block_n_avx2(const uint32_t *in, uint32_t *out, size_t nblocks,
+                     const kf_ctx *ctx);
+
+void kf_block_n_avx2_k(const uint32_t *in, uint32_t *out, size_t nblocks,
+                       const kf_ctx *ctx, const kf_sched *k);
+
+void kf_block_n_avx512(const uint32_t *in, uint32_t *out, size_t nblocks,
+                       const kf_ctx *ctx);
+
+void kf_block_n_avx512_k(const uint32_t *in, uint32_t *out, size_t nblocks,
+                         const kf_ctx *ctx, const kf_sched *k);
+
+void kf_fuse_ctx(const kf_ctx *ctx, kf_xctx *x);
+
+void kf_expand_passphrase_x(const char *passphrase, kf_xctx *x);
+
+void kf_invert_xctx(const kf_xctx *key, kf_xctx *inv);
+
+void kf_block_x(const uint32_t *in, uint32_t *out, const kf_xctx *x);
+
+void kf_block_x_k(const uint32_t *in, uint32_t *out, const kf_xctx *x,
+                  const kf_sched *k);
+
+void kf_block_n_x(const uint32_t *in, uint32_t *out, size_t nblocks,
+                  const kf_xctx *x);
+
+void kf_block_n_k(const uint32_t *in, uint32_t *out, size_t nblocks,
+                  const kf_xctx *x, const kf_sched *k);
+
+void kf_block_n_fused(const uint32_t *in, uint32_t *out, size_t nblocks,
+                      const kf_xctx *x);
+
+void kf_block_n_fused_k(const uint32_t *in, uint32_t *out, size_t nblocks,
+                        const kf_xctx *x, const kf_sched *k);
+
+void kf_block_multi(const kf_xctx *const *xs, const uint32_t *in,
+                    uint32_t *out, const size_t nblocks);
+
+const kf_kernel *kf_kernel_list(size_t *count);
+
+const kf_kernel *kf_kernel_find(const char *name);
+
+const kf_kernel *kf_kernel_get(void);
+
+int kf_kernel_select(const char *name);
+
+const char *kf_strerror(const int status);
+
+void kf_key_init(kf_key *key, const char *passphrase);
+
+void kf_wipe(void *p, size_t len);
+
+void kf_sha256(const uint8_t *data, const size_t len,
+               uint8_t digest[KF_DIGEST_SIZE]);
+
+kf_key_cache *kf_key_cache_create(size_t capacity);
+
+void kf_key_cache_destroy(kf_key_cache *cache);
 
-void kf_block(const uint32_t *in, uint32_t *out, kf_ctx *ctx);
+const kf_key *kf_key_cache_acquire(kf_key_cache *cache,
+                                   const char *passphrase);
 
-void kf_encrypt_file_cbc(const char *infile, const char *outfile,
-                         const char *passphrase, const char *iv,
+void kf_key_cache_release(kf_key_cache *cache, const kf_key *key);
+
+int kf_key_export(const kf_key *key, const char *name);
+
+int kf_keyfile_open(kf_keyfile *kf, const char *name);
+
+void kf_keyfile_close(kf_keyfile *kf);
+
+uint64_t kf_stats_now(void);
+
+int kf_stats_enabled(void);
+
+void kf_stats_get(kf_stats *stats);
+
+void kf_stats_reset(void);
+
+void kf_cbc_encrypt_blocks(const uint32_t *in, uint32_t *out,
+                           const size_t nblocks, uint32_t key[4],
+                           const kf_xctx *x);
+
+void kf_cbc_decrypt_blocks(const uint32_t *in, uint32_t *out,
+                           const size_t nblocks, const kf_key *key,
+                           size_t threads);
+
+kf_cbc_pool *kf_cbc_pool_create(size_t threads);
+
+void kf_cbc_pool_destroy(kf_cbc_pool *pool);
+
+void kf_cbc_decrypt_pool(kf_cbc_pool *pool, const uint32_t *in, uint32_t *out,
+                         const size_t nblocks, const kf_key *key);
+
+void kf_cbc_encrypt_init(kf_cbc_stream *s, const kf_key *key, const char *iv,
                          const char *padding);
 
-void kf_decrypt_file_cbc(const char *infile, const char *outfile,
+size_t kf_cbc_encrypt_update(kf_cbc_stream *s, const uint8_t *in, size_t len,
+                             uint8_t *out);
+
+size_t kf_cbc_encrypt_update_iov(kf_cbc_stream *s, const struct iovec *in,
+                                 const int n, uint8_t *out);
+
+size_t kf_cbc_encrypt_final(kf_cbc_stream *s, uint8_t *out);
+
+void kf_cbc_decrypt_init(kf_cbc_stream *s, const kf_key *key);
+
+size_t kf_cbc_decrypt_update(kf_cbc_stream *s, const uint8_t *in, size_t len,
+                             uint8_t *out);
+
+size_t kf_cbc_decrypt_update_iov(kf_cbc_stream *s, const struct iovec *in,
+                                 const int n, uint8_t *out);
+
+int kf_cbc_decrypt_final(kf_cbc_stream *s, uint8_t *out, size_t *len);
+
+void kf_poly1305_init(kf_poly1305 *p, const uint8_t key[KF_POLY_KEY_SIZE]);
+
+void kf_poly1305_update(kf_poly1305 *p, const uint8_t *m, size_t len);
+
+void kf_poly1305_final(kf_poly1305 *p, uint8_t tag[KF_TAG_SIZE]);
+
+int kf_mmap_wanted(const char *infile, const char *outfile,
+                   const kf_opts *opts);
+
+size_t kf_batch(kf_batch_job *jobs, const size_t njobs, const kf_key *key,
+                const int encrypt, const int mode, size_t workers,
+                const kf_opts *opts, kf_batch_summary *summary);
+
+int kf_encrypt_file_cbc_mmap(const char *infile, const char *outfile,
+                             const kf_key *key, const char *iv,
+                             const char *padding);
+
+int kf_decrypt_file_cbc_mmap(const char *infile, const char *outfile,
+                             const kf_key *key, const kf_opts *opts);
+
+int kf_encrypt_file_ctr_mmap(const char *infile, const char *outfile,
+                             const kf_key *key, const char *iv);
+
+int kf_decrypt_file_ctr_mmap(const char *infile, const char *outfile,
+                             const kf_key *key);
+
+int kf_encrypt_file_chunked(const char *infile, const char *outfile,
+                            const kf_key *key, const char *iv,
+                            const char *padding, size_t chunk_size,
+                            const kf_opts *opts);
+
+int kf_encrypt_file_chunked_updatable(const char *infile, const char *outfile,
+                                      const kf_key *key, const char *iv,
+                                      const char *padding, size_t chunk_size,
+                                      const kf_opts *opts);
+
+int kf_encrypt_file_chunked_deflate(const char *infile, const char *outfile,
+                                    const kf_key *key, const char *iv,
+                                    const char *padding, size_t chunk_size,
+                                    int level, const kf_opts *opts);
+
+int kf_deflate_enabled(void);
+
+int kf_decrypt_file_chunked(const char *infile, const char *outfile,
+                            const kf_key *key, const kf_opts *opts);
+
+int kf_update_file_chunked(const char *infile, const char *outfile,
+                           const kf_key *key, const char *padding,
+                           const kf_opts *opts, uint64_t *changed);
+
+int kf_decrypt_file_range(const char *infile, const char *outfile,
+                          const kf_key *key, const uint64_t offset,
+                          const uint64_t len, const kf_opts *opts);
+
+int kf_decrypt_range(const char *infile, const uint64_t offset,
+                     const size_t len, const kf_key *key, uint8_t *out,
+                     size_t *out_len);
+
+int kf_async_wanted(const char *infile, const char *outfile,
+                    const kf_opts *opts);
+
+int kf_encrypt_file_cbc_async(const char *infile, const char *outfile,
+                              const kf_key *key, const char *iv,
+                              const char *padding, const kf_opts *opts);
+
+int kf_decrypt_file_cbc_async(const char *infile, const char *outfile,
+                              const kf_key *key, const kf_opts *opts);
+
+int kf_encrypt_file_ctr_async(const char *infile, const char *outfile,
+                              const kf_key *key, const char *iv,
+                              const kf_opts *opts);
+
+int kf_decrypt_file_ctr_async(const char *infile, const char *outfile,
+                              const kf_key *key, const kf_opts *opts);
+
+int kf_encrypt_fd_cbc(const int in_fd, const int out_fd, const kf_key *key,
+                      const char *iv, const char *padding,
+                      const kf_opts *opts);
+
+int kf_decrypt_fd_cbc(const int in_fd, const int out_fd, const kf_key *key,
+                      const kf_opts *opts);
+
+int kf_encrypt_fd_ctr(const int in_fd, const int out_fd, const kf_key *key,
+                      const char *iv, const kf_opts *opts);
+
+int kf_decrypt_fd_ctr(const int in_fd, const int out_fd, const kf_key *key,
+                      const kf_opts *opts);
+
+int kf_encrypt_file_cbc(const char *infile, const char *outfile,
+                        const char *passphrase, const char *iv,
+                        const char *padding);
+
+int kf_encrypt_file_cbc_ex(const char *infile, const char *outfile,
+                           const char *passphrase, const char *iv,
+                           const char *padding, const kf_opts *opts);
+
+int kf_encrypt_file_cbc_key(const char *infile, const char *outfile,
+                            const kf_key *key, const char *iv,
+                            const char *padding, const kf_opts *opts);
+
+int kf_decrypt_file_cbc(const char *infile, const char *outfile,
+                        const char *passphrase);
+
+int kf_decrypt_file_cbc_ex(const char *infile, const char *outfile,
+                           const char *passphrase, const kf_opts *opts);
+
+int kf_decrypt_file_cbc_key(const char *infile, const char *outfile,
+                            const kf_key *key, const kf_opts *opts);
+
+void kf_ctr(const uint8_t *in, uint8_t *out, const size_t len, const char *iv,
+            const uint64_t counter, const kf_ctx *ctx);
+
+void kf_ctr_x(const uint8_t *in, uint8_t *out, const size_t len,
+              const char *iv, const uint64_t counter, const kf_xctx *x);
+
+void kf_ctr_multi(const kf_msg *msgs, const size_t nmsgs);
+
+void kf_ctr_stream_init(kf_ctr_stream *s, const kf_xctx *x, const char *iv,
+                        const uint64_t counter, const uint64_t len);
+
+void kf_ctr_stream_update(kf_ctr_stream *s, const uint8_t *in, uint8_t *out,
+                          const size_t len);
+
+void kf_ctr_iov(const struct iovec *in, const struct iovec *out, const int n,
+                const char *iv, const uint64_t counter, const kf_xctx *x);
+
+int kf_encrypt_file_ctr(const char *infile, const char *outfile,
+                        const char *passphrase, const char *iv);
+
+int kf_encrypt_file_ctr_ex(const char *infile, const char *outfile,
+                           const char *passphrase, const char *iv,
+                           const kf_opts *opts);
+
+int kf_encrypt_file_ctr_key(const char *infile, const char *outfile,
+                            const kf_key *key, const char *iv,
+                            const kf_opts *opts);
+
+int kf_decrypt_file_ctr(const char *infile, const char *outfile,
+                        const char *passphrase);
+
+int kf_decrypt_file_ctr_ex(const char *infile, const char *outfile,
+                           const char *passphrase, const kf_opts *opts);
+
+int kf_decrypt_file_ctr_key(const char *infile, const char *outfile,
+                            const kf_key *key, const kf_opts *opts);
+
+void kf_aead_encrypt(const uint8_t *in, uint8_t *out, const size_t len,
+                     const char *iv, const kf_key *key,
+                     uint8_t tag[KF_TAG_SIZE]);
+
+int kf_aead_decrypt(const uint8_t *in, uint8_t *out, const size_t len,
+                    const char *iv, const kf_key *key,
+                    const uint8_t tag[KF_TAG_SIZE]);
+
+void kf_aead_encrypt_iov(const struct iovec *in, const struct iovec *out,
+                         const int n, const char *iv, const kf_key *key,
+                         uint8_t tag[KF_TAG_SIZE]);
+
+int kf_aead_decrypt_iov(const struct iovec *in, const struct iovec *out,
+                        const int n, const char *iv, const kf_key *key,
+                        const uint8_t tag[KF_TAG_SIZE]);
+
+int kf_encrypt_file_aead(const char *infile, const char *outfile,
+                         const char *passphrase, const char *iv);
+
+int kf_encrypt_file_aead_ex(const char *infile, const char *outfile,
+                            const char *passphrase, const char *iv,
+                            const kf_opts *opts);
+
+int kf_encrypt_file_aead_key(const char *infile, const char *outfile,
+                             const kf_key *key, const char *iv,
+                             const kf_opts *opts);
+
+int kf_decrypt_file_aead(const char *infile, const char *outfile,
                          const char *passphrase);
 
+int kf_decrypt_file_aead_ex(const char *infile, const char *outfile,
+                            const char *passphrase, const kf_opts *opts);
+
+int kf_decrypt_file_aead_key(const char *infile, const char *outfile,
+                             const kf_key *key, const kf_opts *opts);
+
+int kf_xts_init(kf_xts *xts, const kf_key *key, const size_t sector_size);
+
+void kf_xts_sectors(const kf_xts *xts, const uint64_t first_sector,
+                    const size_t nsectors, const uint8_t *in, uint8_t *out,
+                    const int encrypt);
+
+kf_jit *kf_jit_create(const kf_xctx *x, const kf_sched *k);
+
+int kf_jit_native(const kf_jit *jit);
+
+void kf_jit_block_n(const kf_jit *jit, const uint32_t *in, uint32_t *out,
+                    size_t nblocks);
+
+void kf_jit_destroy(kf_jit *jit);
+
+int kf_gpu_available(void);
+
+kf_gpu *kf_gpu_create(const kf_xctx *x);
+
+void kf_gpu_destroy(kf_gpu *g);
+
+void kf_ctr_gpu(kf_gpu *g, const uint8_t *in, uint8_t *out, const size_t len,
+                const char *iv, const uint64_t counter, const kf_xctx *x);
+
+int kf_encrypt_file_ctr_gpu(const char *infile, const char *outfile,
+                            const kf_key *key, const char *iv,
+                            const kf_opts *opts);
+
+int kf_decrypt_file_ctr_gpu(const char *infile, const char *outfile,
+                            const kf_key *key, const kf_opts *opts);
+
 #endif // KF128_H
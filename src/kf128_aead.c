@@ -0,0 +1,654 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * the aead mode encrypts in counter mode and authenticates the ciphertext
+ * with poly1305 in the same pass: every slice of KF_AEAD_SLICE bytes is run
+ * through the keystream, which comes from the multi-block kernel, and into
+ * the mac while it is still in the cache. the one-time poly1305 key is the
+ * keystream of counters 0 and 1, and the data starts at counter 2, so the
+ * iv must never be used twice under one key. a file holds
+ *
+ *   0   16 iv
+ *   16     the ciphertext, exactly as long as the plaintext
+ *          the tag, KF_TAG_SIZE bytes
+ *
+ * the mac covers the ciphertext padded with zeros to a whole block, then a
+ * block of eight zero bytes and the ciphertext length, little endian.
+ * decryption checks the tag as the data streams past; when it does not
+ * match, an output file is removed, and a buffer is wiped.
+ */
+
+#define KF_AEAD_SLICE (KF_CTR_BATCH * BLOCK_SIZE)
+#define KF_AEAD_FIRST (KF_POLY_KEY_SIZE / BLOCK_SIZE)
+
+/**
+ * @brief the aead object holds the state carried between the slices of one
+ * message.
+ *
+ */
+typedef struct {
+  kf_poly1305 mac;
+  const kf_xctx *x;
+  char iv[BLOCK_SIZE];
+  uint64_t counter;
+  uint64_t len;
+} kf_aead;
+
+/**
+ * @brief start a message
+ *
+ * @param a a pointer to the aead object
+ * @param key a pointer to the key object
+ * @param iv the initialization vector
+ */
+static void kf_aead_init(kf_aead *a, const kf_key *key, const char *iv) {
+
+  uint8_t mac_key[KF_POLY_KEY_SIZE] = {0};
+
+  kf_ctr_x(mac_key, mac_key, sizeof(mac_key), iv, 0, &key->x);
+  kf_poly1305_init(&a->mac, mac_key);
+  kf_wipe(mac_key, sizeof(mac_key));
+
+  a->x = &key->x;
+  memcpy(a->iv, iv, BLOCK_SIZE);
+  a->counter = KF_AEAD_FIRST;
+  a->len = 0;
+}
+
+/**
+ * @brief run ciphertext through the mac
+ *
+ * the counter mode counts its own blocks and time, so only the mac is timed
+ * here.
+ *
+ * @param a a pointer to the aead object
+ * @param in the ciphertext
+ * @param len the number of bytes
+ */
+static void kf_aead_mac(kf_aead *a, const uint8_t *in, const size_t len) {
+
+  KF_STATS_START(start);
+
+  kf_poly1305_update(&a->mac, in, len);
+
+  KF_STATS_STOP(mac_ns, start);
+}
+
+/**
+ * @brief encrypt and authenticate the next piece of a message
+ *
+ * every piece except the last must be a multiple of BLOCK_SIZE bytes.
+ *
+ * @param a a pointer to the aead object
+ * @param in the plaintext
+ * @param out the ciphertext, in and out may point to the same buffer
+ * @param len the number of bytes
+ */
+static void kf_aead_seal(kf_aead *a, const uint8_t *in, uint8_t *out,
+                         const size_t len) {
+
+  for (size_t done = 0; done < len; done += KF_AEAD_SLICE) {
+    const size_t left = len - done;
+    const size_t bytes = left < KF_AEAD_SLICE ? left : KF_AEAD_SLICE;
+
+    kf_ctr_x(in + done, out + done, bytes, a->iv, a->counter, a->x);
+    kf_aead_mac(a, out + done, bytes);
+    a->counter += bytes / BLOCK_SIZE;
+  }
+
+  a->len += len;
+}
+
+/**
+ * @brief authenticate and decrypt the next piece of a message
+ *
+ * every piece except the last must be a multiple of BLOCK_SIZE bytes.
+ *
+ * @param a a pointer to the aead object
+ * @param in the ciphertext
+ * @param out the plaintext, in and out may point to the same buffer
+ * @param len the number of bytes
+ */
+static void kf_aead_open(kf_aead *a, const uint8_t *in, uint8_t *out,
+                         const size_t len) {
+
+  for (size_t done = 0; done < len; done += KF_AEAD_SLICE) {
+    const size_t left = len - done;
+    const size_t bytes = left < KF_AEAD_SLICE ? left : KF_AEAD_SLICE;
+
+    kf_aead_mac(a, in + done, bytes);
+    kf_ctr_x(in + done, out + done, bytes, a->iv, a->counter, a->x);
+    a->counter += bytes / BLOCK_SIZE;
+  }
+
+  a->len += len;
+}
+
+/**
+ * @brief finish a message
+ *
+ * @param a a pointer to the aead object
+ * @param tag the tag
+ */
+static void kf_aead_tag(kf_aead *a, uint8_t tag[KF_TAG_SIZE]) {
+
+  uint8_t block[KF_POLY_BLOCK] = {0};
+
+  if (a->len % KF_POLY_BLOCK)
+    kf_poly1305_update(&a->mac, block,
+                       KF_POLY_BLOCK - (size_t)(a->len % KF_POLY_BLOCK));
+
+  for (int i = 0; i < 8; i++)
+    block[8 + i] = (uint8_t)(a->len >> (8 * i));
+
+  kf_poly1305_update(&a->mac, block, sizeof(block));
+  kf_poly1305_final(&a->mac, tag);
+}
+
+/**
+ * @brief compare two tags in constant time
+ *
+ * @param a the first tag
+ * @param b the second tag
+ * @return int 1 if they are equal, 0 otherwise
+ */
+static int kf_aead_equal(const uint8_t *a, const uint8_t *b) {
+
+  uint8_t diff = 0;
+
+  for (int i = 0; i < KF_TAG_SIZE; i++)
+    diff |= a[i] ^ b[i];
+
+  return diff == 0;
+}
+
+/**
+ * @brief encrypt and authenticate a buffer with knifefish in aead mode.
+ *
+ * @param in the plaintext
+ * @param out the ciphertext, in and out may point to the same buffer
+ * @param len the number of bytes
+ * @param iv the initialization vector, never to be used twice under one key
+ * @param key a pointer to the key object
+ * @param tag the tag
+ */
+void kf_aead_encrypt(const uint8_t *in, uint8_t *out, const size_t len,
+                     const char *iv, const kf_key *key,
+                     uint8_t tag[KF_TAG_SIZE]) {
+
+  kf_aead a;
+
+  kf_aead_init(&a, key, iv);
+  kf_aead_seal(&a, in, out, len);
+  kf_aead_tag(&a, tag);
+}
+
+/**
+ * @brief authenticate and decrypt a buffer with knifefish in aead mode.
+ *
+ * when the tag does not match, out is wiped.
+ *
+ * @param in the ciphertext
+ * @param out the plaintext, in and out may point to the same buffer
+ * @param len the number of bytes
+ * @param iv the initialization vector
+ * @param key a pointer to the key object
+ * @param tag the tag
+ * @return int KF_OK, or KF_ERR_AUTH
+ */
+int kf_aead_decrypt(const uint8_t *in, uint8_t *out, const size_t len,
+                    const char *iv, const kf_key *key,
+                    const uint8_t tag[KF_TAG_SIZE]) {
+
+  kf_aead a;
+  uint8_t check[KF_TAG_SIZE];
+
+  kf_aead_init(&a, key, iv);
+  kf_aead_open(&a, in, out, len);
+  kf_aead_tag(&a, check);
+
+  if (kf_aead_equal(tag, check))
+    return KF_OK;
+
+  kf_wipe(out, len);
+
+  return KF_ERR_AUTH;
+}
+
+/**
+ * @brief encrypt or decrypt the buffers of a scatter-gather list and run
+ * the ciphertext through the mac
+ *
+ * long buffers go KF_AEAD_SLICE bytes at a time, so the mac reads each
+ * slice of ciphertext while it is still in the cache.
+ *
+ * @param a a pointer to the aead object
+ * @param s the counter mode stream of the message
+ * @param in the input buffers
+ * @param out the output buffers
+ * @param n the number of buffers
+ * @param encrypt 1 to encrypt, 0 to decrypt
+ */
+static void kf_aead_iov(kf_aead *a, kf_ctr_stream *s, const struct iovec *in,
+                        const struct iovec *out, const int n,
+                        const int encrypt) {
+
+  for (int i = 0; i < n; i++) {
+    const uint8_t *src = in[i].iov_base;
+    uint8_t *dst = out[i].iov_base;
+    const size_t len = in[i].iov_len;
+
+    for (size_t done = 0; done < len; done += KF_AEAD_SLICE) {
+      const size_t left = len - done;
+      const size_t bytes = left < KF_AEAD_SLICE ? left : KF_AEAD_SLICE;
+
+      if (!encrypt)
+        kf_aead_mac(a, src + done, bytes);
+
+      kf_ctr_stream_update(s, src + done, dst + done, bytes);
+
+      if (encrypt)
+        kf_aead_mac(a, dst + done, bytes);
+    }
+
+    a->len += len;
+  }
+}
+
+/**
+ * @brief encrypt and authenticate a scatter-gather list with knifefish in
+ * aead mode.
+ *
+ * the buffers of in are one message, and the ciphertext and tag are
+ * identical to kf_aead_encrypt on their concatenation. out[i] receives the
+ * ciphertext of in[i] and must be as long; the buffers may end anywhere, and
+ * out may be in itself.
+ *
+ * @param in the plaintext buffers
+ * @param out the ciphertext buffers
+ * @param n the number of buffers
+ * @param iv the initialization vector, never to be used twice under one key
+ * @param key a pointer to the key object
+ * @param tag the tag
+ */
+void kf_aead_encrypt_iov(const struct iovec *in, const struct iovec *out,
+                         const int n, const char *iv, const kf_key *key,
+                         uint8_t tag[KF_TAG_SIZE]) {
+
+  kf_aead a;
+  kf_ctr_stream s;
+  uint64_t len = 0;
+
+  for (int i = 0; i < n; i++)
+    len += in[i].iov_len;
+
+  kf_aead_init(&a, key, iv);
+  kf_ctr_stream_init(&s, &key->x, iv, KF_AEAD_FIRST, len);
+  kf_aead_iov(&a, &s, in, out, n, 1);
+  kf_aead_tag(&a, tag);
+
+  kf_wipe(s.stream, sizeof(s.stream));
+}
+
+/**
+ * @brief authenticate and decrypt a scatter-gather list with knifefish in
+ * aead mode.
+ *
+ * the counterpart of kf_aead_encrypt_iov. when the tag does not match,
+ * every output buffer is wiped.
+ *
+ * @param in the ciphertext buffers
+ * @param out the plaintext buffers
+ * @param n the number of buffers
+ * @param iv the initialization vector
+ * @param key a pointer to the key object
+ * @param tag the tag
+ * @return int KF_OK, or KF_ERR_AUTH if the message was changed
+ */
+int kf_aead_decrypt_iov(const struct iovec *in, const struct iovec *out,
+                        const int n, const char *iv, const kf_key *key,
+                        const uint8_t tag[KF_TAG_SIZE]) {
+
+  kf_aead a;
+  kf_ctr_stream s;
+  uint8_t check[KF_TAG_SIZE];
+  uint64_t len = 0;
+
+  for (int i = 0; i < n; i++)
+    len += in[i].iov_len;
+
+  kf_aead_init(&a, key, iv);
+  kf_ctr_stream_init(&s, &key->x, iv, KF_AEAD_FIRST, len);
+  kf_aead_iov(&a, &s, in, out, n, 0);
+  kf_aead_tag(&a, check);
+
+  kf_wipe(s.stream, sizeof(s.stream));
+
+  if (kf_aead_equal(tag, check))
+    return KF_OK;
+
+  for (int i = 0; i < n; i++)
+    kf_wipe(out[i].iov_base, in[i].iov_len);
+
+  return KF_ERR_AUTH;
+}
+
+/**
+ * @brief get the size of one file mode buffer
+ *
+ * @param opts the file mode options, or NULL for the defaults
+ * @return size_t the number of bytes, a multiple of BLOCK_SIZE
+ */
+static size_t kf_aead_buffer(const kf_opts *opts) {
+
+  const size_t size =
+      (opts && opts->buffer_size > 0) ? opts->buffer_size : KF_BUFFER_SIZE;
+
+  return size < BLOCK_SIZE ? BLOCK_SIZE : size / BLOCK_SIZE * BLOCK_SIZE;
+}
+
+/**
+ * @brief read up to len bytes
+ *
+ * @param buffer the buffer
+ * @param len the number of bytes
+ * @param in the input file
+ * @return size_t the number of bytes read
+ */
+static size_t kf_aead_read(void *buffer, const size_t len, FILE *in) {
+
+  KF_STATS_START(start);
+
+  const size_t got = fread(buffer, sizeof(uint8_t), len, in);
+
+  KF_STATS_ADD(reads, 1);
+  KF_STATS_ADD(bytes_read, got);
+  KF_STATS_STOP(io_ns, start);
+
+  return got;
+}
+
+/**
+ * @brief write exactly len bytes
+ *
+ * @param buffer the buffer
+ * @param len the number of bytes
+ * @param out the output file
+ * @return int KF_OK, or KF_ERR_WRITE on a short write
+ */
+static int kf_aead_write(const void *buffer, const size_t len, FILE *out) {
+
+  KF_STATS_START(start);
+
+  const size_t put = fwrite(buffer, sizeof(uint8_t), len, out);
+
+  KF_STATS_ADD(writes, 1);
+  KF_STATS_ADD(bytes_written, put);
+  KF_STATS_STOP(io_ns, start);
+
+  return put == len ? KF_OK : KF_ERR_WRITE;
+}
+
+/**
+ * @brief open the input and output files of the aead mode
+ *
+ * @param infile the name of the input file, or "-" for stdin
+ * @param outfile the name of the output file, or "-" for stdout
+ * @param in the input file
+ * @param out the output file
+ * @return int KF_OK, or KF_ERR_OPEN
+ */
+static int kf_aead_files(const char *infile, const char *outfile, FILE **in,
+                         FILE **out) {
+
+  *in = strcmp(infile, "-") == 0 ? stdin : fopen(infile, "rb");
+  if (!*in)
+    return KF_ERR_OPEN;
+
+  *out = strcmp(outfile, "-") == 0 ? stdout : fopen(outfile, "wb");
+  if (!*out) {
+    if (*in != stdin)
+      fclose(*in);
+    return KF_ERR_OPEN;
+  }
+
+  return KF_OK;
+}
+
+/**
+ * @brief close the input and output files of the aead mode
+ *
+ * @param in the input file
+ * @param out the output file
+ * @param status the status of the file mode so far
+ * @return int the status, or KF_ERR_WRITE
+ */
+static int kf_aead_close(FILE *in, FILE *out, const int status) {
+
+  const int closed = out == stdout ? fflush(out) : fclose(out);
+
+  if (in != stdin)
+    fclose(in);
+
+  return (status == KF_OK && closed != 0) ? KF_ERR_WRITE : status;
+}
+
+/**
+ * @brief encrypt a file with knifefish in aead mode.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param passphrase the plaintext passphrase
+ * @param iv the initialization vector
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_file_aead(const char *infile, const char *outfile,
+                         const char *passphrase, const char *iv) {
+
+  return kf_encrypt_file_aead_ex(infile, outfile, passphrase, iv, NULL);
+}
+
+/**
+ * @brief encrypt a file with knifefish in aead mode.
+ *
+ * the passphrase is expanded on every call. use the _key variant to reuse an
+ * expanded key.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param passphrase the plaintext passphrase
+ * @param iv the initialization vector
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_file_aead_ex(const char *infile, const char *outfile,
+                            const char *passphrase, const char *iv,
+                            const kf_opts *opts) {
+
+  kf_key key;
+  kf_key_init(&key, passphrase);
+
+  const int status = kf_encrypt_file_aead_key(infile, outfile, &key, iv, opts);
+
+  kf_wipe(&key, sizeof(key));
+
+  return status;
+}
+
+/**
+ * @brief encrypt a file with knifefish in aead mode.
+ *
+ * the output file holds the iv, a ciphertext of exactly the same length as
+ * the input file, and the tag. the files are streamed, so both can be pipes.
+ *
+ * @param infile the name of the input file, or "-" for stdin
+ * @param outfile the name of the output file, or "-" for stdout
+ * @param key a pointer to the key object
+ * @param iv the initialization vector, never to be used twice under one key
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_file_aead_key(const char *infile, const char *outfile,
+                             const kf_key *key, const char *iv,
+                             const kf_opts *opts) {
+
+  FILE *in, *out;
+
+  int status = kf_aead_files(infile, outfile, &in, &out);
+  if (status != KF_OK)
+    return status;
+
+  const size_t size = kf_aead_buffer(opts);
+
+  uint8_t *buffer = malloc(size);
+  if (!buffer)
+    return kf_aead_close(in, out, KF_ERR_MEMORY);
+
+  kf_aead a;
+
+  kf_aead_init(&a, key, iv);
+  status = kf_aead_write(iv, BLOCK_SIZE, out);
+
+  for (size_t len = size; status == KF_OK && len == size;) {
+    len = kf_aead_read(buffer, size, in);
+
+    if (len < size && ferror(in)) {
+      status = KF_ERR_READ;
+      break;
+    }
+
+    kf_aead_seal(&a, buffer, buffer, len);
+    status = kf_aead_write(buffer, len, out);
+  }
+
+  uint8_t tag[KF_TAG_SIZE];
+
+  kf_aead_tag(&a, tag);
+
+  if (status == KF_OK)
+    status = kf_aead_write(tag, sizeof(tag), out);
+
+  free(buffer);
+
+  return kf_aead_close(in, out, status);
+}
+
+/**
+ * @brief decrypt a file with knifefish in aead mode.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param passphrase the plaintext passphrase
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_file_aead(const char *infile, const char *outfile,
+                         const char *passphrase) {
+
+  return kf_decrypt_file_aead_ex(infile, outfile, passphrase, NULL);
+}
+
+/**
+ * @brief decrypt a file with knifefish in aead mode.
+ *
+ * the passphrase is expanded on every call. use the _key variant to reuse an
+ * expanded key.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param passphrase the plaintext passphrase
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_file_aead_ex(const char *infile, const char *outfile,
+                            const char *passphrase, const kf_opts *opts) {
+
+  kf_key key;
+  kf_key_init(&key, passphrase);
+
+  const int status = kf_decrypt_file_aead_key(infile, outfile, &key, opts);
+
+  kf_wipe(&key, sizeof(key));
+
+  return status;
+}
+
+/**
+ * @brief decrypt a file with knifefish in aead mode.
+ *
+ * the last KF_TAG_SIZE bytes read are always held back, since they may be
+ * the tag, so the ciphertext is checked and decrypted in a single pass.
+ * when the tag does not match, KF_ERR_AUTH is returned and an output file is
+ * removed, as it is on a read or write error, so no unchecked plaintext is
+ * left on disk; what was already written to stdout can not be taken back.
+ *
+ * @param infile the name of the input file, or "-" for stdin
+ * @param outfile the name of the output file, or "-" for stdout
+ * @param key a pointer to the key object
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_file_aead_key(const char *infile, const char *outfile,
+                             const kf_key *key, const kf_opts *opts) {
+
+  FILE *in, *out;
+
+  int status = kf_aead_files(infile, outfile, &in, &out);
+  if (status != KF_OK)
+    return status;
+
+  const size_t size = kf_aead_buffer(opts);
+
+  uint8_t *buffer = malloc(size + KF_TAG_SIZE);
+  if (!buffer)
+    return kf_aead_close(in, out, KF_ERR_MEMORY);
+
+  char iv[BLOCK_SIZE];
+  kf_aead a;
+
+  if (kf_aead_read(iv, BLOCK_SIZE, in) != BLOCK_SIZE ||
+      kf_aead_read(buffer, KF_TAG_SIZE, in) != KF_TAG_SIZE)
+    status = ferror(in) ? KF_ERR_READ : KF_ERR_FORMAT;
+
+  if (status == KF_OK)
+    kf_aead_init(&a, key, iv);
+
+  for (size_t len = size; status == KF_OK && len == size;) {
+    len = kf_aead_read(buffer + KF_TAG_SIZE, size, in);
+
+    if (len < size && ferror(in)) {
+      status = KF_ERR_READ;
+      break;
+    }
+
+    kf_aead_open(&a, buffer, buffer, len);
+    status = kf_aead_write(buffer, len, out);
+    memmove(buffer, buffer + len, KF_TAG_SIZE);
+  }
+
+  if (status == KF_OK) {
+    uint8_t tag[KF_TAG_SIZE];
+
+    kf_aead_tag(&a, tag);
+
+    if (!kf_aead_equal(buffer, tag))
+      status = KF_ERR_AUTH;
+  }
+
+  free(buffer);
+
+  status = kf_aead_close(in, out, status);
+
+  if (status != KF_OK && strcmp(outfile, "-") != 0)
+    remove(outfile);
+
+  return status;
+}
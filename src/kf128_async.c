@@ -0,0 +1,1018 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#define _DEFAULT_SOURCE
+
+#ifdef __linux__
+/* linux/io_uring.h pulls in linux/fs.h, whose BLOCK_SIZE is not ours */
+#include <linux/io_uring.h>
+#undef BLOCK_SIZE
+#endif
+
+#include "kf128.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __unix__
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#define KF_URING 1
+#else
+#define KF_URING 0
+#endif
+
+/*
+ * the async backend splits the input into chunks of one buffer and keeps
+ * KF_ASYNC_DEPTH of them in flight: while chunk n is run through the cipher,
+ * the reads of the next chunks and the writes of the previous ones are
+ * already queued. on linux the reads and writes go through io_uring, set up
+ * with raw system calls. when io_uring is missing or refused, one reader
+ * and one writer thread do the same with pread and pwrite, and when threads
+ * can not be started either the calls are made in place.
+ *
+ * the input size is known from fstat, so a short read or write is simply
+ * queued again for the rest of its range. the output is identical to the
+ * stdio backend.
+ */
+
+#define KF_AIO_READ 0
+#define KF_AIO_WRITE 1
+
+/**
+ * @brief the aio slot object holds the buffers of one chunk in flight and
+ * the state of its read and its write.
+ *
+ */
+typedef struct {
+  uint8_t *base;
+  uint8_t *buf[2];
+  struct iovec iov[2];
+  uint64_t off[2];
+  size_t len[2];
+  size_t done[2];
+  int pending[2];
+} kf_aio_slot;
+
+typedef struct kf_aio kf_aio;
+
+/**
+ * @brief the aio worker object tells an io thread which kind of request it
+ * serves.
+ *
+ */
+typedef struct {
+  kf_aio *aio;
+  int kind;
+} kf_aio_worker;
+
+/**
+ * @brief the aio object holds the open files, the slots, and the state of
+ * the io_uring or the io threads.
+ *
+ */
+struct kf_aio {
+  int in_fd;
+  int out_fd;
+  uint64_t size;
+  uint64_t out_pos;
+  size_t chunk;
+  int status;
+  kf_aio_slot slots[KF_ASYNC_DEPTH];
+
+  int uring;
+  int ring_fd;
+  void *sq_ring;
+  void *cq_ring;
+  size_t sq_ring_size;
+  size_t cq_ring_size;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  int threads;
+  int stop;
+  pthread_t workers[2];
+  kf_aio_worker worker_args[2];
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int queue[2][KF_ASYNC_DEPTH];
+  size_t queue_head[2];
+  size_t queue_tail[2];
+};
+
+/**
+ * @brief run the rest of a request with pread or pwrite
+ *
+ * @param aio the aio object
+ * @param slot the slot of the request
+ * @param kind KF_AIO_READ or KF_AIO_WRITE
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+static int kf_aio_sync(kf_aio *aio, const int slot, const int kind) {
+
+  kf_aio_slot *s = &aio->slots[slot];
+
+  while (s->done[kind] < s->len[kind]) {
+    uint8_t *p = s->buf[kind] + s->done[kind];
+    const size_t n = s->len[kind] - s->done[kind];
+    const off_t off = (off_t)(s->off[kind] + s->done[kind]);
+
+    const ssize_t r = kind == KF_AIO_READ ? pread(aio->in_fd, p, n, off)
+                                          : pwrite(aio->out_fd, p, n, off);
+
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return kind == KF_AIO_READ ? KF_ERR_READ : KF_ERR_WRITE;
+
+    s->done[kind] += (size_t)r;
+  }
+
+  return KF_OK;
+}
+
+/**
+ * @brief serve the requests of one kind until the aio object is closed
+ *
+ * @param arg a pointer to a kf_aio_worker
+ * @return void* always NULL
+ */
+static void *kf_aio_thread(void *arg) {
+
+  kf_aio_worker *w = (kf_aio_worker *)arg;
+  kf_aio *aio = w->aio;
+  const int kind = w->kind;
+
+  pthread_mutex_lock(&aio->lock);
+
+  for (;;) {
+    while (aio->queue_head[kind] == aio->queue_tail[kind] && !aio->stop)
+      pthread_cond_wait(&aio->cond, &aio->lock);
+
+    if (aio->queue_head[kind] == aio->queue_tail[kind])
+      break;
+
+    const int slot =
+        aio->queue[kind][aio->queue_head[kind]++ % KF_ASYNC_DEPTH];
+
+    pthread_mutex_unlock(&aio->lock);
+    const int status = kf_aio_sync(aio, slot, kind);
+    pthread_mutex_lock(&aio->lock);
+
+    if (status != KF_OK && aio->status == KF_OK)
+      aio->status = status;
+
+    aio->slots[slot].pending[kind] = 0;
+    pthread_cond_broadcast(&aio->cond);
+  }
+
+  pthread_mutex_unlock(&aio->lock);
+
+  return NULL;
+}
+
+#if KF_URING
+
+/**
+ * @brief set up an io_uring with room for every request in flight
+ *
+ * @param aio the aio object
+ * @return int 1 if the ring is ready, 0 to use another way
+ */
+static int kf_uring_init(kf_aio *aio) {
+
+  struct io_uring_params p;
+
+  memset(&p, 0, sizeof(p));
+
+  aio->ring_fd = (int)syscall(__NR_io_uring_setup, 2 * KF_ASYNC_DEPTH, &p);
+  if (aio->ring_fd < 0)
+    return 0;
+
+  aio->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  aio->cq_ring_size =
+      p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  aio->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+  aio->sq_ring = mmap(NULL, aio->sq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, aio->ring_fd,
+                      IORING_OFF_SQ_RING);
+  aio->cq_ring = mmap(NULL, aio->cq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, aio->ring_fd,
+                      IORING_OFF_CQ_RING);
+  aio->sqes = mmap(NULL, aio->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, aio->ring_fd, IORING_OFF_SQES);
+
+  if (aio->sq_ring == MAP_FAILED || aio->cq_ring == MAP_FAILED ||
+      aio->sqes == MAP_FAILED) {
+    if (aio->sq_ring != MAP_FAILED)
+      munmap(aio->sq_ring, aio->sq_ring_size);
+    if (aio->cq_ring != MAP_FAILED)
+      munmap(aio->cq_ring, aio->cq_ring_size);
+    if (aio->sqes != MAP_FAILED)
+      munmap(aio->sqes, aio->sqes_size);
+    close(aio->ring_fd);
+    return 0;
+  }
+
+  uint8_t *sq = aio->sq_ring;
+  uint8_t *cq = aio->cq_ring;
+
+  aio->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  aio->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  aio->sq_array = (unsigned *)(sq + p.sq_off.array);
+  aio->cq_head = (unsigned *)(cq + p.cq_off.head);
+  aio->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  aio->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  aio->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+  return 1;
+}
+
+/**
+ * @brief tear down the io_uring
+ *
+ * @param aio the aio object
+ */
+static void kf_uring_close(kf_aio *aio) {
+
+  munmap(aio->sqes, aio->sqes_size);
+  munmap(aio->cq_ring, aio->cq_ring_size);
+  munmap(aio->sq_ring, aio->sq_ring_size);
+  close(aio->ring_fd);
+}
+
+/**
+ * @brief queue the rest of a request on the io_uring
+ *
+ * @param aio the aio object
+ * @param slot the slot of the request
+ * @param kind KF_AIO_READ or KF_AIO_WRITE
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+static int kf_uring_submit(kf_aio *aio, const int slot, const int kind) {
+
+  kf_aio_slot *s = &aio->slots[slot];
+
+  s->iov[kind].iov_base = s->buf[kind] + s->done[kind];
+  s->iov[kind].iov_len = s->len[kind] - s->done[kind];
+
+  const unsigned tail = *aio->sq_tail;
+  const unsigned index = tail & *aio->sq_mask;
+  struct io_uring_sqe *sqe = &aio->sqes[index];
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = kind == KF_AIO_READ ? IORING_OP_READV : IORING_OP_WRITEV;
+  sqe->fd = kind == KF_AIO_READ ? aio->in_fd : aio->out_fd;
+  sqe->addr = (uint64_t)(uintptr_t)&s->iov[kind];
+  sqe->len = 1;
+  sqe->off = s->off[kind] + s->done[kind];
+  sqe->user_data = (uint64_t)(2 * slot + kind);
+
+  aio->sq_array[index] = index;
+  __atomic_store_n(aio->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  long r;
+  do {
+    r = syscall(__NR_io_uring_enter, aio->ring_fd, 1, 0, 0, NULL, 0);
+  } while (r < 0 && errno == EINTR);
+
+  if (r != 1)
+    return kind == KF_AIO_READ ? KF_ERR_READ : KF_ERR_WRITE;
+
+  return KF_OK;
+}
+
+/**
+ * @brief wait for at least one completion and handle every one that is ready
+ *
+ * a short transfer is queued again for the rest of its range.
+ *
+ * @param aio the aio object
+ */
+static void kf_uring_reap(kf_aio *aio) {
+
+  long r;
+  do {
+    r = syscall(__NR_io_uring_enter, aio->ring_fd, 0, 1,
+                IORING_ENTER_GETEVENTS, NULL, 0);
+  } while (r < 0 && errno == EINTR);
+
+  if (r < 0) {
+    /* nothing can complete any more, so give up on every request */
+    if (aio->status == KF_OK)
+      aio->status = KF_ERR_READ;
+    for (int i = 0; i < KF_ASYNC_DEPTH; i++)
+      aio->slots[i].pending[0] = aio->slots[i].pending[1] = 0;
+    return;
+  }
+
+  unsigned head = *aio->cq_head;
+  const unsigned tail = __atomic_load_n(aio->cq_tail, __ATOMIC_ACQUIRE);
+
+  for (; head != tail; head++) {
+    const struct io_uring_cqe *cqe = &aio->cqes[head & *aio->cq_mask];
+    const int slot = (int)(cqe->user_data / 2);
+    const int kind = (int)(cqe->user_data % 2);
+    kf_aio_slot *s = &aio->slots[slot];
+    const int failed = kind == KF_AIO_READ ? KF_ERR_READ : KF_ERR_WRITE;
+
+    if (cqe->res <= 0) {
+      if (aio->status == KF_OK)
+        aio->status = failed;
+      s->pending[kind] = 0;
+      continue;
+    }
+
+    s->done[kind] += (size_t)cqe->res;
+
+    if (s->done[kind] < s->len[kind]) {
+      const int status = kf_uring_submit(aio, slot, kind);
+      if (status == KF_OK)
+        continue;
+      if (aio->status == KF_OK)
+        aio->status = status;
+    }
+
+    s->pending[kind] = 0;
+  }
+
+  __atomic_store_n(aio->cq_head, head, __ATOMIC_RELEASE);
+}
+
+#endif
+
+/**
+ * @brief start a read or a write on a slot
+ *
+ * @param aio the aio object
+ * @param slot the slot
+ * @param kind KF_AIO_READ or KF_AIO_WRITE
+ * @param off the file offset
+ * @param len the number of bytes
+ */
+static void kf_aio_submit(kf_aio *aio, const int slot, const int kind,
+                          const uint64_t off, const size_t len) {
+
+  kf_aio_slot *s = &aio->slots[slot];
+  int status = KF_OK;
+
+  s->off[kind] = off;
+  s->len[kind] = len;
+  s->done[kind] = 0;
+
+  if (len == 0)
+    return;
+
+  if (kind == KF_AIO_READ) {
+    KF_STATS_ADD(reads, 1);
+    KF_STATS_ADD(bytes_read, len);
+  } else {
+    KF_STATS_ADD(writes, 1);
+    KF_STATS_ADD(bytes_written, len);
+  }
+
+#if KF_URING
+  if (aio->uring) {
+    s->pending[kind] = 1;
+    status = kf_uring_submit(aio, slot, kind);
+    if (status != KF_OK) {
+      s->pending[kind] = 0;
+      if (aio->status == KF_OK)
+        aio->status = status;
+    }
+    return;
+  }
+#endif
+
+  if (aio->threads) {
+    pthread_mutex_lock(&aio->lock);
+    s->pending[kind] = 1;
+    aio->queue[kind][aio->queue_tail[kind]++ % KF_ASYNC_DEPTH] = slot;
+    pthread_cond_broadcast(&aio->cond);
+    pthread_mutex_unlock(&aio->lock);
+    return;
+  }
+
+  status = kf_aio_sync(aio, slot, kind);
+  if (status != KF_OK && aio->status == KF_OK)
+    aio->status = status;
+}
+
+/**
+ * @brief wait until the read or the write of a slot has finished
+ *
+ * @param aio the aio object
+ * @param slot the slot
+ * @param kind KF_AIO_READ or KF_AIO_WRITE
+ */
+static void kf_aio_wait(kf_aio *aio, const int slot, const int kind) {
+
+  KF_STATS_START(start);
+
+  kf_aio_slot *s = &aio->slots[slot];
+
+#if KF_URING
+  if (aio->uring) {
+    while (s->pending[kind])
+      kf_uring_reap(aio);
+  }
+#endif
+
+  if (aio->threads) {
+    pthread_mutex_lock(&aio->lock);
+    while (s->pending[kind])
+      pthread_cond_wait(&aio->cond, &aio->lock);
+    pthread_mutex_unlock(&aio->lock);
+  }
+
+  KF_STATS_STOP(io_ns, start);
+}
+
+/**
+ * @brief get the status of an aio object
+ *
+ * @param aio the aio object
+ * @return int KF_OK, or the first KF_ERR_* status of any request
+ */
+static int kf_aio_status(kf_aio *aio) {
+
+  int status;
+
+  if (aio->threads)
+    pthread_mutex_lock(&aio->lock);
+
+  status = aio->status;
+
+  if (aio->threads)
+    pthread_mutex_unlock(&aio->lock);
+
+  return status;
+}
+
+/**
+ * @brief open the files of a file mode and start the io backend
+ *
+ * @param aio the aio object
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param opts the file mode options
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+static int kf_aio_open(kf_aio *aio, const char *infile, const char *outfile,
+                       const kf_opts *opts) {
+
+  static const kf_opts defaults = {0, 0, KF_BACKEND_ASYNC};
+
+  struct stat st;
+
+  if (!opts)
+    opts = &defaults;
+
+  memset(aio, 0, sizeof(*aio));
+
+  aio->chunk = opts->buffer_size > 0 ? opts->buffer_size : KF_BUFFER_SIZE;
+  aio->chunk = aio->chunk < BLOCK_SIZE ? BLOCK_SIZE
+                                       : aio->chunk / BLOCK_SIZE * BLOCK_SIZE;
+
+  aio->in_fd = open(infile, O_RDONLY);
+  if (aio->in_fd < 0)
+    return KF_ERR_OPEN;
+
+  if (fstat(aio->in_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(aio->in_fd);
+    return KF_ERR_READ;
+  }
+
+  aio->size = (uint64_t)st.st_size;
+
+  aio->out_fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (aio->out_fd < 0) {
+    close(aio->in_fd);
+    return KF_ERR_OPEN;
+  }
+
+  /* BLOCK_SIZE bytes of room before the input for the chaining block */
+  for (int i = 0; i < KF_ASYNC_DEPTH; i++) {
+    kf_aio_slot *s = &aio->slots[i];
+
+    s->base = malloc(2 * aio->chunk + 4 * BLOCK_SIZE);
+    if (!s->base) {
+      for (int j = 0; j < i; j++)
+        free(aio->slots[j].base);
+      close(aio->in_fd);
+      close(aio->out_fd);
+      return KF_ERR_MEMORY;
+    }
+
+    s->buf[KF_AIO_READ] = s->base + BLOCK_SIZE;
+    s->buf[KF_AIO_WRITE] = s->base + aio->chunk + BLOCK_SIZE;
+  }
+
+#if KF_URING
+  if (opts->backend == KF_BACKEND_ASYNC)
+    aio->uring = kf_uring_init(aio);
+#endif
+
+  if (!aio->uring) {
+    pthread_mutex_init(&aio->lock, NULL);
+    pthread_cond_init(&aio->cond, NULL);
+
+    int started = 0;
+
+    for (int kind = 0; kind < 2; kind++) {
+      aio->worker_args[kind].aio = aio;
+      aio->worker_args[kind].kind = kind;
+      if (pthread_create(&aio->workers[kind], NULL, kf_aio_thread,
+                         &aio->worker_args[kind]) == 0)
+        started++;
+      else
+        break;
+    }
+
+    if (started == 2) {
+      aio->threads = 1;
+    } else if (started == 1) {
+      /* without both threads the calls are made in place */
+      pthread_mutex_lock(&aio->lock);
+      aio->stop = 1;
+      pthread_cond_broadcast(&aio->cond);
+      pthread_mutex_unlock(&aio->lock);
+      pthread_join(aio->workers[0], NULL);
+      aio->stop = 0;
+    }
+  }
+
+  return KF_OK;
+}
+
+/**
+ * @brief wait for every request, stop the io backend, and close the files
+ *
+ * @param aio the aio object
+ * @param status the status of the file mode so far
+ * @return int the status, or the first error of the io backend
+ */
+static int kf_aio_close(kf_aio *aio, int status) {
+
+  for (int i = 0; i < KF_ASYNC_DEPTH; i++) {
+    kf_aio_wait(aio, i, KF_AIO_READ);
+    kf_aio_wait(aio, i, KF_AIO_WRITE);
+  }
+
+  if (status == KF_OK)
+    status = kf_aio_status(aio);
+
+#if KF_URING
+  if (aio->uring)
+    kf_uring_close(aio);
+#endif
+
+  if (aio->threads) {
+    pthread_mutex_lock(&aio->lock);
+    aio->stop = 1;
+    pthread_cond_broadcast(&aio->cond);
+    pthread_mutex_unlock(&aio->lock);
+    pthread_join(aio->workers[0], NULL);
+    pthread_join(aio->workers[1], NULL);
+  }
+
+  if (!aio->uring) {
+    pthread_cond_destroy(&aio->cond);
+    pthread_mutex_destroy(&aio->lock);
+  }
+
+  for (int i = 0; i < KF_ASYNC_DEPTH; i++)
+    free(aio->slots[i].base);
+
+  close(aio->in_fd);
+  if (close(aio->out_fd) != 0 && status == KF_OK)
+    status = KF_ERR_WRITE;
+
+  return status;
+}
+
+/**
+ * @brief the chunk function of a file mode
+ *
+ * in has BLOCK_SIZE bytes of writable room before it, and out has room for
+ * len + 3 * BLOCK_SIZE bytes.
+ */
+typedef int (*kf_aio_fn)(void *state, uint8_t *in, const size_t len,
+                         uint8_t *out, const int last, size_t *out_len);
+
+/**
+ * @brief run the input from start to its end through a chunk function
+ *
+ * @param aio the aio object
+ * @param start the file offset of the first byte to process
+ * @param fn the chunk function
+ * @param state the state of the chunk function
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+static int kf_aio_run(kf_aio *aio, const uint64_t start, kf_aio_fn fn,
+                      void *state) {
+
+  const uint64_t total = aio->size - start;
+  uint64_t nchunks = (total + aio->chunk - 1) / aio->chunk;
+
+  /* an empty input still produces one, empty, chunk */
+  if (nchunks == 0)
+    nchunks = 1;
+
+#define KF_AIO_LEN(n)                                                          \
+  ((n) == nchunks - 1 ? (size_t)(total - (n) * aio->chunk) : aio->chunk)
+
+  for (uint64_t n = 0; n < KF_ASYNC_DEPTH && n < nchunks; n++)
+    kf_aio_submit(aio, (int)n, KF_AIO_READ, start + n * aio->chunk,
+                  KF_AIO_LEN(n));
+
+  int status = KF_OK;
+
+  for (uint64_t n = 0; n < nchunks && status == KF_OK; n++) {
+    const int slot = (int)(n % KF_ASYNC_DEPTH);
+    kf_aio_slot *s = &aio->slots[slot];
+    size_t out_len = 0;
+
+    kf_aio_wait(aio, slot, KF_AIO_READ);
+    kf_aio_wait(aio, slot, KF_AIO_WRITE);
+
+    status = kf_aio_status(aio);
+    if (status != KF_OK)
+      break;
+
+    status = fn(state, s->buf[KF_AIO_READ], KF_AIO_LEN(n),
+                s->buf[KF_AIO_WRITE], n == nchunks - 1, &out_len);
+    if (status != KF_OK)
+      break;
+
+    kf_aio_submit(aio, slot, KF_AIO_WRITE, aio->out_pos, out_len);
+    aio->out_pos += out_len;
+
+    if (n + KF_ASYNC_DEPTH < nchunks)
+      kf_aio_submit(aio, slot, KF_AIO_READ,
+                    start + (n + KF_ASYNC_DEPTH) * aio->chunk,
+                    KF_AIO_LEN(n + KF_ASYNC_DEPTH));
+  }
+
+#undef KF_AIO_LEN
+
+  return status;
+}
+
+/**
+ * @brief read a header block from the start of the input
+ *
+ * @param aio the aio object
+ * @param block the block
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+static int kf_aio_header(kf_aio *aio, void *block) {
+
+  if (aio->size < BLOCK_SIZE)
+    return KF_ERR_FORMAT;
+
+  uint8_t *p = block;
+
+  for (size_t done = 0; done < BLOCK_SIZE;) {
+    const ssize_t r =
+        pread(aio->in_fd, p + done, BLOCK_SIZE - done, (off_t)done);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return KF_ERR_READ;
+    done += (size_t)r;
+  }
+
+  KF_STATS_ADD(reads, 1);
+  KF_STATS_ADD(bytes_read, BLOCK_SIZE);
+
+  return KF_OK;
+}
+
+/**
+ * @brief write the iv at the start of the output
+ *
+ * @param aio the aio object
+ * @param iv the initialization vector
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+static int kf_aio_write_iv(kf_aio *aio, const char *iv) {
+
+  for (size_t done = 0; done < BLOCK_SIZE;) {
+    const ssize_t r =
+        pwrite(aio->out_fd, iv + done, BLOCK_SIZE - done, (off_t)done);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return KF_ERR_WRITE;
+    done += (size_t)r;
+  }
+
+  KF_STATS_ADD(writes, 1);
+  KF_STATS_ADD(bytes_written, BLOCK_SIZE);
+
+  aio->out_pos = BLOCK_SIZE;
+
+  return KF_OK;
+}
+
+/**
+ * @brief check whether the file modes should use the async backend
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int 1 to use the async backend, 0 otherwise
+ */
+int kf_async_wanted(const char *infile, const char *outfile,
+                    const kf_opts *opts) {
+
+  if (!opts || (opts->backend != KF_BACKEND_ASYNC &&
+                opts->backend != KF_BACKEND_THREADS))
+    return 0;
+
+  return strcmp(infile, "-") != 0 && strcmp(outfile, "-") != 0;
+}
+
+static int kf_aio_cbc_encrypt(void *state, uint8_t *in, const size_t len,
+                              uint8_t *out, const int last, size_t *out_len) {
+
+  kf_cbc_stream *s = state;
+
+  *out_len = kf_cbc_encrypt_update(s, in, len, out);
+  if (last)
+    *out_len += kf_cbc_encrypt_final(s, out + *out_len);
+
+  return KF_OK;
+}
+
+/**
+ * @brief encrypt a file with knifefish in cipher-block-chaining mode through
+ * the async backend.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param key a pointer to the key object
+ * @param iv the initialization vector
+ * @param padding random padding
+ * @param opts the file mode options
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_file_cbc_async(const char *infile, const char *outfile,
+                              const kf_key *key, const char *iv,
+                              const char *padding, const kf_opts *opts) {
+
+  kf_aio aio;
+  kf_cbc_stream s;
+
+  int status = kf_aio_open(&aio, infile, outfile, opts);
+  if (status != KF_OK)
+    return status;
+
+  kf_cbc_encrypt_init(&s, key, iv, padding);
+  status = kf_aio_run(&aio, 0, kf_aio_cbc_encrypt, &s);
+
+  return kf_aio_close(&aio, status);
+}
+
+/**
+ * @brief the state of cbc decryption through the async backend
+ *
+ */
+typedef struct {
+  const kf_key *key;
+  kf_cbc_pool *pool;
+  uint32_t chain[4];
+} kf_aio_cbc;
+
+static int kf_aio_cbc_decrypt(void *state, uint8_t *in, const size_t len,
+                              uint8_t *out, const int last, size_t *out_len) {
+
+  kf_aio_cbc *c = state;
+  const size_t nblocks = len / BLOCK_SIZE;
+
+  memcpy(in - BLOCK_SIZE, c->chain, BLOCK_SIZE);
+  kf_cbc_decrypt_pool(c->pool, (const uint32_t *)in, (uint32_t *)out, nblocks,
+                      c->key);
+  memcpy(c->chain, in + len - BLOCK_SIZE, BLOCK_SIZE);
+
+  *out_len = len;
+
+  if (last) {
+    const uint8_t remaining = out[len - 1];
+    if (remaining >= BLOCK_SIZE)
+      return KF_ERR_FORMAT;
+    *out_len = len - BLOCK_SIZE + remaining;
+  }
+
+  return KF_OK;
+}
+
+/**
+ * @brief decrypt a file with knifefish in cipher-block-chaining mode through
+ * the async backend.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param key a pointer to the key object
+ * @param opts the file mode options
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_file_cbc_async(const char *infile, const char *outfile,
+                              const kf_key *key, const kf_opts *opts) {
+
+  kf_aio aio;
+  kf_aio_cbc c;
+
+  int status = kf_aio_open(&aio, infile, outfile, opts);
+  if (status != KF_OK)
+    return status;
+
+  c.key = key;
+  c.pool = kf_cbc_pool_create(opts ? opts->threads : 1);
+
+  if (aio.size % BLOCK_SIZE != 0 || aio.size < 2 * BLOCK_SIZE)
+    status = KF_ERR_FORMAT;
+
+  if (status == KF_OK)
+    status = kf_aio_header(&aio, c.chain);
+
+  if (status == KF_OK)
+    status = kf_aio_run(&aio, BLOCK_SIZE, kf_aio_cbc_decrypt, &c);
+
+  kf_cbc_pool_destroy(c.pool);
+
+  return kf_aio_close(&aio, status);
+}
+
+/**
+ * @brief the state of counter mode through the async backend
+ *
+ */
+typedef struct {
+  const kf_key *key;
+  char iv[BLOCK_SIZE];
+  uint64_t counter;
+} kf_aio_ctr;
+
+static int kf_aio_ctr_run(void *state, uint8_t *in, const size_t len,
+                          uint8_t *out, const int last, size_t *out_len) {
+
+  kf_aio_ctr *c = state;
+
+  (void)last;
+
+  kf_ctr_x(in, out, len, c->iv, c->counter, &c->key->x);
+  c->counter += len / BLOCK_SIZE;
+  *out_len = len;
+
+  return KF_OK;
+}
+
+/**
+ * @brief encrypt a file with knifefish in counter mode through the async
+ * backend.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param key a pointer to the key object
+ * @param iv the initialization vector
+ * @param opts the file mode options
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_file_ctr_async(const char *infile, const char *outfile,
+                              const kf_key *key, const char *iv,
+                              const kf_opts *opts) {
+
+  kf_aio aio;
+  kf_aio_ctr c;
+
+  int status = kf_aio_open(&aio, infile, outfile, opts);
+  if (status != KF_OK)
+    return status;
+
+  c.key = key;
+  c.counter = 0;
+  memcpy(c.iv, iv, BLOCK_SIZE);
+
+  status = kf_aio_write_iv(&aio, iv);
+
+  if (status == KF_OK)
+    status = kf_aio_run(&aio, 0, kf_aio_ctr_run, &c);
+
+  return kf_aio_close(&aio, status);
+}
+
+/**
+ * @brief decrypt a file with knifefish in counter mode through the async
+ * backend.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param key a pointer to the key object
+ * @param opts the file mode options
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_file_ctr_async(const char *infile, const char *outfile,
+                              const kf_key *key, const kf_opts *opts) {
+
+  kf_aio aio;
+  kf_aio_ctr c;
+
+  int status = kf_aio_open(&aio, infile, outfile, opts);
+  if (status != KF_OK)
+    return status;
+
+  c.key = key;
+  c.counter = 0;
+
+  status = kf_aio_header(&aio, c.iv);
+
+  if (status == KF_OK)
+    status = kf_aio_run(&aio, BLOCK_SIZE, kf_aio_ctr_run, &c);
+
+  return kf_aio_close(&aio, status);
+}
+
+#else
+
+/*
+ * without pread and pwrite the backend is never picked, and forcing it falls
+ * back to the stdio backend.
+ */
+
+static kf_opts kf_stdio_opts(const kf_opts *opts) {
+
+  static const kf_opts defaults = {0, 0, KF_BACKEND_STDIO};
+
+  kf_opts stdio = *(opts ? opts : &defaults);
+
+  stdio.backend = KF_BACKEND_STDIO;
+  return stdio;
+}
+
+int kf_async_wanted(const char *infile, const char *outfile,
+                    const kf_opts *opts) {
+
+  (void)infile;
+  (void)outfile;
+  (void)opts;
+  return 0;
+}
+
+int kf_encrypt_file_cbc_async(const char *infile, const char *outfile,
+                              const kf_key *key, const char *iv,
+                              const char *padding, const kf_opts *opts) {
+
+  const kf_opts stdio = kf_stdio_opts(opts);
+
+  return kf_encrypt_file_cbc_key(infile, outfile, key, iv, padding, &stdio);
+}
+
+int kf_decrypt_file_cbc_async(const char *infile, const char *outfile,
+                              const kf_key *key, const kf_opts *opts) {
+
+  const kf_opts stdio = kf_stdio_opts(opts);
+
+  return kf_decrypt_file_cbc_key(infile, outfile, key, &stdio);
+}
+
+int kf_encrypt_file_ctr_async(const char *infile, const char *outfile,
+                              const kf_key *key, const char *iv,
+                              const kf_opts *opts) {
+
+  const kf_opts stdio = kf_stdio_opts(opts);
+
+  return kf_encrypt_file_ctr_key(infile, outfile, key, iv, &stdio);
+}
+
+int kf_decrypt_file_ctr_async(const char *infile, const char *outfile,
+                              const kf_key *key, const kf_opts *opts) {
+
+  const kf_opts stdio = kf_stdio_opts(opts);
+
+  return kf_decrypt_file_ctr_key(infile, outfile, key, &stdio);
+}
+
+#endif
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __unix__
+#include <pthread.h>
+#include <sys/stat.h>
+#endif
+
+/*
+ * a batch runs many files under one expanded key. the files are handed out
+ * largest first from a shared cursor, so a worker that finishes early takes
+ * the next file instead of idling behind a big one, and the biggest files do
+ * not end up last. every worker reads the same key, which is never written.
+ */
+
+/**
+ * @brief the batch slot object holds a job index and the size it is sorted
+ * by.
+ *
+ */
+typedef struct {
+  uint64_t size;
+  size_t job;
+} kf_batch_slot;
+
+/**
+ * @brief the batch pool object holds the state shared by the workers.
+ *
+ */
+typedef struct {
+  kf_batch_job *jobs;
+  kf_batch_slot *order;
+  size_t njobs;
+  size_t next;
+  const kf_key *key;
+  int encrypt;
+  int mode;
+  kf_opts opts;
+#ifdef __unix__
+  pthread_mutex_t lock;
+#endif
+} kf_batch_pool;
+
+/**
+ * @brief get the size of a file
+ *
+ * @param name the name of the file
+ * @return uint64_t the size in bytes, or 0 if the file can not be read
+ */
+static uint64_t kf_batch_size(const char *name) {
+
+#ifdef __unix__
+  struct stat st;
+
+  return stat(name, &st) == 0 && st.st_size > 0 ? (uint64_t)st.st_size : 0;
+#else
+  FILE *f = fopen(name, "rb");
+  long size = 0;
+
+  if (!f)
+    return 0;
+
+  if (fseek(f, 0, SEEK_END) == 0)
+    size = ftell(f);
+
+  fclose(f);
+
+  return size > 0 ? (uint64_t)size : 0;
+#endif
+}
+
+/**
+ * @brief run one file of a batch
+ *
+ * @param pool the pool object
+ * @param job the job object
+ */
+static void kf_batch_run(const kf_batch_pool *pool, kf_batch_job *job) {
+
+  if (pool->encrypt && pool->mode == KF_MODE_CHUNKED)
+    job->status =
+        kf_encrypt_file_chunked(job->infile, job->outfile, pool->key, job->iv,
+                                job->padding, 0, &pool->opts);
+  else if (pool->mode == KF_MODE_CHUNKED)
+    job->status = kf_decrypt_file_chunked(job->infile, job->outfile,
+                                          pool->key, &pool->opts);
+  else if (pool->encrypt && pool->mode == KF_MODE_AEAD)
+    job->status = kf_encrypt_file_aead_key(job->infile, job->outfile,
+                                           pool->key, job->iv, &pool->opts);
+  else if (pool->mode == KF_MODE_AEAD)
+    job->status = kf_decrypt_file_aead_key(job->infile, job->outfile,
+                                           pool->key, &pool->opts);
+  else if (pool->encrypt && pool->mode == KF_MODE_CTR)
+    job->status = kf_encrypt_file_ctr_key(job->infile, job->outfile,
+                                          pool->key, job->iv, &pool->opts);
+  else if (pool->encrypt)
+    job->status =
+        kf_encrypt_file_cbc_key(job->infile, job->outfile, pool->key,
+                                job->iv, job->padding, &pool->opts);
+  else if (pool->mode == KF_MODE_CTR)
+    job->status = kf_decrypt_file_ctr_key(job->infile, job->outfile,
+                                          pool->key, &pool->opts);
+  else
+    job->status = kf_decrypt_file_cbc_key(job->infile, job->outfile,
+                                          pool->key, &pool->opts);
+
+  job->bytes_out = job->status == KF_OK ? kf_batch_size(job->outfile) : 0;
+}
+
+/**
+ * @brief take the next file of a batch
+ *
+ * @param pool the pool object
+ * @return kf_batch_job* the job, or NULL when every file has been taken
+ */
+static kf_batch_job *kf_batch_take(kf_batch_pool *pool) {
+
+  kf_batch_job *job = NULL;
+
+#ifdef __unix__
+  pthread_mutex_lock(&pool->lock);
+#endif
+
+  if (pool->next < pool->njobs)
+    job = &pool->jobs[pool->order[pool->next++].job];
+
+#ifdef __unix__
+  pthread_mutex_unlock(&pool->lock);
+#endif
+
+  return job;
+}
+
+/**
+ * @brief run files of a batch until none are left
+ *
+ * @param arg a pointer to the kf_batch_pool
+ * @return void* always NULL
+ */
+static void *kf_batch_worker(void *arg) {
+
+  kf_batch_pool *pool = (kf_batch_pool *)arg;
+  kf_batch_job *job;
+
+  while ((job = kf_batch_take(pool)) != NULL)
+    kf_batch_run(pool, job);
+
+  return NULL;
+}
+
+/**
+ * @brief order slots by size, largest first
+ */
+static int kf_batch_compare(const void *a, const void *b) {
+
+  const uint64_t x = ((const kf_batch_slot *)a)->size;
+  const uint64_t y = ((const kf_batch_slot *)b)->size;
+
+  return (x < y) - (x > y);
+}
+
+/**
+ * @brief encrypt or decrypt many files under one key.
+ *
+ * the files are spread over a pool of worker threads. each file is run with
+ * the file mode options; a file mode's own threads are best left at one,
+ * since the pool already keeps the workers busy. the outcome of every file is
+ * stored in its job.
+ *
+ * @param jobs the files of the batch
+ * @param njobs the number of files
+ * @param key a pointer to the key object
+ * @param encrypt 1 to encrypt, 0 to decrypt
+ * @param mode KF_MODE_CBC, KF_MODE_CTR, KF_MODE_CHUNKED or KF_MODE_AEAD
+ * @param workers the number of worker threads
+ * @param opts the file mode options, or NULL for the defaults
+ * @param summary the totals of the batch, or NULL
+ * @return size_t the number of files that failed
+ */
+size_t kf_batch(kf_batch_job *jobs, const size_t njobs, const kf_key *key,
+                const int encrypt, const int mode, size_t workers,
+                const kf_opts *opts, kf_batch_summary *summary) {
+
+  static const kf_opts defaults = {0, 0, KF_BACKEND_AUTO};
+
+  const uint64_t start = kf_stats_now();
+
+  kf_batch_pool pool;
+
+  pool.jobs = jobs;
+  pool.njobs = njobs;
+  pool.next = 0;
+  pool.key = key;
+  pool.encrypt = encrypt;
+  pool.mode = mode;
+  pool.opts = opts ? *opts : defaults;
+  pool.order = malloc((njobs ? njobs : 1) * sizeof(kf_batch_slot));
+
+  for (size_t i = 0; i < njobs; i++) {
+    jobs[i].status = KF_ERR_MEMORY;
+    jobs[i].bytes_in = kf_batch_size(jobs[i].infile);
+    jobs[i].bytes_out = 0;
+  }
+
+  if (pool.order) {
+    for (size_t i = 0; i < njobs; i++) {
+      pool.order[i].size = jobs[i].bytes_in;
+      pool.order[i].job = i;
+    }
+
+    qsort(pool.order, njobs, sizeof(kf_batch_slot), kf_batch_compare);
+
+    if (workers > KF_MAX_THREADS)
+      workers = KF_MAX_THREADS;
+    if (workers > njobs)
+      workers = njobs;
+    if (workers < 1)
+      workers = 1;
+
+#ifdef __unix__
+    pthread_t threads[KF_MAX_THREADS];
+    size_t started = 1;
+
+    pthread_mutex_init(&pool.lock, NULL);
+
+    for (; started < workers; started++) {
+      if (pthread_create(&threads[started], NULL, kf_batch_worker, &pool) !=
+          0)
+        break;
+    }
+
+    kf_batch_worker(&pool);
+
+    for (size_t t = 1; t < started; t++)
+      pthread_join(threads[t], NULL);
+
+    pthread_mutex_destroy(&pool.lock);
+#else
+    kf_batch_worker(&pool);
+#endif
+
+    free(pool.order);
+  }
+
+  size_t failed = 0;
+
+  kf_batch_summary totals = {njobs, 0, 0, 0, 0};
+
+  for (size_t i = 0; i < njobs; i++) {
+    if (jobs[i].status != KF_OK)
+      failed++;
+    totals.bytes_in += jobs[i].bytes_in;
+    totals.bytes_out += jobs[i].bytes_out;
+  }
+
+  totals.failed = failed;
+  totals.ns = kf_stats_now() - start;
+
+  if (summary)
+    *summary = totals;
+
+  return failed;
+}
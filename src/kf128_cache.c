@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "kf128.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __unix__
+#include <pthread.h>
+#endif
+
+/*
+ * the key cache keeps up to capacity expanded keys, looked up by the SHA-256
+ * digest of their passphrase. the passphrase itself is never stored. keys in
+ * use are reference counted and never evicted; when every slot is in use a
+ * key is expanded for the caller alone and freed on release.
+ */
+
+typedef struct {
+  uint8_t digest[KF_DIGEST_SIZE];
+  uint64_t used;
+  size_t refs;
+  int valid;
+  kf_key *key;
+} kf_key_slot;
+
+struct kf_key_cache {
+  kf_key_slot *slots;
+  size_t capacity;
+  uint64_t clock;
+#ifdef __unix__
+  pthread_mutex_t lock;
+#endif
+};
+
+#ifdef __unix__
+#define KF_CACHE_LOCK(c) pthread_mutex_lock(&(c)->lock)
+#define KF_CACHE_UNLOCK(c) pthread_mutex_unlock(&(c)->lock)
+#else
+#define KF_CACHE_LOCK(c) ((void)(c))
+#define KF_CACHE_UNLOCK(c) ((void)(c))
+#endif
+
+/**
+ * @brief create a key cache
+ *
+ * @param capacity the most keys the cache holds, at least 1
+ * @return kf_key_cache* the cache, or NULL if out of memory
+ */
+kf_key_cache *kf_key_cache_create(size_t capacity) {
+
+  if (capacity < 1)
+    capacity = 1;
+
+  kf_key_cache *cache = calloc(1, sizeof(kf_key_cache));
+  if (!cache)
+    return NULL;
+
+  cache->slots = calloc(capacity, sizeof(kf_key_slot));
+  if (!cache->slots) {
+    free(cache);
+    return NULL;
+  }
+
+  cache->capacity = capacity;
+
+#ifdef __unix__
+  pthread_mutex_init(&cache->lock, NULL);
+#endif
+
+  return cache;
+}
+
+/**
+ * @brief wipe and free a cached key
+ *
+ * @param slot the slot holding the key
+ */
+static void kf_key_slot_clear(kf_key_slot *slot) {
+
+  if (slot->key) {
+    kf_wipe(slot->key, sizeof(kf_key));
+    free(slot->key);
+  }
+
+  kf_wipe(slot, sizeof(kf_key_slot));
+}
+
+/**
+ * @brief wipe and free a key cache
+ *
+ * no key from the cache may still be in use.
+ *
+ * @param cache the cache, or NULL
+ */
+void kf_key_cache_destroy(kf_key_cache *cache) {
+
+  if (!cache)
+    return;
+
+  for (size_t i = 0; i < cache->capacity; i++) {
+    kf_key_slot_clear(&cache->slots[i]);
+  }
+
+#ifdef __unix__
+  pthread_mutex_destroy(&cache->lock);
+#endif
+
+  free(cache->slots);
+  free(cache);
+}
+
+/**
+ * @brief get the expanded key for a passphrase
+ *
+ * the key is expanded outside the cache lock, so a miss does not hold up
+ * other threads. every successful call must be paired with a call to
+ * kf_key_cache_release.
+ *
+ * @param cache the cache
+ * @param passphrase the plaintext passphrase
+ * @return const kf_key* the key, or NULL if out of memory
+ */
+const kf_key *kf_key_cache_acquire(kf_key_cache *cache,
+                                   const char *passphrase) {
+
+  uint8_t digest[KF_DIGEST_SIZE];
+
+  kf_sha256((const uint8_t *)passphrase, strlen(passphrase), digest);
+
+  KF_CACHE_LOCK(cache);
+
+  for (size_t i = 0; i < cache->capacity; i++) {
+    kf_key_slot *slot = &cache->slots[i];
+
+    if (slot->valid && memcmp(slot->digest, digest, KF_DIGEST_SIZE) == 0) {
+      slot->refs++;
+      slot->used = ++cache->clock;
+      KF_CACHE_UNLOCK(cache);
+      kf_wipe(digest, sizeof(digest));
+      return slot->key;
+    }
+  }
+
+  KF_CACHE_UNLOCK(cache);
+
+  kf_key *key = malloc(sizeof(kf_key));
+  if (!key) {
+    kf_wipe(digest, sizeof(digest));
+    return NULL;
+  }
+
+  kf_key_init(key, passphrase);
+
+  KF_CACHE_LOCK(cache);
+
+  kf_key_slot *victim = NULL;
+
+  for (size_t i = 0; i < cache->capacity; i++) {
+    kf_key_slot *slot = &cache->slots[i];
+
+    /* another thread may have added the same key meanwhile */
+    if (slot->valid && memcmp(slot->digest, digest, KF_DIGEST_SIZE) == 0) {
+      slot->refs++;
+      slot->used = ++cache->clock;
+      KF_CACHE_UNLOCK(cache);
+      kf_wipe(digest, sizeof(digest));
+      kf_wipe(key, sizeof(kf_key));
+      free(key);
+      return slot->key;
+    }
+
+    if (slot->refs == 0 && (!victim || !slot->valid ||
+                            (victim->valid && slot->used < victim->used)))
+      victim = slot;
+  }
+
+  if (victim) {
+    kf_key_slot_clear(victim);
+    memcpy(victim->digest, digest, KF_DIGEST_SIZE);
+    victim->key = key;
+    victim->valid = 1;
+    victim->refs = 1;
+    victim->used = ++cache->clock;
+  }
+
+  KF_CACHE_UNLOCK(cache);
+
+  kf_wipe(digest, sizeof(digest));
+
+  return key;
+}
+
+/**
+ * @brief release a key returned by kf_key_cache_acquire
+ *
+ * @param cache the cache
+ * @param key the key
+ */
+void kf_key_cache_release(kf_key_cache *cache, const kf_key *key) {
+
+  KF_CACHE_LOCK(cache);
+
+  for (size_t i = 0; i < cache->capacity; i++) {
+    if (cache->slots[i].key == key) {
+      cache->slots[i].refs--;
+      KF_CACHE_UNLOCK(cache);
+      return;
+    }
+  }
+
+  KF_CACHE_UNLOCK(cache);
+
+  /* the key did not fit in the cache and belongs to the caller alone */
+  kf_wipe((kf_key *)key, sizeof(kf_key));
+  free((kf_key *)key);
+}
@@ -0,0 +1,1580 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#define _DEFAULT_SOURCE
+/* 64-bit off_t for fseeko and fstat on 32-bit targets */
+#define _FILE_OFFSET_BITS 64
+
+#include "kf128.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __unix__
+#include <pthread.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef KF_ZLIB
+#include <zlib.h>
+#endif
+
+/*
+ * the chunked container splits the plaintext into chunks of a fixed size and
+ * encrypts every chunk as its own cbc chain, so any byte range can be
+ * decrypted by reading only the blocks that cover it, chunks can be
+ * encrypted on several threads at once, and an update only has to rewrite
+ * the chunks that changed. all fields are little endian:
+ *
+ *   0   8  magic, KF_CHUNKED_MAGIC
+ *   8   4  chunk size in bytes, a multiple of BLOCK_SIZE
+ *   12  4  flags, KF_CHUNKED_INDEX_LAST, KF_CHUNKED_DEFLATE and
+ *          KF_CHUNKED_PRINTS
+ *   16  8  plaintext size in bytes
+ *   24  8  number of chunks
+ *   32  16 base iv
+ *   48     the chunks, each at 48 + i * chunk size
+ *          the index, KF_CHUNK_ENTRY bytes for every chunk:
+ *     0  8   the file offset of the chunk
+ *     8  8   the generation the chunk was last written in
+ *     16 16  the fingerprint of its plaintext, zero without
+ *            KF_CHUNKED_PRINTS
+ *          the newest generation, 8 bytes
+ *
+ * chunk i holds its plaintext rounded up to whole blocks, the last block
+ * filled out with random padding; the plaintext size in the header says
+ * where the data ends. its iv is the base iv with i xored into the first
+ * eight bytes and its generation into the last eight, encrypted once, so no
+ * two chunks, and no two versions of a chunk, share an iv. the fingerprint
+ * is the first half of the sha-256 of the plaintext, xored with the iv and
+ * encrypted, so it says nothing about the plaintext without the key. the
+ * sha-256 is slower than the cipher, so the fingerprints are only taken for
+ * a container that is to be updated; an update of a container without them
+ * rewrites every chunk, and takes them.
+ *
+ * with KF_CHUNKED_DEFLATE every chunk is compressed with raw deflate before
+ * it is encrypted, on the thread that encrypts it, and kept as it is when
+ * that does not save a block. the chunks are packed one after another, and
+ * every index entry has 8 more bytes:
+ *     32 8   the number of bytes stored, the plaintext length of the chunk
+ *            when it is kept as it is
+ * a range is then read a whole chunk at a time, and the container can not
+ * be updated. the deflate stage is built with KF_ZLIB.
+ */
+
+#define KF_CHUNKED_INDEX_LAST 1
+#define KF_CHUNKED_DEFLATE 2
+#define KF_CHUNKED_PRINTS 4
+#define KF_CHUNK_ENTRY 32
+#define KF_CHUNK_ENTRY_DEFLATE (KF_CHUNK_ENTRY + 8)
+#define KF_CHUNK_PRINT 16
+
+/**
+ * @brief the chunked object holds an open container and its header.
+ *
+ */
+typedef struct {
+  FILE *in;
+  uint64_t file_size;
+  uint64_t plain_size;
+  uint64_t nchunks;
+  uint64_t generation;
+  uint64_t index;
+  uint64_t data_start;
+  uint64_t data_end;
+  size_t entry_size;
+  size_t chunk_size;
+  int deflate;
+  int prints;
+  uint8_t iv[BLOCK_SIZE];
+  const kf_key *key;
+  uint32_t *cipher;
+  uint32_t *plain;
+  uint8_t *inflated;
+} kf_chunked;
+
+/**
+ * @brief the chunk job object holds the chunks one thread encrypts.
+ *
+ * the chunks are only fingerprinted with prints set. with the index of a
+ * previous version, a chunk whose fingerprint is unchanged keeps its old
+ * entry and is not encrypted again. with a deflate level, in and out must be
+ * the same buffer.
+ *
+ */
+typedef struct {
+  const uint8_t *in;
+  uint8_t *out;
+  uint8_t *entries;
+  size_t entry_size;
+  int level;
+  int prints;
+  uint8_t *changed;
+  const uint8_t *old;
+  uint64_t old_nchunks;
+  uint64_t first;
+  uint64_t generation;
+  size_t nchunks;
+  size_t last_len;
+  size_t chunk_size;
+  const uint8_t *iv;
+  const char *padding;
+  const kf_key *key;
+} kf_chunk_job;
+
+static void kf_put32(uint8_t *p, const uint32_t v) {
+
+  for (int i = 0; i < 4; i++)
+    p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static void kf_put64(uint8_t *p, const uint64_t v) {
+
+  for (int i = 0; i < 8; i++)
+    p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t kf_get32(const uint8_t *p) {
+
+  uint32_t v = 0;
+
+  for (int i = 3; i >= 0; i--)
+    v = (v << 8) | p[i];
+
+  return v;
+}
+
+static uint64_t kf_get64(const uint8_t *p) {
+
+  uint64_t v = 0;
+
+  for (int i = 7; i >= 0; i--)
+    v = (v << 8) | p[i];
+
+  return v;
+}
+
+/**
+ * @brief get the number of plaintext bytes of a chunk
+ *
+ * @param plain_size the plaintext size of the container
+ * @param chunk_size the chunk size
+ * @param chunk the chunk index
+ * @return uint64_t the plaintext length of the chunk
+ */
+static uint64_t kf_chunk_plain_len(const uint64_t plain_size,
+                                   const size_t chunk_size,
+                                   const uint64_t chunk) {
+
+  const uint64_t left = plain_size - chunk * chunk_size;
+
+  return left < chunk_size ? left : chunk_size;
+}
+
+/**
+ * @brief get the number of ciphertext bytes of a chunk
+ *
+ * @param plain_size the plaintext size of the container
+ * @param chunk_size the chunk size
+ * @param chunk the chunk index
+ * @return uint64_t the plaintext of the chunk rounded up to whole blocks
+ */
+static uint64_t kf_chunk_cipher_len(const uint64_t plain_size,
+                                    const size_t chunk_size,
+                                    const uint64_t chunk) {
+
+  const uint64_t len = kf_chunk_plain_len(plain_size, chunk_size, chunk);
+
+  return (len + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+}
+
+/**
+ * @brief get the number of ciphertext bytes of all chunks
+ *
+ * @param plain_size the plaintext size of the container
+ * @param chunk_size the chunk size
+ * @return uint64_t the size of the data between the header and the index
+ */
+static uint64_t kf_chunked_data_size(const uint64_t plain_size,
+                                     const size_t chunk_size) {
+
+  const uint64_t nchunks = (plain_size + chunk_size - 1) / chunk_size;
+
+  if (nchunks == 0)
+    return 0;
+
+  return (nchunks - 1) * chunk_size +
+         kf_chunk_cipher_len(plain_size, chunk_size, nchunks - 1);
+}
+
+/**
+ * @brief derive the iv of a chunk
+ *
+ * @param base the base iv of the container
+ * @param chunk the chunk index
+ * @param generation the generation the chunk is written in
+ * @param key a pointer to the key object
+ * @param iv the iv of the chunk
+ */
+static void kf_chunk_iv(const uint8_t *base, const uint64_t chunk,
+                        const uint64_t generation, const kf_key *key,
+                        uint32_t iv[4]) {
+
+  uint8_t block[BLOCK_SIZE];
+
+  memcpy(block, base, BLOCK_SIZE);
+  for (int i = 0; i < 8; i++) {
+    block[i] ^= (uint8_t)(chunk >> (8 * i));
+    block[8 + i] ^= (uint8_t)(generation >> (8 * i));
+  }
+
+  memcpy(iv, block, BLOCK_SIZE);
+  kf_block_x(iv, iv, &key->x);
+}
+
+/**
+ * @brief seal the digest of a chunk into its fingerprint
+ *
+ * @param digest the sha-256 digest of the plaintext of the chunk
+ * @param iv the iv of the chunk
+ * @param key a pointer to the key object
+ * @param print the fingerprint, KF_CHUNK_PRINT bytes
+ */
+static void kf_chunk_seal(const uint8_t *digest, const uint32_t iv[4],
+                          const kf_key *key, uint8_t *print) {
+
+  uint32_t block[4];
+
+  memcpy(block, digest, KF_CHUNK_PRINT);
+  for (int i = 0; i < 4; i++)
+    block[i] ^= iv[i];
+
+  kf_block_x(block, block, &key->x);
+  memcpy(print, block, KF_CHUNK_PRINT);
+}
+
+/**
+ * @brief get the size of an open file
+ *
+ * @param f the file
+ * @param size the size in bytes
+ * @return int KF_OK, or KF_ERR_READ if the file has no size
+ */
+static int kf_chunked_size(FILE *f, uint64_t *size) {
+
+#ifdef __unix__
+  struct stat st;
+
+  if (fstat(fileno(f), &st) != 0 || !S_ISREG(st.st_mode))
+    return KF_ERR_READ;
+
+  *size = (uint64_t)st.st_size;
+#elif defined(_WIN32)
+  if (_fseeki64(f, 0, SEEK_END) != 0)
+    return KF_ERR_READ;
+
+  const __int64 end = _ftelli64(f);
+
+  if (end < 0 || _fseeki64(f, 0, SEEK_SET) != 0)
+    return KF_ERR_READ;
+
+  *size = (uint64_t)end;
+#else
+  if (fseek(f, 0, SEEK_END) != 0)
+    return KF_ERR_READ;
+
+  const long end = ftell(f);
+
+  if (end < 0 || fseek(f, 0, SEEK_SET) != 0)
+    return KF_ERR_READ;
+
+  *size = (uint64_t)end;
+#endif
+
+  return KF_OK;
+}
+
+/**
+ * @brief move to an offset of a file
+ *
+ * the offset is 64 bits wide wherever the platform has a way to seek that
+ * far, so containers past 2 GiB work on 32-bit and LLP64 targets too.
+ *
+ * @param f the file
+ * @param off the file offset
+ * @return int 0 on success, -1 otherwise
+ */
+static int kf_chunked_seek(FILE *f, const uint64_t off) {
+
+  if (off > (uint64_t)INT64_MAX)
+    return -1;
+
+#ifdef __unix__
+  return fseeko(f, (off_t)off, SEEK_SET) == 0 ? 0 : -1;
+#elif defined(_WIN32)
+  return _fseeki64(f, (__int64)off, SEEK_SET) == 0 ? 0 : -1;
+#else
+  if (off > (uint64_t)LONG_MAX)
+    return -1;
+
+  return fseek(f, (long)off, SEEK_SET) == 0 ? 0 : -1;
+#endif
+}
+
+/**
+ * @brief read exactly len bytes from an offset
+ *
+ * @param f the file
+ * @param off the file offset
+ * @param buffer the buffer
+ * @param len the number of bytes
+ * @return int KF_OK, or KF_ERR_READ
+ */
+static int kf_chunked_read(FILE *f, const uint64_t off, void *buffer,
+                           const size_t len) {
+
+  KF_STATS_START(start);
+
+  if (kf_chunked_seek(f, off) != 0)
+    return KF_ERR_READ;
+
+  const size_t got = fread(buffer, sizeof(uint8_t), len, f);
+
+  KF_STATS_ADD(reads, 1);
+  KF_STATS_ADD(bytes_read, got);
+  KF_STATS_STOP(io_ns, start);
+
+  return got == len ? KF_OK : KF_ERR_READ;
+}
+
+/**
+ * @brief write exactly len bytes
+ *
+ * @param buffer the buffer
+ * @param len the number of bytes
+ * @param out the output file
+ * @return int KF_OK, or KF_ERR_WRITE
+ */
+static int kf_chunked_write(const void *buffer, const size_t len, FILE *out) {
+
+  KF_STATS_START(start);
+
+  const size_t put = fwrite(buffer, sizeof(uint8_t), len, out);
+
+  KF_STATS_ADD(writes, 1);
+  KF_STATS_ADD(bytes_written, put);
+  KF_STATS_STOP(io_ns, start);
+
+  return put == len ? KF_OK : KF_ERR_WRITE;
+}
+
+/**
+ * @brief write exactly len bytes at an offset
+ *
+ * @param f the file
+ * @param off the file offset
+ * @param buffer the buffer
+ * @param len the number of bytes
+ * @return int KF_OK, or KF_ERR_WRITE
+ */
+static int kf_chunked_write_at(FILE *f, const uint64_t off,
+                               const void *buffer, const size_t len) {
+
+  if (kf_chunked_seek(f, off) != 0)
+    return KF_ERR_WRITE;
+
+  return kf_chunked_write(buffer, len, f);
+}
+
+/**
+ * @brief write the header of a container
+ *
+ * @param out the output file
+ * @param chunk_size the chunk size
+ * @param plain_size the plaintext size
+ * @param iv the base iv
+ * @param flags the flags
+ * @return int KF_OK, or KF_ERR_WRITE
+ */
+static int kf_chunked_header(FILE *out, const size_t chunk_size,
+                             const uint64_t plain_size, const uint8_t *iv,
+                             const uint32_t flags) {
+
+  uint8_t header[KF_CHUNKED_HEADER];
+
+  memcpy(header, KF_CHUNKED_MAGIC, 8);
+  kf_put32(header + 8, (uint32_t)chunk_size);
+  kf_put32(header + 12, flags);
+  kf_put64(header + 16, plain_size);
+  kf_put64(header + 24, (plain_size + chunk_size - 1) / chunk_size);
+  memcpy(header + 32, iv, BLOCK_SIZE);
+
+  return kf_chunked_write(header, KF_CHUNKED_HEADER, out);
+}
+
+/**
+ * @brief write the index and the newest generation of a container
+ *
+ * @param out the output file, positioned after the data
+ * @param entries the index
+ * @param entry_size the size of an index entry
+ * @param nchunks the number of chunks
+ * @param generation the newest generation
+ * @return int KF_OK, or KF_ERR_WRITE
+ */
+static int kf_chunked_trailer(FILE *out, const uint8_t *entries,
+                              const size_t entry_size,
+                              const uint64_t nchunks,
+                              const uint64_t generation) {
+
+  uint8_t last[8];
+
+  kf_put64(last, generation);
+
+  int status = KF_OK;
+
+  if (nchunks > 0)
+    status = kf_chunked_write(entries, (size_t)nchunks * entry_size, out);
+
+  if (status == KF_OK)
+    status = kf_chunked_write(last, sizeof(last), out);
+
+  return status;
+}
+
+#ifdef KF_ZLIB
+
+/**
+ * @brief the deflate object holds the compressor of one thread.
+ *
+ */
+typedef struct {
+  z_stream z;
+  uint8_t *scratch;
+  size_t bound;
+  int ready;
+} kf_deflate;
+
+/**
+ * @brief set up the compressor of a thread
+ *
+ * without the memory for it the chunks are kept as they are.
+ *
+ * @param d the deflate object
+ * @param level the deflate level, 1 to 9
+ * @param chunk_size the chunk size
+ */
+static void kf_deflate_init(kf_deflate *d, const int level,
+                            const size_t chunk_size) {
+
+  memset(d, 0, sizeof(*d));
+
+  if (deflateInit2(&d->z, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) !=
+      Z_OK)
+    return;
+
+  d->bound = deflateBound(&d->z, (uLong)chunk_size);
+  d->scratch = malloc(d->bound);
+
+  if (!d->scratch) {
+    deflateEnd(&d->z);
+    return;
+  }
+
+  d->ready = 1;
+}
+
+/**
+ * @brief compress a chunk in place, when that saves at least a block
+ *
+ * @param d the deflate object
+ * @param data the plaintext of the chunk, replaced by its compressed form
+ * @param len the plaintext length
+ * @return size_t the number of bytes to store, len when it is kept as it is
+ */
+static size_t kf_deflate_chunk(kf_deflate *d, uint8_t *data,
+                               const size_t len) {
+
+  if (!d->ready || deflateReset(&d->z) != Z_OK)
+    return len;
+
+  d->z.next_in = data;
+  d->z.avail_in = (uInt)len;
+  d->z.next_out = d->scratch;
+  d->z.avail_out = (uInt)d->bound;
+
+  if (deflate(&d->z, Z_FINISH) != Z_STREAM_END)
+    return len;
+
+  const size_t stored = (size_t)d->z.total_out;
+
+  if ((stored + BLOCK_SIZE - 1) / BLOCK_SIZE >=
+      (len + BLOCK_SIZE - 1) / BLOCK_SIZE)
+    return len;
+
+  memcpy(data, d->scratch, stored);
+
+  return stored;
+}
+
+/**
+ * @brief free the compressor of a thread
+ *
+ * @param d the deflate object
+ */
+static void kf_deflate_end(kf_deflate *d) {
+
+  if (d->ready) {
+    deflateEnd(&d->z);
+    free(d->scratch);
+  }
+}
+
+#endif
+
+/**
+ * @brief fingerprint the chunks of a job, and encrypt those that changed
+ *
+ * with a deflate level every chunk is compressed first, and its entry gets
+ * the number of bytes stored; the writer fills in its offset.
+ *
+ * @param arg a pointer to a kf_chunk_job
+ * @return void* always NULL
+ */
+static void *kf_chunk_encrypt(void *arg) {
+
+  kf_chunk_job *job = (kf_chunk_job *)arg;
+
+#ifdef KF_ZLIB
+  kf_deflate d;
+
+  if (job->level > 0)
+    kf_deflate_init(&d, job->level, job->chunk_size);
+#endif
+
+  for (size_t c = 0; c < job->nchunks; c++) {
+    const uint64_t chunk = job->first + c;
+    const uint32_t *in = (const uint32_t *)(job->in + c * job->chunk_size);
+    uint32_t *out = (uint32_t *)(job->out + c * job->chunk_size);
+    uint8_t *entry = job->entries + c * job->entry_size;
+    const size_t len =
+        c == job->nchunks - 1 ? job->last_len : job->chunk_size;
+
+    uint8_t digest[KF_DIGEST_SIZE];
+    uint8_t print[KF_CHUNK_PRINT] = {0};
+    uint32_t chain[4];
+
+    if (job->prints)
+      kf_sha256((const uint8_t *)in, len, digest);
+
+    if (job->old && chunk < job->old_nchunks) {
+      const uint8_t *old = job->old + chunk * KF_CHUNK_ENTRY;
+
+      kf_chunk_iv(job->iv, chunk, kf_get64(old + 8), job->key, chain);
+      kf_chunk_seal(digest, chain, job->key, print);
+
+      if (memcmp(print, old + 16, KF_CHUNK_PRINT) == 0) {
+        memcpy(entry, old, KF_CHUNK_ENTRY);
+        job->changed[c] = 0;
+        continue;
+      }
+    }
+
+    kf_chunk_iv(job->iv, chunk, job->generation, job->key, chain);
+    if (job->prints)
+      kf_chunk_seal(digest, chain, job->key, print);
+
+    kf_put64(entry, KF_CHUNKED_HEADER + chunk * job->chunk_size);
+    kf_put64(entry + 8, job->generation);
+    memcpy(entry + 16, print, KF_CHUNK_PRINT);
+    job->changed[c] = 1;
+
+    size_t stored = len;
+
+#ifdef KF_ZLIB
+    if (job->level > 0) {
+      stored = kf_deflate_chunk(&d, (uint8_t *)out, len);
+      in = out;
+      kf_put64(entry + KF_CHUNK_ENTRY, stored);
+    }
+#endif
+
+    const size_t nblocks = stored / BLOCK_SIZE;
+    const size_t remaining = stored % BLOCK_SIZE;
+
+    kf_cbc_encrypt_blocks(in, out, nblocks, chain, &job->key->x);
+
+    if (remaining != 0) {
+      uint32_t last[4];
+
+      memcpy(last, job->padding, BLOCK_SIZE);
+      memcpy(last, in + 4 * nblocks, remaining);
+      kf_cbc_encrypt_blocks(last, out + 4 * nblocks, 1, chain, &job->key->x);
+    }
+
+    KF_STATS_ADD(blocks, (stored + BLOCK_SIZE - 1) / BLOCK_SIZE);
+  }
+
+#ifdef KF_ZLIB
+  if (job->level > 0)
+    kf_deflate_end(&d);
+#endif
+
+  return NULL;
+}
+
+/**
+ * @brief run consecutive chunks on several threads
+ *
+ * the chunks are split into one contiguous run per thread. when threads are
+ * unavailable, or only one is requested, the runs are done by the calling
+ * thread.
+ *
+ * @param all the job for all the chunks
+ * @param threads the number of worker threads
+ */
+static void kf_chunk_encrypt_n(const kf_chunk_job *all, size_t threads) {
+
+  kf_chunk_job jobs[KF_MAX_THREADS];
+
+  KF_STATS_START(start);
+
+  if (threads > KF_MAX_THREADS)
+    threads = KF_MAX_THREADS;
+  if (threads > all->nchunks)
+    threads = all->nchunks;
+  if (threads < 1)
+    threads = 1;
+
+  const size_t per_thread = all->nchunks / threads;
+
+  for (size_t t = 0; t < threads; t++) {
+    const int last = t == threads - 1;
+    const size_t skip = per_thread * t;
+
+    jobs[t] = *all;
+    jobs[t].in = all->in + skip * all->chunk_size;
+    jobs[t].out = all->out + skip * all->chunk_size;
+    jobs[t].entries = all->entries + skip * all->entry_size;
+    jobs[t].changed = all->changed + skip;
+    jobs[t].first = all->first + skip;
+    jobs[t].nchunks = last ? all->nchunks - skip : per_thread;
+    jobs[t].last_len = last ? all->last_len : all->chunk_size;
+  }
+
+#ifdef __unix__
+  pthread_t workers[KF_MAX_THREADS];
+  size_t started = 1;
+
+  for (; started < threads; started++) {
+    if (pthread_create(&workers[started], NULL, kf_chunk_encrypt,
+                       &jobs[started]) != 0)
+      break;
+  }
+
+  for (size_t t = started; t < threads; t++)
+    kf_chunk_encrypt(&jobs[t]);
+
+  kf_chunk_encrypt(&jobs[0]);
+
+  for (size_t t = 1; t < started; t++)
+    pthread_join(workers[t], NULL);
+#else
+  for (size_t t = 0; t < threads; t++)
+    kf_chunk_encrypt(&jobs[t]);
+#endif
+
+  KF_STATS_STOP(cipher_ns, start);
+}
+
+/**
+ * @brief the chunk reader object walks the plaintext in groups of chunks.
+ *
+ */
+typedef struct {
+  FILE *in;
+  uint64_t size;
+  uint64_t nchunks;
+  size_t chunk_size;
+  size_t group;
+  size_t threads;
+  uint8_t *data;
+  uint8_t *changed;
+} kf_chunk_reader;
+
+/**
+ * @brief open the plaintext of a container
+ *
+ * @param r the chunk reader object
+ * @param infile the name of the input file, which must be a regular file
+ * @param chunk_size the chunk size
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+static int kf_chunk_reader_open(kf_chunk_reader *r, const char *infile,
+                                const size_t chunk_size,
+                                const kf_opts *opts) {
+
+  r->data = NULL;
+  r->changed = NULL;
+
+  if (strcmp(infile, "-") == 0)
+    return KF_ERR_READ;
+
+  r->in = fopen(infile, "rb");
+  if (!r->in)
+    return KF_ERR_OPEN;
+
+  int status = kf_chunked_size(r->in, &r->size);
+
+  const size_t buffer = opts && opts->buffer_size > 0 ? opts->buffer_size
+                                                      : KF_BUFFER_SIZE;
+
+  r->chunk_size = chunk_size;
+  r->nchunks = (r->size + chunk_size - 1) / chunk_size;
+  r->threads = opts && opts->threads > 0 ? opts->threads : 1;
+
+  /* every thread gets at least one chunk of each read */
+  r->group = buffer / chunk_size;
+  if (r->group < r->threads)
+    r->group = r->threads;
+  if (r->group < 1)
+    r->group = 1;
+
+  if (status == KF_OK) {
+    r->data = malloc(r->group * chunk_size);
+    r->changed = malloc(r->group);
+    if (!r->data || !r->changed)
+      status = KF_ERR_MEMORY;
+  }
+
+  if (status != KF_OK) {
+    free(r->data);
+    free(r->changed);
+    fclose(r->in);
+  }
+
+  return status;
+}
+
+/**
+ * @brief read the next group of chunks
+ *
+ * @param r the chunk reader object
+ * @param first the index of the first chunk of the group
+ * @param job the job, whose in, nchunks and last_len are set
+ * @return int KF_OK, or KF_ERR_READ if the file changed size
+ */
+static int kf_chunk_reader_next(kf_chunk_reader *r, const uint64_t first,
+                                kf_chunk_job *job) {
+
+  const size_t n = r->nchunks - first < r->group ? (size_t)(r->nchunks - first)
+                                                 : r->group;
+  const uint64_t left = r->size - first * r->chunk_size;
+  const size_t len = left < (uint64_t)n * r->chunk_size ? (size_t)left
+                                                        : n * r->chunk_size;
+
+  KF_STATS_START(start);
+  const size_t got = fread(r->data, sizeof(uint8_t), len, r->in);
+  KF_STATS_ADD(reads, 1);
+  KF_STATS_ADD(bytes_read, got);
+  KF_STATS_STOP(io_ns, start);
+
+  job->in = r->data;
+  job->out = r->data;
+  job->changed = r->changed;
+  job->first = first;
+  job->nchunks = n;
+  job->last_len = len - (n - 1) * r->chunk_size;
+  job->chunk_size = r->chunk_size;
+
+  return got == len ? KF_OK : KF_ERR_READ;
+}
+
+/**
+ * @brief close the plaintext of a container
+ *
+ * @param r the chunk reader object
+ */
+static void kf_chunk_reader_close(kf_chunk_reader *r) {
+
+  free(r->data);
+  free(r->changed);
+  fclose(r->in);
+}
+
+/**
+ * @brief encrypt a file into a chunked container, compressed or not
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param key a pointer to the key object
+ * @param iv the base initialization vector
+ * @param padding random padding
+ * @param chunk_size the chunk size in bytes, or 0 for KF_CHUNK_SIZE
+ * @param level the deflate level, 1 to 9, or 0 to store the chunks as they
+ * are
+ * @param prints 1 to fingerprint the chunks for an update, 0 otherwise
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+static int kf_chunked_encrypt(const char *infile, const char *outfile,
+                              const kf_key *key, const char *iv,
+                              const char *padding, size_t chunk_size,
+                              const int level, const int prints,
+                              const kf_opts *opts) {
+
+  kf_chunk_reader r;
+
+  if (chunk_size == 0)
+    chunk_size = KF_CHUNK_SIZE;
+  chunk_size = chunk_size < BLOCK_SIZE ? BLOCK_SIZE
+                                       : chunk_size / BLOCK_SIZE * BLOCK_SIZE;
+  if (chunk_size > UINT32_MAX / 2)
+    return KF_ERR_FORMAT;
+
+  int status = kf_chunk_reader_open(&r, infile, chunk_size, opts);
+  if (status != KF_OK)
+    return status;
+
+  FILE *out = strcmp(outfile, "-") == 0 ? stdout : fopen(outfile, "wb");
+  if (!out) {
+    kf_chunk_reader_close(&r);
+    return KF_ERR_OPEN;
+  }
+
+  const size_t entry_size =
+      level > 0 ? KF_CHUNK_ENTRY_DEFLATE : KF_CHUNK_ENTRY;
+  const uint32_t flags = KF_CHUNKED_INDEX_LAST |
+                        (level > 0 ? KF_CHUNKED_DEFLATE : 0) |
+                        (prints ? KF_CHUNKED_PRINTS : 0);
+
+  uint8_t *entries = malloc((r.nchunks ? r.nchunks : 1) * entry_size);
+  if (!entries)
+    status = KF_ERR_MEMORY;
+
+  if (status == KF_OK)
+    status = kf_chunked_header(out, chunk_size, r.size, (const uint8_t *)iv,
+                               flags);
+
+  kf_chunk_job job;
+
+  memset(&job, 0, sizeof(job));
+  job.iv = (const uint8_t *)iv;
+  job.padding = padding;
+  job.key = key;
+  job.entry_size = entry_size;
+  job.level = level;
+  job.prints = prints;
+
+  uint64_t at = KF_CHUNKED_HEADER;
+
+  for (uint64_t i = 0; status == KF_OK && i < r.nchunks; i += job.nchunks) {
+    status = kf_chunk_reader_next(&r, i, &job);
+    if (status != KF_OK)
+      break;
+
+    job.entries = entries + i * entry_size;
+    kf_chunk_encrypt_n(&job, r.threads);
+
+    if (level == 0) {
+      status = kf_chunked_write(
+          r.data,
+          (job.nchunks - 1) * chunk_size +
+              (size_t)kf_chunk_cipher_len(r.size, chunk_size,
+                                          i + job.nchunks - 1),
+          out);
+      continue;
+    }
+
+    /* compressed chunks are packed, so only now is their offset known */
+    for (size_t j = 0; status == KF_OK && j < job.nchunks; j++) {
+      uint8_t *entry = job.entries + j * entry_size;
+      const uint64_t stored = kf_get64(entry + KF_CHUNK_ENTRY);
+      const size_t len =
+          (size_t)(stored + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+
+      kf_put64(entry, at);
+      status = kf_chunked_write(r.data + j * chunk_size, len, out);
+      at += len;
+    }
+  }
+
+  if (status == KF_OK)
+    status = kf_chunked_trailer(out, entries, entry_size, r.nchunks, 0);
+
+  free(entries);
+  kf_chunk_reader_close(&r);
+
+  const int closed = out == stdout ? fflush(out) : fclose(out);
+
+  return (status == KF_OK && closed != 0) ? KF_ERR_WRITE : status;
+}
+
+/**
+ * @brief encrypt a file into a chunked container.
+ *
+ * the input must be a regular file, since its size goes into the header
+ * ahead of the data. the output can be "-" for stdout. chunks are encrypted
+ * on the threads of the file mode options, and the index is held in memory
+ * until the end. the chunks are not fingerprinted, so the first update
+ * rewrites all of them; use kf_encrypt_file_chunked_updatable for a
+ * container that is to be updated.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param key a pointer to the key object
+ * @param iv the base initialization vector
+ * @param padding random padding
+ * @param chunk_size the chunk size in bytes, or 0 for KF_CHUNK_SIZE
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_file_chunked(const char *infile, const char *outfile,
+                            const kf_key *key, const char *iv,
+                            const char *padding, size_t chunk_size,
+                            const kf_opts *opts) {
+
+  return kf_chunked_encrypt(infile, outfile, key, iv, padding, chunk_size, 0,
+                            0, opts);
+}
+
+/**
+ * @brief encrypt a file into a chunked container that is to be updated.
+ *
+ * like kf_encrypt_file_chunked, but every chunk is fingerprinted, so
+ * kf_update_file_chunked only rewrites the chunks that change.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param key a pointer to the key object
+ * @param iv the base initialization vector
+ * @param padding random padding
+ * @param chunk_size the chunk size in bytes, or 0 for KF_CHUNK_SIZE
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_file_chunked_updatable(const char *infile, const char *outfile,
+                                      const kf_key *key, const char *iv,
+                                      const char *padding, size_t chunk_size,
+                                      const kf_opts *opts) {
+
+  return kf_chunked_encrypt(infile, outfile, key, iv, padding, chunk_size, 0,
+                            1, opts);
+}
+
+/**
+ * @brief check whether the library was built with the deflate stage
+ *
+ * @return int 1 with KF_ZLIB, 0 without
+ */
+int kf_deflate_enabled(void) {
+
+#ifdef KF_ZLIB
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @brief compress and encrypt a file into a chunked container.
+ *
+ * like kf_encrypt_file_chunked, but every chunk is compressed with deflate
+ * on the thread that encrypts it, and the header says so, so the decrypt
+ * and range functions inflate it without being asked. a chunk that does
+ * not shrink by a block is stored as it is. the container can not be
+ * updated.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param key a pointer to the key object
+ * @param iv the base initialization vector
+ * @param padding random padding
+ * @param chunk_size the chunk size in bytes, or 0 for KF_CHUNK_SIZE
+ * @param level the deflate level, 1 (fastest) to 9 (smallest), or 0 for 6
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status, KF_ERR_UNSUPPORTED when the
+ * library was built without KF_ZLIB
+ */
+int kf_encrypt_file_chunked_deflate(const char *infile, const char *outfile,
+                                    const kf_key *key, const char *iv,
+                                    const char *padding, size_t chunk_size,
+                                    int level, const kf_opts *opts) {
+
+  if (!kf_deflate_enabled())
+    return KF_ERR_UNSUPPORTED;
+
+  if (level <= 0)
+    level = 6;
+  if (level > 9)
+    level = 9;
+
+  return kf_chunked_encrypt(infile, outfile, key, iv, padding, chunk_size,
+                            level, 0, opts);
+}
+
+/**
+ * @brief open a chunked container and check its header
+ *
+ * @param c the chunked object
+ * @param infile the name of the container
+ * @param mode the fopen mode
+ * @param key a pointer to the key object
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+static int kf_chunked_open(kf_chunked *c, const char *infile,
+                           const char *mode, const kf_key *key) {
+
+  uint8_t header[KF_CHUNKED_HEADER];
+  uint32_t flags = 0;
+
+  c->key = key;
+  c->cipher = NULL;
+  c->plain = NULL;
+  c->inflated = NULL;
+  c->deflate = 0;
+  c->prints = 0;
+  c->in = fopen(infile, mode);
+  if (!c->in)
+    return KF_ERR_OPEN;
+
+  int status = kf_chunked_size(c->in, &c->file_size);
+
+  if (status == KF_OK && c->file_size < KF_CHUNKED_HEADER)
+    status = KF_ERR_FORMAT;
+
+  if (status == KF_OK)
+    status = kf_chunked_read(c->in, 0, header, KF_CHUNKED_HEADER);
+
+  if (status == KF_OK) {
+    c->chunk_size = kf_get32(header + 8);
+    flags = kf_get32(header + 12);
+    c->plain_size = kf_get64(header + 16);
+    c->nchunks = kf_get64(header + 24);
+    memcpy(c->iv, header + 32, BLOCK_SIZE);
+
+    if (memcmp(header, KF_CHUNKED_MAGIC, 8) != 0 ||
+        (flags & ~(uint32_t)(KF_CHUNKED_INDEX_LAST | KF_CHUNKED_DEFLATE |
+                             KF_CHUNKED_PRINTS)) ||
+        !(flags & KF_CHUNKED_INDEX_LAST) || c->chunk_size == 0 ||
+        c->chunk_size % BLOCK_SIZE != 0 ||
+        c->nchunks != (c->plain_size + c->chunk_size - 1) / c->chunk_size ||
+        (c->plain_size > c->file_size && !(flags & KF_CHUNKED_DEFLATE)))
+      status = KF_ERR_FORMAT;
+
+    c->deflate = (flags & KF_CHUNKED_DEFLATE) != 0;
+    c->prints = (flags & KF_CHUNKED_PRINTS) != 0;
+
+    if (status == KF_OK && c->deflate && !kf_deflate_enabled())
+      status = KF_ERR_UNSUPPORTED;
+  }
+
+  if (status == KF_OK && c->deflate) {
+    uint8_t last[8];
+    const uint64_t trailer = c->nchunks * KF_CHUNK_ENTRY_DEFLATE + 8;
+
+    c->entry_size = KF_CHUNK_ENTRY_DEFLATE;
+    c->data_start = KF_CHUNKED_HEADER;
+
+    if (c->nchunks > c->file_size / KF_CHUNK_ENTRY_DEFLATE ||
+        c->file_size - KF_CHUNKED_HEADER < trailer) {
+      status = KF_ERR_FORMAT;
+    } else {
+      c->data_end = c->file_size - trailer;
+      c->index = c->data_end;
+      status = kf_chunked_read(c->in, c->file_size - 8, last, 8);
+    }
+
+    c->generation = kf_get64(last);
+  } else if (status == KF_OK) {
+    uint8_t last[8];
+
+    c->entry_size = KF_CHUNK_ENTRY;
+    c->data_start = KF_CHUNKED_HEADER;
+    c->data_end =
+        KF_CHUNKED_HEADER + kf_chunked_data_size(c->plain_size, c->chunk_size);
+    c->index = c->data_end;
+
+    if (c->file_size != c->index + c->nchunks * KF_CHUNK_ENTRY + 8)
+      status = KF_ERR_FORMAT;
+    else
+      status = kf_chunked_read(c->in, c->file_size - 8, last, 8);
+
+    c->generation = kf_get64(last);
+  }
+
+  if (status == KF_OK) {
+    c->cipher = malloc(c->chunk_size + BLOCK_SIZE);
+    c->plain = malloc(c->chunk_size);
+    if (c->deflate)
+      c->inflated = malloc(c->chunk_size);
+    if (!c->cipher || !c->plain || (c->deflate && !c->inflated))
+      status = KF_ERR_MEMORY;
+  }
+
+  if (status != KF_OK) {
+    free(c->cipher);
+    free(c->plain);
+    free(c->inflated);
+    fclose(c->in);
+  }
+
+  return status;
+}
+
+/**
+ * @brief close a chunked container
+ *
+ * @param c the chunked object
+ * @return int KF_OK, or KF_ERR_WRITE if it was written and could not be
+ * closed
+ */
+static int kf_chunked_close(kf_chunked *c) {
+
+  free(c->cipher);
+  free(c->plain);
+  free(c->inflated);
+
+  return fclose(c->in) == 0 ? KF_OK : KF_ERR_WRITE;
+}
+
+/**
+ * @brief re-encrypt a chunked container from a new version of its plaintext.
+ *
+ * every chunk of the new plaintext is fingerprinted, and only the chunks
+ * whose fingerprint changed are encrypted, under a new generation; in a
+ * container written without fingerprints every chunk counts as changed,
+ * and the update takes them for the next one. when the
+ * layout stays the same, which it does unless the number of chunks or the
+ * length of the last one changes, those chunks and the index are rewritten
+ * in place. otherwise a new container is built next to the old one, copying
+ * the ciphertext of the unchanged chunks, and renamed over it. an update
+ * in place that fails part way leaves the container unreadable, so keep a
+ * copy when that matters.
+ *
+ * @param infile the name of the new plaintext, which must be a regular file
+ * @param outfile the name of the container to update
+ * @param key a pointer to the key the container was written with
+ * @param padding random padding
+ * @param opts the file mode options, or NULL for the defaults
+ * @param changed the number of chunks written, or NULL
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_update_file_chunked(const char *infile, const char *outfile,
+                           const kf_key *key, const char *padding,
+                           const kf_opts *opts, uint64_t *changed) {
+
+  kf_chunked c;
+  kf_chunk_reader r;
+
+  if (changed)
+    *changed = 0;
+
+  int status = kf_chunked_open(&c, outfile, "r+b", key);
+  if (status != KF_OK)
+    return status;
+
+  if (c.deflate) {
+    kf_chunked_close(&c);
+    return KF_ERR_UNSUPPORTED;
+  }
+
+  status = kf_chunk_reader_open(&r, infile, c.chunk_size, opts);
+  if (status != KF_OK) {
+    kf_chunked_close(&c);
+    return status;
+  }
+
+  uint8_t *old = malloc((c.nchunks ? c.nchunks : 1) * KF_CHUNK_ENTRY);
+  uint8_t *entries = malloc((r.nchunks ? r.nchunks : 1) * KF_CHUNK_ENTRY);
+
+  if (!old || !entries)
+    status = KF_ERR_MEMORY;
+
+  if (status == KF_OK && c.nchunks > 0)
+    status = kf_chunked_read(c.in, c.index, old,
+                             (size_t)c.nchunks * KF_CHUNK_ENTRY);
+
+  const int in_place =
+      r.nchunks == c.nchunks &&
+      kf_chunked_data_size(r.size, c.chunk_size) ==
+          kf_chunked_data_size(c.plain_size, c.chunk_size);
+
+  char *temp = NULL;
+  FILE *out = c.in;
+
+  if (status == KF_OK && !in_place) {
+    temp = malloc(strlen(outfile) + 5);
+    if (!temp) {
+      status = KF_ERR_MEMORY;
+    } else {
+      strcpy(temp, outfile);
+      strcat(temp, ".tmp");
+      out = fopen(temp, "wb");
+      if (!out)
+        status = KF_ERR_OPEN;
+    }
+  }
+
+  if (status == KF_OK && !in_place)
+    status = kf_chunked_header(out, c.chunk_size, r.size, c.iv,
+                               KF_CHUNKED_INDEX_LAST | KF_CHUNKED_PRINTS);
+
+  kf_chunk_job job;
+
+  memset(&job, 0, sizeof(job));
+  job.iv = c.iv;
+  job.padding = padding;
+  job.key = key;
+  job.old = c.prints ? old : NULL;
+  job.old_nchunks = c.nchunks;
+  job.entry_size = KF_CHUNK_ENTRY;
+  job.prints = 1;
+  job.generation = c.generation + 1;
+
+  uint64_t written = 0;
+
+  for (uint64_t i = 0; status == KF_OK && i < r.nchunks; i += job.nchunks) {
+    status = kf_chunk_reader_next(&r, i, &job);
+    if (status != KF_OK)
+      break;
+
+    job.entries = entries + i * KF_CHUNK_ENTRY;
+    kf_chunk_encrypt_n(&job, r.threads);
+
+    for (size_t j = 0; status == KF_OK && j < job.nchunks; j++) {
+      const uint64_t chunk = i + j;
+      uint8_t *data = r.data + j * c.chunk_size;
+      const size_t len =
+          (size_t)kf_chunk_cipher_len(r.size, c.chunk_size, chunk);
+      const uint64_t at = KF_CHUNKED_HEADER + chunk * c.chunk_size;
+
+      if (r.changed[j]) {
+        written++;
+        if (in_place)
+          status = kf_chunked_write_at(out, at, data, len);
+        else
+          status = kf_chunked_write(data, len, out);
+      } else if (!in_place) {
+        /* the same plaintext gives the same length, so copy it as it is */
+        const uint64_t from = kf_get64(old + chunk * KF_CHUNK_ENTRY);
+
+        if (from < c.data_start || from > c.data_end ||
+            c.data_end - from < len)
+          status = KF_ERR_FORMAT;
+        else
+          status = kf_chunked_read(c.in, from, data, len);
+        if (status == KF_OK)
+          status = kf_chunked_write(data, len, out);
+      }
+    }
+  }
+
+  const int dirty = written > 0 || r.size != c.plain_size;
+  const uint64_t generation = written > 0 ? job.generation : c.generation;
+
+  if (status == KF_OK && in_place && dirty) {
+    if (kf_chunked_seek(out, 0) != 0)
+      status = KF_ERR_WRITE;
+    if (status == KF_OK)
+      status = kf_chunked_header(out, c.chunk_size, r.size, c.iv,
+                                 KF_CHUNKED_INDEX_LAST | KF_CHUNKED_PRINTS);
+    if (status == KF_OK && kf_chunked_seek(out, c.index) != 0)
+      status = KF_ERR_WRITE;
+  }
+
+  if (status == KF_OK && (dirty || !in_place))
+    status = kf_chunked_trailer(out, entries, KF_CHUNK_ENTRY, r.nchunks,
+                                generation);
+
+  free(old);
+  free(entries);
+  kf_chunk_reader_close(&r);
+
+  if (!in_place && out && out != c.in && fclose(out) != 0 && status == KF_OK)
+    status = KF_ERR_WRITE;
+
+  const int closed = kf_chunked_close(&c);
+  if (status == KF_OK)
+    status = closed;
+
+  if (temp && status == KF_OK) {
+#ifdef _WIN32
+    remove(outfile);
+#endif
+    if (rename(temp, outfile) != 0)
+      status = KF_ERR_WRITE;
+  }
+
+  if (temp && status != KF_OK)
+    remove(temp);
+
+  free(temp);
+
+  if (changed)
+    *changed = written;
+
+  return status;
+}
+
+#ifdef KF_ZLIB
+
+/**
+ * @brief decrypt and inflate a whole compressed chunk
+ *
+ * @param c the chunked object
+ * @param chunk the chunk index
+ * @param offset the file offset of the chunk
+ * @param generation the generation of the chunk
+ * @param stored the number of bytes stored
+ * @param len the plaintext length of the chunk
+ * @param pool the threads of cbc decryption, or NULL
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+static int kf_chunked_inflate(kf_chunked *c, const uint64_t chunk,
+                              const uint64_t offset,
+                              const uint64_t generation, const size_t stored,
+                              const size_t len, kf_cbc_pool *pool) {
+
+  const size_t nblocks = (stored + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  z_stream z;
+
+  kf_chunk_iv(c->iv, chunk, generation, c->key, c->cipher);
+
+  int status = kf_chunked_read(c->in, offset, c->cipher + 4,
+                               nblocks * BLOCK_SIZE);
+  if (status != KF_OK)
+    return status;
+
+  kf_cbc_decrypt_pool(pool, c->cipher + 4, c->plain, nblocks, c->key);
+
+  memset(&z, 0, sizeof(z));
+  if (inflateInit2(&z, -15) != Z_OK)
+    return KF_ERR_MEMORY;
+
+  z.next_in = (uint8_t *)c->plain;
+  z.avail_in = (uInt)stored;
+  z.next_out = c->inflated;
+  z.avail_out = (uInt)len;
+
+  if (inflate(&z, Z_FINISH) != Z_STREAM_END || z.total_out != len)
+    status = KF_ERR_FORMAT;
+
+  inflateEnd(&z);
+
+  return status;
+}
+
+#endif
+
+/**
+ * @brief decrypt bytes start to end of one chunk
+ *
+ * only the blocks that cover the bytes are read, along with the block
+ * before them, which chains the first one. a compressed chunk is read and
+ * inflated whole.
+ *
+ * @param c the chunked object
+ * @param chunk the chunk index
+ * @param start the first byte within the chunk
+ * @param end one past the last byte within the chunk
+ * @param out the plaintext bytes
+ * @param pool the threads of cbc decryption, or NULL
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+static int kf_chunked_part(kf_chunked *c, const uint64_t chunk,
+                           const size_t start, const size_t end, uint8_t *out,
+                           kf_cbc_pool *pool) {
+
+  uint8_t entry[KF_CHUNK_ENTRY_DEFLATE];
+
+  int status = kf_chunked_read(c->in, c->index + c->entry_size * chunk, entry,
+                               c->entry_size);
+  if (status != KF_OK)
+    return status;
+
+  const uint64_t offset = kf_get64(entry);
+  const uint64_t generation = kf_get64(entry + 8);
+  const size_t first = start / BLOCK_SIZE;
+  const size_t nblocks = (end + BLOCK_SIZE - 1) / BLOCK_SIZE - first;
+  const uint64_t len = kf_chunk_plain_len(c->plain_size, c->chunk_size, chunk);
+  const uint64_t stored = c->deflate ? kf_get64(entry + KF_CHUNK_ENTRY) : len;
+  const uint64_t cipher_len =
+      (stored + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+
+  if (stored > len || offset < c->data_start || offset > c->data_end ||
+      c->data_end - offset < cipher_len)
+    return KF_ERR_FORMAT;
+
+#ifdef KF_ZLIB
+  if (stored < len) {
+    status = kf_chunked_inflate(c, chunk, offset, generation, (size_t)stored,
+                                (size_t)len, pool);
+    if (status == KF_OK)
+      memcpy(out, c->inflated + start, end - start);
+    return status;
+  }
+#endif
+
+  if (first == 0) {
+    kf_chunk_iv(c->iv, chunk, generation, c->key, c->cipher);
+    status = kf_chunked_read(c->in, offset, c->cipher + 4,
+                             nblocks * BLOCK_SIZE);
+  } else {
+    status = kf_chunked_read(c->in, offset + (first - 1) * BLOCK_SIZE,
+                             c->cipher, (nblocks + 1) * BLOCK_SIZE);
+  }
+
+  if (status != KF_OK)
+    return status;
+
+  kf_cbc_decrypt_pool(pool, c->cipher + 4, c->plain, nblocks, c->key);
+  memcpy(out, (uint8_t *)c->plain + start - first * BLOCK_SIZE, end - start);
+
+  return KF_OK;
+}
+
+/**
+ * @brief clip a range to the plaintext of a container
+ *
+ * @param c the chunked object
+ * @param offset the first byte of the range
+ * @param len the length of the range
+ * @return uint64_t the length of the range inside the plaintext
+ */
+static uint64_t kf_chunked_clip(const kf_chunked *c, const uint64_t offset,
+                                const uint64_t len) {
+
+  if (offset >= c->plain_size)
+    return 0;
+
+  return c->plain_size - offset < len ? c->plain_size - offset : len;
+}
+
+/**
+ * @brief decrypt a byte range of a chunked container into memory.
+ *
+ * only the chunks, and within them the blocks, that cover the range are read
+ * and decrypted. a range running past the end of the plaintext is cut short.
+ *
+ * @param infile the name of the container
+ * @param offset the first plaintext byte of the range
+ * @param len the length of the range in bytes
+ * @param key a pointer to the key object
+ * @param out the plaintext, at least len bytes
+ * @param out_len the number of bytes decrypted
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_range(const char *infile, const uint64_t offset,
+                     const size_t len, const kf_key *key, uint8_t *out,
+                     size_t *out_len) {
+
+  kf_chunked c;
+
+  *out_len = 0;
+
+  int status = kf_chunked_open(&c, infile, "rb", key);
+  if (status != KF_OK)
+    return status;
+
+  const uint64_t end = offset + kf_chunked_clip(&c, offset, len);
+
+  for (uint64_t pos = offset; status == KF_OK && pos < end;) {
+    const uint64_t chunk = pos / c.chunk_size;
+    const uint64_t chunk_end = (chunk + 1) * c.chunk_size;
+    const uint64_t stop = chunk_end < end ? chunk_end : end;
+    const size_t start = (size_t)(pos - chunk * c.chunk_size);
+
+    status = kf_chunked_part(&c, chunk, start, start + (size_t)(stop - pos),
+                             out + (pos - offset), NULL);
+    pos = stop;
+  }
+
+  if (status == KF_OK)
+    *out_len = (size_t)(end - offset);
+
+  kf_chunked_close(&c);
+
+  return status;
+}
+
+/**
+ * @brief decrypt a byte range of a chunked container into a file.
+ *
+ * the range is decrypted one chunk at a time, so memory use does not depend
+ * on its length. a range running past the end of the plaintext is cut short.
+ *
+ * @param infile the name of the container
+ * @param outfile the name of the output file, or "-" for stdout
+ * @param key a pointer to the key object
+ * @param offset the first plaintext byte of the range
+ * @param len the length of the range in bytes
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_file_range(const char *infile, const char *outfile,
+                          const kf_key *key, const uint64_t offset,
+                          const uint64_t len, const kf_opts *opts) {
+
+  kf_chunked c;
+
+  int status = kf_chunked_open(&c, infile, "rb", key);
+  if (status != KF_OK)
+    return status;
+
+  FILE *out = strcmp(outfile, "-") == 0 ? stdout : fopen(outfile, "wb");
+  uint8_t *plain = malloc(c.chunk_size);
+
+  if (!out)
+    status = KF_ERR_OPEN;
+  else if (!plain)
+    status = KF_ERR_MEMORY;
+
+  kf_cbc_pool *pool = kf_cbc_pool_create(opts ? opts->threads : 1);
+  const uint64_t end = offset + kf_chunked_clip(&c, offset, len);
+
+  for (uint64_t pos = offset; status == KF_OK && pos < end;) {
+    const uint64_t chunk = pos / c.chunk_size;
+    const uint64_t chunk_end = (chunk + 1) * c.chunk_size;
+    const uint64_t stop = chunk_end < end ? chunk_end : end;
+    const size_t start = (size_t)(pos - chunk * c.chunk_size);
+    const size_t n = (size_t)(stop - pos);
+
+    status = kf_chunked_part(&c, chunk, start, start + n, plain, pool);
+    if (status == KF_OK)
+      status = kf_chunked_write(plain, n, out);
+    pos = stop;
+  }
+
+  kf_cbc_pool_destroy(pool);
+  free(plain);
+  kf_chunked_close(&c);
+
+  if (out) {
+    const int closed = out == stdout ? fflush(out) : fclose(out);
+    if (status == KF_OK && closed != 0)
+      status = KF_ERR_WRITE;
+  }
+
+  return status;
+}
+
+/**
+ * @brief decrypt a whole chunked container into a file.
+ *
+ * @param infile the name of the container
+ * @param outfile the name of the output file, or "-" for stdout
+ * @param key a pointer to the key object
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_file_chunked(const char *infile, const char *outfile,
+                            const kf_key *key, const kf_opts *opts) {
+
+  return kf_decrypt_file_range(infile, outfile, key, 0, UINT64_MAX, opts);
+}
@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __unix__
+#include <pthread.h>
+#endif
+
+static void kf_block_n_k_scalar(const uint32_t *in, uint32_t *out,
+                                size_t nblocks, const kf_xctx *x,
+                                const kf_sched *k) {
+
+  kf_block_n_scalar_k(in, out, nblocks, &x->ctx, k);
+}
+
+static void kf_block_n_k_avx2(const uint32_t *in, uint32_t *out,
+                              size_t nblocks, const kf_xctx *x,
+                              const kf_sched *k) {
+
+  kf_block_n_avx2_k(in, out, nblocks, &x->ctx, k);
+}
+
+static void kf_block_n_k_avx512(const uint32_t *in, uint32_t *out,
+                                size_t nblocks, const kf_xctx *x,
+                                const kf_sched *k) {
+
+  kf_block_n_avx512_k(in, out, nblocks, &x->ctx, k);
+}
+
+static int kf_cpu_any(void) { return 1; }
+
+static int kf_cpu_avx2(void) {
+
+#if KF_X86_SIMD
+  return __builtin_cpu_supports("avx2");
+#else
+  return 0;
+#endif
+}
+
+static int kf_cpu_avx512(void) {
+
+#if KF_X86_SIMD
+  return __builtin_cpu_supports("avx2") &&
+         __builtin_cpu_supports("avx512f") &&
+         __builtin_cpu_supports("avx512bw") &&
+         __builtin_cpu_supports("avx512vbmi");
+#else
+  return 0;
+#endif
+}
+
+/*
+ * the kernels in order of preference, lowest first. the fused kernel only
+ * speeds up callers that hold an expanded ctx; with a plain ctx it runs the
+ * scalar code. the AVX2 kernel is about as fast as the fused tables, and is
+ * preferred over them because its S-box lookups run in constant time; the
+ * vector kernels pad a short remainder out to a whole group rather than
+ * running it through the tables. single blocks, as in cbc encryption, still
+ * use the tables.
+ */
+static const kf_kernel kf_kernels[] = {
+    {"scalar", kf_cpu_any, kf_block_n_scalar, kf_block_n_k_scalar},
+    {"fused", kf_cpu_any, kf_block_n_scalar, kf_block_n_fused_k},
+    {"avx2", kf_cpu_avx2, kf_block_n_avx2, kf_block_n_k_avx2},
+    {"avx512", kf_cpu_avx512, kf_block_n_avx512, kf_block_n_k_avx512},
+};
+
+#define KF_KERNEL_COUNT (sizeof(kf_kernels) / sizeof(kf_kernels[0]))
+
+static const kf_kernel *kf_active = NULL;
+
+/**
+ * @brief pick the kernel used by the multi-block functions
+ *
+ * the KF128_KERNEL environment variable forces a kernel by name when the CPU
+ * supports it. otherwise the most preferred supported kernel is used, and a
+ * name that could not be honoured is reported on stderr with the kernel
+ * picked in its place, so a benchmark does not silently time another one.
+ *
+ */
+static void kf_kernel_init(void) {
+
+  const char *name = getenv("KF128_KERNEL");
+  const kf_kernel *forced = name ? kf_kernel_find(name) : NULL;
+
+  if (forced && forced->supported()) {
+    kf_active = forced;
+    return;
+  }
+
+  for (size_t i = 0; i < KF_KERNEL_COUNT; i++) {
+    if (kf_kernels[i].supported())
+      kf_active = &kf_kernels[i];
+  }
+
+  if (name)
+    fprintf(stderr, "kf128: KF128_KERNEL=%s is %s, using %s.\n", name,
+            forced ? "not supported by this cpu" : "not a known kernel",
+            kf_active->name);
+}
+
+#ifdef __unix__
+static pthread_once_t kf_kernel_once = PTHREAD_ONCE_INIT;
+#define KF_KERNEL_INIT() pthread_once(&kf_kernel_once, kf_kernel_init)
+#else
+#define KF_KERNEL_INIT()                                                       \
+  do {                                                                         \
+    if (!kf_active)                                                            \
+      kf_kernel_init();                                                        \
+  } while (0)
+#endif
+
+/**
+ * @brief get the table of known kernels
+ *
+ * @param count the number of kernels in the table
+ * @return const kf_kernel* the kernel table
+ */
+const kf_kernel *kf_kernel_list(size_t *count) {
+
+  *count = KF_KERNEL_COUNT;
+  return kf_kernels;
+}
+
+/**
+ * @brief find a kernel by name
+ *
+ * @param name the kernel name
+ * @return const kf_kernel* the kernel, or NULL if there is no such kernel
+ */
+const kf_kernel *kf_kernel_find(const char *name) {
+
+  for (size_t i = 0; i < KF_KERNEL_COUNT; i++) {
+    if (strcmp(kf_kernels[i].name, name) == 0)
+      return &kf_kernels[i];
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief get the active kernel
+ *
+ * the kernel is picked on the first call.
+ *
+ * @return const kf_kernel* the active kernel
+ */
+const kf_kernel *kf_kernel_get(void) {
+
+  KF_KERNEL_INIT();
+  return kf_active;
+}
+
+/**
+ * @brief force the kernel used by the multi-block functions
+ *
+ * this is meant for benchmarking and testing, and must not be called while
+ * other threads are encrypting.
+ *
+ * @param name the kernel name
+ * @return int 0 on success, -1 if the kernel is unknown or unsupported
+ */
+int kf_kernel_select(const char *name) {
+
+  const kf_kernel *kernel = kf_kernel_find(name);
+
+  KF_KERNEL_INIT();
+
+  if (!kernel || !kernel->supported())
+    return -1;
+
+  kf_active = kernel;
+  return 0;
+}
+
+/**
+ * @brief the multi-block function
+ *
+ * runs nblocks independent 128-bit blocks through the active kernel. the
+ * output is identical to calling kf_block on every block. in and out may
+ * point to the same buffer.
+ *
+ * @param in the input blocks
+ * @param out the output blocks
+ * @param nblocks the number of 128-bit blocks
+ * @param ctx a pointer to the ctx object
+ */
+void kf_block_n(const uint32_t *in, uint32_t *out, size_t nblocks,
+                const kf_ctx *ctx) {
+
+  kf_kernel_get()->block_n(in, out, nblocks, ctx);
+}
+
+/**
+ * @brief the multi-block function on an expanded ctx
+ *
+ * @param in the input blocks
+ * @param out the output blocks
+ * @param nblocks the number of 128-bit blocks
+ * @param x a pointer to the expanded ctx object
+ */
+void kf_block_n_x(const uint32_t *in, uint32_t *out, size_t nblocks,
+                  const kf_xctx *x) {
+
+  kf_kernel_get()->block_n_k(in, out, nblocks, x, &x->sched);
+}
+
+/**
+ * @brief the multi-block function on an expanded ctx with an explicit key
+ * schedule
+ *
+ * with the schedule from kf_invert_sched this decrypts with the tables of
+ * the encrypting ctx, and the output is identical to kf_block_n_x on an
+ * inverted ctx.
+ *
+ * @param in the input blocks
+ * @param out the output blocks
+ * @param nblocks the number of 128-bit blocks
+ * @param x a pointer to the expanded ctx object
+ * @param k a pointer to the schedule object
+ */
+void kf_block_n_k(const uint32_t *in, uint32_t *out, size_t nblocks,
+                  const kf_xctx *x, const kf_sched *k) {
+
+  kf_kernel_get()->block_n_k(in, out, nblocks, x, k);
+}
@@ -0,0 +1,576 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+/* O_DIRECT */
+#define _GNU_SOURCE
+
+#include "kf128.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __unix__
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/*
+ * the fd functions run the cipher from a file descriptor to a file
+ * descriptor, which may be a file, a pipe or a socket, with no stdio and no
+ * temporary file in between. the input is read into one buffer of
+ * KF_FD_ALIGN aligned memory, encrypted there in place, and written straight
+ * from it, so the kernel makes the only copies; sendfile and splice can not
+ * take their place, as the bytes change on the way. the iv and the last
+ * block go out in the same writev as the buffer next to them.
+ *
+ * the buffer is a multiple of KF_FD_ALIGN bytes and is filled at aligned
+ * offsets, so the input may be opened with O_DIRECT. a descriptor set to
+ * non-blocking is waited on with poll. the descriptors are left open, at
+ * the offsets where the functions stopped, and the output is identical to
+ * the file modes.
+ */
+
+#define KF_FD_ALIGN 4096
+
+/**
+ * @brief the fd object holds the descriptors and the aligned buffers of
+ * the fd functions.
+ *
+ */
+typedef struct {
+  int in_fd;
+  int out_fd;
+  int direct;
+  uint8_t *base;
+  uint8_t *in;
+  uint8_t *out;
+  size_t size;
+} kf_fd;
+
+/**
+ * @brief set up the buffers of the fd functions
+ *
+ * in is preceded by BLOCK_SIZE bytes of room for a chaining block, and out
+ * is only allocated when asked for.
+ *
+ * @param f the fd object
+ * @param in_fd the input descriptor
+ * @param out_fd the output descriptor
+ * @param opts the file mode options, or NULL for the defaults
+ * @param two 1 for separate input and output buffers, 0 for one buffer
+ * @return int KF_OK, or KF_ERR_MEMORY
+ */
+static int kf_fd_open(kf_fd *f, const int in_fd, const int out_fd,
+                      const kf_opts *opts, const int two) {
+
+  size_t size =
+      (opts && opts->buffer_size > 0) ? opts->buffer_size : KF_BUFFER_SIZE;
+  void *base;
+
+  size = (size + KF_FD_ALIGN - 1) / KF_FD_ALIGN * KF_FD_ALIGN;
+
+  if (posix_memalign(&base, KF_FD_ALIGN, KF_FD_ALIGN + (two ? 2 : 1) * size))
+    return KF_ERR_MEMORY;
+
+  f->in_fd = in_fd;
+  f->out_fd = out_fd;
+  f->base = base;
+  f->in = f->base + KF_FD_ALIGN;
+  f->out = two ? f->in + size : NULL;
+  f->size = size;
+  f->direct = 0;
+
+#ifdef O_DIRECT
+  const int flags = fcntl(in_fd, F_GETFL);
+  f->direct = flags >= 0 && (flags & O_DIRECT) != 0;
+#endif
+
+  return KF_OK;
+}
+
+/**
+ * @brief wipe and free the buffers of the fd functions
+ *
+ * @param f the fd object
+ * @param status the status of the fd function
+ * @return int the status
+ */
+static int kf_fd_close(kf_fd *f, const int status) {
+
+  kf_wipe(f->base, KF_FD_ALIGN + (f->out ? 2 : 1) * f->size);
+  free(f->base);
+
+  return status;
+}
+
+/**
+ * @brief wait for a non-blocking descriptor to become ready
+ *
+ * @param fd the descriptor
+ * @param events POLLIN or POLLOUT
+ * @return int 0 when it is ready, -1 on an error
+ */
+static int kf_fd_wait(const int fd, const short events) {
+
+  struct pollfd p;
+
+  p.fd = fd;
+  p.events = events;
+
+  for (;;) {
+    const int r = poll(&p, 1, -1);
+
+    if (r > 0)
+      return 0;
+    if (r < 0 && errno != EINTR)
+      return -1;
+  }
+}
+
+/**
+ * @brief check whether a failed call should be made again
+ *
+ * @param fd the descriptor
+ * @param events the events to wait for on a non-blocking descriptor
+ * @return int 1 to call again, 0 to give up
+ */
+static int kf_fd_retry(const int fd, const short events) {
+
+  if (errno == EINTR)
+    return 1;
+
+  return (errno == EAGAIN || errno == EWOULDBLOCK) &&
+         kf_fd_wait(fd, events) == 0;
+}
+
+/**
+ * @brief fill the input buffer, or read up to the end of the input
+ *
+ * @param f the fd object
+ * @param got the number of bytes read, less than the buffer size only at the
+ * end of the input
+ * @return int KF_OK, or KF_ERR_READ
+ */
+static int kf_fd_fill(kf_fd *f, size_t *got) {
+
+  KF_STATS_START(start);
+
+  int status = KF_OK;
+
+  *got = 0;
+
+  while (*got < f->size) {
+    const ssize_t r = read(f->in_fd, f->in + *got, f->size - *got);
+
+    if (r < 0 && kf_fd_retry(f->in_fd, POLLIN))
+      continue;
+
+    if (r < 0) {
+      status = KF_ERR_READ;
+      break;
+    }
+
+    KF_STATS_ADD(reads, 1);
+    KF_STATS_ADD(bytes_read, r);
+
+    *got += (size_t)r;
+
+    /* a direct read ends short only at the end of the file */
+    if (r == 0 || (f->direct && (size_t)r % KF_FD_ALIGN != 0))
+      break;
+  }
+
+  KF_STATS_STOP(io_ns, start);
+
+  return status;
+}
+
+/**
+ * @brief write every byte of a list of buffers
+ *
+ * @param f the fd object
+ * @param iov the buffers, which are changed
+ * @param n the number of buffers
+ * @return int KF_OK, or KF_ERR_WRITE
+ */
+static int kf_fd_write(kf_fd *f, struct iovec *iov, int n) {
+
+  KF_STATS_START(start);
+
+  int status = KF_OK;
+
+  for (;;) {
+    while (n > 0 && iov->iov_len == 0) {
+      iov++;
+      n--;
+    }
+
+    if (n == 0)
+      break;
+
+    const ssize_t w = writev(f->out_fd, iov, n);
+
+    if (w < 0 && kf_fd_retry(f->out_fd, POLLOUT))
+      continue;
+
+    if (w <= 0) {
+      status = KF_ERR_WRITE;
+      break;
+    }
+
+    KF_STATS_ADD(writes, 1);
+    KF_STATS_ADD(bytes_written, w);
+
+    size_t done = (size_t)w;
+
+    for (; n > 0 && done >= iov->iov_len; iov++, n--)
+      done -= iov->iov_len;
+
+    if (n > 0) {
+      iov->iov_base = (uint8_t *)iov->iov_base + done;
+      iov->iov_len -= done;
+    }
+  }
+
+  KF_STATS_STOP(io_ns, start);
+
+  return status;
+}
+
+/**
+ * @brief encrypt from a file descriptor to a file descriptor with knifefish
+ * in cipher-block-chaining mode.
+ *
+ * @param in_fd the input descriptor, which may be opened with O_DIRECT
+ * @param out_fd the output descriptor
+ * @param key a pointer to the key object
+ * @param iv the initialization vector
+ * @param padding random padding
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_fd_cbc(const int in_fd, const int out_fd, const kf_key *key,
+                      const char *iv, const char *padding,
+                      const kf_opts *opts) {
+
+  kf_fd f;
+  struct iovec iov[3];
+  uint32_t head[4];
+  uint32_t chain[4];
+  uint32_t last[4] = {0};
+  size_t got;
+  int n = 0;
+
+  int status = kf_fd_open(&f, in_fd, out_fd, opts, 0);
+  if (status != KF_OK)
+    return status;
+
+  memcpy(head, iv, BLOCK_SIZE);
+  memcpy(chain, iv, BLOCK_SIZE);
+
+  iov[n].iov_base = head;
+  iov[n++].iov_len = BLOCK_SIZE;
+
+  while ((status = kf_fd_fill(&f, &got)) == KF_OK) {
+    const size_t nblocks = got / BLOCK_SIZE;
+    const size_t remaining = got % BLOCK_SIZE;
+
+    KF_STATS_START(start);
+
+    kf_cbc_encrypt_blocks((const uint32_t *)f.in, (uint32_t *)f.in, nblocks,
+                          chain, &key->x);
+
+    /* the input may end on a buffer, so the last block waits for a read */
+    if (got < f.size) {
+      if (remaining != 0) {
+        memcpy(last, padding, BLOCK_SIZE);
+        memcpy(last, f.in + nblocks * BLOCK_SIZE, remaining);
+        ((uint8_t *)last)[BLOCK_SIZE - 1] = (uint8_t)remaining;
+      }
+
+      kf_cbc_encrypt_blocks(last, last, 1, chain, &key->x);
+    }
+
+    KF_STATS_ADD(blocks, nblocks + (got < f.size));
+    KF_STATS_STOP(cipher_ns, start);
+
+    iov[n].iov_base = f.in;
+    iov[n++].iov_len = nblocks * BLOCK_SIZE;
+
+    if (got < f.size) {
+      iov[n].iov_base = last;
+      iov[n++].iov_len = BLOCK_SIZE;
+    }
+
+    status = kf_fd_write(&f, iov, n);
+    n = 0;
+
+    if (status != KF_OK || got < f.size)
+      break;
+  }
+
+  return kf_fd_close(&f, status);
+}
+
+/**
+ * @brief decrypt from a file descriptor to a file descriptor with knifefish
+ * in cipher-block-chaining mode.
+ *
+ * the last plaintext block of every buffer is held back until the next read
+ * tells whether it is the last of the message, which holds the padding.
+ *
+ * @param in_fd the input descriptor, which may be opened with O_DIRECT
+ * @param out_fd the output descriptor
+ * @param key a pointer to the key object
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_fd_cbc(const int in_fd, const int out_fd, const kf_key *key,
+                      const kf_opts *opts) {
+
+  kf_fd f;
+  struct iovec iov[3];
+  uint32_t chain[4];
+  uint32_t held[4];
+  int holding = 0;
+  int first = 1;
+  uint64_t total = 0;
+  size_t got;
+
+  int status = kf_fd_open(&f, in_fd, out_fd, opts, 1);
+  if (status != KF_OK)
+    return status;
+
+  kf_cbc_pool *pool = kf_cbc_pool_create(opts ? opts->threads : 1);
+
+  while ((status = kf_fd_fill(&f, &got)) == KF_OK) {
+    const int end = got < f.size;
+    const uint8_t *cipher = f.in;
+    size_t len = got;
+
+    total += got;
+
+    if (got % BLOCK_SIZE != 0 || (end && total < 2 * BLOCK_SIZE)) {
+      status = KF_ERR_FORMAT;
+      break;
+    }
+
+    /* the iv chains the first block, and the last block of a buffer the
+     * first of the next */
+    if (first) {
+      cipher += BLOCK_SIZE;
+      len -= BLOCK_SIZE;
+      first = 0;
+    } else {
+      memcpy(f.in - BLOCK_SIZE, chain, BLOCK_SIZE);
+    }
+
+    const size_t nblocks = len / BLOCK_SIZE;
+
+    kf_cbc_decrypt_pool(pool, (const uint32_t *)cipher, (uint32_t *)f.out,
+                        nblocks, key);
+
+    uint8_t *tail =
+        nblocks > 0 ? f.out + (nblocks - 1) * BLOCK_SIZE : (uint8_t *)held;
+    const uint8_t remaining = tail[BLOCK_SIZE - 1];
+
+    if (end && remaining >= BLOCK_SIZE) {
+      status = KF_ERR_FORMAT;
+      break;
+    }
+
+    int n = 0;
+
+    if (holding && nblocks > 0) {
+      iov[n].iov_base = held;
+      iov[n++].iov_len = BLOCK_SIZE;
+    }
+
+    if (nblocks > 1) {
+      iov[n].iov_base = f.out;
+      iov[n++].iov_len = (nblocks - 1) * BLOCK_SIZE;
+    }
+
+    if (end) {
+      iov[n].iov_base = tail;
+      iov[n++].iov_len = remaining;
+    }
+
+    status = kf_fd_write(&f, iov, n);
+
+    if (status != KF_OK || end)
+      break;
+
+    if (nblocks > 0) {
+      memcpy(held, tail, BLOCK_SIZE);
+      memcpy(chain, cipher + len - BLOCK_SIZE, BLOCK_SIZE);
+      holding = 1;
+    }
+  }
+
+  kf_cbc_pool_destroy(pool);
+  kf_wipe(held, sizeof(held));
+
+  return kf_fd_close(&f, status);
+}
+
+/**
+ * @brief run the input through counter mode, after the iv
+ *
+ * @param f the fd object
+ * @param key a pointer to the key object
+ * @param iv the initialization vector, written before the ciphertext when
+ * encrypting and read from the start of the input when decrypting
+ * @param decrypt 1 to decrypt, 0 to encrypt
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+static int kf_fd_ctr(kf_fd *f, const kf_key *key, char iv[BLOCK_SIZE],
+                     const int decrypt) {
+
+  struct iovec iov[2];
+  uint64_t counter = 0;
+  int first = 1;
+  size_t got;
+  int status;
+
+  while ((status = kf_fd_fill(f, &got)) == KF_OK) {
+    uint8_t *data = f->in;
+    size_t len = got;
+    int n = 0;
+
+    if (first && decrypt) {
+      if (got < BLOCK_SIZE) {
+        status = KF_ERR_FORMAT;
+        break;
+      }
+
+      memcpy(iv, data, BLOCK_SIZE);
+      data += BLOCK_SIZE;
+      len -= BLOCK_SIZE;
+    } else if (first) {
+      iov[n].iov_base = iv;
+      iov[n++].iov_len = BLOCK_SIZE;
+    }
+
+    first = 0;
+
+    kf_ctr_x(data, data, len, iv, counter, &key->x);
+    counter += len / BLOCK_SIZE;
+
+    iov[n].iov_base = data;
+    iov[n++].iov_len = len;
+
+    status = kf_fd_write(f, iov, n);
+
+    if (status != KF_OK || got < f->size)
+      break;
+  }
+
+  return status;
+}
+
+/**
+ * @brief encrypt from a file descriptor to a file descriptor with knifefish
+ * in counter mode.
+ *
+ * @param in_fd the input descriptor, which may be opened with O_DIRECT
+ * @param out_fd the output descriptor
+ * @param key a pointer to the key object
+ * @param iv the initialization vector
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_fd_ctr(const int in_fd, const int out_fd, const kf_key *key,
+                      const char *iv, const kf_opts *opts) {
+
+  kf_fd f;
+  char head[BLOCK_SIZE];
+
+  int status = kf_fd_open(&f, in_fd, out_fd, opts, 0);
+  if (status != KF_OK)
+    return status;
+
+  memcpy(head, iv, BLOCK_SIZE);
+
+  return kf_fd_close(&f, kf_fd_ctr(&f, key, head, 0));
+}
+
+/**
+ * @brief decrypt from a file descriptor to a file descriptor with knifefish
+ * in counter mode.
+ *
+ * @param in_fd the input descriptor, which may be opened with O_DIRECT
+ * @param out_fd the output descriptor
+ * @param key a pointer to the key object
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_fd_ctr(const int in_fd, const int out_fd, const kf_key *key,
+                      const kf_opts *opts) {
+
+  kf_fd f;
+  char iv[BLOCK_SIZE];
+
+  int status = kf_fd_open(&f, in_fd, out_fd, opts, 0);
+  if (status != KF_OK)
+    return status;
+
+  return kf_fd_close(&f, kf_fd_ctr(&f, key, iv, 1));
+}
+
+#else
+
+/*
+ * without file descriptors there is nothing to read from, and the fd
+ * functions fail as if the input could not be opened.
+ */
+
+int kf_encrypt_fd_cbc(const int in_fd, const int out_fd, const kf_key *key,
+                      const char *iv, const char *padding,
+                      const kf_opts *opts) {
+
+  (void)in_fd;
+  (void)out_fd;
+  (void)key;
+  (void)iv;
+  (void)padding;
+  (void)opts;
+  return KF_ERR_OPEN;
+}
+
+int kf_decrypt_fd_cbc(const int in_fd, const int out_fd, const kf_key *key,
+                      const kf_opts *opts) {
+
+  (void)in_fd;
+  (void)out_fd;
+  (void)key;
+  (void)opts;
+  return KF_ERR_OPEN;
+}
+
+int kf_encrypt_fd_ctr(const int in_fd, const int out_fd, const kf_key *key,
+                      const char *iv, const kf_opts *opts) {
+
+  (void)in_fd;
+  (void)out_fd;
+  (void)key;
+  (void)iv;
+  (void)opts;
+  return KF_ERR_OPEN;
+}
+
+int kf_decrypt_fd_ctr(const int in_fd, const int out_fd, const kf_key *key,
+                      const kf_opts *opts) {
+
+  (void)in_fd;
+  (void)out_fd;
+  (void)key;
+  (void)opts;
+  return KF_ERR_OPEN;
+}
+
+#endif
@@ -0,0 +1,741 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __unix__
+#include <sys/stat.h>
+#endif
+
+#ifdef KF_OPENCL
+#define CL_TARGET_OPENCL_VERSION 120
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#endif
+
+/*
+ * the gpu backend generates counter mode keystream on an OpenCL device. one
+ * work item encrypts one counter block, rebuilt on the device from the iv
+ * and its index, so nothing but the keystream crosses the bus, and the host
+ * xors it into the data. every work group copies the fused S-box/P-box
+ * tables into local memory before its rounds, and the schedule sits in
+ * constant memory.
+ *
+ * the keystream comes back in slices of KF_GPU_SLICE bytes through two
+ * pinned host buffers, each with its own queue: while the host xors and
+ * writes one slice and reads the next, the device fills the other. below
+ * KF_GPU_THRESHOLD bytes the launch and the transfer cost more than the
+ * whole job on the cpu, and kf_ctr_x does it instead, as it does when no
+ * device is found, the library is built without KF_OPENCL, or a launch
+ * fails.
+ *
+ * a gpu object is used by one thread at a time.
+ */
+
+#define KF_GPU_GROUP 256
+
+#ifdef KF_OPENCL
+
+/* the keystream kernel; its block function mirrors kf_block_xk */
+static const char kf_gpu_source[] =
+    "#ifdef KF_HOST_BIG\n"
+    "#define KF_BYTE(w, i) ((uchar)((w) >> (24 - 8 * (i))))\n"
+    "#else\n"
+    "#define KF_BYTE(w, i) ((uchar)((w) >> (8 * (i))))\n"
+    "#endif\n"
+    "\n"
+    "#define KF_F(r0, r1, a, b)                                         \\\n"
+    "  do {                                                             \\\n"
+    "    const ulong v_ = sp[KF_BYTE(r0, 0)] | sp[256 + KF_BYTE(r0, 1)] | \\\n"
+    "        sp[512 + KF_BYTE(r0, 2)] | sp[768 + KF_BYTE(r0, 3)] |      \\\n"
+    "        sp[1024 + KF_BYTE(r1, 0)] | sp[1280 + KF_BYTE(r1, 1)] |    \\\n"
+    "        sp[1536 + KF_BYTE(r1, 2)] | sp[1792 + KF_BYTE(r1, 3)];     \\\n"
+    "    const uint lo_ = (uint)v_;                                     \\\n"
+    "    const uint hi_ = (uint)(v_ >> 32);                             \\\n"
+    "    a = lo_ + hi_;                                                 \\\n"
+    "    b = lo_ + 2 * hi_;                                             \\\n"
+    "  } while (0)\n"
+    "\n"
+    "static void kf_store(__global uchar *p, const uint w) {\n"
+    "  for (int i = 0; i < 4; i++)\n"
+    "    p[i] = KF_BYTE(w, i);\n"
+    "}\n"
+    "\n"
+    "static uint kf_word(const ulong c, const int hi) {\n"
+    "  const uint w = hi ? (uint)(c >> 32) : (uint)c;\n"
+    "#ifdef KF_HOST_BIG\n"
+    "  return as_uint(as_uchar4(w).wzyx);\n"
+    "#else\n"
+    "  return w;\n"
+    "#endif\n"
+    "}\n"
+    "\n"
+    "__kernel void kf_keystream(__global const ulong *tables,\n"
+    "                           __constant uint *k, const uint iv0,\n"
+    "                           const uint iv1, const ulong base,\n"
+    "                           const ulong nblocks,\n"
+    "                           __global uchar *out, __local ulong *sp) {\n"
+    "  for (size_t i = get_local_id(0); i < 2048; i += get_local_size(0))\n"
+    "    sp[i] = tables[i];\n"
+    "  barrier(CLK_LOCAL_MEM_FENCE);\n"
+    "\n"
+    "  const size_t gid = get_global_id(0);\n"
+    "  if (gid >= nblocks)\n"
+    "    return;\n"
+    "\n"
+    "  const ulong c = base + gid;\n"
+    "  uint l0 = iv0 ^ k[32];\n"
+    "  uint l1 = iv1 ^ k[33];\n"
+    "  uint r0 = kf_word(c, 0) ^ k[34];\n"
+    "  uint r1 = kf_word(c, 1) ^ k[35];\n"
+    "  uint a, b;\n"
+    "\n"
+    "  for (int r = 0; r < 15; r++) {\n"
+    "    KF_F(r0, r1, a, b);\n"
+    "    a ^= k[2 * r] ^ l0;\n"
+    "    b ^= k[2 * r + 1] ^ l1;\n"
+    "    l0 = r0;\n"
+    "    l1 = r1;\n"
+    "    r0 = a;\n"
+    "    r1 = b;\n"
+    "  }\n"
+    "\n"
+    "  KF_F(r0, r1, a, b);\n"
+    "  l0 ^= a ^ k[30];\n"
+    "  l1 ^= b ^ k[31];\n"
+    "\n"
+    "  __global uchar *p = out + 16 * gid;\n"
+    "  kf_store(p, l0 ^ k[36]);\n"
+    "  kf_store(p + 4, l1 ^ k[37]);\n"
+    "  kf_store(p + 8, r0 ^ k[38]);\n"
+    "  kf_store(p + 12, r1 ^ k[39]);\n"
+    "}\n";
+
+struct kf_gpu {
+  const kf_xctx *x;
+  cl_context context;
+  cl_command_queue queue[2];
+  cl_program program;
+  cl_kernel kernel;
+  cl_mem tables;
+  cl_mem keys;
+  cl_mem stream[2];
+  cl_mem pinned[2];
+  uint8_t *host[2];
+  cl_event done[2];
+  int pending[2];
+  size_t group;
+};
+
+/**
+ * @brief find the first gpu device of any platform
+ *
+ * @param device the output device
+ * @return int 1 if a device was found, 0 otherwise
+ */
+static int kf_gpu_device(cl_device_id *device) {
+
+  cl_platform_id platforms[8];
+  cl_uint n = 0;
+
+  if (clGetPlatformIDs(8, platforms, &n) != CL_SUCCESS)
+    return 0;
+
+  for (cl_uint i = 0; i < n && i < 8; i++) {
+    cl_uint found = 0;
+
+    if (clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, 1, device, &found) ==
+            CL_SUCCESS &&
+        found > 0)
+      return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief check whether a gpu device is there
+ *
+ * @return int 1 if kf_gpu_create can find a device, 0 otherwise
+ */
+int kf_gpu_available(void) {
+
+  cl_device_id device;
+
+  return kf_gpu_device(&device);
+}
+
+/**
+ * @brief build the kernel and the buffers of a gpu object
+ *
+ * @param g the gpu object, zeroed
+ * @param device the device
+ * @param x a pointer to the expanded ctx object
+ * @return int 1 on success, 0 on any failure
+ */
+static int kf_gpu_setup(kf_gpu *g, cl_device_id device, const kf_xctx *x) {
+
+  cl_int err = CL_SUCCESS;
+
+  g->x = x;
+  g->context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
+  if (!g->context)
+    return 0;
+
+  for (int i = 0; i < 2; i++) {
+    g->queue[i] = clCreateCommandQueue(g->context, device, 0, &err);
+    if (!g->queue[i])
+      return 0;
+  }
+
+  const char *source = kf_gpu_source;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  const char *options = "-DKF_HOST_BIG";
+#else
+  const char *options = "";
+#endif
+
+  g->program = clCreateProgramWithSource(g->context, 1, &source, NULL, &err);
+  if (!g->program ||
+      clBuildProgram(g->program, 1, &device, options, NULL, NULL) !=
+          CL_SUCCESS)
+    return 0;
+
+  g->kernel = clCreateKernel(g->program, "kf_keystream", &err);
+  if (!g->kernel)
+    return 0;
+
+  size_t group = 0;
+
+  if (clGetKernelWorkGroupInfo(g->kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                               sizeof(group), &group, NULL) != CL_SUCCESS ||
+      group == 0)
+    return 0;
+  g->group = group < KF_GPU_GROUP ? group : KF_GPU_GROUP;
+
+  const cl_mem_flags copy = CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR;
+
+  g->tables = clCreateBuffer(g->context, copy, sizeof(x->spbox),
+                             (void *)x->spbox, &err);
+  g->keys = clCreateBuffer(g->context, copy, sizeof(kf_sched),
+                           (void *)&x->sched, &err);
+  if (!g->tables || !g->keys)
+    return 0;
+
+  for (int i = 0; i < 2; i++) {
+    g->stream[i] = clCreateBuffer(g->context, CL_MEM_WRITE_ONLY,
+                                  KF_GPU_SLICE, NULL, &err);
+    g->pinned[i] =
+        clCreateBuffer(g->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                       KF_GPU_SLICE, NULL, &err);
+    if (!g->stream[i] || !g->pinned[i])
+      return 0;
+
+    /* the pinned buffers stay mapped for the life of the gpu object */
+    g->host[i] = clEnqueueMapBuffer(g->queue[i], g->pinned[i], CL_TRUE,
+                                    CL_MAP_READ | CL_MAP_WRITE, 0,
+                                    KF_GPU_SLICE, 0, NULL, NULL, &err);
+    if (!g->host[i])
+      return 0;
+  }
+
+  return clSetKernelArg(g->kernel, 0, sizeof(cl_mem), &g->tables) ==
+             CL_SUCCESS &&
+         clSetKernelArg(g->kernel, 1, sizeof(cl_mem), &g->keys) ==
+             CL_SUCCESS &&
+         clSetKernelArg(g->kernel, 7, sizeof(x->spbox), NULL) == CL_SUCCESS;
+}
+
+/**
+ * @brief create a gpu object for a key.
+ *
+ * the kernel is compiled for the first gpu device found, and the tables and
+ * schedule of x are copied to it once. x must outlive the gpu object, which
+ * uses it for the slices left to the cpu.
+ *
+ * @param x a pointer to the expanded ctx object
+ * @return kf_gpu* the gpu object, or NULL when there is no usable device
+ */
+kf_gpu *kf_gpu_create(const kf_xctx *x) {
+
+  cl_device_id device;
+  cl_ulong local = 0;
+
+  if (!kf_gpu_device(&device))
+    return NULL;
+
+  if (clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local), &local,
+                      NULL) != CL_SUCCESS ||
+      local < sizeof(x->spbox))
+    return NULL;
+
+  kf_gpu *g = calloc(1, sizeof(kf_gpu));
+  if (!g)
+    return NULL;
+
+  if (!kf_gpu_setup(g, device, x)) {
+    kf_gpu_destroy(g);
+    return NULL;
+  }
+
+  return g;
+}
+
+/**
+ * @brief destroy a gpu object.
+ *
+ * @param g the gpu object, or NULL
+ */
+void kf_gpu_destroy(kf_gpu *g) {
+
+  if (!g)
+    return;
+
+  for (int i = 0; i < 2; i++) {
+    if (g->queue[i])
+      clFinish(g->queue[i]);
+    if (g->pending[i])
+      clReleaseEvent(g->done[i]);
+    if (g->host[i])
+      clEnqueueUnmapMemObject(g->queue[i], g->pinned[i], g->host[i], 0, NULL,
+                              NULL);
+    if (g->queue[i])
+      clFinish(g->queue[i]);
+    if (g->pinned[i])
+      clReleaseMemObject(g->pinned[i]);
+    if (g->stream[i])
+      clReleaseMemObject(g->stream[i]);
+  }
+
+  if (g->keys)
+    clReleaseMemObject(g->keys);
+  if (g->tables)
+    clReleaseMemObject(g->tables);
+  if (g->kernel)
+    clReleaseKernel(g->kernel);
+  if (g->program)
+    clReleaseProgram(g->program);
+
+  for (int i = 0; i < 2; i++)
+    if (g->queue[i])
+      clReleaseCommandQueue(g->queue[i]);
+
+  if (g->context)
+    clReleaseContext(g->context);
+
+  free(g);
+}
+
+/**
+ * @brief start generating the keystream of a slice
+ *
+ * @param g the gpu object
+ * @param slot the pinned buffer to fill, 0 or 1
+ * @param iv the initialization vector
+ * @param counter the block counter of the first block
+ * @param nblocks the number of blocks, at most KF_GPU_SLICE / BLOCK_SIZE
+ */
+static void kf_gpu_start(kf_gpu *g, const int slot, const char *iv,
+                         const uint64_t counter, const size_t nblocks) {
+
+  const uint8_t *b8 = (const uint8_t *)iv;
+  cl_uint iv0, iv1;
+  cl_ulong base = 0;
+  cl_ulong n = nblocks;
+
+  memcpy(&iv0, iv, 4);
+  memcpy(&iv1, iv + 4, 4);
+
+  /* as in kf_ctr_block, the last 8 bytes of the iv are a little-endian
+   * counter */
+  for (int i = 0; i < 8; i++)
+    base |= (cl_ulong)b8[8 + i] << (8 * i);
+  base += counter;
+
+  const size_t global = (nblocks + g->group - 1) / g->group * g->group;
+
+  g->pending[slot] =
+      clSetKernelArg(g->kernel, 2, sizeof(iv0), &iv0) == CL_SUCCESS &&
+      clSetKernelArg(g->kernel, 3, sizeof(iv1), &iv1) == CL_SUCCESS &&
+      clSetKernelArg(g->kernel, 4, sizeof(base), &base) == CL_SUCCESS &&
+      clSetKernelArg(g->kernel, 5, sizeof(n), &n) == CL_SUCCESS &&
+      clSetKernelArg(g->kernel, 6, sizeof(cl_mem), &g->stream[slot]) ==
+          CL_SUCCESS &&
+      clEnqueueNDRangeKernel(g->queue[slot], g->kernel, 1, NULL, &global,
+                             &g->group, 0, NULL, NULL) == CL_SUCCESS &&
+      clEnqueueReadBuffer(g->queue[slot], g->stream[slot], CL_FALSE, 0,
+                          nblocks * BLOCK_SIZE, g->host[slot], 0, NULL,
+                          &g->done[slot]) == CL_SUCCESS;
+
+  clFlush(g->queue[slot]);
+}
+
+/**
+ * @brief wait for the keystream of a slice
+ *
+ * @param g the gpu object
+ * @param slot the pinned buffer started by kf_gpu_start
+ * @return const uint8_t* the keystream, or NULL if the device failed
+ */
+static const uint8_t *kf_gpu_wait(kf_gpu *g, const int slot) {
+
+  if (!g->pending[slot]) {
+    clFinish(g->queue[slot]);
+    return NULL;
+  }
+
+  const cl_int err = clWaitForEvents(1, &g->done[slot]);
+
+  clReleaseEvent(g->done[slot]);
+  g->pending[slot] = 0;
+
+  return err == CL_SUCCESS ? g->host[slot] : NULL;
+}
+
+#else
+
+/*
+ * without KF_OPENCL there is never a device, and every function of the
+ * backend runs on the cpu.
+ */
+
+struct kf_gpu {
+  const kf_xctx *x;
+};
+
+int kf_gpu_available(void) {
+
+  return 0;
+}
+
+kf_gpu *kf_gpu_create(const kf_xctx *x) {
+
+  (void)x;
+  return NULL;
+}
+
+void kf_gpu_destroy(kf_gpu *g) {
+
+  (void)g;
+}
+
+static void kf_gpu_start(kf_gpu *g, const int slot, const char *iv,
+                         const uint64_t counter, const size_t nblocks) {
+
+  (void)g;
+  (void)slot;
+  (void)iv;
+  (void)counter;
+  (void)nblocks;
+}
+
+static const uint8_t *kf_gpu_wait(kf_gpu *g, const int slot) {
+
+  (void)g;
+  (void)slot;
+  return NULL;
+}
+
+#endif
+
+/**
+ * @brief apply a slice of keystream, or counter mode on the cpu without one
+ *
+ * @param in the input buffer
+ * @param out the output buffer
+ * @param len the number of bytes
+ * @param stream the keystream, or NULL
+ * @param iv the initialization vector
+ * @param counter the block counter of the first byte of in
+ * @param x a pointer to the expanded ctx object
+ */
+static void kf_gpu_xor(const uint8_t *in, uint8_t *out, const size_t len,
+                       const uint8_t *stream, const char *iv,
+                       const uint64_t counter, const kf_xctx *x) {
+
+  if (!stream) {
+    kf_ctr_x(in, out, len, iv, counter, x);
+    return;
+  }
+
+  for (size_t i = 0; i < len; i++)
+    out[i] = in[i] ^ stream[i];
+
+  KF_STATS_ADD(blocks, (len + BLOCK_SIZE - 1) / BLOCK_SIZE);
+}
+
+/**
+ * @brief encrypt or decrypt a buffer in counter mode on the gpu.
+ *
+ * the output is identical to kf_ctr_x, which does the work when g is NULL
+ * or len is below KF_GPU_THRESHOLD.
+ *
+ * @param g the gpu object, or NULL
+ * @param in the input buffer
+ * @param out the output buffer
+ * @param len the number of bytes to process
+ * @param iv the initialization vector
+ * @param counter the block index of the first byte of in
+ * @param x a pointer to the expanded ctx object
+ */
+void kf_ctr_gpu(kf_gpu *g, const uint8_t *in, uint8_t *out, const size_t len,
+                const char *iv, const uint64_t counter, const kf_xctx *x) {
+
+  if (!g || len < KF_GPU_THRESHOLD) {
+    kf_ctr_x(in, out, len, iv, counter, x);
+    return;
+  }
+
+  KF_STATS_START(start);
+
+  const size_t nslices = (len + KF_GPU_SLICE - 1) / KF_GPU_SLICE;
+
+  kf_gpu_start(g, 0, iv, counter,
+               (len < KF_GPU_SLICE ? len + BLOCK_SIZE - 1 : KF_GPU_SLICE) /
+                   BLOCK_SIZE);
+
+  for (size_t i = 0; i < nslices; i++) {
+    const size_t done = i * KF_GPU_SLICE;
+    const size_t bytes =
+        len - done < KF_GPU_SLICE ? len - done : KF_GPU_SLICE;
+
+    /* the next slice is generated while this one is applied */
+    if (i + 1 < nslices) {
+      const size_t next = len - done - bytes;
+      const size_t nbytes = next < KF_GPU_SLICE ? next : KF_GPU_SLICE;
+
+      kf_gpu_start(g, (int)((i + 1) & 1), iv,
+                   counter + (done + bytes) / BLOCK_SIZE,
+                   (nbytes + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    }
+
+    kf_gpu_xor(in + done, out + done, bytes, kf_gpu_wait(g, (int)(i & 1)),
+               iv, counter + done / BLOCK_SIZE, x);
+  }
+
+  KF_STATS_STOP(cipher_ns, start);
+}
+
+/**
+ * @brief check whether a file is too small for the gpu
+ *
+ * @param infile the name of the input file
+ * @return int 1 for a regular file below KF_GPU_THRESHOLD bytes, 0 otherwise
+ */
+static int kf_gpu_small(const char *infile) {
+
+#ifdef __unix__
+  struct stat st;
+
+  return strcmp(infile, "-") != 0 && stat(infile, &st) == 0 &&
+         S_ISREG(st.st_mode) && st.st_size < KF_GPU_THRESHOLD;
+#else
+  (void)infile;
+  return 0;
+#endif
+}
+
+/**
+ * @brief run the rest of a file through counter mode on the gpu
+ *
+ * reading the input overlaps with the device generating the keystream of
+ * the slice it is read for, and the xor and the write with the next one.
+ *
+ * @param g the gpu object
+ * @param in the input file
+ * @param out the output file
+ * @param iv the initialization vector
+ * @param x a pointer to the expanded ctx object
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+static int kf_gpu_file(kf_gpu *g, FILE *in, FILE *out, const char *iv,
+                       const kf_xctx *x) {
+
+  uint8_t *data = malloc(KF_GPU_SLICE);
+  if (!data)
+    return KF_ERR_MEMORY;
+
+  const size_t nblocks = KF_GPU_SLICE / BLOCK_SIZE;
+  uint64_t counter = 0;
+  int slot = 0;
+  int status = KF_OK;
+
+  kf_gpu_start(g, slot, iv, counter, nblocks);
+
+  for (;;) {
+    KF_STATS_START(io);
+
+    const size_t got = fread(data, 1, KF_GPU_SLICE, in);
+
+    KF_STATS_ADD(reads, 1);
+    KF_STATS_ADD(bytes_read, got);
+    KF_STATS_STOP(io_ns, io);
+
+    if (got == KF_GPU_SLICE)
+      kf_gpu_start(g, slot ^ 1, iv, counter + nblocks, nblocks);
+
+    const uint8_t *stream = kf_gpu_wait(g, slot);
+
+    if (got < KF_GPU_SLICE && ferror(in)) {
+      status = KF_ERR_READ;
+      break;
+    }
+    if (got == 0)
+      break;
+
+    kf_gpu_xor(data, data, got, stream, iv, counter, x);
+
+    if (fwrite(data, 1, got, out) != got) {
+      status = KF_ERR_WRITE;
+      break;
+    }
+
+    KF_STATS_ADD(writes, 1);
+    KF_STATS_ADD(bytes_written, got);
+
+    if (got < KF_GPU_SLICE)
+      break;
+
+    slot ^= 1;
+    counter += nblocks;
+  }
+
+  /* a slice started ahead of an error is still waited for */
+  kf_gpu_wait(g, slot ^ 1);
+
+  kf_wipe(data, KF_GPU_SLICE);
+  free(data);
+
+  return status;
+}
+
+/**
+ * @brief open the files of a gpu file mode, as the stdio backend does
+ *
+ * @param infile the name of the input file, or "-" for stdin
+ * @param outfile the name of the output file, or "-" for stdout
+ * @param in the input file
+ * @param out the output file
+ * @return int KF_OK, or KF_ERR_OPEN
+ */
+static int kf_gpu_open(const char *infile, const char *outfile, FILE **in,
+                       FILE **out) {
+
+  *in = strcmp(infile, "-") == 0 ? stdin : fopen(infile, "rb");
+  if (!*in)
+    return KF_ERR_OPEN;
+
+  *out = strcmp(outfile, "-") == 0 ? stdout : fopen(outfile, "wb");
+  if (!*out) {
+    if (*in != stdin)
+      fclose(*in);
+    return KF_ERR_OPEN;
+  }
+
+  return KF_OK;
+}
+
+/**
+ * @brief close the files of a gpu file mode
+ *
+ * @param in the input file
+ * @param out the output file
+ * @param status the status of the file mode so far
+ * @return int the status, or KF_ERR_WRITE
+ */
+static int kf_gpu_close(FILE *in, FILE *out, const int status) {
+
+  const int closed = out == stdout ? fflush(out) : fclose(out);
+
+  if (in != stdin)
+    fclose(in);
+
+  return (status == KF_OK && closed != 0) ? KF_ERR_WRITE : status;
+}
+
+/**
+ * @brief encrypt a file with knifefish in counter mode on the gpu.
+ *
+ * the output is identical to kf_encrypt_file_ctr_key, which does the work
+ * with opts when there is no device or the input is a regular file below
+ * KF_GPU_THRESHOLD bytes.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param key a pointer to the key object
+ * @param iv the initialization vector
+ * @param opts the file mode options for the cpu, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_file_ctr_gpu(const char *infile, const char *outfile,
+                            const kf_key *key, const char *iv,
+                            const kf_opts *opts) {
+
+  kf_gpu *g = kf_gpu_small(infile) ? NULL : kf_gpu_create(&key->x);
+
+  if (!g)
+    return kf_encrypt_file_ctr_key(infile, outfile, key, iv, opts);
+
+  FILE *in, *out;
+
+  int status = kf_gpu_open(infile, outfile, &in, &out);
+
+  if (status == KF_OK) {
+    if (fwrite(iv, 1, BLOCK_SIZE, out) != BLOCK_SIZE)
+      status = KF_ERR_WRITE;
+    if (status == KF_OK)
+      status = kf_gpu_file(g, in, out, iv, &key->x);
+    status = kf_gpu_close(in, out, status);
+  }
+
+  kf_gpu_destroy(g);
+
+  return status;
+}
+
+/**
+ * @brief decrypt a file with knifefish in counter mode on the gpu.
+ *
+ * like kf_encrypt_file_ctr_gpu, kf_decrypt_file_ctr_key does the work when
+ * the gpu would not pay off.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param key a pointer to the key object
+ * @param opts the file mode options for the cpu, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_file_ctr_gpu(const char *infile, const char *outfile,
+                            const kf_key *key, const kf_opts *opts) {
+
+  kf_gpu *g = kf_gpu_small(infile) ? NULL : kf_gpu_create(&key->x);
+
+  if (!g)
+    return kf_decrypt_file_ctr_key(infile, outfile, key, opts);
+
+  FILE *in, *out;
+  char iv[BLOCK_SIZE];
+
+  int status = kf_gpu_open(infile, outfile, &in, &out);
+
+  if (status == KF_OK) {
+    if (fread(iv, 1, BLOCK_SIZE, in) != BLOCK_SIZE)
+      status = ferror(in) ? KF_ERR_READ : KF_ERR_FORMAT;
+    if (status == KF_OK)
+      status = kf_gpu_file(g, in, out, iv, &key->x);
+    status = kf_gpu_close(in, out, status);
+  }
+
+  kf_gpu_destroy(g);
+
+  return status;
+}
@@ -0,0 +1,552 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#define _DEFAULT_SOURCE
+
+#include "kf128.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define KF_JIT 1
+#else
+#define KF_JIT 0
+#endif
+
+/*
+ * the jit emits a block function specialised to one schedule: every round
+ * key and white key is an immediate operand, the fused S-box/P-box tables
+ * sit at a fixed address held in a register, and all rounds are unrolled
+ * with the halves swapped by renaming, as in kf_block. two blocks are run
+ * side by side, so the table loads of one overlap the other's, and a single
+ * block body takes an odd block at the end.
+ *
+ * the code is written into a private read-write mapping, which is then made
+ * read-execute, so no page is ever writable and executable at once. when
+ * that is refused, as under a strict W^X policy, on other CPUs, or when
+ * KF128_JIT=off is set, the jit object keeps working through
+ * kf_block_n_k instead.
+ *
+ * only x86-64 has an emitter. the code follows the System V calling
+ * convention: in, out and nblocks arrive in rdi, rsi and rdx.
+ */
+
+#define KF_JIT_MAX (32 << 10)
+
+typedef void (*kf_jit_fn)(const uint32_t *in, uint32_t *out, size_t nblocks);
+
+struct kf_jit {
+  const kf_xctx *x;
+  const kf_sched *k;
+  kf_jit_fn fn;
+  void *code;
+  size_t code_size;
+};
+
+#if KF_JIT
+
+/* x86-64 register numbers */
+#define KF_RAX 0
+#define KF_RCX 1
+#define KF_RDX 2
+#define KF_RBX 3
+#define KF_RBP 5
+#define KF_RSI 6
+#define KF_RDI 7
+#define KF_R15 15
+
+/**
+ * @brief the emitter object holds the code being written.
+ *
+ */
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  int overflow;
+} kf_emit;
+
+/**
+ * @brief the lane object holds the registers of one block in flight.
+ *
+ */
+typedef struct {
+  int l0, l1, r0, r1;
+  int offset;
+} kf_jit_lane;
+
+/**
+ * @brief append one byte
+ *
+ * @param e a pointer to the emitter object
+ * @param b the byte
+ */
+static void kf_emit_byte(kf_emit *e, const uint8_t b) {
+
+  if (e->len < KF_JIT_MAX)
+    e->buf[e->len++] = b;
+  else
+    e->overflow = 1;
+}
+
+/**
+ * @brief append a little endian word
+ *
+ * @param e a pointer to the emitter object
+ * @param v the word
+ * @param bytes the number of bytes, 4 or 8
+ */
+static void kf_emit_word(kf_emit *e, const uint64_t v, const int bytes) {
+
+  for (int i = 0; i < bytes; i++)
+    kf_emit_byte(e, (uint8_t)(v >> (8 * i)));
+}
+
+/**
+ * @brief append a rex prefix when one is needed
+ *
+ * @param e a pointer to the emitter object
+ * @param w 1 for a 64-bit operand
+ * @param reg the register in the reg field
+ * @param rm the register in the rm or base field
+ * @param force 1 to emit the prefix even when it is empty
+ */
+static void kf_emit_rex(kf_emit *e, const int w, const int reg, const int rm,
+                        const int force) {
+
+  const uint8_t rex =
+      (uint8_t)(0x40 | w << 3 | (reg >> 3) << 2 | (rm >> 3));
+
+  if (rex != 0x40 || force)
+    kf_emit_byte(e, rex);
+}
+
+/**
+ * @brief append a register to register instruction
+ *
+ * @param e a pointer to the emitter object
+ * @param w 1 for a 64-bit operand
+ * @param op the opcode
+ * @param reg the register in the reg field
+ * @param rm the register in the rm field
+ */
+static void kf_emit_rr(kf_emit *e, const int w, const uint8_t op,
+                       const int reg, const int rm) {
+
+  kf_emit_rex(e, w, reg, rm, 0);
+  kf_emit_byte(e, op);
+  kf_emit_byte(e, (uint8_t)(0xc0 | (reg & 7) << 3 | (rm & 7)));
+}
+
+/**
+ * @brief append an instruction on a register and an immediate
+ *
+ * @param e a pointer to the emitter object
+ * @param w 1 for a 64-bit operand
+ * @param op the opcode, 0x81 for an imm32, or 0x83 or 0xc1 for an imm8
+ * @param ext the opcode extension in the reg field
+ * @param rm the register
+ * @param imm the immediate
+ */
+static void kf_emit_ri(kf_emit *e, const int w, const uint8_t op,
+                       const int ext, const int rm, const uint32_t imm) {
+
+  kf_emit_rex(e, w, 0, rm, 0);
+  kf_emit_byte(e, op);
+  kf_emit_byte(e, (uint8_t)(0xc0 | ext << 3 | (rm & 7)));
+  kf_emit_word(e, imm, op == 0x81 ? 4 : 1);
+}
+
+/**
+ * @brief append a 32-bit load or store through a base register
+ *
+ * @param e a pointer to the emitter object
+ * @param op 0x8b to load, 0x89 to store
+ * @param reg the register loaded or stored
+ * @param base the base register, rdi or rsi
+ * @param disp the byte offset, below 128
+ */
+static void kf_emit_mem(kf_emit *e, const uint8_t op, const int reg,
+                        const int base, const int disp) {
+
+  kf_emit_rex(e, 0, reg, base, 0);
+  kf_emit_byte(e, op);
+  kf_emit_byte(e, (uint8_t)(0x40 | (reg & 7) << 3 | (base & 7)));
+  kf_emit_byte(e, (uint8_t)disp);
+}
+
+/**
+ * @brief append a 64-bit load or or from a fused table, indexed by rdx
+ *
+ * @param e a pointer to the emitter object
+ * @param op 0x8b to load, 0x0b to or
+ * @param reg the destination register
+ * @param table the table index
+ */
+static void kf_emit_table(kf_emit *e, const uint8_t op, const int reg,
+                          const int table) {
+
+  kf_emit_rex(e, 1, reg, KF_R15, 0);
+  kf_emit_byte(e, op);
+  kf_emit_byte(e, (uint8_t)(0x80 | (reg & 7) << 3 | 4));
+  kf_emit_byte(e, (uint8_t)(3 << 6 | KF_RDX << 3 | (KF_R15 & 7)));
+  kf_emit_word(e, (uint64_t)table * SBOX_SIZE * sizeof(uint64_t), 4);
+}
+
+/**
+ * @brief append a byte of ecx, zero extended into edx
+ *
+ * @param e a pointer to the emitter object
+ * @param high 1 for ch, 0 for cl
+ */
+static void kf_emit_index(kf_emit *e, const int high) {
+
+  kf_emit_byte(e, 0x0f);
+  kf_emit_byte(e, 0xb6);
+  kf_emit_byte(e, (uint8_t)(0xc0 | KF_RDX << 3 | (high ? 5 : KF_RCX)));
+}
+
+/**
+ * @brief append an instruction on the 64-bit word at the top of the stack
+ *
+ * @param e a pointer to the emitter object
+ * @param ext the opcode extension of an 0x83 instruction
+ * @param imm the imm8
+ */
+static void kf_emit_stack(kf_emit *e, const int ext, const uint8_t imm) {
+
+  kf_emit_byte(e, 0x48);
+  kf_emit_byte(e, 0x83);
+  kf_emit_byte(e, (uint8_t)(ext << 3 | 4));
+  kf_emit_byte(e, 0x24);
+  kf_emit_byte(e, imm);
+}
+
+/**
+ * @brief append one round of one lane
+ *
+ * the left half (l0, l1) takes the F function of the right half (r0, r1),
+ * like KF_ROUND.
+ *
+ * @param e a pointer to the emitter object
+ * @param l0 the first word of the left half
+ * @param l1 the second word of the left half
+ * @param r0 the first word of the right half
+ * @param r1 the second word of the right half
+ * @param skey the round key
+ */
+static void kf_emit_round(kf_emit *e, const int l0, const int l1,
+                          const int r0, const int r1,
+                          const uint32_t skey[SKEY_SIZE]) {
+
+  /* the bytes come out of cl and ch, two at a time. the tables of r0 and r1
+   * are gathered in rax and rbp, so the two chains of ors overlap */
+  for (int i = 0; i < SBOX_COUNT; i += 2) {
+    const int acc = i < 4 ? KF_RAX : KF_RBP;
+
+    if (i % 4 == 0)
+      kf_emit_rr(e, 0, 0x89, i < 4 ? r0 : r1, KF_RCX);
+    else
+      kf_emit_ri(e, 0, 0xc1, 5, KF_RCX, 16);
+
+    kf_emit_index(e, 0);
+    kf_emit_table(e, i % 4 == 0 ? 0x8b : 0x0b, acc, i);
+    kf_emit_index(e, 1);
+    kf_emit_table(e, 0x0b, acc, i + 1);
+  }
+
+  kf_emit_rr(e, 1, 0x09, KF_RBP, KF_RAX);
+
+  /* the pseudo-hadamard transform of the low and high halves */
+  kf_emit_rr(e, 1, 0x89, KF_RAX, KF_RCX);
+  kf_emit_ri(e, 1, 0xc1, 5, KF_RCX, 32);
+  kf_emit_rr(e, 0, 0x01, KF_RCX, KF_RAX);
+  kf_emit_rr(e, 0, 0x01, KF_RAX, KF_RCX);
+
+  kf_emit_ri(e, 0, 0x81, 6, KF_RAX, skey[0]);
+  kf_emit_rr(e, 0, 0x31, KF_RAX, l0);
+  kf_emit_ri(e, 0, 0x81, 6, KF_RCX, skey[1]);
+  kf_emit_rr(e, 0, 0x31, KF_RCX, l1);
+}
+
+/**
+ * @brief append the body that runs a number of lanes through the cipher
+ *
+ * @param e a pointer to the emitter object
+ * @param lanes the lanes
+ * @param nlanes the number of lanes
+ * @param k a pointer to the schedule object
+ */
+static void kf_emit_blocks(kf_emit *e, const kf_jit_lane *lanes,
+                           const int nlanes, const kf_sched *k) {
+
+  for (int n = 0; n < nlanes; n++) {
+    const kf_jit_lane *l = &lanes[n];
+    const int regs[4] = {l->l0, l->l1, l->r0, l->r1};
+
+    for (int w = 0; w < 4; w++) {
+      kf_emit_mem(e, 0x8b, regs[w], KF_RDI, l->offset + 4 * w);
+      kf_emit_ri(e, 0, 0x81, 6, regs[w], k->wkey[0][w]);
+    }
+  }
+
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int n = 0; n < nlanes; n++) {
+      const kf_jit_lane *l = &lanes[n];
+
+      if (r % 2 == 0)
+        kf_emit_round(e, l->l0, l->l1, l->r0, l->r1, k->skey[r]);
+      else
+        kf_emit_round(e, l->r0, l->r1, l->l0, l->l1, k->skey[r]);
+    }
+  }
+
+  for (int n = 0; n < nlanes; n++) {
+    const kf_jit_lane *l = &lanes[n];
+    const int regs[4] = {l->r0, l->r1, l->l0, l->l1};
+
+    for (int w = 0; w < 4; w++) {
+      kf_emit_ri(e, 0, 0x81, 6, regs[w], k->wkey[1][w]);
+      kf_emit_mem(e, 0x89, regs[w], KF_RSI, l->offset + 4 * w);
+    }
+  }
+}
+
+/**
+ * @brief append a conditional or unconditional jump with a rel32 to patch
+ *
+ * @param e a pointer to the emitter object
+ * @param cc the condition code, or -1 for an unconditional jump
+ * @return size_t the position of the rel32
+ */
+static size_t kf_emit_jump(kf_emit *e, const int cc) {
+
+  if (cc < 0) {
+    kf_emit_byte(e, 0xe9);
+  } else {
+    kf_emit_byte(e, 0x0f);
+    kf_emit_byte(e, (uint8_t)(0x80 | cc));
+  }
+
+  const size_t at = e->len;
+  kf_emit_word(e, 0, 4);
+
+  return at;
+}
+
+/**
+ * @brief point a jump at a position
+ *
+ * @param e a pointer to the emitter object
+ * @param at the position of the rel32
+ * @param target the position jumped to
+ */
+static void kf_emit_patch(kf_emit *e, const size_t at, const size_t target) {
+
+  const uint32_t rel = (uint32_t)(target - (at + 4));
+
+  if (at + 4 <= e->len)
+    for (int i = 0; i < 4; i++)
+      e->buf[at + i] = (uint8_t)(rel >> (8 * i));
+}
+
+/**
+ * @brief write the specialised function
+ *
+ * @param e a pointer to the emitter object
+ * @param x a pointer to the expanded ctx object
+ * @param k a pointer to the schedule object
+ */
+static void kf_emit_function(kf_emit *e, const kf_xctx *x,
+                             const kf_sched *k) {
+
+  const kf_jit_lane lanes[2] = {{8, 9, 10, 11, 0},
+                                {12, 13, 14, KF_RBX, BLOCK_SIZE}};
+  const int saved[] = {KF_RBX, KF_RBP, 12, 13, 14, 15};
+  const int nsaved = sizeof(saved) / sizeof(saved[0]);
+
+  for (int i = 0; i < nsaved; i++) {
+    kf_emit_rex(e, 0, 0, saved[i], 0);
+    kf_emit_byte(e, (uint8_t)(0x50 | (saved[i] & 7)));
+  }
+
+  /* nblocks moves to the stack, leaving rdx for the table index */
+  kf_emit_byte(e, (uint8_t)(0x50 | KF_RDX));
+
+  /* movabs r15, spbox */
+  kf_emit_rex(e, 1, 0, KF_R15, 0);
+  kf_emit_byte(e, (uint8_t)(0xb8 | (KF_R15 & 7)));
+  kf_emit_word(e, (uint64_t)(uintptr_t)x->spbox, 8);
+
+  /* two blocks at a time while there are two left */
+  const size_t pair = e->len;
+  kf_emit_stack(e, 7, 2);
+  const size_t to_single = kf_emit_jump(e, 0x2);
+
+  kf_emit_blocks(e, lanes, 2, k);
+
+  kf_emit_ri(e, 1, 0x83, 0, KF_RDI, 2 * BLOCK_SIZE);
+  kf_emit_ri(e, 1, 0x83, 0, KF_RSI, 2 * BLOCK_SIZE);
+  kf_emit_stack(e, 5, 2);
+  kf_emit_patch(e, kf_emit_jump(e, -1), pair);
+
+  /* then the last block, if any */
+  kf_emit_patch(e, to_single, e->len);
+  kf_emit_stack(e, 7, 0);
+  const size_t to_done = kf_emit_jump(e, 0x4);
+
+  kf_emit_blocks(e, lanes, 1, k);
+
+  kf_emit_patch(e, to_done, e->len);
+  kf_emit_byte(e, (uint8_t)(0x58 | KF_RDX));
+
+  for (int i = nsaved - 1; i >= 0; i--) {
+    kf_emit_rex(e, 0, 0, saved[i], 0);
+    kf_emit_byte(e, (uint8_t)(0x58 | (saved[i] & 7)));
+  }
+
+  kf_emit_byte(e, 0xc3);
+}
+
+/**
+ * @brief emit the specialised function into an executable mapping
+ *
+ * @param jit a pointer to the jit object
+ * @return int 1 if the code is ready to run, 0 otherwise
+ */
+static int kf_jit_compile(kf_jit *jit) {
+
+  const char *env = getenv("KF128_JIT");
+  if (env && strcmp(env, "off") == 0)
+    return 0;
+
+  kf_emit e = {malloc(KF_JIT_MAX), 0, 0};
+  if (!e.buf)
+    return 0;
+
+  kf_emit_function(&e, jit->x, jit->k);
+
+  const long page = sysconf(_SC_PAGESIZE);
+  const size_t size =
+      page > 0 ? (e.len + (size_t)page - 1) / (size_t)page * (size_t)page
+               : e.len;
+
+  void *code = e.overflow ? MAP_FAILED
+                          : mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (code != MAP_FAILED) {
+    memcpy(code, e.buf, e.len);
+
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+      kf_wipe(code, size);
+      munmap(code, size);
+      code = MAP_FAILED;
+    }
+  }
+
+  kf_wipe(e.buf, KF_JIT_MAX);
+  free(e.buf);
+
+  if (code == MAP_FAILED)
+    return 0;
+
+  jit->code = code;
+  jit->code_size = size;
+  memcpy(&jit->fn, &code, sizeof(jit->fn));
+
+  return 1;
+}
+
+#else
+
+static int kf_jit_compile(kf_jit *jit) {
+
+  (void)jit;
+
+  return 0;
+}
+
+#endif
+
+/**
+ * @brief build a block function specialised to one key.
+ *
+ * the code reads the fused tables of x, so x and k must outlive the jit
+ * object. when no code can be emitted the object still works, through the
+ * multi-block kernels.
+ *
+ * @param x a pointer to the expanded ctx object
+ * @param k a pointer to the schedule object, x->sched to encrypt or an
+ * inverted schedule to decrypt
+ * @return kf_jit* the jit object, or NULL when out of memory
+ */
+kf_jit *kf_jit_create(const kf_xctx *x, const kf_sched *k) {
+
+  kf_jit *jit = calloc(1, sizeof(kf_jit));
+  if (!jit)
+    return NULL;
+
+  jit->x = x;
+  jit->k = k;
+
+  kf_jit_compile(jit);
+
+  return jit;
+}
+
+/**
+ * @brief tell whether a jit object runs emitted code.
+ *
+ * @param jit a pointer to the jit object
+ * @return int 1 for emitted code, 0 for the fallback
+ */
+int kf_jit_native(const kf_jit *jit) { return jit->fn != NULL; }
+
+/**
+ * @brief run independent blocks through a specialised block function.
+ *
+ * the output is identical to kf_block_n_k with the x and k the jit object
+ * was built for. in and out may point to the same buffer.
+ *
+ * @param jit a pointer to the jit object
+ * @param in the input blocks
+ * @param out the output blocks
+ * @param nblocks the number of 128-bit blocks
+ */
+void kf_jit_block_n(const kf_jit *jit, const uint32_t *in, uint32_t *out,
+                    size_t nblocks) {
+
+  if (jit->fn)
+    jit->fn(in, out, nblocks);
+  else
+    kf_block_n_k(in, out, nblocks, jit->x, jit->k);
+}
+
+/**
+ * @brief free a jit object and its code.
+ *
+ * the code holds every round key and white key as immediates, so it is made
+ * writable again and wiped before it is unmapped.
+ *
+ * @param jit a pointer to the jit object, or NULL
+ */
+void kf_jit_destroy(kf_jit *jit) {
+
+  if (!jit)
+    return;
+
+#if KF_JIT
+  if (jit->code) {
+    if (mprotect(jit->code, jit->code_size, PROT_READ | PROT_WRITE) == 0)
+      kf_wipe(jit->code, jit->code_size);
+    munmap(jit->code, jit->code_size);
+  }
+#endif
+
+  free(jit);
+}
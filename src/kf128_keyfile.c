@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#define _DEFAULT_SOURCE
+
+#include "kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * a keyfile holds a key object exactly as it sits in memory, both
+ * directions with the fused tables, after a KF_KEYFILE_HEADER byte header:
+ *
+ *   offset size
+ *        0    8  KF_KEYFILE_MAGIC
+ *        8    4  KF_KEYFILE_VERSION, little endian
+ *       12    4  0x01020304 in the byte order of the writer
+ *       16    8  the size of the key object, little endian
+ *       24    8  the checksum of the key object, little endian
+ *       32   32  zero
+ *
+ * the key object starts on a 64 byte boundary of a mapping, so it is used
+ * straight from the page cache with nothing parsed or copied, and processes
+ * mapping the same file share its pages. the layout of the key object is
+ * that of the build which wrote it, and a file from a build with another
+ * byte order or key size is refused. the checksum catches a damaged or
+ * truncated file; it is not a mac, and the file must be kept as secret as a
+ * passphrase.
+ */
+
+#define KF_KEYFILE_BYTE_ORDER 0x01020304u
+
+static void kf_keyfile_put32(uint8_t *p, const uint32_t v) {
+
+  for (int i = 0; i < 4; i++)
+    p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static void kf_keyfile_put64(uint8_t *p, const uint64_t v) {
+
+  for (int i = 0; i < 8; i++)
+    p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t kf_keyfile_get32(const uint8_t *p) {
+
+  uint32_t v = 0;
+
+  for (int i = 3; i >= 0; i--)
+    v = (v << 8) | p[i];
+
+  return v;
+}
+
+static uint64_t kf_keyfile_get64(const uint8_t *p) {
+
+  uint64_t v = 0;
+
+  for (int i = 7; i >= 0; i--)
+    v = (v << 8) | p[i];
+
+  return v;
+}
+
+/**
+ * @brief checksum a key object, FNV-1a over its 64-bit words
+ *
+ * @param key a pointer to the key object
+ * @return uint64_t the checksum
+ */
+static uint64_t kf_keyfile_sum(const kf_key *key) {
+
+  const uint8_t *p = (const uint8_t *)key;
+  uint64_t h = 0xcbf29ce484222325u;
+
+  for (size_t i = 0; i + 8 <= sizeof(kf_key); i += 8) {
+    uint64_t w;
+
+    memcpy(&w, p + i, 8);
+    h = (h ^ w) * 0x100000001b3u;
+  }
+
+  return h;
+}
+
+/**
+ * @brief build the header of a keyfile
+ *
+ * @param key a pointer to the key object
+ * @param header the output header, KF_KEYFILE_HEADER bytes
+ */
+static void kf_keyfile_header(const kf_key *key, uint8_t *header) {
+
+  const uint32_t order = KF_KEYFILE_BYTE_ORDER;
+
+  memset(header, 0, KF_KEYFILE_HEADER);
+  memcpy(header, KF_KEYFILE_MAGIC, 8);
+  kf_keyfile_put32(header + 8, KF_KEYFILE_VERSION);
+  memcpy(header + 12, &order, 4);
+  kf_keyfile_put64(header + 16, sizeof(kf_key));
+  kf_keyfile_put64(header + 24, kf_keyfile_sum(key));
+}
+
+/**
+ * @brief check a keyfile read into memory
+ *
+ * @param data the whole file
+ * @param size the size of the file in bytes
+ * @return int KF_OK, or KF_ERR_FORMAT if it is not a keyfile of this build
+ */
+static int kf_keyfile_check(const uint8_t *data, const size_t size) {
+
+  uint32_t order;
+
+  if (size != KF_KEYFILE_HEADER + sizeof(kf_key))
+    return KF_ERR_FORMAT;
+
+  memcpy(&order, data + 12, 4);
+
+  if (memcmp(data, KF_KEYFILE_MAGIC, 8) != 0 ||
+      kf_keyfile_get32(data + 8) != KF_KEYFILE_VERSION ||
+      order != KF_KEYFILE_BYTE_ORDER ||
+      kf_keyfile_get64(data + 16) != sizeof(kf_key))
+    return KF_ERR_FORMAT;
+
+  const kf_key *key = (const kf_key *)(data + KF_KEYFILE_HEADER);
+
+  return kf_keyfile_get64(data + 24) == kf_keyfile_sum(key) ? KF_OK
+                                                            : KF_ERR_FORMAT;
+}
+
+/**
+ * @brief write a key object to a keyfile.
+ *
+ * on unix the file is created readable by its owner only.
+ *
+ * @param key a pointer to the key object
+ * @param name the name of the keyfile
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_key_export(const kf_key *key, const char *name) {
+
+  uint8_t header[KF_KEYFILE_HEADER];
+
+  kf_keyfile_header(key, header);
+
+#ifdef __unix__
+  const int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  FILE *f = fd < 0 ? NULL : fdopen(fd, "wb");
+
+  if (!f && fd >= 0)
+    close(fd);
+#else
+  FILE *f = fopen(name, "wb");
+#endif
+
+  if (!f)
+    return KF_ERR_OPEN;
+
+  int failed = fwrite(header, 1, sizeof(header), f) != sizeof(header) ||
+               fwrite(key, 1, sizeof(kf_key), f) != sizeof(kf_key);
+
+  failed |= fclose(f) != 0;
+
+  if (failed) {
+    remove(name);
+    return KF_ERR_WRITE;
+  }
+
+  return KF_OK;
+}
+
+/**
+ * @brief open a keyfile written by kf_key_export.
+ *
+ * on unix the file is mapped read-only and kf->key points into the mapping;
+ * elsewhere it is read into memory. either way the key is ready for every
+ * function taking a key object until kf_keyfile_close.
+ *
+ * @param kf a pointer to the keyfile object
+ * @param name the name of the keyfile
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_keyfile_open(kf_keyfile *kf, const char *name) {
+
+  KF_STATS_START(start);
+
+  memset(kf, 0, sizeof(*kf));
+
+#ifdef __unix__
+  struct stat st;
+  const int fd = open(name, O_RDONLY);
+
+  if (fd < 0)
+    return KF_ERR_OPEN;
+
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return KF_ERR_READ;
+  }
+
+  const size_t size = (size_t)st.st_size;
+
+  if (size != KF_KEYFILE_HEADER + sizeof(kf_key)) {
+    close(fd);
+    return KF_ERR_FORMAT;
+  }
+
+  void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED)
+    return KF_ERR_READ;
+
+  KF_STATS_ADD(maps, 1);
+#else
+  FILE *f = fopen(name, "rb");
+
+  if (!f)
+    return KF_ERR_OPEN;
+
+  const size_t size = KF_KEYFILE_HEADER + sizeof(kf_key);
+  uint8_t *data = malloc(size + 1);
+
+  if (!data) {
+    fclose(f);
+    return KF_ERR_MEMORY;
+  }
+
+  /* one byte more than a keyfile holds tells a longer file apart */
+  const size_t got = fread(data, 1, size + 1, f);
+  fclose(f);
+
+  if (got != size) {
+    kf_wipe(data, size + 1);
+    free(data);
+    return KF_ERR_FORMAT;
+  }
+#endif
+
+  kf->data = data;
+  kf->size = size;
+
+  const int status = kf_keyfile_check(data, size);
+
+  if (status != KF_OK) {
+    kf_keyfile_close(kf);
+    return status;
+  }
+
+  kf->key = (const kf_key *)((const uint8_t *)data + KF_KEYFILE_HEADER);
+
+  KF_STATS_ADD(keys, 1);
+  KF_STATS_ADD(bytes_read, size);
+  KF_STATS_STOP(key_ns, start);
+
+  return KF_OK;
+}
+
+/**
+ * @brief close a keyfile opened by kf_keyfile_open.
+ *
+ * a key read into memory is wiped; a mapped key lives on in the page cache
+ * like the file itself.
+ *
+ * @param kf a pointer to the keyfile object
+ */
+void kf_keyfile_close(kf_keyfile *kf) {
+
+  if (!kf->data)
+    return;
+
+#ifdef __unix__
+  munmap(kf->data, kf->size);
+#else
+  kf_wipe(kf->data, kf->size);
+  free(kf->data);
+#endif
+
+  memset(kf, 0, sizeof(*kf));
+}
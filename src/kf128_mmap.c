@@ -0,0 +1,413 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#define _DEFAULT_SOURCE
+
+#include "kf128.h"
+
+#include <string.h>
+
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * the mmap backend maps the input file, creates the output file at its final
+ * size and maps it too, and runs the cipher from one mapping straight into
+ * the other. the only copies left are the iv and the last block, which holds
+ * the padding. the output is identical to the stdio backend.
+ *
+ * the space of the output is reserved with posix_fallocate before it is
+ * mapped, since a store to a page the filesystem can not back raises
+ * SIGBUS instead of failing. when the space can not be reserved the file
+ * mode falls back to stdio, which reports a full disk as a write failure.
+ * the output is synced before it is unmapped, so a writeback error is
+ * returned too.
+ */
+
+static const kf_opts kf_stdio_opts = {0, 0, KF_BACKEND_STDIO};
+
+/**
+ * @brief the map object holds one mapped file.
+ *
+ */
+typedef struct {
+  int fd;
+  uint8_t *data;
+  size_t size;
+  int output;
+} kf_map;
+
+/**
+ * @brief map a whole file for reading
+ *
+ * @param name the name of the file
+ * @param map the map object
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+static int kf_map_input(const char *name, kf_map *map) {
+
+  struct stat st;
+
+  map->data = NULL;
+  map->output = 0;
+  map->fd = open(name, O_RDONLY);
+  if (map->fd < 0)
+    return KF_ERR_OPEN;
+
+  if (fstat(map->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(map->fd);
+    return KF_ERR_READ;
+  }
+
+  map->size = (size_t)st.st_size;
+  if (map->size == 0)
+    return KF_OK;
+
+  void *data = mmap(NULL, map->size, PROT_READ, MAP_SHARED, map->fd, 0);
+  if (data == MAP_FAILED) {
+    close(map->fd);
+    return KF_ERR_READ;
+  }
+
+  madvise(data, map->size, MADV_SEQUENTIAL);
+  map->data = data;
+
+  KF_STATS_ADD(maps, 1);
+  KF_STATS_ADD(bytes_read, map->size);
+
+  return KF_OK;
+}
+
+/**
+ * @brief create a file of the given size and map it for writing
+ *
+ * @param name the name of the file
+ * @param size the size of the file in bytes
+ * @param map the map object
+ * @return int KF_OK, KF_ERR_UNSUPPORTED if the space could not be reserved
+ * and the caller should fall back to stdio, or another KF_ERR_* status
+ */
+static int kf_map_output(const char *name, const size_t size, kf_map *map) {
+
+  map->data = NULL;
+  map->size = size;
+  map->output = 1;
+  map->fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (map->fd < 0)
+    return KF_ERR_OPEN;
+
+  if (size == 0)
+    return KF_OK;
+
+  if (posix_fallocate(map->fd, 0, (off_t)size) != 0) {
+    close(map->fd);
+    return KF_ERR_UNSUPPORTED;
+  }
+
+  void *data =
+      mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+  if (data == MAP_FAILED) {
+    close(map->fd);
+    return KF_ERR_WRITE;
+  }
+
+  madvise(data, size, MADV_SEQUENTIAL);
+  map->data = data;
+
+  KF_STATS_ADD(maps, 1);
+  KF_STATS_ADD(bytes_written, size);
+
+  return KF_OK;
+}
+
+/**
+ * @brief unmap and close a mapped file
+ *
+ * an output file is synced first.
+ *
+ * @param map the map object
+ * @param status the status of the file mode so far
+ * @return int the status, or KF_ERR_WRITE if the file could not be synced or
+ * closed
+ */
+static int kf_unmap(kf_map *map, const int status) {
+
+  int failed = 0;
+
+  if (map->data && map->output)
+    failed |= msync(map->data, map->size, MS_SYNC);
+  if (map->data)
+    failed |= munmap(map->data, map->size);
+
+  failed |= close(map->fd);
+
+  return (status == KF_OK && failed) ? KF_ERR_WRITE : status;
+}
+
+/**
+ * @brief check whether the file modes should use the mmap backend
+ *
+ * stdin and stdout can not be mapped, so "-" always uses stdio.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int 1 to use the mmap backend, 0 to use stdio
+ */
+int kf_mmap_wanted(const char *infile, const char *outfile,
+                   const kf_opts *opts) {
+
+  const int backend = opts ? opts->backend : KF_BACKEND_AUTO;
+  struct stat st;
+
+  if (strcmp(infile, "-") == 0 || strcmp(outfile, "-") == 0)
+    return 0;
+
+  if (backend != KF_BACKEND_AUTO)
+    return backend == KF_BACKEND_MMAP;
+
+  return stat(infile, &st) == 0 && S_ISREG(st.st_mode) &&
+         st.st_size >= KF_MMAP_THRESHOLD;
+}
+
+/**
+ * @brief encrypt a file with knifefish in cipher-block-chaining mode through
+ * memory maps.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param key a pointer to the key object
+ * @param iv the initialization vector
+ * @param padding random padding
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_file_cbc_mmap(const char *infile, const char *outfile,
+                             const kf_key *key, const char *iv,
+                             const char *padding) {
+
+  kf_map in, out;
+
+  int status = kf_map_input(infile, &in);
+  if (status != KF_OK)
+    return status;
+
+  const size_t nblocks = in.size / BLOCK_SIZE;
+  const size_t remaining = in.size % BLOCK_SIZE;
+
+  status = kf_map_output(outfile, (nblocks + 2) * BLOCK_SIZE, &out);
+  if (status == KF_ERR_UNSUPPORTED) {
+    kf_unmap(&in, KF_OK);
+    return kf_encrypt_file_cbc_key(infile, outfile, key, iv, padding,
+                                   &kf_stdio_opts);
+  }
+  if (status != KF_OK)
+    return kf_unmap(&in, status);
+
+  uint32_t chain[4];
+  uint32_t last[4] = {0};
+
+  memcpy(chain, iv, BLOCK_SIZE);
+  memcpy(out.data, iv, BLOCK_SIZE);
+
+  uint32_t *cipher = (uint32_t *)(out.data + BLOCK_SIZE);
+
+  KF_STATS_START(start);
+
+  kf_cbc_encrypt_blocks((const uint32_t *)in.data, cipher, nblocks, chain,
+                        &key->x);
+
+  if (remaining != 0) {
+    memcpy(last, padding, BLOCK_SIZE);
+    memcpy(last, in.data + nblocks * BLOCK_SIZE, remaining);
+    ((uint8_t *)last)[BLOCK_SIZE - 1] = (uint8_t)remaining;
+  }
+
+  kf_cbc_encrypt_blocks(last, cipher + 4 * nblocks, 1, chain, &key->x);
+
+  KF_STATS_ADD(blocks, nblocks + 1);
+  KF_STATS_STOP(cipher_ns, start);
+
+  return kf_unmap(&in, kf_unmap(&out, status));
+}
+
+/**
+ * @brief decrypt a file with knifefish in cipher-block-chaining mode through
+ * memory maps.
+ *
+ * the last block is decrypted first to learn the size of the plaintext, so
+ * the output can be created at its final size before the rest is decrypted
+ * into it.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param key a pointer to the key object
+ * @param opts the file mode options, or NULL for the defaults
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_file_cbc_mmap(const char *infile, const char *outfile,
+                             const kf_key *key, const kf_opts *opts) {
+
+  kf_map in, out;
+
+  int status = kf_map_input(infile, &in);
+  if (status != KF_OK)
+    return status;
+
+  if (in.size % BLOCK_SIZE != 0 || in.size < 2 * BLOCK_SIZE)
+    return kf_unmap(&in, KF_ERR_FORMAT);
+
+  const uint32_t *cipher = (const uint32_t *)in.data;
+  const size_t nblocks = in.size / BLOCK_SIZE - 1;
+
+  uint32_t last[4];
+
+  kf_cbc_decrypt_blocks(cipher + 4 * nblocks, last, 1, key, 1);
+
+  const uint8_t remaining = ((uint8_t *)last)[BLOCK_SIZE - 1];
+  if (remaining >= BLOCK_SIZE)
+    return kf_unmap(&in, KF_ERR_FORMAT);
+
+  const size_t full = (nblocks - 1) * BLOCK_SIZE;
+
+  status = kf_map_output(outfile, full + remaining, &out);
+  if (status == KF_ERR_UNSUPPORTED) {
+    kf_opts stdio = *(opts ? opts : &kf_stdio_opts);
+
+    stdio.backend = KF_BACKEND_STDIO;
+    kf_unmap(&in, KF_OK);
+    return kf_decrypt_file_cbc_key(infile, outfile, key, &stdio);
+  }
+  if (status != KF_OK)
+    return kf_unmap(&in, status);
+
+  if (out.data) {
+    kf_cbc_decrypt_blocks(cipher + 4, (uint32_t *)out.data, nblocks - 1, key,
+                          opts ? opts->threads : 1);
+    memcpy(out.data + full, last, remaining);
+  }
+
+  return kf_unmap(&in, kf_unmap(&out, status));
+}
+
+/**
+ * @brief encrypt a file with knifefish in counter mode through memory maps.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param key a pointer to the key object
+ * @param iv the initialization vector
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_encrypt_file_ctr_mmap(const char *infile, const char *outfile,
+                             const kf_key *key, const char *iv) {
+
+  kf_map in, out;
+
+  int status = kf_map_input(infile, &in);
+  if (status != KF_OK)
+    return status;
+
+  status = kf_map_output(outfile, in.size + BLOCK_SIZE, &out);
+  if (status == KF_ERR_UNSUPPORTED) {
+    kf_unmap(&in, KF_OK);
+    return kf_encrypt_file_ctr_key(infile, outfile, key, iv, &kf_stdio_opts);
+  }
+  if (status != KF_OK)
+    return kf_unmap(&in, status);
+
+  memcpy(out.data, iv, BLOCK_SIZE);
+
+  if (in.data)
+    kf_ctr_x(in.data, out.data + BLOCK_SIZE, in.size, iv, 0, &key->x);
+
+  return kf_unmap(&in, kf_unmap(&out, status));
+}
+
+/**
+ * @brief decrypt a file with knifefish in counter mode through memory maps.
+ *
+ * @param infile the name of the input file
+ * @param outfile the name of the output file
+ * @param key a pointer to the key object
+ * @return int KF_OK, or a KF_ERR_* status
+ */
+int kf_decrypt_file_ctr_mmap(const char *infile, const char *outfile,
+                             const kf_key *key) {
+
+  kf_map in, out;
+
+  int status = kf_map_input(infile, &in);
+  if (status != KF_OK)
+    return status;
+
+  if (in.size < BLOCK_SIZE)
+    return kf_unmap(&in, KF_ERR_FORMAT);
+
+  status = kf_map_output(outfile, in.size - BLOCK_SIZE, &out);
+  if (status == KF_ERR_UNSUPPORTED) {
+    kf_unmap(&in, KF_OK);
+    return kf_decrypt_file_ctr_key(infile, outfile, key, &kf_stdio_opts);
+  }
+  if (status != KF_OK)
+    return kf_unmap(&in, status);
+
+  if (out.data)
+    kf_ctr_x(in.data + BLOCK_SIZE, out.data, out.size, (const char *)in.data,
+             0, &key->x);
+
+  return kf_unmap(&in, kf_unmap(&out, status));
+}
+
+#else
+
+/*
+ * without mmap the backend is never picked, and forcing it falls back to the
+ * stdio backend.
+ */
+
+static const kf_opts kf_stdio_opts = {0, 0, KF_BACKEND_STDIO};
+
+int kf_mmap_wanted(const char *infile, const char *outfile,
+                   const kf_opts *opts) {
+
+  (void)infile;
+  (void)outfile;
+  (void)opts;
+  return 0;
+}
+
+int kf_encrypt_file_cbc_mmap(const char *infile, const char *outfile,
+                             const kf_key *key, const char *iv,
+                             const char *padding) {
+
+  return kf_encrypt_file_cbc_key(infile, outfile, key, iv, padding,
+                                 &kf_stdio_opts);
+}
+
+int kf_decrypt_file_cbc_mmap(const char *infile, const char *outfile,
+                             const kf_key *key, const kf_opts *opts) {
+
+  kf_opts stdio = *(opts ? opts : &kf_stdio_opts);
+
+  stdio.backend = KF_BACKEND_STDIO;
+  return kf_decrypt_file_cbc_key(infile, outfile, key, &stdio);
+}
+
+int kf_encrypt_file_ctr_mmap(const char *infile, const char *outfile,
+                             const kf_key *key, const char *iv) {
+
+  return kf_encrypt_file_ctr_key(infile, outfile, key, iv, &kf_stdio_opts);
+}
+
+int kf_decrypt_file_ctr_mmap(const char *infile, const char *outfile,
+                             const kf_key *key) {
+
+  return kf_decrypt_file_ctr_key(infile, outfile, key, &kf_stdio_opts);
+}
+
+#endif
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "kf128.h"
+
+#include <string.h>
+
+/*
+ * poly1305 as in RFC 8439, evaluated in radix 2^26 so every product fits in
+ * 64 bits. it authenticates the aead mode, where a one-time key is drawn
+ * from the keystream for every message. a key must never be used twice.
+ */
+
+#define KF_POLY_MASK 0x3ffffff
+#define KF_POLY_HIBIT (1u << 24)
+
+/**
+ * @brief load a little endian 32-bit word
+ *
+ * @param p the bytes
+ * @return uint32_t the word
+ */
+static uint32_t kf_poly_get32(const uint8_t *p) {
+
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+/**
+ * @brief store a little endian 32-bit word
+ *
+ * @param p the bytes
+ * @param v the word
+ */
+static void kf_poly_put32(uint8_t *p, const uint32_t v) {
+
+  for (int i = 0; i < 4; i++)
+    p[i] = (uint8_t)(v >> (8 * i));
+}
+
+/**
+ * @brief start a poly1305 mac.
+ *
+ * @param p a pointer to the poly1305 object
+ * @param key the one-time key, r followed by s
+ */
+void kf_poly1305_init(kf_poly1305 *p, const uint8_t key[KF_POLY_KEY_SIZE]) {
+
+  p->r[0] = kf_poly_get32(key + 0) & 0x3ffffff;
+  p->r[1] = (kf_poly_get32(key + 3) >> 2) & 0x3ffff03;
+  p->r[2] = (kf_poly_get32(key + 6) >> 4) & 0x3ffc0ff;
+  p->r[3] = (kf_poly_get32(key + 9) >> 6) & 0x3f03fff;
+  p->r[4] = (kf_poly_get32(key + 12) >> 8) & 0x00fffff;
+
+  for (int i = 0; i < 5; i++)
+    p->h[i] = 0;
+
+  for (int i = 0; i < 4; i++)
+    p->pad[i] = kf_poly_get32(key + 16 + 4 * i);
+
+  p->leftover = 0;
+}
+
+/**
+ * @brief absorb whole 16-byte blocks
+ *
+ * @param p a pointer to the poly1305 object
+ * @param m the message bytes
+ * @param len the number of bytes, a multiple of 16
+ * @param hibit KF_POLY_HIBIT, or 0 for a final block that is already padded
+ */
+static void kf_poly1305_blocks(kf_poly1305 *p, const uint8_t *m, size_t len,
+                               const uint32_t hibit) {
+
+  const uint32_t r0 = p->r[0], r1 = p->r[1], r2 = p->r[2], r3 = p->r[3],
+                 r4 = p->r[4];
+  const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+
+  uint32_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2], h3 = p->h[3],
+           h4 = p->h[4];
+
+  for (; len >= KF_POLY_BLOCK; m += KF_POLY_BLOCK, len -= KF_POLY_BLOCK) {
+    h0 += kf_poly_get32(m + 0) & KF_POLY_MASK;
+    h1 += (kf_poly_get32(m + 3) >> 2) & KF_POLY_MASK;
+    h2 += (kf_poly_get32(m + 6) >> 4) & KF_POLY_MASK;
+    h3 += (kf_poly_get32(m + 9) >> 6) & KF_POLY_MASK;
+    h4 += (kf_poly_get32(m + 12) >> 8) | hibit;
+
+    uint64_t d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 + (uint64_t)h2 * s3 +
+                  (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+    uint64_t d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 + (uint64_t)h2 * s4 +
+                  (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+    uint64_t d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 + (uint64_t)h2 * r0 +
+                  (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+    uint64_t d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 + (uint64_t)h2 * r1 +
+                  (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+    uint64_t d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 + (uint64_t)h2 * r2 +
+                  (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+
+    uint32_t c = (uint32_t)(d0 >> 26);
+    h0 = (uint32_t)d0 & KF_POLY_MASK;
+    d1 += c;
+    c = (uint32_t)(d1 >> 26);
+    h1 = (uint32_t)d1 & KF_POLY_MASK;
+    d2 += c;
+    c = (uint32_t)(d2 >> 26);
+    h2 = (uint32_t)d2 & KF_POLY_MASK;
+    d3 += c;
+    c = (uint32_t)(d3 >> 26);
+    h3 = (uint32_t)d3 & KF_POLY_MASK;
+    d4 += c;
+    c = (uint32_t)(d4 >> 26);
+    h4 = (uint32_t)d4 & KF_POLY_MASK;
+    h0 += c * 5;
+    c = h0 >> 26;
+    h0 &= KF_POLY_MASK;
+    h1 += c;
+  }
+
+  p->h[0] = h0;
+  p->h[1] = h1;
+  p->h[2] = h2;
+  p->h[3] = h3;
+  p->h[4] = h4;
+}
+
+/**
+ * @brief add message bytes to a poly1305 mac.
+ *
+ * the message can be passed in pieces of any length.
+ *
+ * @param p a pointer to the poly1305 object
+ * @param m the message bytes
+ * @param len the number of bytes
+ */
+void kf_poly1305_update(kf_poly1305 *p, const uint8_t *m, size_t len) {
+
+  if (p->leftover) {
+    size_t want = KF_POLY_BLOCK - p->leftover;
+    if (want > len)
+      want = len;
+
+    memcpy(p->buffer + p->leftover, m, want);
+    p->leftover += want;
+    m += want;
+    len -= want;
+
+    if (p->leftover < KF_POLY_BLOCK)
+      return;
+
+    kf_poly1305_blocks(p, p->buffer, KF_POLY_BLOCK, KF_POLY_HIBIT);
+    p->leftover = 0;
+  }
+
+  const size_t whole = len / KF_POLY_BLOCK * KF_POLY_BLOCK;
+
+  kf_poly1305_blocks(p, m, whole, KF_POLY_HIBIT);
+
+  memcpy(p->buffer, m + whole, len - whole);
+  p->leftover = len - whole;
+}
+
+/**
+ * @brief finish a poly1305 mac.
+ *
+ * the object is wiped afterwards.
+ *
+ * @param p a pointer to the poly1305 object
+ * @param tag the 16-byte tag
+ */
+void kf_poly1305_final(kf_poly1305 *p, uint8_t tag[KF_TAG_SIZE]) {
+
+  if (p->leftover) {
+    p->buffer[p->leftover] = 1;
+    memset(p->buffer + p->leftover + 1, 0,
+           KF_POLY_BLOCK - p->leftover - 1);
+    kf_poly1305_blocks(p, p->buffer, KF_POLY_BLOCK, 0);
+  }
+
+  uint32_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2], h3 = p->h[3],
+           h4 = p->h[4];
+
+  /* carry all the way through */
+  uint32_t c = h1 >> 26;
+  h1 &= KF_POLY_MASK;
+  h2 += c;
+  c = h2 >> 26;
+  h2 &= KF_POLY_MASK;
+  h3 += c;
+  c = h3 >> 26;
+  h3 &= KF_POLY_MASK;
+  h4 += c;
+  c = h4 >> 26;
+  h4 &= KF_POLY_MASK;
+  h0 += c * 5;
+  c = h0 >> 26;
+  h0 &= KF_POLY_MASK;
+  h1 += c;
+
+  /* g = h + 5 - 2^130, kept only when it does not go negative */
+  uint32_t g0 = h0 + 5;
+  c = g0 >> 26;
+  g0 &= KF_POLY_MASK;
+  uint32_t g1 = h1 + c;
+  c = g1 >> 26;
+  g1 &= KF_POLY_MASK;
+  uint32_t g2 = h2 + c;
+  c = g2 >> 26;
+  g2 &= KF_POLY_MASK;
+  uint32_t g3 = h3 + c;
+  c = g3 >> 26;
+  g3 &= KF_POLY_MASK;
+  uint32_t g4 = h4 + c - (1u << 26);
+
+  uint32_t mask = (g4 >> 31) - 1;
+  h0 = (h0 & ~mask) | (g0 & mask);
+  h1 = (h1 & ~mask) | (g1 & mask);
+  h2 = (h2 & ~mask) | (g2 & mask);
+  h3 = (h3 & ~mask) | (g3 & mask);
+  h4 = (h4 & ~mask) | (g4 & mask);
+
+  /* h mod 2^128, plus s */
+  h0 = h0 | (h1 << 26);
+  h1 = (h1 >> 6) | (h2 << 20);
+  h2 = (h2 >> 12) | (h3 << 14);
+  h3 = (h3 >> 18) | (h4 << 8);
+
+  uint64_t f = (uint64_t)h0 + p->pad[0];
+  kf_poly_put32(tag + 0, (uint32_t)f);
+  f = (uint64_t)h1 + p->pad[1] + (f >> 32);
+  kf_poly_put32(tag + 4, (uint32_t)f);
+  f = (uint64_t)h2 + p->pad[2] + (f >> 32);
+  kf_poly_put32(tag + 8, (uint32_t)f);
+  f = (uint64_t)h3 + p->pad[3] + (f >> 32);
+  kf_poly_put32(tag + 12, (uint32_t)f);
+
+  kf_wipe(p, sizeof(*p));
+}
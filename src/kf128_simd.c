@@ -0,0 +1,508 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "kf128.h"
+
+#include <string.h>
+
+#if KF_X86_SIMD
+#include <immintrin.h>
+
+#define KF_TARGET_AVX2 __attribute__((target("avx2")))
+#define KF_TARGET_AVX512                                                       \
+  __attribute__((target("avx2,avx512f,avx512bw,avx512vbmi")))
+
+/*
+ * the SIMD engines keep a group of blocks in "byte-lane" form: register k
+ * holds byte k of every block in the group. the P-box then becomes a
+ * renaming of registers, and every S-box lookup substitutes a whole register
+ * with the same S-box. the pseudo-hadamard transform is done as a 32-bit
+ * vector add after moving the F output into word-lane form and back.
+ *
+ * all of the shuffles used work inside 128-bit lanes, so the AVX2 and
+ * AVX-512 engines have the same structure and only differ in width and in
+ * how the S-box lookup is done.
+ */
+
+/**
+ * @brief transpose 16 rows of 16 bytes in every 128-bit lane
+ *
+ * four rounds of interleaving row i with row i + 8 transpose the matrix, and
+ * the transpose is its own inverse.
+ *
+ * @param r the 16 registers
+ */
+static inline KF_TARGET_AVX2 void kf_transpose_avx2(__m256i r[16]) {
+
+  __m256i t[16];
+
+  for (int stage = 0; stage < 4; stage++) {
+    for (int i = 0; i < 8; i++) {
+      t[2 * i] = _mm256_unpacklo_epi8(r[i], r[i + 8]);
+      t[2 * i + 1] = _mm256_unpackhi_epi8(r[i], r[i + 8]);
+    }
+    for (int i = 0; i < 16; i++)
+      r[i] = t[i];
+  }
+}
+
+/**
+ * @brief substitute every byte of a register through one S-box
+ *
+ * vpshufb looks up 16 entries at a time, so the S-box is walked in 16
+ * chunks. bytes whose high nibble does not select the current chunk are
+ * pushed above 0x7F by a saturating add, which makes vpshufb return zero for
+ * them. every chunk is visited for every byte, so the lookup runs in
+ * constant time.
+ *
+ * @param idx the input bytes
+ * @param s the S-box
+ * @return __m256i the substituted bytes
+ */
+static inline KF_TARGET_AVX2 __m256i kf_sbox_avx2(const __m256i idx,
+                                                  const uint8_t *s) {
+
+  const __m256i bias = _mm256_set1_epi8(0x70);
+
+  __m256i r = _mm256_setzero_si256();
+
+  for (int c = 0; c < 16; c++) {
+    const __m256i table = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)(s + 16 * c)));
+    __m256i j = _mm256_xor_si256(idx, _mm256_set1_epi8((char)(c << 4)));
+    j = _mm256_adds_epu8(j, bias);
+    r = _mm256_or_si256(r, _mm256_shuffle_epi8(table, j));
+  }
+
+  return r;
+}
+
+/**
+ * @brief move 4 byte-lane registers into word-lane form
+ *
+ * @param b the byte-lane registers, least significant byte first
+ * @param w the word-lane registers
+ */
+static inline KF_TARGET_AVX2 void kf_to_words_avx2(const __m256i b[4],
+                                                   __m256i w[4]) {
+
+  const __m256i t0 = _mm256_unpacklo_epi8(b[0], b[1]);
+  const __m256i t1 = _mm256_unpackhi_epi8(b[0], b[1]);
+  const __m256i t2 = _mm256_unpacklo_epi8(b[2], b[3]);
+  const __m256i t3 = _mm256_unpackhi_epi8(b[2], b[3]);
+
+  w[0] = _mm256_unpacklo_epi16(t0, t2);
+  w[1] = _mm256_unpackhi_epi16(t0, t2);
+  w[2] = _mm256_unpacklo_epi16(t1, t3);
+  w[3] = _mm256_unpackhi_epi16(t1, t3);
+}
+
+/**
+ * @brief move 4 word-lane registers back into byte-lane form
+ *
+ * @param w the word-lane registers
+ * @param b the byte-lane registers, least significant byte first
+ */
+static inline KF_TARGET_AVX2 void kf_to_bytes_avx2(const __m256i w[4],
+                                                   __m256i b[4]) {
+
+  const __m256i gather = _mm256_setr_epi8(
+      0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15, 0, 4, 8, 12, 1, 5,
+      9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+
+  const __m256i u0 = _mm256_shuffle_epi8(w[0], gather);
+  const __m256i u1 = _mm256_shuffle_epi8(w[1], gather);
+  const __m256i u2 = _mm256_shuffle_epi8(w[2], gather);
+  const __m256i u3 = _mm256_shuffle_epi8(w[3], gather);
+
+  const __m256i x01 = _mm256_unpacklo_epi32(u0, u1);
+  const __m256i x23 = _mm256_unpacklo_epi32(u2, u3);
+  const __m256i y01 = _mm256_unpackhi_epi32(u0, u1);
+  const __m256i y23 = _mm256_unpackhi_epi32(u2, u3);
+
+  b[0] = _mm256_unpacklo_epi64(x01, x23);
+  b[1] = _mm256_unpackhi_epi64(x01, x23);
+  b[2] = _mm256_unpacklo_epi64(y01, y23);
+  b[3] = _mm256_unpackhi_epi64(y01, y23);
+}
+
+/**
+ * @brief the pseudo-hadamard transform on byte-lane registers
+ *
+ * a_prime = a + b and b_prime = a_prime + b, computed as 32-bit adds.
+ *
+ * @param t the 8 byte-lane registers of the F output, bytes of a first
+ */
+static inline KF_TARGET_AVX2 void kf_pht_avx2(__m256i t[8]) {
+
+  __m256i a[4], b[4];
+
+  kf_to_words_avx2(t, a);
+  kf_to_words_avx2(t + 4, b);
+
+  for (int i = 0; i < 4; i++) {
+    a[i] = _mm256_add_epi32(a[i], b[i]);
+    b[i] = _mm256_add_epi32(a[i], b[i]);
+  }
+
+  kf_to_bytes_avx2(a, t);
+  kf_to_bytes_avx2(b, t + 4);
+}
+
+/**
+ * @brief run 32 blocks through the cipher with AVX2
+ *
+ * @param in 32 input blocks
+ * @param out 32 output blocks
+ * @param ctx a pointer to the ctx object
+ * @param k a pointer to the schedule object
+ */
+static KF_TARGET_AVX2 void kf_block_group_avx2(const uint32_t *in,
+                                               uint32_t *out,
+                                               const kf_ctx *ctx,
+                                               const kf_sched *k) {
+
+  const uint8_t *w0 = (const uint8_t *)k->wkey[0];
+  const uint8_t *w1 = (const uint8_t *)k->wkey[1];
+
+  __m256i s[16], t[8];
+
+  for (int i = 0; i < 16; i++)
+    s[i] = _mm256_loadu_si256((const __m256i *)(in + 8 * i));
+
+  kf_transpose_avx2(s);
+
+  for (int j = 0; j < 16; j++)
+    s[j] = _mm256_xor_si256(s[j], _mm256_set1_epi8((char)w0[j]));
+
+  for (int r = 0; r < ROUNDS; r++) {
+    const uint8_t *sk = (const uint8_t *)k->skey[r];
+
+    for (int i = 0; i < SBOX_COUNT; i++)
+      t[ctx->pbox[i]] = kf_sbox_avx2(s[8 + i], ctx->sbox[i]);
+
+    kf_pht_avx2(t);
+
+    for (int j = 0; j < 8; j++) {
+      t[j] = _mm256_xor_si256(t[j], _mm256_set1_epi8((char)sk[j]));
+      t[j] = _mm256_xor_si256(t[j], s[j]);
+    }
+
+    for (int j = 0; j < 8; j++) {
+      if (r != ROUNDS - 1) {
+        s[j] = s[8 + j];
+        s[8 + j] = t[j];
+      } else {
+        s[j] = t[j];
+      }
+    }
+  }
+
+  for (int j = 0; j < 16; j++)
+    s[j] = _mm256_xor_si256(s[j], _mm256_set1_epi8((char)w1[j]));
+
+  kf_transpose_avx2(s);
+
+  for (int i = 0; i < 16; i++)
+    _mm256_storeu_si256((__m256i *)(out + 8 * i), s[i]);
+}
+
+/**
+ * @brief the AVX2 multi-block function
+ *
+ * blocks are processed 32 at a time with constant-time S-box lookups, and
+ * any remaining blocks are padded out to a group of 32, so no block goes
+ * through the table lookups of kf_block_n_scalar. the output is identical to
+ * kf_block_n. the caller must check that the CPU supports AVX2.
+ *
+ * @param in the input blocks
+ * @param out the output blocks
+ * @param nblocks the number of 128-bit blocks
+ * @param ctx a pointer to the ctx object
+ */
+void kf_block_n_avx2(const uint32_t *in, uint32_t *out, size_t nblocks,
+                     const kf_ctx *ctx) {
+
+  kf_sched k;
+
+  kf_sched_ctx(ctx, &k);
+  kf_block_n_avx2_k(in, out, nblocks, ctx, &k);
+}
+
+/**
+ * @brief the AVX2 multi-block function with an explicit key schedule
+ *
+ * @param in the input blocks
+ * @param out the output blocks
+ * @param nblocks the number of 128-bit blocks
+ * @param ctx a pointer to the ctx object
+ * @param k a pointer to the schedule object
+ */
+KF_TARGET_AVX2 void kf_block_n_avx2_k(const uint32_t *in, uint32_t *out,
+                                      size_t nblocks, const kf_ctx *ctx,
+                                      const kf_sched *k) {
+
+  size_t i = 0;
+
+  for (; i + 32 <= nblocks; i += 32) {
+    kf_block_group_avx2(in + 4 * i, out + 4 * i, ctx, k);
+  }
+
+  if (i == nblocks)
+    return;
+
+  uint32_t pad[4 * 32] = {0};
+  const size_t bytes = (nblocks - i) * BLOCK_SIZE;
+
+  memcpy(pad, in + 4 * i, bytes);
+  kf_block_group_avx2(pad, pad, ctx, k);
+  memcpy(out + 4 * i, pad, bytes);
+
+  kf_wipe(pad, sizeof(pad));
+}
+
+/**
+ * @brief transpose 16 rows of 16 bytes in every 128-bit lane
+ *
+ * @param r the 16 registers
+ */
+static inline KF_TARGET_AVX512 void kf_transpose_avx512(__m512i r[16]) {
+
+  __m512i t[16];
+
+  for (int stage = 0; stage < 4; stage++) {
+    for (int i = 0; i < 8; i++) {
+      t[2 * i] = _mm512_unpacklo_epi8(r[i], r[i + 8]);
+      t[2 * i + 1] = _mm512_unpackhi_epi8(r[i], r[i + 8]);
+    }
+    for (int i = 0; i < 16; i++)
+      r[i] = t[i];
+  }
+}
+
+/**
+ * @brief substitute every byte of a register through one S-box
+ *
+ * the 256-byte S-box fits in four 64-byte registers. vpermi2b looks up the
+ * low 7 bits of every index in each half of the S-box, and the high bit
+ * picks one of the two results. the lookup runs in constant time.
+ *
+ * @param idx the input bytes
+ * @param s the S-box
+ * @return __m512i the substituted bytes
+ */
+static inline KF_TARGET_AVX512 __m512i kf_sbox_avx512(const __m512i idx,
+                                                      const uint8_t *s) {
+
+  const __m512i t0 = _mm512_loadu_si512((const void *)(s + 0));
+  const __m512i t1 = _mm512_loadu_si512((const void *)(s + 64));
+  const __m512i t2 = _mm512_loadu_si512((const void *)(s + 128));
+  const __m512i t3 = _mm512_loadu_si512((const void *)(s + 192));
+
+  const __m512i lo = _mm512_permutex2var_epi8(t0, idx, t1);
+  const __m512i hi = _mm512_permutex2var_epi8(t2, idx, t3);
+
+  return _mm512_mask_blend_epi8(_mm512_movepi8_mask(idx), lo, hi);
+}
+
+/**
+ * @brief move 4 byte-lane registers into word-lane form
+ *
+ * @param b the byte-lane registers, least significant byte first
+ * @param w the word-lane registers
+ */
+static inline KF_TARGET_AVX512 void kf_to_words_avx512(const __m512i b[4],
+                                                       __m512i w[4]) {
+
+  const __m512i t0 = _mm512_unpacklo_epi8(b[0], b[1]);
+  const __m512i t1 = _mm512_unpackhi_epi8(b[0], b[1]);
+  const __m512i t2 = _mm512_unpacklo_epi8(b[2], b[3]);
+  const __m512i t3 = _mm512_unpackhi_epi8(b[2], b[3]);
+
+  w[0] = _mm512_unpacklo_epi16(t0, t2);
+  w[1] = _mm512_unpackhi_epi16(t0, t2);
+  w[2] = _mm512_unpacklo_epi16(t1, t3);
+  w[3] = _mm512_unpackhi_epi16(t1, t3);
+}
+
+/**
+ * @brief move 4 word-lane registers back into byte-lane form
+ *
+ * @param w the word-lane registers
+ * @param b the byte-lane registers, least significant byte first
+ */
+static inline KF_TARGET_AVX512 void kf_to_bytes_avx512(const __m512i w[4],
+                                                       __m512i b[4]) {
+
+  const __m512i gather = _mm512_broadcast_i32x4(
+      _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15));
+
+  const __m512i u0 = _mm512_shuffle_epi8(w[0], gather);
+  const __m512i u1 = _mm512_shuffle_epi8(w[1], gather);
+  const __m512i u2 = _mm512_shuffle_epi8(w[2], gather);
+  const __m512i u3 = _mm512_shuffle_epi8(w[3], gather);
+
+  const __m512i x01 = _mm512_unpacklo_epi32(u0, u1);
+  const __m512i x23 = _mm512_unpacklo_epi32(u2, u3);
+  const __m512i y01 = _mm512_unpackhi_epi32(u0, u1);
+  const __m512i y23 = _mm512_unpackhi_epi32(u2, u3);
+
+  b[0] = _mm512_unpacklo_epi64(x01, x23);
+  b[1] = _mm512_unpackhi_epi64(x01, x23);
+  b[2] = _mm512_unpacklo_epi64(y01, y23);
+  b[3] = _mm512_unpackhi_epi64(y01, y23);
+}
+
+/**
+ * @brief the pseudo-hadamard transform on byte-lane registers
+ *
+ * @param t the 8 byte-lane registers of the F output, bytes of a first
+ */
+static inline KF_TARGET_AVX512 void kf_pht_avx512(__m512i t[8]) {
+
+  __m512i a[4], b[4];
+
+  kf_to_words_avx512(t, a);
+  kf_to_words_avx512(t + 4, b);
+
+  for (int i = 0; i < 4; i++) {
+    a[i] = _mm512_add_epi32(a[i], b[i]);
+    b[i] = _mm512_add_epi32(a[i], b[i]);
+  }
+
+  kf_to_bytes_avx512(a, t);
+  kf_to_bytes_avx512(b, t + 4);
+}
+
+/**
+ * @brief run 64 blocks through the cipher with AVX-512
+ *
+ * @param in 64 input blocks
+ * @param out 64 output blocks
+ * @param ctx a pointer to the ctx object
+ * @param k a pointer to the schedule object
+ */
+static KF_TARGET_AVX512 void kf_block_group_avx512(const uint32_t *in,
+                                                   uint32_t *out,
+                                                   const kf_ctx *ctx,
+                                                   const kf_sched *k) {
+
+  const uint8_t *w0 = (const uint8_t *)k->wkey[0];
+  const uint8_t *w1 = (const uint8_t *)k->wkey[1];
+
+  __m512i s[16], t[8];
+
+  for (int i = 0; i < 16; i++)
+    s[i] = _mm512_loadu_si512((const void *)(in + 16 * i));
+
+  kf_transpose_avx512(s);
+
+  for (int j = 0; j < 16; j++)
+    s[j] = _mm512_xor_si512(s[j], _mm512_set1_epi8((char)w0[j]));
+
+  for (int r = 0; r < ROUNDS; r++) {
+    const uint8_t *sk = (const uint8_t *)k->skey[r];
+
+    for (int i = 0; i < SBOX_COUNT; i++)
+      t[ctx->pbox[i]] = kf_sbox_avx512(s[8 + i], ctx->sbox[i]);
+
+    kf_pht_avx512(t);
+
+    for (int j = 0; j < 8; j++) {
+      t[j] = _mm512_xor_si512(t[j], _mm512_set1_epi8((char)sk[j]));
+      t[j] = _mm512_xor_si512(t[j], s[j]);
+    }
+
+    for (int j = 0; j < 8; j++) {
+      if (r != ROUNDS - 1) {
+        s[j] = s[8 + j];
+        s[8 + j] = t[j];
+      } else {
+        s[j] = t[j];
+      }
+    }
+  }
+
+  for (int j = 0; j < 16; j++)
+    s[j] = _mm512_xor_si512(s[j], _mm512_set1_epi8((char)w1[j]));
+
+  kf_transpose_avx512(s);
+
+  for (int i = 0; i < 16; i++)
+    _mm512_storeu_si512((void *)(out + 16 * i), s[i]);
+}
+
+/**
+ * @brief the AVX-512 VBMI multi-block function
+ *
+ * blocks are processed 64 at a time with constant-time S-box lookups, and
+ * any remaining blocks go through kf_block_n_avx2_k, which pads out its own
+ * remainder. the output is identical
+ * to kf_block_n. the caller must check that the CPU supports AVX-512 F, BW
+ * and VBMI.
+ *
+ * @param in the input blocks
+ * @param out the output blocks
+ * @param nblocks the number of 128-bit blocks
+ * @param ctx a pointer to the ctx object
+ */
+void kf_block_n_avx512(const uint32_t *in, uint32_t *out, size_t nblocks,
+                       const kf_ctx *ctx) {
+
+  kf_sched k;
+
+  kf_sched_ctx(ctx, &k);
+  kf_block_n_avx512_k(in, out, nblocks, ctx, &k);
+}
+
+/**
+ * @brief the AVX-512 VBMI multi-block function with an explicit key schedule
+ *
+ * @param in the input blocks
+ * @param out the output blocks
+ * @param nblocks the number of 128-bit blocks
+ * @param ctx a pointer to the ctx object
+ * @param k a pointer to the schedule object
+ */
+KF_TARGET_AVX512 void kf_block_n_avx512_k(const uint32_t *in, uint32_t *out,
+                                          size_t nblocks, const kf_ctx *ctx,
+                                          const kf_sched *k) {
+
+  size_t i = 0;
+
+  for (; i + 64 <= nblocks; i += 64) {
+    kf_block_group_avx512(in + 4 * i, out + 4 * i, ctx, k);
+  }
+
+  kf_block_n_avx2_k(in + 4 * i, out + 4 * i, nblocks - i, ctx, k);
+}
+
+#else
+
+void kf_block_n_avx2(const uint32_t *in, uint32_t *out, size_t nblocks,
+                     const kf_ctx *ctx) {
+
+  kf_block_n_scalar(in, out, nblocks, ctx);
+}
+
+void kf_block_n_avx2_k(const uint32_t *in, uint32_t *out, size_t nblocks,
+                       const kf_ctx *ctx, const kf_sched *k) {
+
+  kf_block_n_scalar_k(in, out, nblocks, ctx, k);
+}
+
+void kf_block_n_avx512(const uint32_t *in, uint32_t *out, size_t nblocks,
+                       const kf_ctx *ctx) {
+
+  kf_block_n_scalar(in, out, nblocks, ctx);
+}
+
+void kf_block_n_avx512_k(const uint32_t *in, uint32_t *out, size_t nblocks,
+                         const kf_ctx *ctx, const kf_sched *k) {
+
+  kf_block_n_scalar_k(in, out, nblocks, ctx, k);
+}
+
+#endif // KF_X86_SIMD
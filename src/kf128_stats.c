@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "kf128.h"
+
+#include <string.h>
+#include <time.h>
+
+/*
+ * the counters are plain globals bumped with relaxed atomic adds, so worker
+ * threads can count without a lock. they are only read as a snapshot, which
+ * is exact once every file mode has returned.
+ */
+
+#if KF_STATS
+
+kf_stats kf_stats_counters;
+
+#endif
+
+/**
+ * @brief read the monotonic clock
+ *
+ * @return uint64_t the time in nanoseconds
+ */
+uint64_t kf_stats_now(void) {
+
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#else
+  return (uint64_t)clock() * (1000000000u / CLOCKS_PER_SEC);
+#endif
+}
+
+/**
+ * @brief check whether the library was built with instrumentation
+ *
+ * @return int 1 if the counters are kept, 0 if they were compiled out
+ */
+int kf_stats_enabled(void) { return KF_STATS; }
+
+/**
+ * @brief take a snapshot of the counters
+ *
+ * @param stats the stats object
+ */
+void kf_stats_get(kf_stats *stats) {
+
+#if KF_STATS
+  memcpy(stats, &kf_stats_counters, sizeof(kf_stats));
+#else
+  memset(stats, 0, sizeof(kf_stats));
+#endif
+}
+
+/**
+ * @brief set every counter back to zero
+ *
+ * must not be called while a file mode is running.
+ */
+void kf_stats_reset(void) {
+
+#if KF_STATS
+  memset(&kf_stats_counters, 0, sizeof(kf_stats));
+#endif
+}
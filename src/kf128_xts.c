@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "kf128.h"
+
+#include <string.h>
+
+/*
+ * the xts mode encrypts every sector on its own, addressed by its number,
+ * with nothing stored beside it. block j of sector s is
+ *
+ *   C = E(P ^ T) ^ T, T = E(s) * a^(j + 1)
+ *
+ * where s is a little endian 128-bit number and the product is in
+ * GF(2^128) with the xts polynomial x^128 + x^7 + x^2 + x + 1. the tweak and
+ * the data are encrypted under the same key, which is the XEX construction,
+ * so one passphrase expansion is enough. the exponent starts at 1: with a^0
+ * the mask of block 0 would be E(s) itself, and a zero ciphertext block
+ * would decrypt to s ^ E(s), handing out the masks of the sector. sector
+ * numbers and data blocks are both gathered KF_XTS_BATCH blocks at a time
+ * and passed to the multi-block kernel, so a call on many sectors runs at
+ * the kernel's throughput.
+ */
+
+#define KF_XTS_BATCH KF_CTR_BATCH
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define KF_XTS_WORD(w) __builtin_bswap32(w)
+#else
+#define KF_XTS_WORD(w) (w)
+#endif
+
+/**
+ * @brief load a block as the low and high halves of a little endian number
+ *
+ * @param w the block
+ * @param lo the low 64 bits
+ * @param hi the high 64 bits
+ */
+static void kf_xts_load(const uint32_t *w, uint64_t *lo, uint64_t *hi) {
+
+  *lo = KF_XTS_WORD(w[0]) | (uint64_t)KF_XTS_WORD(w[1]) << 32;
+  *hi = KF_XTS_WORD(w[2]) | (uint64_t)KF_XTS_WORD(w[3]) << 32;
+}
+
+/**
+ * @brief store the low and high halves of a little endian number as a block
+ *
+ * @param w the block
+ * @param lo the low 64 bits
+ * @param hi the high 64 bits
+ */
+static void kf_xts_store(uint32_t *w, const uint64_t lo, const uint64_t hi) {
+
+  w[0] = KF_XTS_WORD((uint32_t)lo);
+  w[1] = KF_XTS_WORD((uint32_t)(lo >> 32));
+  w[2] = KF_XTS_WORD((uint32_t)hi);
+  w[3] = KF_XTS_WORD((uint32_t)(hi >> 32));
+}
+
+/**
+ * @brief multiply a tweak by a in GF(2^128)
+ *
+ * @param lo the low 64 bits of the tweak
+ * @param hi the high 64 bits of the tweak
+ */
+static void kf_xts_double(uint64_t *lo, uint64_t *hi) {
+
+  const uint64_t carry = *hi >> 63;
+
+  *hi = *hi << 1 | *lo >> 63;
+  *lo = *lo << 1 ^ (0x87 & (0 - carry));
+}
+
+/**
+ * @brief set up sector encryption.
+ *
+ * @param xts a pointer to the xts object
+ * @param key a pointer to the key object, which must outlive the xts object
+ * @param sector_size the sector size in bytes, a multiple of BLOCK_SIZE
+ * @return int KF_OK, or KF_ERR_FORMAT for an unusable sector size
+ */
+int kf_xts_init(kf_xts *xts, const kf_key *key, const size_t sector_size) {
+
+  if (sector_size == 0 || sector_size % BLOCK_SIZE != 0)
+    return KF_ERR_FORMAT;
+
+  xts->key = key;
+  xts->sector_size = sector_size;
+
+  return KF_OK;
+}
+
+/**
+ * @brief encrypt or decrypt consecutive sectors with knifefish in xts mode.
+ *
+ * sector i of the buffers is sector first_sector + i of the device, and is
+ * independent of every other sector, so any run of sectors can be passed in
+ * any order and in calls of any size. in and out may point to the same
+ * buffer.
+ *
+ * @param xts a pointer to the xts object
+ * @param first_sector the number of the first sector
+ * @param nsectors the number of sectors
+ * @param in the input sectors
+ * @param out the output sectors
+ * @param encrypt 1 to encrypt, 0 to decrypt
+ */
+void kf_xts_sectors(const kf_xts *xts, const uint64_t first_sector,
+                    const size_t nsectors, const uint8_t *in, uint8_t *out,
+                    const int encrypt) {
+
+  uint32_t tweaks[KF_XTS_BATCH * 4];
+  uint32_t sectors[KF_XTS_BATCH * 4];
+  uint32_t data[KF_XTS_BATCH * 4];
+
+  const kf_key *key = xts->key;
+  const size_t per_sector = xts->sector_size / BLOCK_SIZE;
+
+  KF_STATS_START(start);
+
+  for (size_t s = 0; s < nsectors; s += KF_XTS_BATCH) {
+    const size_t left = nsectors - s;
+    const size_t group = left < KF_XTS_BATCH ? left : KF_XTS_BATCH;
+
+    /* the tweaks of a group of sectors, a few are quicker one by one */
+    for (size_t i = 0; i < group; i++)
+      kf_xts_store(sectors + 4 * i, first_sector + s + i, 0);
+
+    if (group < KF_LANES) {
+      for (size_t i = 0; i < group; i++)
+        kf_block_x(sectors + 4 * i, sectors + 4 * i, &key->x);
+    } else {
+      kf_block_n_x(sectors, sectors, group, &key->x);
+    }
+
+    const size_t nblocks = group * per_sector;
+    const uint8_t *src = in + s * xts->sector_size;
+    uint8_t *dst = out + s * xts->sector_size;
+
+    uint64_t lo = 0, hi = 0;
+    size_t sector = 0, j = 0;
+
+    for (size_t b = 0; b < nblocks; b += KF_XTS_BATCH) {
+      const size_t rest = nblocks - b;
+      const size_t n = rest < KF_XTS_BATCH ? rest : KF_XTS_BATCH;
+
+      for (size_t i = 0; i < n; i++, j++) {
+        if (j == per_sector)
+          j = 0;
+
+        if (j == 0)
+          kf_xts_load(sectors + 4 * sector++, &lo, &hi);
+        kf_xts_double(&lo, &hi);
+
+        kf_xts_store(tweaks + 4 * i, lo, hi);
+      }
+
+      memcpy(data, src + BLOCK_SIZE * b, n * BLOCK_SIZE);
+      for (size_t i = 0; i < 4 * n; i++)
+        data[i] ^= tweaks[i];
+
+      if (encrypt)
+        kf_block_n_x(data, data, n, &key->x);
+      else
+        kf_block_n_k(data, data, n, &key->x, &key->inv);
+
+      for (size_t i = 0; i < 4 * n; i++)
+        data[i] ^= tweaks[i];
+      memcpy(dst + BLOCK_SIZE * b, data, n * BLOCK_SIZE);
+    }
+  }
+
+  KF_STATS_ADD(blocks, nsectors * per_sector);
+  KF_STATS_STOP(cipher_ns, start);
+}
@@ -3,16 +3,23 @@
  *
  * See LICENSE for licensing information */
 
+#define _DEFAULT_SOURCE
+
 #include "kf128.h"
 
 #include <getopt.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #ifdef __unix__
+#include <dirent.h>
+#include <sys/stat.h>
 #include <termios.h>
 #elif _WIN32
+#include <fcntl.h>
+#include <io.h>
 #include <windows.h>
 #include <ntsecapi.h>
 #endif
@@ -45,14 +52,438 @@ void usage(void) {
   printf("Usage: ./kf128 [options]\n\n");
   printf("-e\t--encrypt \t-Encrypt mode.\n");
   printf("-d\t--decrypt \t-Decrypt mode.\n");
-  printf("-i\t--input   \t-Input file.\n");
-  printf("-o\t--output  \t-Output file.\n");
+  printf("-i\t--input   \t-Input file, or - for stdin.\n");
+  printf("-o\t--output  \t-Output file, or - for stdout.\n");
   printf("-p\t--pass    \t-The passphrase.\n");
-  printf("-k\t--iv      \t-The initialization vector.\n");
+  printf("-k\t--iv      \t-The initialization vector, not for ctr or "
+         "aead.\n");
+  printf("-m\t--mode    \t-Cipher mode: cbc (default), ctr, chunked or "
+         "aead.\n");
+  printf("-j\t--threads \t-Worker threads for cbc decryption, batch and "
+         "chunked.\n");
+  printf("-b\t--buffer  \t-File buffer size in bytes, k or m suffix "
+         "allowed.\n");
+  printf("-I\t--io      \t-File backend: auto (default), stdio, mmap, async "
+         "or threads.\n");
+  printf("-K\t--kernel  \t-Force a cipher kernel: scalar, fused, avx2, "
+         "avx512.\n");
+  printf("-B\t--batch   \t-Run every file of a manifest or directory tree "
+         "under one key.\n");
+  printf("   \t--device  \t-Run ctr mode on the cpu (default) or the gpu.\n");
+  printf("   \t--stats   \t-Print counters and timings, or --stats=json.\n");
+  printf("   \t--chunk   \t-Chunk size of the chunked mode, 64k by default.\n");
+  printf("   \t--update  \t-Rewrite only the changed chunks of the output.\n");
+  printf("   \t--compress\t-Deflate the chunks first, or --compress=1-9.\n");
+  printf("   \t--keyfile \t-Use the key in a keyfile instead of a "
+         "passphrase.\n");
+  printf("   \t--export  \t-Write the key of the passphrase to a keyfile.\n");
+  printf("   \t--offset  \t-First byte to decrypt in chunked mode.\n");
+  printf("   \t--length  \t-Number of bytes to decrypt in chunked mode.\n");
   printf("-h\t--help    \t-Show help.\n");
   printf("\n");
 }
 
+void print_stats(FILE *f, int json) {
+  kf_stats s;
+  kf_stats_get(&s);
+
+  if (!kf_stats_enabled()) {
+    fprintf(f, "Error: the library was built without KF_STATS, rebuild it "
+               "with make STATS=1.\n");
+    return;
+  }
+
+  if (json) {
+    fprintf(f,
+            "{\"bytes_read\": %" PRIu64 ", \"bytes_written\": %" PRIu64
+            ", \"blocks\": %" PRIu64 ", \"reads\": %" PRIu64
+            ", \"writes\": %" PRIu64 ", \"maps\": %" PRIu64
+            ", \"keys\": %" PRIu64 ", \"key_ns\": %" PRIu64
+            ", \"io_ns\": %" PRIu64 ", \"cipher_ns\": %" PRIu64
+            ", \"mac_ns\": %" PRIu64 "}\n",
+            s.bytes_read, s.bytes_written, s.blocks, s.reads, s.writes,
+            s.maps, s.keys, s.key_ns, s.io_ns, s.cipher_ns, s.mac_ns);
+    return;
+  }
+
+  fprintf(f, "bytes read:    %" PRIu64 "\n", s.bytes_read);
+  fprintf(f, "bytes written: %" PRIu64 "\n", s.bytes_written);
+  fprintf(f, "blocks:        %" PRIu64 "\n", s.blocks);
+  fprintf(f,
+          "io calls:      %" PRIu64 " reads, %" PRIu64 " writes, %" PRIu64
+          " maps\n",
+          s.reads, s.writes, s.maps);
+  fprintf(f, "key setup:     %.3f ms (%" PRIu64 " keys)\n", s.key_ns / 1e6,
+          s.keys);
+  fprintf(f, "io wait:       %.3f ms\n", s.io_ns / 1e6);
+  fprintf(f, "cipher:        %.3f ms\n", s.cipher_ns / 1e6);
+  fprintf(f, "mac:           %.3f ms\n", s.mac_ns / 1e6);
+}
+
+/*
+ * a batch manifest holds one file per line, the input and output names
+ * separated by a tab. empty lines and lines starting with # are skipped.
+ * a batch directory is walked recursively, and every regular file is
+ * written to the same relative path under the output directory.
+ */
+
+typedef struct {
+  kf_batch_job *jobs;
+  size_t count;
+  size_t capacity;
+} job_list;
+
+char *copy_string(const char *s, size_t len) {
+  char *copy = malloc(len + 1);
+  if (copy) {
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+  }
+  return copy;
+}
+
+char *join_path(const char *dir, const char *name) {
+  const size_t a = strlen(dir), b = strlen(name);
+  char *path = malloc(a + b + 2);
+  if (path) {
+    memcpy(path, dir, a);
+    path[a] = '/';
+    memcpy(path + a + 1, name, b + 1);
+  }
+  return path;
+}
+
+int add_job(job_list *list, char *in, char *out) {
+  if (!in || !out) {
+    free(in);
+    free(out);
+    return -1;
+  }
+
+  if (list->count == list->capacity) {
+    size_t capacity = list->capacity ? 2 * list->capacity : 64;
+    kf_batch_job *jobs = realloc(list->jobs, capacity * sizeof(kf_batch_job));
+    if (!jobs) {
+      free(in);
+      free(out);
+      return -1;
+    }
+    list->jobs = jobs;
+    list->capacity = capacity;
+  }
+
+  kf_batch_job *job = &list->jobs[list->count++];
+  memset(job, 0, sizeof(*job));
+  job->infile = in;
+  job->outfile = out;
+  return 0;
+}
+
+int read_manifest(job_list *list, const char *name) {
+  FILE *f = fopen(name, "r");
+  char line[2 * MAX_FILE_PATH + 4];
+
+  if (!f) {
+    printf("Error: cant open manifest: %s\n", name);
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0' || line[0] == '#')
+      continue;
+
+    char *tab = strchr(line, '\t');
+    if (!tab) {
+      printf("Error: manifest line has no tab: %s\n", line);
+      fclose(f);
+      return -1;
+    }
+
+    if (add_job(list, copy_string(line, tab - line),
+                copy_string(tab + 1, strlen(tab + 1))) != 0) {
+      fclose(f);
+      return -1;
+    }
+  }
+
+  fclose(f);
+  return 0;
+}
+
+int is_directory(const char *name) {
+#ifdef __unix__
+  struct stat st;
+  return stat(name, &st) == 0 && S_ISDIR(st.st_mode);
+#else
+  (void)name;
+  return 0;
+#endif
+}
+
+#ifdef __unix__
+
+int walk_tree(job_list *list, const char *indir, const char *outdir) {
+  DIR *dir = opendir(indir);
+  struct dirent *entry;
+  int result = 0;
+
+  if (!dir) {
+    printf("Error: cant open directory: %s\n", indir);
+    return -1;
+  }
+
+  mkdir(outdir, 0777);
+
+  while (result == 0 && (entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+
+    char *in = join_path(indir, entry->d_name);
+    char *out = join_path(outdir, entry->d_name);
+    struct stat st;
+
+    if (!in || !out || stat(in, &st) != 0) {
+      free(in);
+      free(out);
+    } else if (S_ISDIR(st.st_mode)) {
+      result = walk_tree(list, in, out);
+      free(in);
+      free(out);
+    } else if (S_ISREG(st.st_mode)) {
+      result = add_job(list, in, out);
+    } else {
+      free(in);
+      free(out);
+    }
+  }
+
+  closedir(dir);
+  return result;
+}
+
+#endif
+
+int fill_random(char *buffer, size_t len) {
+#ifdef __unix__
+  FILE *in = fopen("/dev/urandom", "r");
+  if (!in)
+    return -1;
+  size_t got = fread(buffer, sizeof(char), len, in);
+  fclose(in);
+  return got == len ? 0 : -1;
+#elif _WIN32
+  return RtlGenRandom(buffer, (ULONG)len) ? 0 : -1;
+#else
+  (void)buffer;
+  (void)len;
+  return -1;
+#endif
+}
+
+int parse_size(const char *arg, uint64_t *size) {
+  char *end;
+  *size = strtoull(arg, &end, 10);
+  if (end == arg)
+    return -1;
+  if (*end == 'k' || *end == 'K') {
+    *size <<= 10;
+    end++;
+  } else if (*end == 'm' || *end == 'M') {
+    *size <<= 20;
+    end++;
+  } else if (*end == 'g' || *end == 'G') {
+    *size <<= 30;
+    end++;
+  }
+  return *end == '\0' ? 0 : -1;
+}
+
+void read_passphrase(char *pass, char *pass2) {
+  int first = 1;
+  do {
+    if (!first) {
+      printf("Error: passwords do not match.\n");
+    }
+
+    printf("password:");
+#ifdef __unix__
+    set_input_mode();
+#endif
+    fgets(pass, MAX_PASS, stdin);
+    printf("\nrepeat:");
+    fgets(pass2, MAX_PASS, stdin);
+#ifdef __unix__
+    reset_input_mode();
+#endif
+    printf("\n");
+
+    first = 0;
+  } while (memcmp(pass, pass2, MAX_PASS) != 0);
+}
+
+/*
+ * the key comes from a keyfile when one is given, mapped and ready, and is
+ * expanded from the passphrase otherwise.
+ */
+
+const kf_key *open_key(const char *keyfile, const char *pass,
+                       kf_keyfile *kf) {
+  if (keyfile) {
+    const int status = kf_keyfile_open(kf, keyfile);
+    if (status != KF_OK) {
+      printf("Error: cant use keyfile %s: %s\n", keyfile,
+             status == KF_ERR_FORMAT ? "not a keyfile of this build"
+                                     : kf_strerror(status));
+      return NULL;
+    }
+    return kf->key;
+  }
+
+  kf_key *key = malloc(sizeof(kf_key));
+  if (!key) {
+    printf("Error: %s\n", kf_strerror(KF_ERR_MEMORY));
+    return NULL;
+  }
+
+  kf_key_init(key, pass);
+  return key;
+}
+
+void close_key(const kf_key *key, kf_keyfile *kf) {
+  if (kf->data) {
+    kf_keyfile_close(kf);
+  } else if (key) {
+    kf_wipe((kf_key *)key, sizeof(kf_key));
+    free((kf_key *)key);
+  }
+}
+
+int export_key(const char *name, const char *pass) {
+  kf_key *key = malloc(sizeof(kf_key));
+  int status = KF_ERR_MEMORY;
+
+  if (key) {
+    kf_key_init(key, pass);
+    status = kf_key_export(key, name);
+    kf_wipe(key, sizeof(kf_key));
+    free(key);
+  }
+
+  if (status != KF_OK) {
+    printf("Error: %s: %s\n", name, kf_strerror(status));
+    return 1;
+  }
+
+  printf("Wrote the key to %s\n", name);
+  return 0;
+}
+
+int run_chunked(const char *input, const char *output, const kf_key *key,
+                int encrypt, const char *iv, const char *padding,
+                size_t chunk, int level, int update, int range,
+                uint64_t offset, uint64_t length, const kf_opts *opts,
+                FILE *msg) {
+  int status;
+  int create = 0;
+
+  /* with nothing to update yet, the first run writes the whole container,
+   * with the fingerprints the next run compares against */
+  if (update) {
+    FILE *test = fopen(output, "rb");
+    if (test) {
+      fclose(test);
+    } else {
+      update = 0;
+      create = 1;
+    }
+  }
+
+  if (update) {
+    uint64_t changed;
+    status = kf_update_file_chunked(input, output, key, padding, opts,
+                                    &changed);
+    if (status == KF_OK)
+      fprintf(msg, "Rewrote %" PRIu64 " chunks.\n", changed);
+  } else if (create)
+    status = kf_encrypt_file_chunked_updatable(input, output, key, iv, padding,
+                                               chunk, opts);
+  else if (encrypt && level > 0)
+    status = kf_encrypt_file_chunked_deflate(input, output, key, iv, padding,
+                                             chunk, level, opts);
+  else if (encrypt)
+    status = kf_encrypt_file_chunked(input, output, key, iv, padding, chunk,
+                                     opts);
+  else if (range)
+    status = kf_decrypt_file_range(input, output, key, offset, length, opts);
+  else
+    status = kf_decrypt_file_chunked(input, output, key, opts);
+
+  return status;
+}
+
+int run_batch(const char *batch, const char *outdir, const kf_key *key,
+              int encrypt, int mode, const kf_opts *opts) {
+  job_list list = {NULL, 0, 0};
+  int result = 0;
+
+  if (is_directory(batch)) {
+#ifdef __unix__
+    if (!outdir) {
+      printf("Error: a batch directory needs an output directory.\n");
+      return 1;
+    }
+    result = walk_tree(&list, batch, outdir);
+#endif
+  } else {
+    result = read_manifest(&list, batch);
+  }
+
+  for (size_t i = 0; result == 0 && encrypt && i < list.count; i++) {
+    if (fill_random(list.jobs[i].iv, IV_SIZE) != 0 ||
+        fill_random(list.jobs[i].padding, IV_SIZE) != 0) {
+      printf("Error - Cant generate an iv.\nExiting.\n");
+      result = -1;
+    }
+  }
+
+  if (result == 0) {
+    kf_opts file_opts = *opts;
+    kf_batch_summary summary;
+
+    /* the pool keeps every thread busy, so each file runs on one */
+    file_opts.threads = 1;
+
+    printf("%s %zu files\n", encrypt ? "Encrypting" : "Decrypting",
+           list.count);
+    kf_batch(list.jobs, list.count, key, encrypt,
+             mode, opts->threads, &file_opts,
+             &summary);
+
+    for (size_t i = 0; i < list.count; i++) {
+      if (list.jobs[i].status != KF_OK)
+        printf("Error: %s: %s\n", list.jobs[i].infile,
+               kf_strerror(list.jobs[i].status));
+    }
+
+    const double seconds = summary.ns / 1e9;
+    printf("%zu files, %zu failed, %" PRIu64 " bytes in, %" PRIu64
+           " bytes out, %.3f s, %.1f MB/s\n",
+           summary.files, summary.failed, summary.bytes_in,
+           summary.bytes_out, seconds,
+           seconds > 0 ? summary.bytes_in / seconds / 1e6 : 0.0);
+    result = summary.failed ? -1 : 0;
+  }
+
+  for (size_t i = 0; i < list.count; i++) {
+    free((char *)list.jobs[i].infile);
+    free((char *)list.jobs[i].outfile);
+  }
+  free(list.jobs);
+
+  return result == 0 ? 0 : 1;
+}
+
 int main(int argc, char **argv) {
   int help_flag = 0;
   int encrypt_flag = 0;
@@ -61,9 +492,27 @@ int main(int argc, char **argv) {
   int output_flag = 0;
   int passphrase_flag = 0;
   int iv_flag = 0;
+  int mode = KF_MODE_CBC;
+  int stats_flag = 0;
+  int stats_json = 0;
+  int batch_flag = 0;
+  int range_flag = 0;
+  int update_flag = 0;
+  int level = 0;
+  int keyfile_flag = 0;
+  int export_flag = 0;
+  int gpu_flag = 0;
+
+  uint64_t chunk = KF_CHUNK_SIZE;
+  uint64_t offset = 0;
+  uint64_t length = UINT64_MAX;
+
+  kf_opts opts = {1, KF_BUFFER_SIZE, KF_BACKEND_AUTO};
 
   char input[MAX_FILE_PATH + 1];
   char output[MAX_FILE_PATH + 1];
+  char batch[MAX_FILE_PATH + 1];
+  char keyfile[MAX_FILE_PATH + 1];
   char pass[MAX_PASS + 1] = {0};
   char pass2[MAX_PASS + 1] = {0};
 
@@ -81,12 +530,27 @@ int main(int argc, char **argv) {
         {"output", required_argument, 0, 'o'},
         {"pass", required_argument, 0, 'p'},
         {"iv", required_argument, 0, 'k'},
+        {"mode", required_argument, 0, 'm'},
+        {"threads", required_argument, 0, 'j'},
+        {"buffer", required_argument, 0, 'b'},
+        {"io", required_argument, 0, 'I'},
+        {"kernel", required_argument, 0, 'K'},
+        {"batch", required_argument, 0, 'B'},
+        {"stats", optional_argument, 0, 'S'},
+        {"chunk", required_argument, 0, 'C'},
+        {"offset", required_argument, 0, 'O'},
+        {"length", required_argument, 0, 'L'},
+        {"update", no_argument, 0, 'U'},
+        {"compress", optional_argument, 0, 'Z'},
+        {"keyfile", required_argument, 0, 'F'},
+        {"export", required_argument, 0, 'X'},
+        {"device", required_argument, 0, 'G'},
 
         {0, 0, 0, 0}};
 
     int option_index = 0;
 
-    c = getopt_long(argc, argv, "hedi:o:p:k:", long_options, &option_index);
+    c = getopt_long(argc, argv, "hedi:o:p:k:m:j:b:I:K:B:", long_options, &option_index);
 
     if (c == -1)
       break;
@@ -124,6 +588,137 @@ int main(int argc, char **argv) {
       strncpy(iv, optarg, IV_SIZE);
       break;
 
+    case 'm':
+      if (strcmp(optarg, "ctr") == 0) {
+        mode = KF_MODE_CTR;
+      } else if (strcmp(optarg, "cbc") == 0) {
+        mode = KF_MODE_CBC;
+      } else if (strcmp(optarg, "chunked") == 0) {
+        mode = KF_MODE_CHUNKED;
+      } else if (strcmp(optarg, "aead") == 0) {
+        mode = KF_MODE_AEAD;
+      } else {
+        printf("Error: unknown mode: %s\n", optarg);
+        return 0;
+      }
+      break;
+
+    case 'j':
+      opts.threads = strtoul(optarg, NULL, 10);
+      if (opts.threads < 1 || opts.threads > KF_MAX_THREADS) {
+        printf("Error: threads must be between 1 and %d.\n", KF_MAX_THREADS);
+        return 0;
+      }
+      break;
+
+    case 'b': {
+      uint64_t size;
+      if (parse_size(optarg, &size) != 0 || size < 16 || size > SIZE_MAX) {
+        printf("Error: buffer must be at least 16 bytes.\n");
+        return 0;
+      }
+      opts.buffer_size = (size_t)size;
+    } break;
+
+    case 'C':
+      if (parse_size(optarg, &chunk) != 0 || chunk < 16 || chunk % 16 != 0 ||
+          chunk > (1u << 30)) {
+        printf("Error: chunk must be a multiple of 16 bytes, up to 1g.\n");
+        return 0;
+      }
+      break;
+
+    case 'U':
+      update_flag = 1;
+      break;
+
+    case 'Z':
+      level = optarg ? atoi(optarg) : 6;
+      if (level < 1 || level > 9) {
+        printf("Error: compression level must be 1 to 9.\n");
+        return 0;
+      }
+      break;
+
+    case 'F':
+      keyfile_flag = 1;
+      strncpy(keyfile, optarg, MAX_FILE_PATH);
+      keyfile[MAX_FILE_PATH] = '\0';
+      break;
+
+    case 'X':
+      export_flag = 1;
+      strncpy(keyfile, optarg, MAX_FILE_PATH);
+      keyfile[MAX_FILE_PATH] = '\0';
+      break;
+
+    case 'O':
+      range_flag = 1;
+      if (parse_size(optarg, &offset) != 0) {
+        printf("Error: bad offset: %s\n", optarg);
+        return 0;
+      }
+      break;
+
+    case 'L':
+      range_flag = 1;
+      if (parse_size(optarg, &length) != 0) {
+        printf("Error: bad length: %s\n", optarg);
+        return 0;
+      }
+      break;
+
+    case 'I':
+      if (strcmp(optarg, "auto") == 0) {
+        opts.backend = KF_BACKEND_AUTO;
+      } else if (strcmp(optarg, "stdio") == 0) {
+        opts.backend = KF_BACKEND_STDIO;
+      } else if (strcmp(optarg, "mmap") == 0) {
+        opts.backend = KF_BACKEND_MMAP;
+      } else if (strcmp(optarg, "async") == 0) {
+        opts.backend = KF_BACKEND_ASYNC;
+      } else if (strcmp(optarg, "threads") == 0) {
+        opts.backend = KF_BACKEND_THREADS;
+      } else {
+        printf("Error: unknown io backend: %s\n", optarg);
+        return 0;
+      }
+      break;
+
+    case 'G':
+      if (strcmp(optarg, "cpu") == 0) {
+        gpu_flag = 0;
+      } else if (strcmp(optarg, "gpu") == 0) {
+        gpu_flag = 1;
+      } else {
+        printf("Error: unknown device: %s\n", optarg);
+        return 0;
+      }
+      break;
+
+    case 'K':
+      if (kf_kernel_select(optarg) != 0) {
+        printf("Error: kernel %s is unknown or not supported.\n", optarg);
+        return 0;
+      }
+      break;
+
+    case 'B':
+      batch_flag = 1;
+      strncpy(batch, optarg, MAX_FILE_PATH);
+      batch[MAX_FILE_PATH] = '\0';
+      break;
+
+    case 'S':
+      stats_flag = 1;
+      if (optarg && strcmp(optarg, "json") == 0) {
+        stats_json = 1;
+      } else if (optarg && strcmp(optarg, "text") != 0) {
+        printf("Error: unknown stats format: %s\n", optarg);
+        return 0;
+      }
+      break;
+
     case '?':
       break;
 
@@ -142,37 +737,102 @@ int main(int argc, char **argv) {
     return 0;
   }
 
+  if (export_flag) {
+    if (encrypt_flag || decrypt_flag || keyfile_flag) {
+      printf("Error: --export can not be used with -e, -d or --keyfile.\n");
+      return 0;
+    }
+    if (!passphrase_flag)
+      read_passphrase(pass, pass2);
+    return export_key(keyfile, pass);
+  }
+
+  if (keyfile_flag && passphrase_flag) {
+    printf("Error: -p and --keyfile are incompatible flags.\n");
+    return 0;
+  }
+
+  if (range_flag && (!decrypt_flag || mode != KF_MODE_CHUNKED || batch_flag)) {
+    printf("Error: --offset and --length need -d -m chunked.\n");
+    return 0;
+  }
+
+  if (update_flag && (!encrypt_flag || mode != KF_MODE_CHUNKED ||
+                      batch_flag || (output_flag && strcmp(output, "-") == 0))) {
+    printf("Error: --update needs -e -m chunked and an output file.\n");
+    return 0;
+  }
+
+  if (level > 0 && (!encrypt_flag || mode != KF_MODE_CHUNKED || update_flag ||
+                    batch_flag)) {
+    printf("Error: --compress needs -e -m chunked, without --update.\n");
+    return 0;
+  }
+
+  if (level > 0 && !kf_deflate_enabled()) {
+    printf("Error: built without compression, rebuild with make ZLIB=1.\n");
+    return 0;
+  }
+
+  if (iv_flag && (mode == KF_MODE_CTR || mode == KF_MODE_AEAD)) {
+    printf("Error: -k can not be used with -m ctr or aead, an iv used twice "
+           "repeats the keystream.\n");
+    return 0;
+  }
+
+  if (gpu_flag && (mode != KF_MODE_CTR || batch_flag)) {
+    printf("Error: --device gpu needs -m ctr, without -B.\n");
+    return 0;
+  }
+
+  if (encrypt_flag && mode == KF_MODE_CHUNKED && input_flag &&
+      strcmp(input, "-") == 0) {
+    printf("Error: chunked mode needs an input file, not stdin.\n");
+    return 0;
+  }
+
   if (encrypt_flag || decrypt_flag) {
-    if (!input_flag) {
+    if (batch_flag) {
+      if (input_flag) {
+        printf("Error: -i and -B are incompatible flags.\n");
+        return 0;
+      }
+      if (iv_flag) {
+        printf("Error: -k can not be used with -B, every file gets its own "
+               "iv.\n");
+        return 0;
+      }
+    } else if (!input_flag) {
       printf("Error: must specify an input file.\n");
       return 0;
     }
-    if (!output_flag) {
+    if (!output_flag && !batch_flag) {
       printf("Error: must specify an output file.\n");
       return 0;
     }
 
-    if (!passphrase_flag) {
-      int first = 1;
-      do {
-        if (!first) {
-          printf("Error: passwords do not match.\n");
-        }
+    if (!passphrase_flag && !keyfile_flag && input_flag &&
+        strcmp(input, "-") == 0) {
+      printf("Error: -p or --keyfile is required when the input is stdin.\n");
+      return 0;
+    }
 
-        printf("password:");
-#ifdef __unix__
-        set_input_mode();
-#endif
-        fgets(pass, MAX_PASS, stdin);
-        printf("\nrepeat:");
-        fgets(pass2, MAX_PASS, stdin);
-#ifdef __unix__
-        reset_input_mode();
-#endif
-        printf("\n");
+    if (!passphrase_flag && !keyfile_flag)
+      read_passphrase(pass, pass2);
+
+    kf_keyfile kf = {NULL, NULL, 0};
+
+    if (batch_flag) {
+      const kf_key *key = open_key(keyfile_flag ? keyfile : NULL, pass, &kf);
+      if (!key)
+        return 1;
 
-        first = 0;
-      } while (memcmp(pass, pass2, MAX_PASS) != 0);
+      int result = run_batch(batch, output_flag ? output : NULL, key,
+                             encrypt_flag, mode, &opts);
+      close_key(key, &kf);
+      if (stats_flag)
+        print_stats(stdout, stats_json);
+      return result;
     }
 
     if (iv_flag) {
@@ -208,23 +868,74 @@ int main(int argc, char **argv) {
       }
     }
 
-    FILE *test = fopen(input, "r");
-    if (!test) {
-      printf("Error: cant open input file: %s\n", input);
-      return 0;
+    /* with the output on stdout, everything else goes to stderr */
+    FILE *msg = strcmp(output, "-") == 0 ? stderr : stdout;
+
+    if (strcmp(input, "-") != 0) {
+      FILE *test = fopen(input, "r");
+      if (!test) {
+        printf("Error: cant open input file: %s\n", input);
+        return 0;
+      }
+      fclose(test);
     }
-    fclose(test);
+
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    const kf_key *key = open_key(keyfile_flag ? keyfile : NULL, pass, &kf);
+    if (!key)
+      return 1;
+
+    int status = KF_OK;
+
+    if (gpu_flag && !kf_gpu_available())
+      fprintf(msg, "Note: no gpu device found, running on the cpu.\n");
 
     if (encrypt_flag) {
-      printf("Encrypting %s\n", input);
-      kf_encrypt_file_cbc(input, output, pass, iv, padding);
+      fprintf(msg, "Encrypting %s\n", input);
+      if (mode == KF_MODE_CHUNKED)
+        status = run_chunked(input, output, key, 1, iv, padding,
+                             (size_t)chunk, level, update_flag, 0, 0, 0,
+                             &opts, msg);
+      else if (mode == KF_MODE_AEAD)
+        status = kf_encrypt_file_aead_key(input, output, key, iv, &opts);
+      else if (mode == KF_MODE_CTR && gpu_flag)
+        status = kf_encrypt_file_ctr_gpu(input, output, key, iv, &opts);
+      else if (mode == KF_MODE_CTR)
+        status = kf_encrypt_file_ctr_key(input, output, key, iv, &opts);
+      else
+        status =
+            kf_encrypt_file_cbc_key(input, output, key, iv, padding, &opts);
     }
 
     if (decrypt_flag) {
-      printf("Decrypting %s\n", input);
-      kf_decrypt_file_cbc(input, output, pass);
+      fprintf(msg, "Decrypting %s\n", input);
+      if (mode == KF_MODE_CHUNKED)
+        status = run_chunked(input, output, key, 0, NULL, NULL, 0, 0, 0,
+                             range_flag, offset, length, &opts, msg);
+      else if (mode == KF_MODE_AEAD)
+        status = kf_decrypt_file_aead_key(input, output, key, &opts);
+      else if (mode == KF_MODE_CTR && gpu_flag)
+        status = kf_decrypt_file_ctr_gpu(input, output, key, &opts);
+      else if (mode == KF_MODE_CTR)
+        status = kf_decrypt_file_ctr_key(input, output, key, &opts);
+      else
+        status = kf_decrypt_file_cbc_key(input, output, key, &opts);
+    }
+
+    close_key(key, &kf);
+
+    if (stats_flag)
+      print_stats(msg, stats_json);
+
+    if (status != KF_OK) {
+      fprintf(msg, "Error: %s\n", kf_strerror(status));
+      return 1;
     }
-    printf("Finished.\n");
+    fprintf(msg, "Finished.\n");
   } else {
     usage();
   }
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PLAIN_SIZE 100003
+
+static void report(const int passed, int *test, int *fail) {
+  if (passed) {
+    printf("    [*] Test #%d Passed.\n", ++*test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++*test);
+    (*fail)++;
+  }
+}
+
+static size_t read_file(const char *name, uint8_t *buffer, size_t len) {
+  FILE *f = fopen(name, "rb");
+  if (!f)
+    return 0;
+  size_t got = fread(buffer, 1, len, f);
+  fclose(f);
+  return got;
+}
+
+static void write_file(const char *name, const uint8_t *buffer, size_t len) {
+  FILE *f = fopen(name, "wb");
+  fwrite(buffer, 1, len, f);
+  fclose(f);
+}
+
+/*
+ * poly1305 must match RFC 8439, the aead mode must round trip and agree with
+ * the buffer functions, and any change to an aead file must be caught.
+ */
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the aead mode.\n");
+
+  /* RFC 8439 section 2.5.2 */
+  const uint8_t poly_key[KF_POLY_KEY_SIZE] = {
+      0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33, 0x7f, 0x44, 0x52,
+      0xfe, 0x42, 0xd5, 0x06, 0xa8, 0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d,
+      0xb2, 0xfd, 0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b};
+  const uint8_t poly_tag[KF_TAG_SIZE] = {0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51,
+                                         0x36, 0xc6, 0xc2, 0x2b, 0x8b, 0xaf,
+                                         0x0c, 0x01, 0x27, 0xa9};
+  const char *message = "Cryptographic Forum Research Group";
+
+  kf_poly1305 p;
+  uint8_t tag[KF_TAG_SIZE];
+
+  kf_poly1305_init(&p, poly_key);
+  kf_poly1305_update(&p, (const uint8_t *)message, strlen(message));
+  kf_poly1305_final(&p, tag);
+  report(memcmp(tag, poly_tag, KF_TAG_SIZE) == 0, &test, &fail);
+
+  /* the same mac in uneven pieces */
+  kf_poly1305_init(&p, poly_key);
+  for (size_t i = 0, step = 1; i < strlen(message); i += step, step += 2) {
+    const size_t left = strlen(message) - i;
+    kf_poly1305_update(&p, (const uint8_t *)message + i,
+                       step < left ? step : left);
+  }
+  kf_poly1305_final(&p, tag);
+  report(memcmp(tag, poly_tag, KF_TAG_SIZE) == 0, &test, &fail);
+
+  char iv[] = "ABCDabcd1234EFGH";
+  char passphrase[] = "this is my password";
+
+  static kf_key key;
+  static uint8_t plain[PLAIN_SIZE];
+  static uint8_t enc[PLAIN_SIZE + 64];
+  static uint8_t back[PLAIN_SIZE + 64];
+  static uint8_t dec[PLAIN_SIZE + 64];
+
+  kf_key_init(&key, passphrase);
+
+  for (size_t i = 0; i < PLAIN_SIZE; i++)
+    plain[i] = (uint8_t)(rand() % 26 + 65);
+
+  const size_t sizes[] = {0, 1, 15, 16, 17, 1024, 1025, PLAIN_SIZE};
+  const kf_opts opts[] = {{1, 0, KF_BACKEND_AUTO},
+                          {1, 16, KF_BACKEND_AUTO},
+                          {1, 4000, KF_BACKEND_AUTO}};
+
+  /* round trips, with a payload of the counter mode keystream from 2 on */
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    write_file("kf_aead_plain.txt", plain, sizes[s]);
+
+    kf_ctr_x(plain, back, sizes[s], iv, 2, &key.x);
+    kf_aead_encrypt(plain, dec, sizes[s], iv, &key, tag);
+
+    int passed = memcmp(back, dec, sizes[s]) == 0;
+
+    for (size_t o = 0; o < sizeof(opts) / sizeof(opts[0]); o++) {
+      int status = kf_encrypt_file_aead_key(
+          "kf_aead_plain.txt", "kf_aead_enc.txt", &key, iv, &opts[o]);
+      const size_t len = read_file("kf_aead_enc.txt", enc, sizeof(enc));
+
+      status |= kf_decrypt_file_aead_key("kf_aead_enc.txt", "kf_aead_dec.txt",
+                                         &key, &opts[o]);
+
+      passed &= status == KF_OK &&
+                len == sizes[s] + BLOCK_SIZE + KF_TAG_SIZE &&
+                memcmp(enc, iv, BLOCK_SIZE) == 0 &&
+                memcmp(enc + BLOCK_SIZE, back, sizes[s]) == 0 &&
+                memcmp(enc + BLOCK_SIZE + sizes[s], tag, KF_TAG_SIZE) == 0 &&
+                read_file("kf_aead_dec.txt", dec, sizeof(dec)) == sizes[s] &&
+                memcmp(dec, plain, sizes[s]) == 0;
+    }
+
+    report(passed, &test, &fail);
+  }
+
+  /* the passphrase functions agree with the key functions */
+  int status = kf_encrypt_file_aead("kf_aead_plain.txt", "kf_aead_enc.txt",
+                                    passphrase, iv);
+  status |= kf_decrypt_file_aead("kf_aead_enc.txt", "kf_aead_dec.txt",
+                                 passphrase);
+  report(status == KF_OK &&
+             read_file("kf_aead_dec.txt", back, sizeof(back)) == PLAIN_SIZE &&
+             memcmp(back, plain, PLAIN_SIZE) == 0,
+         &test, &fail);
+
+  /* a flipped bit anywhere is caught, and the output is removed */
+  const size_t enc_len = read_file("kf_aead_enc.txt", enc, sizeof(enc));
+  const size_t flips[] = {0, 15, 16, 5000, enc_len - KF_TAG_SIZE - 1,
+                          enc_len - 1};
+
+  for (size_t f = 0; f < sizeof(flips) / sizeof(flips[0]); f++) {
+    enc[flips[f]] ^= 0x10;
+    write_file("kf_aead_bad.txt", enc, enc_len);
+    enc[flips[f]] ^= 0x10;
+
+    status = kf_decrypt_file_aead_key("kf_aead_bad.txt", "kf_aead_dec.txt",
+                                      &key, &opts[1]);
+    report(status == KF_ERR_AUTH &&
+               read_file("kf_aead_dec.txt", back, sizeof(back)) == 0,
+           &test, &fail);
+  }
+
+  /* so is a missing byte, and the wrong key */
+  write_file("kf_aead_bad.txt", enc, enc_len - 1);
+  report(kf_decrypt_file_aead_key("kf_aead_bad.txt", "kf_aead_dec.txt", &key,
+                                  NULL) == KF_ERR_AUTH,
+         &test, &fail);
+
+  report(kf_decrypt_file_aead("kf_aead_enc.txt", "kf_aead_dec.txt",
+                              "not my password") == KF_ERR_AUTH,
+         &test, &fail);
+
+  /* a file too short to hold the iv and the tag is not a ciphertext */
+  write_file("kf_aead_bad.txt", enc, BLOCK_SIZE + KF_TAG_SIZE - 1);
+  report(kf_decrypt_file_aead_key("kf_aead_bad.txt", "kf_aead_dec.txt", &key,
+                                  NULL) == KF_ERR_FORMAT,
+         &test, &fail);
+
+  /* a buffer that fails to authenticate is wiped */
+  uint8_t small[64];
+  uint8_t zero[64] = {0};
+
+  kf_aead_encrypt(plain, small, sizeof(small), iv, &key, tag);
+  small[7] ^= 1;
+  report(kf_aead_decrypt(small, small, sizeof(small), iv, &key, tag) ==
+                 KF_ERR_AUTH &&
+             memcmp(small, zero, sizeof(small)) == 0,
+         &test, &fail);
+
+  kf_wipe(&key, sizeof(key));
+
+  remove("kf_aead_plain.txt");
+  remove("kf_aead_enc.txt");
+  remove("kf_aead_dec.txt");
+  remove("kf_aead_bad.txt");
+
+  if (fail == 0)
+    printf("[*] All aead tests passed.\n");
+
+  return fail;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int compare_files(const char *a, const char *b) {
+  FILE *in = fopen(a, "rb");
+  FILE *in2 = fopen(b, "rb");
+
+  int ch1 = getc(in);
+  int ch2 = getc(in2);
+
+  while ((ch1 != EOF) && (ch2 != EOF) && (ch1 == ch2)) {
+    ch1 = getc(in);
+    ch2 = getc(in2);
+  }
+
+  fclose(in);
+  fclose(in2);
+
+  return ch1 == ch2;
+}
+
+static void report(const int passed, int *test, int *fail) {
+  if (passed) {
+    printf("    [*] Test #%d Passed.\n", ++*test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++*test);
+    (*fail)++;
+  }
+}
+
+/*
+ * the async backend must produce the same ciphertext as the stdio backend,
+ * and decrypt it back to the plaintext, both through io_uring and through
+ * the io threads. small buffers keep several chunks in flight at once.
+ */
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the async file backend.\n");
+
+  char iv[] = "ABCDabcd1234EFGH";
+  char padding[] = "vdslsilvfdkvlfdn";
+  char passphrase[] = "this is my password";
+
+  const kf_opts stdio = {1, 0, KF_BACKEND_STDIO};
+  const kf_opts backends[] = {{1, 48, KF_BACKEND_ASYNC},
+                              {2, 4096, KF_BACKEND_ASYNC},
+                              {1, 16, KF_BACKEND_THREADS},
+                              {3, 1000, KF_BACKEND_THREADS}};
+
+  const long sizes[] = {0, 1, 15, 16, 17, 48, 49, 1000, 100003};
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    FILE *f = fopen("kf_async_plain.txt", "wb");
+    for (long i = 0; i < sizes[s]; i++) {
+      putc(rand() % 26 + 65, f);
+    }
+    fclose(f);
+
+    int passed = 1;
+
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+      int status =
+          kf_encrypt_file_cbc_ex("kf_async_plain.txt", "kf_async_a.txt",
+                                 passphrase, iv, padding, &stdio);
+      status |= kf_encrypt_file_cbc_ex("kf_async_plain.txt", "kf_async_b.txt",
+                                       passphrase, iv, padding, &backends[b]);
+      status |= kf_decrypt_file_cbc_ex("kf_async_b.txt", "kf_async_dec.txt",
+                                       passphrase, &backends[b]);
+
+      passed &= status == KF_OK &&
+                compare_files("kf_async_a.txt", "kf_async_b.txt") &&
+                compare_files("kf_async_plain.txt", "kf_async_dec.txt");
+
+      status = kf_encrypt_file_ctr_ex("kf_async_plain.txt", "kf_async_a.txt",
+                                      passphrase, iv, &stdio);
+      status |= kf_encrypt_file_ctr_ex("kf_async_plain.txt", "kf_async_b.txt",
+                                       passphrase, iv, &backends[b]);
+      status |= kf_decrypt_file_ctr_ex("kf_async_b.txt", "kf_async_dec.txt",
+                                       passphrase, &backends[b]);
+
+      passed &= status == KF_OK &&
+                compare_files("kf_async_a.txt", "kf_async_b.txt") &&
+                compare_files("kf_async_plain.txt", "kf_async_dec.txt");
+    }
+
+    report(passed, &test, &fail);
+  }
+
+  /* a truncated ciphertext is rejected */
+  FILE *f = fopen("kf_async_a.txt", "wb");
+  fwrite(iv, 1, 20, f);
+  fclose(f);
+
+  report(kf_decrypt_file_cbc_ex("kf_async_a.txt", "kf_async_dec.txt",
+                                passphrase, &backends[0]) == KF_ERR_FORMAT,
+         &test, &fail);
+
+  /* a missing input is reported before anything is written */
+  report(kf_encrypt_file_cbc_ex("kf_async_missing.txt", "kf_async_dec.txt",
+                                passphrase, iv, padding,
+                                &backends[0]) == KF_ERR_OPEN,
+         &test, &fail);
+
+  remove("kf_async_plain.txt");
+  remove("kf_async_a.txt");
+  remove("kf_async_b.txt");
+  remove("kf_async_dec.txt");
+
+  if (fail == 0)
+    printf("[*] All async tests passed.\n");
+
+  return fail;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FILES 7
+
+static void report(const int passed, int *test, int *fail) {
+  if (passed) {
+    printf("    [*] Test #%d Passed.\n", ++*test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++*test);
+    (*fail)++;
+  }
+}
+
+static int compare_files(const char *a, const char *b) {
+  FILE *in = fopen(a, "rb");
+  FILE *in2 = fopen(b, "rb");
+
+  if (!in || !in2) {
+    if (in)
+      fclose(in);
+    if (in2)
+      fclose(in2);
+    return 0;
+  }
+
+  int ch1 = getc(in);
+  int ch2 = getc(in2);
+
+  while ((ch1 != EOF) && (ch2 != EOF) && (ch1 == ch2)) {
+    ch1 = getc(in);
+    ch2 = getc(in2);
+  }
+
+  fclose(in);
+  fclose(in2);
+
+  return ch1 == ch2;
+}
+
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the batch function.\n");
+
+  char passphrase[] = "this is my password";
+  const long sizes[FILES] = {0, 15, 16, 1000, 4096, 70000, 3 * 65536 + 5};
+
+  static char plain[FILES][32], enc[FILES][32], dec[FILES][32], ref[32];
+  kf_batch_job jobs[FILES], back[FILES];
+
+  static kf_key key;
+  kf_key_init(&key, passphrase);
+
+  for (int mode = KF_MODE_CBC; mode <= KF_MODE_CTR; mode++) {
+    for (int i = 0; i < FILES; i++) {
+      sprintf(plain[i], "kf_test_plain_%d.txt", i);
+      sprintf(enc[i], "kf_test_enc_%d.txt", i);
+      sprintf(dec[i], "kf_test_dec_%d.txt", i);
+
+      FILE *f = fopen(plain[i], "wb");
+      for (long j = 0; j < sizes[i]; j++) {
+        putc(rand() % 26 + 65, f);
+      }
+      fclose(f);
+
+      memset(&jobs[i], 0, sizeof(kf_batch_job));
+      jobs[i].infile = plain[i];
+      jobs[i].outfile = enc[i];
+      memcpy(jobs[i].iv, "ABCDabcd1234EFGH", BLOCK_SIZE);
+      memcpy(jobs[i].padding, "vdslsilvfdkvlfdn", BLOCK_SIZE);
+      jobs[i].iv[0] = (char)('a' + i);
+
+      memset(&back[i], 0, sizeof(kf_batch_job));
+      back[i].infile = enc[i];
+      back[i].outfile = dec[i];
+    }
+
+    kf_batch_summary summary;
+    size_t failed = kf_batch(jobs, FILES, &key, 1, mode, 3, NULL, &summary);
+
+    report(failed == 0 && summary.files == FILES && summary.failed == 0,
+           &test, &fail);
+
+    /* every file matches the file mode run on its own */
+    int same = 1;
+    uint64_t total = 0;
+
+    sprintf(ref, "kf_test_ref.txt");
+
+    for (int i = 0; i < FILES; i++) {
+      kf_opts opts = {1, KF_BUFFER_SIZE, KF_BACKEND_STDIO};
+
+      if (mode == KF_MODE_CTR)
+        kf_encrypt_file_ctr_key(plain[i], ref, &key, jobs[i].iv, &opts);
+      else
+        kf_encrypt_file_cbc_key(plain[i], ref, &key, jobs[i].iv,
+                                jobs[i].padding, &opts);
+
+      same &= jobs[i].status == KF_OK && compare_files(ref, enc[i]);
+      same &= jobs[i].bytes_in == (uint64_t)sizes[i];
+      total += jobs[i].bytes_in;
+    }
+
+    remove(ref);
+
+    report(same && summary.bytes_in == total, &test, &fail);
+
+    failed = kf_batch(back, FILES, &key, 0, mode, 2, NULL, &summary);
+
+    same = failed == 0;
+    for (int i = 0; i < FILES; i++) {
+      same &= compare_files(plain[i], dec[i]);
+    }
+
+    report(same && summary.bytes_out == total, &test, &fail);
+
+    for (int i = 0; i < FILES; i++) {
+      remove(plain[i]);
+      remove(enc[i]);
+      remove(dec[i]);
+    }
+  }
+
+  /* a file that can not be opened fails alone */
+  FILE *f = fopen("kf_test_plain_0.txt", "wb");
+  fputs("some plaintext", f);
+  fclose(f);
+
+  memset(jobs, 0, 2 * sizeof(kf_batch_job));
+  jobs[0].infile = "kf_test_plain_0.txt";
+  jobs[0].outfile = "kf_test_enc_0.txt";
+  jobs[1].infile = "kf_test_missing.txt";
+  jobs[1].outfile = "kf_test_enc_1.txt";
+
+  size_t failed = kf_batch(jobs, 2, &key, 1, KF_MODE_CBC, 2, NULL, NULL);
+
+  report(failed == 1 && jobs[0].status == KF_OK &&
+             jobs[1].status == KF_ERR_OPEN,
+         &test, &fail);
+
+  remove("kf_test_plain_0.txt");
+  remove("kf_test_enc_0.txt");
+  remove("kf_test_enc_1.txt");
+
+  if (fail == 0)
+    printf("[*] All batch tests passed.\n");
+
+  return fail;
+}
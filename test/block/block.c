@@ -9,6 +9,22 @@
 #include <stdio.h>
 #include <string.h>
 
+/* the block function written out round by round */
+static void ref_block(const uint32_t *in, uint32_t *out, const kf_ctx *ctx) {
+
+  for (int i = 0; i < 4; i++) {
+    out[i] = in[i] ^ ctx->wkey[0][i];
+  }
+
+  for (size_t r = 0; r < ROUNDS; r++) {
+    kf_round(out, out, r, ctx);
+  }
+
+  for (int i = 0; i < 4; i++) {
+    out[i] ^= ctx->wkey[1][i];
+  }
+}
+
 int main(void) {
   int fail = 0;
 
@@ -37,6 +53,26 @@ int main(void) {
     fail = 1;
   }
 
+  uint32_t ref[4];
+  int same = 1;
+
+  for (int i = 0; i < 1000; i++) {
+    for (int j = 0; j < 4; j++) {
+      in[j] = (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+    }
+
+    kf_block(in, out, &ctx);
+    ref_block(in, ref, &ctx);
+    same &= memcmp(out, ref, sizeof(ref)) == 0;
+  }
+
+  if (same) {
+    printf("    [*] Test #2 Passed.\n");
+  } else {
+    printf("    [*] Test #2 Failed.\n");
+    fail++;
+  }
+
   if (fail == 0)
     printf("[*] All block tests passed.\n");
 
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_BLOCKS 19
+
+int main(void) {
+  int fail = 0;
+
+  printf("[*] Testing the block_n function.\n");
+
+  kf_ctx ctx;
+  char pass[] = "This is a password";
+  uint32_t in[MAX_BLOCKS * 4];
+  uint32_t out[MAX_BLOCKS * 4];
+  uint32_t ref[MAX_BLOCKS * 4];
+
+  kf_expand_passphrase(pass, &ctx);
+
+  for (int i = 0; i < MAX_BLOCKS * 4; i++) {
+    in[i] = (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+  }
+
+  for (int i = 0; i < MAX_BLOCKS * 4; i += 4) {
+    kf_block(in + i, ref + i, &ctx);
+  }
+
+  for (int n = 0; n <= MAX_BLOCKS; n++) {
+    memset(out, 0, sizeof(out));
+
+    kf_block_n(in, out, n, &ctx);
+
+    if (memcmp(ref, out, sizeof(uint32_t) * 4 * n) == 0) {
+      printf("    [*] Test #%d Passed.\n", n + 1);
+    } else {
+      printf("    [*] Test #%d Failed.\n", n + 1);
+      fail++;
+    }
+  }
+
+  memcpy(out, in, sizeof(in));
+
+  kf_block_n(out, out, MAX_BLOCKS, &ctx);
+
+  if (memcmp(ref, out, sizeof(out)) == 0) {
+    printf("    [*] Test #%d Passed.\n", MAX_BLOCKS + 2);
+  } else {
+    printf("    [*] Test #%d Failed.\n", MAX_BLOCKS + 2);
+    fail++;
+  }
+
+  if (fail == 0)
+    printf("[*] All block_n tests passed.\n");
+
+  return fail;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_BLOCKS 200
+
+typedef void (*block_n_fn)(const uint32_t *, uint32_t *, size_t,
+                           const kf_ctx *);
+
+static int test_engine(const char *name, block_n_fn fn, const kf_ctx *ctx,
+                       const kf_ctx *inv, int *test) {
+  static uint32_t in[MAX_BLOCKS * 4], out[MAX_BLOCKS * 4],
+      ref[MAX_BLOCKS * 4];
+
+  const size_t counts[] = {0, 1, 31, 32, 33, 63, 64, 65, 127, 128, 129, 200};
+
+  int fail = 0;
+
+  for (int i = 0; i < MAX_BLOCKS * 4; i++) {
+    in[i] = (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+  }
+
+  kf_block_n(in, ref, MAX_BLOCKS, ctx);
+
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+    memset(out, 0, sizeof(out));
+
+    fn(in, out, counts[c], ctx);
+
+    if (memcmp(ref, out, sizeof(uint32_t) * 4 * counts[c]) == 0) {
+      printf("    [*] Test #%d Passed.\n", ++*test);
+    } else {
+      printf("    [*] Test #%d Failed (%s, %zu blocks).\n", ++*test, name,
+             counts[c]);
+      fail++;
+    }
+  }
+
+  fn(out, out, MAX_BLOCKS, inv);
+
+  if (memcmp(in, out, sizeof(out)) == 0) {
+    printf("    [*] Test #%d Passed.\n", ++*test);
+  } else {
+    printf("    [*] Test #%d Failed (%s, decrypt).\n", ++*test, name);
+    fail++;
+  }
+
+  return fail;
+}
+
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the SIMD block functions.\n");
+
+  kf_ctx ctx, inv;
+  kf_expand_passphrase("This is a password", &ctx);
+  kf_invert_ctx(&ctx, &inv);
+
+#if KF_X86_SIMD
+  if (__builtin_cpu_supports("avx2")) {
+    fail += test_engine("avx2", kf_block_n_avx2, &ctx, &inv, &test);
+  } else {
+    printf("    [*] AVX2 not supported, skipping.\n");
+  }
+
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx512vbmi")) {
+    fail += test_engine("avx512", kf_block_n_avx512, &ctx, &inv, &test);
+  } else {
+    printf("    [*] AVX-512 VBMI not supported, skipping.\n");
+  }
+#else
+  printf("    [*] No x86 SIMD engines in this build, skipping.\n");
+#endif
+
+  if (fail == 0)
+    printf("[*] All block_simd tests passed.\n");
+
+  return fail;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_BLOCKS 19
+
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the fused table block functions.\n");
+
+  const char *passphrases[] = {"This is a password", "AbCdEfGhIj",
+                               "correct horse battery staple"};
+
+  static kf_ctx ctx, inv;
+  static kf_xctx x, xinv;
+  static kf_key key;
+
+  uint32_t in[MAX_BLOCKS * 4];
+  uint32_t out[MAX_BLOCKS * 4];
+  uint32_t ref[MAX_BLOCKS * 4];
+
+  for (int i = 0; i < MAX_BLOCKS * 4; i++) {
+    in[i] = (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+  }
+
+  for (int p = 0; p < 3; p++) {
+    kf_expand_passphrase(passphrases[p], &ctx);
+    kf_invert_ctx(&ctx, &inv);
+    kf_expand_passphrase_x(passphrases[p], &x);
+    kf_invert_xctx(&x, &xinv);
+
+    /* the expanded ctx holds the same key schedule */
+    if (memcmp(&ctx, &x.ctx, sizeof(kf_ctx)) == 0) {
+      printf("    [*] Test #%d Passed.\n", ++test);
+    } else {
+      printf("    [*] Test #%d Failed.\n", ++test);
+      fail++;
+    }
+
+    for (int i = 0; i < MAX_BLOCKS * 4; i += 4) {
+      kf_block(in + i, ref + i, &ctx);
+      kf_block_x(in + i, out + i, &x);
+    }
+
+    if (memcmp(ref, out, sizeof(out)) == 0) {
+      printf("    [*] Test #%d Passed.\n", ++test);
+    } else {
+      printf("    [*] Test #%d Failed.\n", ++test);
+      fail++;
+    }
+
+    memset(out, 0, sizeof(out));
+    kf_block_n_fused(in, out, MAX_BLOCKS, &x);
+
+    if (memcmp(ref, out, sizeof(out)) == 0) {
+      printf("    [*] Test #%d Passed.\n", ++test);
+    } else {
+      printf("    [*] Test #%d Failed.\n", ++test);
+      fail++;
+    }
+
+    kf_block_n_fused(out, out, MAX_BLOCKS, &xinv);
+
+    if (memcmp(in, out, sizeof(out)) == 0) {
+      printf("    [*] Test #%d Passed.\n", ++test);
+    } else {
+      printf("    [*] Test #%d Failed.\n", ++test);
+      fail++;
+    }
+
+    /* the inverse schedule decrypts with the forward tables */
+    kf_key_init(&key, passphrases[p]);
+
+    for (int i = 0; i < MAX_BLOCKS * 4; i += 4) {
+      kf_block_x_k(ref + i, out + i, &key.x, &key.inv);
+    }
+
+    if (memcmp(in, out, sizeof(out)) == 0) {
+      printf("    [*] Test #%d Passed.\n", ++test);
+    } else {
+      printf("    [*] Test #%d Failed.\n", ++test);
+      fail++;
+    }
+
+    size_t count;
+    const kf_kernel *kernels = kf_kernel_list(&count);
+
+    for (size_t k = 0; k < count; k++) {
+      if (!kernels[k].supported())
+        continue;
+
+      memset(out, 0, sizeof(out));
+      kernels[k].block_n_k(ref, out, MAX_BLOCKS, &key.x, &key.inv);
+
+      if (memcmp(in, out, sizeof(out)) == 0) {
+        printf("    [*] Test #%d Passed.\n", ++test);
+      } else {
+        printf("    [*] Test #%d Failed.\n", ++test);
+        fail++;
+      }
+    }
+  }
+
+  if (fail == 0)
+    printf("[*] All block_x tests passed.\n");
+
+  return fail;
+}
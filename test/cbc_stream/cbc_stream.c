@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LEN 5000
+
+/*
+ * the cbc stream must produce the file format byte for byte, however the
+ * input is split between the calls, and decrypt it back the same way.
+ */
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the cbc stream functions.\n");
+
+  char iv[] = "ABCDabcd1234EFGH";
+  char padding[] = "vdslsilvfdkvlfdn";
+  char passphrase[] = "this is my password";
+
+  static uint8_t plain[MAX_LEN];
+  static uint8_t file[MAX_LEN + 2 * BLOCK_SIZE];
+  static uint8_t cipher[MAX_LEN + 4 * BLOCK_SIZE];
+  static uint8_t decrypted[MAX_LEN + 2 * BLOCK_SIZE];
+
+  kf_key key;
+  kf_key_init(&key, passphrase);
+
+  const size_t sizes[] = {0, 1, 15, 16, 17, 31, 32, 100, 4999};
+
+  for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++) {
+    const size_t size = sizes[n];
+
+    for (size_t i = 0; i < size; i++) {
+      plain[i] = (uint8_t)rand();
+    }
+
+    FILE *f = fopen("kf_stream_plain.txt", "wb");
+    fwrite(plain, 1, size, f);
+    fclose(f);
+
+    kf_encrypt_file_cbc("kf_stream_plain.txt", "kf_stream_enc.txt", passphrase,
+                        iv, padding);
+
+    f = fopen("kf_stream_enc.txt", "rb");
+    const size_t file_len = fread(file, 1, sizeof(file), f);
+    fclose(f);
+
+    kf_cbc_stream s;
+    size_t len = 0;
+
+    kf_cbc_encrypt_init(&s, &key, iv, padding);
+    for (size_t i = 0; i < size;) {
+      size_t step = (size_t)(rand() % 40);
+      if (step > size - i)
+        step = size - i;
+      len += kf_cbc_encrypt_update(&s, plain + i, step, cipher + len);
+      i += step;
+    }
+    len += kf_cbc_encrypt_final(&s, cipher + len);
+
+    int passed = len == file_len && memcmp(cipher, file, len) == 0;
+
+    size_t out_len = 0, last = 0;
+
+    kf_cbc_decrypt_init(&s, &key);
+    for (size_t i = 0; i < len;) {
+      size_t step = (size_t)(rand() % 40);
+      if (step > len - i)
+        step = len - i;
+      out_len += kf_cbc_decrypt_update(&s, cipher + i, step,
+                                       decrypted + out_len);
+      i += step;
+    }
+    passed = passed &&
+             kf_cbc_decrypt_final(&s, decrypted + out_len, &last) == KF_OK &&
+             out_len + last == size && memcmp(decrypted, plain, size) == 0;
+
+    if (passed) {
+      printf("    [*] Test #%d Passed.\n", ++test);
+    } else {
+      printf("    [*] Test #%d Failed.\n", ++test);
+      fail++;
+    }
+  }
+
+  /* whole runs of more than KF_CBC_RUN blocks in one call, on buffers that
+   * are not word aligned, and decrypted in place */
+  static uint8_t odd[MAX_LEN + 4 * BLOCK_SIZE + 1];
+  kf_cbc_stream s;
+  size_t len, out_len, last;
+
+  kf_cbc_encrypt_init(&s, &key, iv, padding);
+  len = kf_cbc_encrypt_update(&s, plain, MAX_LEN, cipher);
+  len += kf_cbc_encrypt_final(&s, cipher + len);
+
+  memcpy(odd + 1, plain, MAX_LEN);
+  kf_cbc_encrypt_init(&s, &key, iv, padding);
+  out_len = kf_cbc_encrypt_update(&s, odd + 1, MAX_LEN, decrypted);
+  out_len += kf_cbc_encrypt_final(&s, decrypted + out_len);
+
+  int passed = out_len == len && memcmp(decrypted, cipher, len) == 0;
+
+  memcpy(odd + 1, cipher, len);
+  kf_cbc_decrypt_init(&s, &key);
+  out_len = kf_cbc_decrypt_update(&s, odd + 1, len, odd + 1);
+  passed = passed &&
+           kf_cbc_decrypt_final(&s, odd + 1 + out_len, &last) == KF_OK &&
+           out_len + last == MAX_LEN && memcmp(odd + 1, plain, MAX_LEN) == 0;
+
+  kf_cbc_decrypt_init(&s, &key);
+  out_len = kf_cbc_decrypt_update(&s, cipher, len, decrypted);
+  passed = passed &&
+           kf_cbc_decrypt_final(&s, decrypted + out_len, &last) == KF_OK &&
+           out_len + last == MAX_LEN && memcmp(decrypted, plain, MAX_LEN) == 0;
+
+  if (passed) {
+    printf("    [*] Test #%d Passed.\n", ++test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++test);
+    fail++;
+  }
+
+  /* a stream cut inside a block is rejected */
+
+  kf_cbc_decrypt_init(&s, &key);
+  kf_cbc_decrypt_update(&s, file, 40, decrypted);
+
+  if (kf_cbc_decrypt_final(&s, decrypted, &last) == KF_ERR_FORMAT) {
+    printf("    [*] Test #%d Passed.\n", ++test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++test);
+    fail++;
+  }
+
+  remove("kf_stream_plain.txt");
+  remove("kf_stream_enc.txt");
+
+  if (fail == 0)
+    printf("[*] All cbc stream tests passed.\n");
+
+  return fail;
+}
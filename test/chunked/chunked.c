@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PLAIN_SIZE 100003
+
+static void report(const int passed, int *test, int *fail) {
+  if (passed) {
+    printf("    [*] Test #%d Passed.\n", ++*test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++*test);
+    (*fail)++;
+  }
+}
+
+static size_t read_file(const char *name, uint8_t *buffer, size_t len) {
+  FILE *f = fopen(name, "rb");
+  size_t got = fread(buffer, 1, len, f);
+  fclose(f);
+  return got;
+}
+
+/*
+ * a chunked container must decrypt back to the plaintext as a whole, and
+ * any byte range of it on its own, and an update must leave it decrypting
+ * to the new plaintext.
+ */
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the chunked container.\n");
+
+  char iv[] = "ABCDabcd1234EFGH";
+  char padding[] = "vdslsilvfdkvlfdn";
+  char passphrase[] = "this is my password";
+
+  static kf_key key;
+  static uint8_t plain[PLAIN_SIZE];
+  static uint8_t back[PLAIN_SIZE + 8192];
+
+  kf_key_init(&key, passphrase);
+
+  for (size_t i = 0; i < PLAIN_SIZE; i++)
+    plain[i] = (uint8_t)(rand() % 26 + 65);
+
+  const size_t sizes[] = {0, 1, 15, 16, 17, 4096, PLAIN_SIZE};
+  const size_t chunks[] = {16, 48, 4096, 0};
+  const kf_opts opts[] = {{1, 0, KF_BACKEND_AUTO}, {3, 4096, KF_BACKEND_AUTO}};
+
+  /* whole files, over chunk sizes and thread counts */
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    FILE *f = fopen("kf_chunked_plain.txt", "wb");
+    fwrite(plain, 1, sizes[s], f);
+    fclose(f);
+
+    int passed = 1;
+
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+      for (size_t o = 0; o < sizeof(opts) / sizeof(opts[0]); o++) {
+        int status = kf_encrypt_file_chunked("kf_chunked_plain.txt",
+                                             "kf_chunked_enc.txt", &key, iv,
+                                             padding, chunks[c], &opts[o]);
+        status |= kf_decrypt_file_chunked("kf_chunked_enc.txt",
+                                          "kf_chunked_dec.txt", &key,
+                                          &opts[o]);
+
+        passed &= status == KF_OK &&
+                  read_file("kf_chunked_dec.txt", back, sizeof(back)) ==
+                      sizes[s] &&
+                  memcmp(plain, back, sizes[s]) == 0;
+      }
+    }
+
+    report(passed, &test, &fail);
+  }
+
+  /* the payload is the same with one thread and with several */
+  static uint8_t one[PLAIN_SIZE + 4096];
+  static uint8_t many[PLAIN_SIZE + 4096];
+
+  kf_encrypt_file_chunked("kf_chunked_plain.txt", "kf_chunked_enc.txt", &key,
+                          iv, padding, 4096, &opts[0]);
+  const size_t one_len = read_file("kf_chunked_enc.txt", one, sizeof(one));
+  kf_encrypt_file_chunked("kf_chunked_plain.txt", "kf_chunked_enc.txt", &key,
+                          iv, padding, 4096, &opts[1]);
+  const size_t many_len = read_file("kf_chunked_enc.txt", many, sizeof(many));
+
+  report(one_len == many_len && memcmp(one, many, one_len) == 0 &&
+             memcmp(one, KF_CHUNKED_MAGIC, 8) == 0,
+         &test, &fail);
+
+  /* ranges inside one chunk, across chunks, and on block boundaries */
+  const uint64_t ranges[][2] = {{0, 1},     {0, 4096},     {17, 1},
+                                {4095, 2},  {4000, 10000}, {16, 16},
+                                {99999, 4}, {0, PLAIN_SIZE}};
+  int passed = 1;
+
+  for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+    size_t got;
+    int status = kf_decrypt_range("kf_chunked_enc.txt", ranges[r][0],
+                                  (size_t)ranges[r][1], &key, back, &got);
+
+    passed &= status == KF_OK && got == ranges[r][1] &&
+              memcmp(back, plain + ranges[r][0], got) == 0;
+  }
+
+  report(passed, &test, &fail);
+
+  /* a range past the end is cut short, one beyond it is empty */
+  size_t got;
+  int status =
+      kf_decrypt_range("kf_chunked_enc.txt", PLAIN_SIZE - 3, 64, &key, back,
+                       &got);
+  report(status == KF_OK && got == 3 &&
+             memcmp(back, plain + PLAIN_SIZE - 3, 3) == 0,
+         &test, &fail);
+
+  status = kf_decrypt_range("kf_chunked_enc.txt", PLAIN_SIZE + 100, 64, &key,
+                            back, &got);
+  report(status == KF_OK && got == 0, &test, &fail);
+
+  /* the range file mode writes the same bytes */
+  status = kf_decrypt_file_range("kf_chunked_enc.txt", "kf_chunked_dec.txt",
+                                 &key, 5000, 20000, &opts[1]);
+  report(status == KF_OK &&
+             read_file("kf_chunked_dec.txt", back, sizeof(back)) == 20000 &&
+             memcmp(back, plain + 5000, 20000) == 0,
+         &test, &fail);
+
+  /* an update rewrites only the chunks that changed */
+  static uint8_t next[PLAIN_SIZE + 5000];
+  uint64_t changed;
+  FILE *f;
+
+  memcpy(next, plain, PLAIN_SIZE);
+  f = fopen("kf_chunked_plain.txt", "wb");
+  fwrite(next, 1, PLAIN_SIZE, f);
+  fclose(f);
+
+  /* without fingerprints the first update rewrites every chunk */
+  kf_encrypt_file_chunked("kf_chunked_plain.txt", "kf_chunked_enc.txt", &key,
+                          iv, padding, 4096, &opts[0]);
+  status = kf_update_file_chunked("kf_chunked_plain.txt", "kf_chunked_enc.txt",
+                                  &key, padding, &opts[1], &changed);
+  report(status == KF_OK && changed == (PLAIN_SIZE + 4095) / 4096, &test,
+         &fail);
+
+  kf_encrypt_file_chunked_updatable("kf_chunked_plain.txt",
+                                    "kf_chunked_enc.txt", &key, iv, padding,
+                                    4096, &opts[0]);
+  status = kf_update_file_chunked("kf_chunked_plain.txt", "kf_chunked_enc.txt",
+                                  &key, padding, &opts[1], &changed);
+  report(status == KF_OK && changed == 0 &&
+             read_file("kf_chunked_enc.txt", many, sizeof(many)) == one_len,
+         &test, &fail);
+
+  next[10] ^= 1;
+  next[50000] ^= 1;
+  next[50001] ^= 1;
+  f = fopen("kf_chunked_plain.txt", "wb");
+  fwrite(next, 1, PLAIN_SIZE, f);
+  fclose(f);
+
+  status = kf_update_file_chunked("kf_chunked_plain.txt", "kf_chunked_enc.txt",
+                                  &key, padding, &opts[1], &changed);
+  status |= kf_decrypt_file_chunked("kf_chunked_enc.txt", "kf_chunked_dec.txt",
+                                    &key, NULL);
+  report(status == KF_OK && changed == 2 &&
+             read_file("kf_chunked_dec.txt", back, sizeof(back)) ==
+                 PLAIN_SIZE &&
+             memcmp(back, next, PLAIN_SIZE) == 0,
+         &test, &fail);
+
+  /* the untouched chunks keep their ciphertext */
+  read_file("kf_chunked_enc.txt", many, sizeof(many));
+  report(memcmp(one + KF_CHUNKED_HEADER + 4096,
+                many + KF_CHUNKED_HEADER + 4096, 8 * 4096) == 0 &&
+             memcmp(one + KF_CHUNKED_HEADER, many + KF_CHUNKED_HEADER,
+                    4096) != 0,
+         &test, &fail);
+
+  /* growing and shrinking change the layout, so the container is rebuilt */
+  const size_t lengths[] = {PLAIN_SIZE + 5000, PLAIN_SIZE - 9000, 0, 17};
+
+  for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+    for (size_t i = PLAIN_SIZE; i < lengths[l]; i++)
+      next[i] = (uint8_t)i;
+
+    f = fopen("kf_chunked_plain.txt", "wb");
+    fwrite(next, 1, lengths[l], f);
+    fclose(f);
+
+    status = kf_update_file_chunked("kf_chunked_plain.txt",
+                                    "kf_chunked_enc.txt", &key, padding,
+                                    &opts[0], &changed);
+    status |= kf_decrypt_file_chunked("kf_chunked_enc.txt",
+                                      "kf_chunked_dec.txt", &key, NULL);
+    report(status == KF_OK &&
+               read_file("kf_chunked_dec.txt", back, sizeof(back)) ==
+                   lengths[l] &&
+               memcmp(back, next, lengths[l]) == 0,
+           &test, &fail);
+  }
+
+  /* a file that is not a container is rejected */
+  report(kf_decrypt_range("kf_chunked_plain.txt", 0, 16, &key, back, &got) ==
+             KF_ERR_FORMAT,
+         &test, &fail);
+
+  /* a truncated container is rejected */
+  f = fopen("kf_chunked_enc.txt", "wb");
+  fwrite(one, 1, one_len - 100, f);
+  fclose(f);
+
+  report(kf_decrypt_file_chunked("kf_chunked_enc.txt", "kf_chunked_dec.txt",
+                                 &key, NULL) == KF_ERR_FORMAT,
+         &test, &fail);
+
+  /* the header goes ahead of the data, so stdin can not be encrypted */
+  report(kf_encrypt_file_chunked("-", "kf_chunked_enc.txt", &key, iv,
+                                 padding, 0, NULL) == KF_ERR_READ,
+         &test, &fail);
+
+  /* compressed containers decrypt, whole and in ranges, like plain ones */
+  if (kf_deflate_enabled()) {
+    static uint8_t mixed[PLAIN_SIZE];
+    static uint8_t stored[PLAIN_SIZE + 8192];
+
+    /* letters compress, random bytes do not and are stored as they are */
+    for (size_t i = 0; i < PLAIN_SIZE; i++)
+      mixed[i] = i < PLAIN_SIZE / 2 ? plain[i] : (uint8_t)rand();
+
+    int passed = 1;
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+      f = fopen("kf_chunked_plain.txt", "wb");
+      fwrite(mixed, 1, sizes[s], f);
+      fclose(f);
+
+      for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        for (size_t o = 0; o < sizeof(opts) / sizeof(opts[0]); o++) {
+          status = kf_encrypt_file_chunked_deflate(
+              "kf_chunked_plain.txt", "kf_chunked_enc.txt", &key, iv,
+              padding, chunks[c], 1 + (int)(4 * o), &opts[o]);
+          status |= kf_decrypt_file_chunked("kf_chunked_enc.txt",
+                                            "kf_chunked_dec.txt", &key,
+                                            &opts[o]);
+
+          passed &= status == KF_OK &&
+                    read_file("kf_chunked_dec.txt", back, sizeof(back)) ==
+                        sizes[s] &&
+                    memcmp(mixed, back, sizes[s]) == 0;
+        }
+      }
+    }
+    report(passed, &test, &fail);
+
+    status = kf_encrypt_file_chunked_deflate("kf_chunked_plain.txt",
+                                             "kf_chunked_enc.txt", &key, iv,
+                                             padding, 4096, 0, &opts[1]);
+    const size_t stored_len =
+        read_file("kf_chunked_enc.txt", stored, sizeof(stored));
+
+    passed = status == KF_OK;
+    for (size_t r = 0; r < 200; r++) {
+      const uint64_t at = (uint64_t)rand() % PLAIN_SIZE;
+      const size_t n = (size_t)rand() % 10000;
+      const size_t want = n < PLAIN_SIZE - at ? n : PLAIN_SIZE - at;
+
+      status = kf_decrypt_range("kf_chunked_enc.txt", at, n, &key, back, &got);
+      passed &= status == KF_OK && got == want &&
+                memcmp(back, mixed + at, want) == 0;
+    }
+    report(passed, &test, &fail);
+
+    /* the letters shrink, and the random bytes are stored as they are */
+    report(stored_len < PLAIN_SIZE * 9 / 10 && stored_len > PLAIN_SIZE / 2,
+           &test, &fail);
+
+    /* and it can not be updated */
+    report(kf_update_file_chunked("kf_chunked_plain.txt", "kf_chunked_enc.txt",
+                                  &key, padding, NULL,
+                                  NULL) == KF_ERR_UNSUPPORTED,
+           &test, &fail);
+  } else {
+    report(kf_encrypt_file_chunked_deflate("kf_chunked_plain.txt",
+                                           "kf_chunked_enc.txt", &key, iv,
+                                           padding, 0, 0,
+                                           NULL) == KF_ERR_UNSUPPORTED,
+           &test, &fail);
+  }
+
+  kf_wipe(&key, sizeof(key));
+
+  remove("kf_chunked_plain.txt");
+  remove("kf_chunked_enc.txt");
+  remove("kf_chunked_dec.txt");
+
+  if (fail == 0)
+    printf("[*] All chunked tests passed.\n");
+
+  return fail;
+}
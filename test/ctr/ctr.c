@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#define BUFFER_SIZE 4099
+
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the ctr functions.\n");
+
+  char iv[] = "ABCDabcd1234EFGH";
+  char passphrase[] = "this is my password";
+
+  kf_ctx ctx;
+  kf_expand_passphrase(passphrase, &ctx);
+
+  static uint8_t plain[BUFFER_SIZE], enc[BUFFER_SIZE], enc2[BUFFER_SIZE],
+      dec[BUFFER_SIZE];
+
+  for (int i = 0; i < BUFFER_SIZE; i++) {
+    plain[i] = rand() % 256;
+  }
+
+  /* the first keystream block is the encrypted iv */
+  uint32_t block[4], stream[4];
+  memcpy(block, iv, BLOCK_SIZE);
+  kf_block(block, stream, &ctx);
+
+  kf_ctr(plain, enc, BUFFER_SIZE, iv, 0, &ctx);
+
+  int ok = 1;
+  for (int i = 0; i < BLOCK_SIZE; i++) {
+    if ((enc[i] ^ plain[i]) != ((uint8_t *)stream)[i])
+      ok = 0;
+  }
+
+  if (ok) {
+    printf("    [*] Test #%d Passed.\n", ++test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++test);
+    fail++;
+  }
+
+  /* processing in block aligned pieces matches a single call */
+  kf_ctr(plain, enc2, 48, iv, 0, &ctx);
+  kf_ctr(plain + 48, enc2 + 48, 1024, iv, 3, &ctx);
+  kf_ctr(plain + 1072, enc2 + 1072, BUFFER_SIZE - 1072, iv, 67, &ctx);
+
+  if (memcmp(enc, enc2, BUFFER_SIZE) == 0) {
+    printf("    [*] Test #%d Passed.\n", ++test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++test);
+    fail++;
+  }
+
+  /* decryption is the same operation, and works in place */
+  memcpy(dec, enc, BUFFER_SIZE);
+  kf_ctr(dec, dec, BUFFER_SIZE, iv, 0, &ctx);
+
+  if (memcmp(plain, dec, BUFFER_SIZE) == 0) {
+    printf("    [*] Test #%d Passed.\n", ++test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++test);
+    fail++;
+  }
+
+  for (int i = 0; i < 64; i++) {
+    FILE *f = fopen("kf_test_plain.txt", "wb");
+    fwrite(plain, sizeof(char), i * 37, f);
+    fclose(f);
+
+    kf_encrypt_file_ctr("kf_test_plain.txt", "kf_test_enc.txt", passphrase,
+                        iv);
+    kf_decrypt_file_ctr("kf_test_enc.txt", "kf_test_dec.txt", passphrase);
+
+    f = fopen("kf_test_enc.txt", "rb");
+    fseek(f, 0L, SEEK_END);
+    const long enc_size = ftell(f);
+    fclose(f);
+
+    memset(dec, 0, BUFFER_SIZE);
+    f = fopen("kf_test_dec.txt", "rb");
+    const size_t dec_size = fread(dec, sizeof(char), BUFFER_SIZE, f);
+    fclose(f);
+
+    if (enc_size == i * 37 + BLOCK_SIZE && dec_size == (size_t)i * 37 &&
+        memcmp(plain, dec, dec_size) == 0) {
+      printf("    [*] Test #%d Passed.\n", ++test);
+    } else {
+      printf("    [*] Test #%d Failed.\n", ++test);
+      fail++;
+    }
+
+    remove("kf_test_plain.txt");
+    remove("kf_test_enc.txt");
+    remove("kf_test_dec.txt");
+  }
+
+  if (fail == 0)
+    printf("[*] All ctr tests passed.\n");
+
+  return fail;
+}
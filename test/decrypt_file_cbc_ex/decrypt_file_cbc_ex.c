@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+static int compare_files(const char *a, const char *b) {
+  FILE *in = fopen(a, "rb");
+  FILE *in2 = fopen(b, "rb");
+
+  int ch1 = getc(in);
+  int ch2 = getc(in2);
+
+  while ((ch1 != EOF) && (ch2 != EOF) && (ch1 == ch2)) {
+    ch1 = getc(in);
+    ch2 = getc(in2);
+  }
+
+  fclose(in);
+  fclose(in2);
+
+  return ch1 == ch2;
+}
+
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the decrypt_file_cbc_ex function.\n");
+
+  char iv[] = "ABCDabcd1234EFGH";
+  char padding[] = "vdslsilvfdkvlfdn";
+  char passphrase[] = "this is my password";
+
+  const long sizes[] = {0, 15, 16, 1000, KF_BUFFER_SIZE,
+                        3 * KF_BUFFER_SIZE + 7};
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    FILE *f = fopen("kf_test_plain.txt", "wb");
+    for (long i = 0; i < sizes[s]; i++) {
+      putc(rand() % 26 + 65, f);
+    }
+    fclose(f);
+
+    kf_encrypt_file_cbc("kf_test_plain.txt", "kf_test_enc.txt", passphrase, iv,
+                        padding);
+
+    for (size_t threads = 1; threads <= 4; threads++) {
+      /* odd thread counts use the default buffer, even ones a tiny one */
+      kf_opts opts = {threads, threads % 2 ? KF_BUFFER_SIZE : 1000,
+                      KF_BACKEND_STDIO};
+
+      int status = kf_decrypt_file_cbc_ex("kf_test_enc.txt", "kf_test_dec.txt",
+                                          passphrase, &opts);
+
+      if (status == KF_OK &&
+          compare_files("kf_test_plain.txt", "kf_test_dec.txt")) {
+        printf("    [*] Test #%d Passed.\n", ++test);
+      } else {
+        printf("    [*] Test #%d Failed.\n", ++test);
+        fail++;
+      }
+
+      remove("kf_test_dec.txt");
+    }
+
+    remove("kf_test_plain.txt");
+    remove("kf_test_enc.txt");
+  }
+
+  /* every plaintext length around the read-ahead of a 3 block buffer */
+  int exact = 1;
+
+  for (long size = 0; size < 100; size++) {
+    FILE *f = fopen("kf_test_plain.txt", "wb");
+    for (long i = 0; i < size; i++) {
+      putc(rand() % 26 + 65, f);
+    }
+    fclose(f);
+
+    kf_opts opts = {1, 3 * BLOCK_SIZE, KF_BACKEND_STDIO};
+
+    kf_encrypt_file_cbc("kf_test_plain.txt", "kf_test_enc.txt", passphrase, iv,
+                        padding);
+    exact &= kf_decrypt_file_cbc_ex("kf_test_enc.txt", "kf_test_dec.txt",
+                                    passphrase, &opts) == KF_OK &&
+             compare_files("kf_test_plain.txt", "kf_test_dec.txt");
+  }
+
+  if (exact) {
+    printf("    [*] Test #%d Passed.\n", ++test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++test);
+    fail++;
+  }
+
+  /* ciphertexts of the wrong length are rejected */
+  const long bad[] = {0, 15, 16, 17, 33, 47};
+  int rejected = 1;
+
+  for (size_t b = 0; b < sizeof(bad) / sizeof(bad[0]); b++) {
+    FILE *f = fopen("kf_test_enc.txt", "wb");
+    for (long i = 0; i < bad[b]; i++) {
+      putc(rand() % 256, f);
+    }
+    fclose(f);
+
+    kf_opts opts = {1, 3 * BLOCK_SIZE, KF_BACKEND_STDIO};
+
+    rejected &= kf_decrypt_file_cbc_ex("kf_test_enc.txt", "kf_test_dec.txt",
+                                       passphrase, &opts) == KF_ERR_FORMAT;
+  }
+
+  if (rejected) {
+    printf("    [*] Test #%d Passed.\n", ++test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++test);
+    fail++;
+  }
+
+  /* the input can be stdin, which is never seeked */
+  kf_encrypt_file_cbc("kf_test_plain.txt", "kf_test_enc.txt", passphrase, iv,
+                      padding);
+
+  if (freopen("kf_test_enc.txt", "rb", stdin) &&
+      kf_decrypt_file_cbc_ex("-", "kf_test_dec.txt", passphrase, NULL) ==
+          KF_OK &&
+      compare_files("kf_test_plain.txt", "kf_test_dec.txt")) {
+    printf("    [*] Test #%d Passed.\n", ++test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++test);
+    fail++;
+  }
+
+  /* one pool decrypts buffer after buffer as the calling thread alone does */
+  static kf_key key;
+  static uint32_t cipher[4 * 4097];
+  static uint32_t single[4 * 4096];
+  static uint32_t pooled[4 * 4096];
+
+  kf_key_init(&key, passphrase);
+
+  for (size_t i = 0; i < sizeof(cipher) / sizeof(cipher[0]); i++)
+    cipher[i] = (uint32_t)rand();
+
+  kf_cbc_pool *pool = kf_cbc_pool_create(4);
+  const size_t lengths[] = {4096, 1, 31, 32, 33, 4095, 4096};
+  int same = pool != NULL;
+
+  for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+    kf_cbc_decrypt_pool(NULL, cipher + 4, single, lengths[l], &key);
+    kf_cbc_decrypt_pool(pool, cipher + 4, pooled, lengths[l], &key);
+    same &= memcmp(single, pooled, lengths[l] * BLOCK_SIZE) == 0;
+  }
+
+  kf_cbc_pool_destroy(pool);
+
+  if (same) {
+    printf("    [*] Test #%d Passed.\n", ++test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++test);
+    fail++;
+  }
+
+  remove("kf_test_plain.txt");
+  remove("kf_test_enc.txt");
+  remove("kf_test_dec.txt");
+
+  if (fail == 0)
+    printf("[*] All decrypt_file_cbc_ex tests passed.\n");
+
+  return fail;
+}
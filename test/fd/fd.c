@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+/* O_DIRECT */
+#define _GNU_SOURCE
+
+#include "../../src/kf128.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PLAIN_SIZE 100000
+
+static void report(const int passed, int *test, int *fail) {
+  if (passed) {
+    printf("    [*] Test #%d Passed.\n", ++*test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++*test);
+    (*fail)++;
+  }
+}
+
+static size_t read_file(const char *name, uint8_t *buffer, size_t len) {
+  FILE *f = fopen(name, "rb");
+  if (!f)
+    return 0;
+  size_t got = fread(buffer, 1, len, f);
+  fclose(f);
+  return got;
+}
+
+static void write_file(const char *name, const uint8_t *buffer, size_t len) {
+  FILE *f = fopen(name, "wb");
+  fwrite(buffer, 1, len, f);
+  fclose(f);
+}
+
+/* run an fd function from one named file to another */
+static int run(const int mode, const char *infile, const char *outfile,
+               const kf_key *key, const char *iv, const kf_opts *opts,
+               const int flags) {
+  const int in = open(infile, O_RDONLY | flags);
+  const int out = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  char padding[] = "0123456789abcdef";
+  int status = KF_ERR_OPEN;
+
+  if (in >= 0 && out >= 0) {
+    switch (mode) {
+    case 0:
+      status = kf_encrypt_fd_cbc(in, out, key, iv, padding, opts);
+      break;
+    case 1:
+      status = kf_decrypt_fd_cbc(in, out, key, opts);
+      break;
+    case 2:
+      status = kf_encrypt_fd_ctr(in, out, key, iv, opts);
+      break;
+    default:
+      status = kf_decrypt_fd_ctr(in, out, key, opts);
+      break;
+    }
+  }
+
+  if (in >= 0)
+    close(in);
+  if (out >= 0)
+    close(out);
+
+  return status;
+}
+
+/* compare the fd functions with the file modes on one plaintext size */
+static int matches(const kf_key *key, const char *iv, const uint8_t *plain,
+                   const size_t len, const kf_opts *opts, const int flags) {
+  static uint8_t want[PLAIN_SIZE + 2 * BLOCK_SIZE];
+  static uint8_t got[PLAIN_SIZE + 2 * BLOCK_SIZE];
+  char padding[] = "0123456789abcdef";
+  int passed = 1;
+
+  write_file("kf_fd_plain.txt", plain, len);
+
+  kf_encrypt_file_cbc_key("kf_fd_plain.txt", "kf_fd_want.txt", key, iv,
+                          padding, NULL);
+  passed &= run(0, "kf_fd_plain.txt", "kf_fd_enc.txt", key, iv, opts,
+                flags) == KF_OK;
+
+  size_t want_len = read_file("kf_fd_want.txt", want, sizeof(want));
+  size_t got_len = read_file("kf_fd_enc.txt", got, sizeof(got));
+  passed &= want_len == got_len && memcmp(want, got, want_len) == 0;
+
+  passed &= run(1, "kf_fd_enc.txt", "kf_fd_dec.txt", key, iv, opts, flags) ==
+            KF_OK;
+  passed &= read_file("kf_fd_dec.txt", got, sizeof(got)) == len &&
+            memcmp(got, plain, len) == 0;
+
+  kf_encrypt_file_ctr_key("kf_fd_plain.txt", "kf_fd_want.txt", key, iv,
+                          NULL);
+  passed &= run(2, "kf_fd_plain.txt", "kf_fd_enc.txt", key, iv, opts,
+                flags) == KF_OK;
+
+  want_len = read_file("kf_fd_want.txt", want, sizeof(want));
+  got_len = read_file("kf_fd_enc.txt", got, sizeof(got));
+  passed &= want_len == got_len && memcmp(want, got, want_len) == 0;
+
+  passed &= run(3, "kf_fd_enc.txt", "kf_fd_dec.txt", key, iv, opts, flags) ==
+            KF_OK;
+  passed &= read_file("kf_fd_dec.txt", got, sizeof(got)) == len &&
+            memcmp(got, plain, len) == 0;
+
+  return passed;
+}
+
+/*
+ * the fd functions must give the output of the file modes, whatever the
+ * size of the input and of the buffer, and from files, pipes and direct io.
+ */
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the fd functions.\n");
+
+  char iv[] = "ABCDabcd1234EFGH";
+  char padding[] = "0123456789abcdef";
+
+  static kf_key key;
+  static uint8_t plain[PLAIN_SIZE];
+  static uint8_t got[PLAIN_SIZE + 2 * BLOCK_SIZE];
+
+  kf_key_init(&key, "this is my password");
+
+  for (size_t i = 0; i < PLAIN_SIZE; i++)
+    plain[i] = (uint8_t)(rand() % 26 + 65);
+
+  const size_t lens[] = {0,    1,    15,   16,    17,    4079,      4080,
+                         4095, 4096, 4097, 12288, 12345, PLAIN_SIZE};
+  const size_t nlens = sizeof(lens) / sizeof(lens[0]);
+  const kf_opts small = {2, 4096, 0};
+  int passed;
+
+  /* the default buffer */
+  passed = 1;
+  for (size_t l = 0; l < nlens; l++)
+    passed &= matches(&key, iv, plain, lens[l], NULL, 0);
+  report(passed, &test, &fail);
+
+  /* a buffer of one page, so the input ends on and across buffers */
+  passed = 1;
+  for (size_t l = 0; l < nlens; l++)
+    passed &= matches(&key, iv, plain, lens[l], &small, 0);
+  report(passed, &test, &fail);
+
+  /* direct io where the file system has it */
+  passed = 1;
+#ifdef O_DIRECT
+  write_file("kf_fd_plain.txt", plain, 1);
+  const int direct = open("kf_fd_plain.txt", O_RDONLY | O_DIRECT);
+
+  if (direct >= 0) {
+    close(direct);
+    for (size_t l = 0; l < nlens; l++)
+      passed &= matches(&key, iv, plain, lens[l], &small, O_DIRECT);
+  }
+#endif
+  report(passed, &test, &fail);
+
+  /* from a pipe, which gives the input in pieces and can not seek */
+  int fds[2];
+  const size_t piped = 5000;
+
+  passed = pipe(fds) == 0 &&
+           write(fds[1], plain, piped) == (ssize_t)piped && close(fds[1]) == 0;
+
+  const int out = open("kf_fd_enc.txt", O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+  passed &= kf_encrypt_fd_cbc(fds[0], out, &key, iv, padding, &small) ==
+            KF_OK;
+  close(fds[0]);
+  close(out);
+
+  passed &= kf_decrypt_file_cbc_key("kf_fd_enc.txt", "kf_fd_dec.txt", &key,
+                                    NULL) == KF_OK &&
+            read_file("kf_fd_dec.txt", got, sizeof(got)) == piped &&
+            memcmp(got, plain, piped) == 0;
+  report(passed, &test, &fail);
+
+  /* a ciphertext cut short or not a whole number of blocks is refused */
+  const size_t cuts[] = {0, 15, 16, 17, 4096 + 23};
+
+  write_file("kf_fd_plain.txt", plain, 4096);
+  kf_encrypt_file_cbc_key("kf_fd_plain.txt", "kf_fd_want.txt", &key, iv,
+                          padding, NULL);
+  read_file("kf_fd_want.txt", got, sizeof(got));
+
+  passed = 1;
+  for (size_t c = 0; c < sizeof(cuts) / sizeof(cuts[0]); c++) {
+    write_file("kf_fd_enc.txt", got, cuts[c]);
+    passed &= run(1, "kf_fd_enc.txt", "kf_fd_dec.txt", &key, iv, &small,
+                  0) == KF_ERR_FORMAT;
+  }
+  passed &= run(3, "kf_fd_enc.txt", "kf_fd_dec.txt", &key, iv, &small, 0) ==
+            KF_OK;
+  write_file("kf_fd_enc.txt", got, 15);
+  passed &= run(3, "kf_fd_enc.txt", "kf_fd_dec.txt", &key, iv, &small, 0) ==
+            KF_ERR_FORMAT;
+  report(passed, &test, &fail);
+
+  kf_wipe(&key, sizeof(key));
+
+  remove("kf_fd_plain.txt");
+  remove("kf_fd_want.txt");
+  remove("kf_fd_enc.txt");
+  remove("kf_fd_dec.txt");
+
+  if (fail == 0)
+    printf("[*] All fd tests passed.\n");
+
+  return fail;
+}
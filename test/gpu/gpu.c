@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* two slices and a part block, so the second pinned buffer is used */
+#define PLAIN_SIZE (KF_GPU_SLICE + KF_GPU_SLICE / 2 + 7)
+#define SMALL_SIZE 10007
+
+static void report(const int passed, int *test, int *fail) {
+  if (passed) {
+    printf("    [*] Test #%d Passed.\n", ++*test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++*test);
+    (*fail)++;
+  }
+}
+
+static size_t read_file(const char *name, uint8_t *buffer, size_t len) {
+  FILE *f = fopen(name, "rb");
+  if (!f)
+    return 0;
+  size_t got = fread(buffer, 1, len, f);
+  fclose(f);
+  return got;
+}
+
+static void write_file(const char *name, const uint8_t *buffer, size_t len) {
+  FILE *f = fopen(name, "wb");
+  fwrite(buffer, 1, len, f);
+  fclose(f);
+}
+
+/*
+ * the gpu backend must give the output of the cpu counter mode, whether a
+ * device does the work or the cpu does it in its place, so the same tests
+ * pass on a machine without a gpu.
+ */
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the gpu backend.\n");
+
+  char iv[] = "ABCDabcd1234EFGH";
+  char passphrase[] = "this is my password";
+
+  static kf_key key;
+  static uint8_t plain[PLAIN_SIZE];
+  static uint8_t cpu[PLAIN_SIZE + BLOCK_SIZE];
+  static uint8_t gpu[PLAIN_SIZE + BLOCK_SIZE];
+
+  kf_key_init(&key, passphrase);
+
+  for (size_t i = 0; i < PLAIN_SIZE; i++)
+    plain[i] = (uint8_t)(rand() % 26 + 65);
+
+  kf_gpu *g = kf_gpu_create(&key.x);
+
+  if (!g)
+    printf("    [*] No gpu device, testing the cpu fallback.\n");
+  report((g != NULL) == (kf_gpu_available() != 0), &test, &fail);
+
+  /* the buffer function, above and below the threshold */
+  kf_ctr_x(plain, cpu, PLAIN_SIZE, iv, 5, &key.x);
+  kf_ctr_gpu(g, plain, gpu, PLAIN_SIZE, iv, 5, &key.x);
+  report(memcmp(cpu, gpu, PLAIN_SIZE) == 0, &test, &fail);
+
+  kf_ctr_gpu(g, plain, gpu, SMALL_SIZE, iv, 5, &key.x);
+  report(memcmp(cpu, gpu, SMALL_SIZE) == 0, &test, &fail);
+
+  kf_gpu_destroy(g);
+
+  /* the file functions, against the stdio counter mode */
+  int status = KF_OK;
+  int passed = 1;
+  const size_t sizes[] = {PLAIN_SIZE, SMALL_SIZE};
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const size_t size = sizes[s];
+
+    write_file("kf_gpu_plain.txt", plain, size);
+
+    status |= kf_encrypt_file_ctr_key("kf_gpu_plain.txt", "kf_gpu_cpu.txt",
+                                      &key, iv, NULL);
+    status |= kf_encrypt_file_ctr_gpu("kf_gpu_plain.txt", "kf_gpu_enc.txt",
+                                      &key, iv, NULL);
+    passed &= read_file("kf_gpu_cpu.txt", cpu, sizeof(cpu)) == size + 16 &&
+              read_file("kf_gpu_enc.txt", gpu, sizeof(gpu)) == size + 16 &&
+              memcmp(cpu, gpu, size + 16) == 0;
+
+    status |= kf_decrypt_file_ctr_gpu("kf_gpu_enc.txt", "kf_gpu_dec.txt",
+                                      &key, NULL);
+    passed &= read_file("kf_gpu_dec.txt", gpu, sizeof(gpu)) == size &&
+              memcmp(gpu, plain, size) == 0;
+  }
+  report(status == KF_OK && passed, &test, &fail);
+
+  /* a file shorter than the iv is refused, as by the cpu */
+  write_file("kf_gpu_bad.txt", plain, BLOCK_SIZE - 1);
+  report(kf_decrypt_file_ctr_gpu("kf_gpu_bad.txt", "kf_gpu_dec.txt", &key,
+                                 NULL) == KF_ERR_FORMAT,
+         &test, &fail);
+
+  remove("kf_gpu_plain.txt");
+  remove("kf_gpu_cpu.txt");
+  remove("kf_gpu_enc.txt");
+  remove("kf_gpu_dec.txt");
+  remove("kf_gpu_bad.txt");
+
+  if (fail == 0)
+    printf("[*] All gpu tests passed.\n");
+
+  return fail;
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PLAIN_SIZE 20000
+#define SEGS 12
+
+static void report(const int passed, int *test, int *fail) {
+  if (passed) {
+    printf("    [*] Test #%d Passed.\n", ++*test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++*test);
+    (*fail)++;
+  }
+}
+
+/* cut a buffer into segments of the given lengths */
+static void split(struct iovec *v, uint8_t *buffer, const size_t *lens,
+                  const int n) {
+  for (int i = 0; i < n; i++) {
+    v[i].iov_base = buffer;
+    v[i].iov_len = lens[i];
+    buffer += lens[i];
+  }
+}
+
+/*
+ * a message cut into buffers that end anywhere must come out as it does
+ * whole, in place or not, in every mode with a scatter-gather variant.
+ */
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the scatter-gather functions.\n");
+
+  char iv[] = "ABCDabcd1234EFGH";
+  char padding[] = "0123456789abcdef";
+
+  static kf_key key;
+  static uint8_t plain[PLAIN_SIZE];
+  static uint8_t want[PLAIN_SIZE + 2 * BLOCK_SIZE];
+  static uint8_t got[PLAIN_SIZE + 2 * BLOCK_SIZE];
+  static uint8_t back[PLAIN_SIZE + BLOCK_SIZE];
+
+  const size_t lens[SEGS] = {0, 1, 15, 17, 1000, 16, 3, 4096, 5, 0, 9999, 1};
+  size_t total = 0;
+
+  for (int i = 0; i < SEGS; i++)
+    total += lens[i];
+
+  struct iovec in[SEGS];
+  struct iovec out[SEGS];
+
+  kf_key_init(&key, "this is my password");
+
+  for (size_t i = 0; i < PLAIN_SIZE; i++)
+    plain[i] = (uint8_t)(rand() % 26 + 65);
+
+  /* counter mode, from any counter */
+  int passed = 1;
+  const uint64_t counters[] = {0, 1, 1000};
+
+  for (size_t c = 0; c < sizeof(counters) / sizeof(counters[0]); c++) {
+    kf_ctr_x(plain, want, total, iv, counters[c], &key.x);
+
+    memset(got, 0, sizeof(got));
+    split(in, plain, lens, SEGS);
+    split(out, got, lens, SEGS);
+    kf_ctr_iov(in, out, SEGS, iv, counters[c], &key.x);
+
+    passed &= memcmp(want, got, total) == 0;
+  }
+  report(passed, &test, &fail);
+
+  /* in place, and back */
+  split(in, got, lens, SEGS);
+  kf_ctr_iov(in, in, SEGS, iv, 1000, &key.x);
+  report(memcmp(got, plain, total) == 0, &test, &fail);
+
+  /* a stream fed a byte at a time */
+  kf_ctr_stream s;
+
+  kf_ctr_x(plain, want, total, iv, 0, &key.x);
+  kf_ctr_stream_init(&s, &key.x, iv, 0, total);
+  for (size_t i = 0; i < total; i++)
+    kf_ctr_stream_update(&s, plain + i, got + i, 1);
+  report(memcmp(want, got, total) == 0, &test, &fail);
+
+  /* aead mode gives the ciphertext and tag of the whole message */
+  uint8_t want_tag[KF_TAG_SIZE];
+  uint8_t tag[KF_TAG_SIZE];
+
+  kf_aead_encrypt(plain, want, total, iv, &key, want_tag);
+  split(in, plain, lens, SEGS);
+  split(out, got, lens, SEGS);
+  kf_aead_encrypt_iov(in, out, SEGS, iv, &key, tag);
+
+  report(memcmp(want, got, total) == 0 &&
+             memcmp(want_tag, tag, KF_TAG_SIZE) == 0,
+         &test, &fail);
+
+  /* and opens in place */
+  split(in, got, lens, SEGS);
+  report(kf_aead_decrypt_iov(in, in, SEGS, iv, &key, tag) == KF_OK &&
+             memcmp(got, plain, total) == 0,
+         &test, &fail);
+
+  /* a changed byte is refused and every buffer is wiped */
+  kf_aead_encrypt_iov(in, in, SEGS, iv, &key, tag);
+  got[total / 2] ^= 0x01;
+
+  passed = kf_aead_decrypt_iov(in, in, SEGS, iv, &key, tag) == KF_ERR_AUTH;
+  for (size_t i = 0; i < total; i++)
+    passed &= got[i] == 0;
+  report(passed, &test, &fail);
+
+  /* the cbc stream gives what it does fed the whole message at once */
+  kf_cbc_stream c;
+  size_t want_len, got_len, back_len, last;
+
+  kf_cbc_encrypt_init(&c, &key, iv, padding);
+  want_len = kf_cbc_encrypt_update(&c, plain, total, want);
+  want_len += kf_cbc_encrypt_final(&c, want + want_len);
+
+  split(in, plain, lens, SEGS);
+  kf_cbc_encrypt_init(&c, &key, iv, padding);
+  got_len = kf_cbc_encrypt_update_iov(&c, in, SEGS, got);
+  got_len += kf_cbc_encrypt_final(&c, got + got_len);
+
+  report(got_len == want_len && memcmp(want, got, want_len) == 0, &test,
+         &fail);
+
+  /* and decrypts from buffers cut across the blocks */
+  const size_t cuts[SEGS] = {7, 0, 16, 33, 1, 4000, 15, 17, 2, 0, 1, 0};
+  size_t rest = got_len;
+
+  for (int i = 0; i < SEGS - 1; i++)
+    rest -= cuts[i];
+
+  split(in, got, cuts, SEGS - 1);
+  in[SEGS - 1].iov_base = got + got_len - rest;
+  in[SEGS - 1].iov_len = rest;
+
+  kf_cbc_decrypt_init(&c, &key);
+  back_len = kf_cbc_decrypt_update_iov(&c, in, SEGS, back);
+  passed = kf_cbc_decrypt_final(&c, back + back_len, &last) == KF_OK;
+  back_len += last;
+
+  report(passed && back_len == total && memcmp(back, plain, total) == 0,
+         &test, &fail);
+
+  kf_wipe(&key, sizeof(key));
+
+  if (fail == 0)
+    printf("[*] All scatter-gather tests passed.\n");
+
+  return fail;
+}
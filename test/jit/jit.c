@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "../../src/kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_BLOCKS 4099
+
+static void report(const int passed, int *test, int *fail) {
+  if (passed) {
+    printf("    [*] Test #%d Passed.\n", ++*test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++*test);
+    (*fail)++;
+  }
+}
+
+/* compare a jit object with kf_block_n_k over many block counts */
+static int matches(const kf_jit *jit, const kf_key *key, const kf_sched *k,
+                   const uint32_t *in) {
+  static uint32_t want[MAX_BLOCKS * 4];
+  static uint32_t got[MAX_BLOCKS * 4];
+
+  const size_t counts[] = {0, 1, 2, 3, 4, 5, 8, 9, 64, MAX_BLOCKS};
+  int passed = 1;
+
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+    const size_t n = counts[c];
+
+    kf_block_n_k(in, want, n, &key->x, k);
+    memset(got, 0, sizeof(got));
+    kf_jit_block_n(jit, in, got, n);
+
+    passed &= memcmp(want, got, n * BLOCK_SIZE) == 0 &&
+              got[4 * n] == 0;
+  }
+
+  return passed;
+}
+
+/*
+ * the specialised block function must give the same output as the
+ * multi-block kernels, for both directions, whether or not code could be
+ * emitted.
+ */
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the jit block function.\n");
+
+  static kf_key key;
+  static uint32_t in[MAX_BLOCKS * 4];
+  static uint32_t buf[MAX_BLOCKS * 4];
+
+  kf_key_init(&key, "this is my password");
+
+  for (size_t i = 0; i < MAX_BLOCKS * 4; i++)
+    in[i] = (uint32_t)rand() ^ (uint32_t)rand() << 16;
+
+  kf_jit *enc = kf_jit_create(&key.x, &key.x.sched);
+  kf_jit *dec = kf_jit_create(&key.x, &key.inv);
+
+  report(enc && dec, &test, &fail);
+
+  report(matches(enc, &key, &key.x.sched, in), &test, &fail);
+  report(matches(dec, &key, &key.inv, in), &test, &fail);
+
+  /* in place, and back */
+  memcpy(buf, in, sizeof(buf));
+  kf_jit_block_n(enc, buf, buf, MAX_BLOCKS);
+  kf_jit_block_n(dec, buf, buf, MAX_BLOCKS);
+  report(memcmp(buf, in, sizeof(buf)) == 0, &test, &fail);
+
+  /* a key of its own gets code of its own */
+  static kf_key other;
+  kf_key_init(&other, "another password");
+  kf_jit *third = kf_jit_create(&other.x, &other.x.sched);
+
+  report(matches(third, &other, &other.x.sched, in), &test, &fail);
+
+  kf_jit_destroy(enc);
+  kf_jit_destroy(dec);
+  kf_jit_destroy(third);
+
+  /* with the jit turned off the fallback gives the same output */
+  setenv("KF128_JIT", "off", 1);
+  kf_jit *off = kf_jit_create(&key.x, &key.x.sched);
+
+  report(!kf_jit_native(off) && matches(off, &key, &key.x.sched, in), &test,
+         &fail);
+
+  kf_jit_destroy(off);
+  kf_jit_destroy(NULL);
+
+  kf_wipe(&key, sizeof(key));
+  kf_wipe(&other, sizeof(other));
+
+  if (fail == 0)
+    printf("[*] All jit tests passed.\n");
+
+  return fail;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "../../src/kf128.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_BLOCKS 150
+
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the kernel dispatch functions.\n");
+
+  /* the environment override is read when the first kernel is picked */
+  setenv("KF128_KERNEL", "scalar", 1);
+
+  if (strcmp(kf_kernel_get()->name, "scalar") == 0) {
+    printf("    [*] Test #%d Passed.\n", ++test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++test);
+    fail++;
+  }
+
+  if (kf_kernel_select("no such kernel") == -1) {
+    printf("    [*] Test #%d Passed.\n", ++test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++test);
+    fail++;
+  }
+
+  static kf_xctx x;
+  kf_expand_passphrase_x("This is a password", &x);
+
+  static uint32_t in[MAX_BLOCKS * 4], out[MAX_BLOCKS * 4],
+      ref[MAX_BLOCKS * 4];
+
+  for (int i = 0; i < MAX_BLOCKS * 4; i++) {
+    in[i] = (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+  }
+
+  for (int i = 0; i < MAX_BLOCKS * 4; i += 4) {
+    kf_block(in + i, ref + i, &x.ctx);
+  }
+
+  size_t count;
+  const kf_kernel *kernels = kf_kernel_list(&count);
+
+  for (size_t k = 0; k < count; k++) {
+    if (!kernels[k].supported()) {
+      printf("    [*] Kernel %s not supported, skipping.\n", kernels[k].name);
+      continue;
+    }
+
+    if (kf_kernel_select(kernels[k].name) != 0 ||
+        kf_kernel_get() != &kernels[k]) {
+      printf("    [*] Test #%d Failed.\n", ++test);
+      fail++;
+      continue;
+    }
+
+    memset(out, 0, sizeof(out));
+    kf_block_n(in, out, MAX_BLOCKS, &x.ctx);
+
+    if (memcmp(ref, out, sizeof(out)) == 0) {
+      printf("    [*] Test #%d Passed.\n", ++test);
+    } else {
+      printf("    [*] Test #%d Failed (%s).\n", ++test, kernels[k].name);
+      fail++;
+    }
+
+    memset(out, 0, sizeof(out));
+    kf_block_n_x(in, out, MAX_BLOCKS, &x);
+
+    if (memcmp(ref, out, sizeof(out)) == 0) {
+      printf("    [*] Test #%d Passed.\n", ++test);
+    } else {
+      printf("    [*] Test #%d Failed (%s).\n", ++test, kernels[k].name);
+      fail++;
+    }
+  }
+
+  if (fail == 0)
+    printf("[*] All kernel tests passed.\n");
+
+  return fail;
+}
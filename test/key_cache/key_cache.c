@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int compare_files(const char *a, const char *b) {
+  FILE *in = fopen(a, "rb");
+  FILE *in2 = fopen(b, "rb");
+
+  int ch1 = getc(in);
+  int ch2 = getc(in2);
+
+  while ((ch1 != EOF) && (ch2 != EOF) && (ch1 == ch2)) {
+    ch1 = getc(in);
+    ch2 = getc(in2);
+  }
+
+  fclose(in);
+  fclose(in2);
+
+  return ch1 == ch2;
+}
+
+static void report(const int passed, int *test, int *fail) {
+  if (passed) {
+    printf("    [*] Test #%d Passed.\n", ++*test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++*test);
+    (*fail)++;
+  }
+}
+
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the key cache.\n");
+
+  /* the FIPS 180-4 "abc" test vector */
+  const uint8_t abc[KF_DIGEST_SIZE] = {
+      0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40,
+      0xde, 0x5d, 0xae, 0x22, 0x23, 0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17,
+      0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad};
+  uint8_t digest[KF_DIGEST_SIZE];
+
+  kf_sha256((const uint8_t *)"abc", 3, digest);
+  report(memcmp(digest, abc, KF_DIGEST_SIZE) == 0, &test, &fail);
+
+  kf_key_cache *cache = kf_key_cache_create(2);
+
+  kf_key expected;
+  kf_key_init(&expected, "first passphrase");
+
+  /* a hit returns the same key, which matches a fresh expansion */
+  const kf_key *a = kf_key_cache_acquire(cache, "first passphrase");
+  const kf_key *b = kf_key_cache_acquire(cache, "first passphrase");
+
+  report(a && a == b && memcmp(a, &expected, sizeof(kf_key)) == 0, &test,
+         &fail);
+
+  kf_key_cache_release(cache, a);
+  kf_key_cache_release(cache, b);
+
+  /* the least recently used key is evicted, not the first one */
+  const kf_key *c = kf_key_cache_acquire(cache, "second passphrase");
+  kf_key_cache_release(cache, c);
+  a = kf_key_cache_acquire(cache, "first passphrase");
+  kf_key_cache_release(cache, a);
+  const kf_key *d = kf_key_cache_acquire(cache, "third passphrase");
+  kf_key_cache_release(cache, d);
+
+  const kf_key *a2 = kf_key_cache_acquire(cache, "first passphrase");
+  report(a2 == a, &test, &fail);
+
+  /* a full cache of keys in use hands out a private key */
+  const kf_key *e = kf_key_cache_acquire(cache, "third passphrase");
+  const kf_key *f = kf_key_cache_acquire(cache, "fourth passphrase");
+
+  kf_key fourth;
+  kf_key_init(&fourth, "fourth passphrase");
+
+  report(f && f != a2 && f != e && memcmp(f, &fourth, sizeof(kf_key)) == 0,
+         &test, &fail);
+
+  kf_key_cache_release(cache, a2);
+  kf_key_cache_release(cache, e);
+  kf_key_cache_release(cache, f);
+
+  /* the file modes give the same output with a cached key */
+  char iv[] = "ABCDabcd1234EFGH";
+  char padding[] = "vdslsilvfdkvlfdn";
+
+  FILE *file = fopen("kf_cache_plain.txt", "wb");
+  for (int i = 0; i < 1000; i++) {
+    putc(i % 26 + 65, file);
+  }
+  fclose(file);
+
+  kf_encrypt_file_cbc("kf_cache_plain.txt", "kf_cache_a.txt",
+                      "first passphrase", iv, padding);
+
+  a = kf_key_cache_acquire(cache, "first passphrase");
+  int status = kf_encrypt_file_cbc_key("kf_cache_plain.txt", "kf_cache_b.txt",
+                                       a, iv, padding, NULL);
+  status |= kf_decrypt_file_cbc_key("kf_cache_b.txt", "kf_cache_dec.txt", a,
+                                    NULL);
+  kf_key_cache_release(cache, a);
+
+  report(status == KF_OK && compare_files("kf_cache_a.txt", "kf_cache_b.txt") &&
+             compare_files("kf_cache_plain.txt", "kf_cache_dec.txt"),
+         &test, &fail);
+
+  kf_key_cache_destroy(cache);
+
+  remove("kf_cache_plain.txt");
+  remove("kf_cache_a.txt");
+  remove("kf_cache_b.txt");
+  remove("kf_cache_dec.txt");
+
+  if (fail == 0)
+    printf("[*] All key cache tests passed.\n");
+
+  return fail;
+}
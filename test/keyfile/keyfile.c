@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PLAIN_SIZE 10007
+#define KEYFILE_SIZE (KF_KEYFILE_HEADER + sizeof(kf_key))
+
+static void report(const int passed, int *test, int *fail) {
+  if (passed) {
+    printf("    [*] Test #%d Passed.\n", ++*test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++*test);
+    (*fail)++;
+  }
+}
+
+static size_t read_file(const char *name, uint8_t *buffer, size_t len) {
+  FILE *f = fopen(name, "rb");
+  if (!f)
+    return 0;
+  size_t got = fread(buffer, 1, len, f);
+  fclose(f);
+  return got;
+}
+
+static void write_file(const char *name, const uint8_t *buffer, size_t len) {
+  FILE *f = fopen(name, "wb");
+  fwrite(buffer, 1, len, f);
+  fclose(f);
+}
+
+/*
+ * an exported key must open to the same key object, in both directions, and
+ * a damaged or foreign keyfile must be refused.
+ */
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing keyfiles.\n");
+
+  char iv[] = "ABCDabcd1234EFGH";
+  char passphrase[] = "this is my password";
+
+  static kf_key key;
+  static uint8_t file[KEYFILE_SIZE + 1];
+  static uint8_t plain[PLAIN_SIZE];
+  static uint8_t back[PLAIN_SIZE + 64];
+
+  kf_key_init(&key, passphrase);
+
+  for (size_t i = 0; i < PLAIN_SIZE; i++)
+    plain[i] = (uint8_t)(rand() % 26 + 65);
+
+  write_file("kf_keyfile_plain.txt", plain, PLAIN_SIZE);
+
+  report(kf_key_export(&key, "kf_keyfile.kfk") == KF_OK &&
+             read_file("kf_keyfile.kfk", file, sizeof(file)) == KEYFILE_SIZE,
+         &test, &fail);
+
+  /* the key opens as it was exported */
+  kf_keyfile kf;
+  int status = kf_keyfile_open(&kf, "kf_keyfile.kfk");
+
+  report(status == KF_OK && memcmp(kf.key, &key, sizeof(kf_key)) == 0, &test,
+         &fail);
+
+  /* and encrypts and decrypts like the passphrase */
+  status |= kf_encrypt_file_cbc_key("kf_keyfile_plain.txt",
+                                    "kf_keyfile_enc.txt", kf.key, iv, iv,
+                                    NULL);
+  status |= kf_decrypt_file_cbc("kf_keyfile_enc.txt", "kf_keyfile_dec.txt",
+                                passphrase);
+  status |= read_file("kf_keyfile_dec.txt", back, sizeof(back)) != PLAIN_SIZE ||
+            memcmp(back, plain, PLAIN_SIZE) != 0;
+  status |= kf_encrypt_file_ctr("kf_keyfile_plain.txt", "kf_keyfile_enc.txt",
+                                passphrase, iv);
+  status |= kf_decrypt_file_ctr_key("kf_keyfile_enc.txt", "kf_keyfile_dec.txt",
+                                    kf.key, NULL);
+
+  report(status == KF_OK &&
+             read_file("kf_keyfile_dec.txt", back, sizeof(back)) ==
+                 PLAIN_SIZE &&
+             memcmp(back, plain, PLAIN_SIZE) == 0,
+         &test, &fail);
+
+  kf_keyfile_close(&kf);
+  report(kf.key == NULL && kf.data == NULL, &test, &fail);
+
+  /* a changed byte anywhere, in the header or the key, is refused */
+  const size_t flips[] = {0, 8, 12, 16, 24, KF_KEYFILE_HEADER,
+                          KEYFILE_SIZE / 2, KEYFILE_SIZE - 1};
+  int passed = 1;
+
+  for (size_t f = 0; f < sizeof(flips) / sizeof(flips[0]); f++) {
+    file[flips[f]] ^= 0x01;
+    write_file("kf_keyfile_bad.kfk", file, KEYFILE_SIZE);
+    file[flips[f]] ^= 0x01;
+
+    passed &= kf_keyfile_open(&kf, "kf_keyfile_bad.kfk") == KF_ERR_FORMAT &&
+              kf.key == NULL;
+  }
+  report(passed, &test, &fail);
+
+  /* so is a keyfile too short or too long */
+  write_file("kf_keyfile_bad.kfk", file, KEYFILE_SIZE - 1);
+  passed = kf_keyfile_open(&kf, "kf_keyfile_bad.kfk") == KF_ERR_FORMAT;
+  write_file("kf_keyfile_bad.kfk", file, KEYFILE_SIZE + 1);
+  passed &= kf_keyfile_open(&kf, "kf_keyfile_bad.kfk") == KF_ERR_FORMAT;
+  report(passed, &test, &fail);
+
+  /* and a keyfile that is not there */
+  report(kf_keyfile_open(&kf, "kf_keyfile_missing.kfk") == KF_ERR_OPEN, &test,
+         &fail);
+
+  kf_wipe(&key, sizeof(key));
+
+  remove("kf_keyfile.kfk");
+  remove("kf_keyfile_bad.kfk");
+  remove("kf_keyfile_plain.txt");
+  remove("kf_keyfile_enc.txt");
+  remove("kf_keyfile_dec.txt");
+
+  if (fail == 0)
+    printf("[*] All keyfile tests passed.\n");
+
+  return fail;
+}
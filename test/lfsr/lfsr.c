@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * the leaping lfsr must match stepping kf_lfsr one bit at a time.
+ */
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the lfsr_n and lfsr_byte functions.\n");
+
+  const size_t steps[] = {0, 1, 7, 8, 15, 16, 17, 26, 32, 100, 1000};
+
+  for (size_t s = 0; s < sizeof(steps) / sizeof(steps[0]); s++) {
+    int passed = 1;
+
+    for (int i = 0; i < 1000; i++) {
+      uint32_t a = (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+      uint32_t b = a;
+
+      for (size_t j = 0; j < steps[s]; j++)
+        kf_lfsr(&a);
+
+      kf_lfsr_n(&b, steps[s]);
+
+      passed &= a == b;
+    }
+
+    if (passed) {
+      printf("    [*] Test #%d Passed.\n", ++test);
+    } else {
+      printf("    [*] Test #%d Failed.\n", ++test);
+      fail++;
+    }
+  }
+
+  int passed = 1;
+  uint32_t a = 0x8000A5C3, b = a;
+
+  for (int i = 0; i < 1000; i++) {
+    for (int j = 0; j < 8; j++)
+      kf_lfsr(&a);
+
+    passed &= (a & 0xFF) == kf_lfsr_byte(&b) && a == b;
+  }
+
+  if (passed) {
+    printf("    [*] Test #%d Passed.\n", ++test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++test);
+    fail++;
+  }
+
+  if (fail == 0)
+    printf("[*] All lfsr tests passed.\n");
+
+  return fail;
+}
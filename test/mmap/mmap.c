@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int compare_files(const char *a, const char *b) {
+  FILE *in = fopen(a, "rb");
+  FILE *in2 = fopen(b, "rb");
+
+  int ch1 = getc(in);
+  int ch2 = getc(in2);
+
+  while ((ch1 != EOF) && (ch2 != EOF) && (ch1 == ch2)) {
+    ch1 = getc(in);
+    ch2 = getc(in2);
+  }
+
+  fclose(in);
+  fclose(in2);
+
+  return ch1 == ch2;
+}
+
+static void report(const int passed, int *test, int *fail) {
+  if (passed) {
+    printf("    [*] Test #%d Passed.\n", ++*test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++*test);
+    (*fail)++;
+  }
+}
+
+/*
+ * the mmap backend must produce the same ciphertext as the stdio backend,
+ * and decrypt it back to the plaintext.
+ */
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the mmap file backend.\n");
+
+  char iv[] = "ABCDabcd1234EFGH";
+  char padding[] = "vdslsilvfdkvlfdn";
+  char passphrase[] = "this is my password";
+
+  const kf_opts stdio = {1, 0, KF_BACKEND_STDIO};
+  const kf_opts mmap = {2, 0, KF_BACKEND_MMAP};
+
+  const long sizes[] = {0, 1, 15, 16, 17, 1000, 100003};
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    FILE *f = fopen("kf_mmap_plain.txt", "wb");
+    for (long i = 0; i < sizes[s]; i++) {
+      putc(rand() % 26 + 65, f);
+    }
+    fclose(f);
+
+    int status = kf_encrypt_file_cbc_ex("kf_mmap_plain.txt", "kf_mmap_a.txt",
+                                        passphrase, iv, padding, &stdio);
+    status |= kf_encrypt_file_cbc_ex("kf_mmap_plain.txt", "kf_mmap_b.txt",
+                                     passphrase, iv, padding, &mmap);
+    status |= kf_decrypt_file_cbc_ex("kf_mmap_b.txt", "kf_mmap_dec.txt",
+                                     passphrase, &mmap);
+
+    report(status == KF_OK && compare_files("kf_mmap_a.txt", "kf_mmap_b.txt") &&
+               compare_files("kf_mmap_plain.txt", "kf_mmap_dec.txt"),
+           &test, &fail);
+
+    status = kf_encrypt_file_ctr_ex("kf_mmap_plain.txt", "kf_mmap_a.txt",
+                                    passphrase, iv, &stdio);
+    status |= kf_encrypt_file_ctr_ex("kf_mmap_plain.txt", "kf_mmap_b.txt",
+                                     passphrase, iv, &mmap);
+    status |= kf_decrypt_file_ctr_ex("kf_mmap_b.txt", "kf_mmap_dec.txt",
+                                     passphrase, &mmap);
+
+    report(status == KF_OK && compare_files("kf_mmap_a.txt", "kf_mmap_b.txt") &&
+               compare_files("kf_mmap_plain.txt", "kf_mmap_dec.txt"),
+           &test, &fail);
+  }
+
+  /* a truncated ciphertext is rejected */
+  FILE *f = fopen("kf_mmap_a.txt", "wb");
+  fwrite(iv, 1, 20, f);
+  fclose(f);
+
+  report(kf_decrypt_file_cbc_ex("kf_mmap_a.txt", "kf_mmap_dec.txt", passphrase,
+                                &mmap) == KF_ERR_FORMAT,
+         &test, &fail);
+
+  remove("kf_mmap_plain.txt");
+  remove("kf_mmap_a.txt");
+  remove("kf_mmap_b.txt");
+  remove("kf_mmap_dec.txt");
+
+  if (fail == 0)
+    printf("[*] All mmap tests passed.\n");
+
+  return fail;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEYS 3
+#define MAX_BLOCKS 1000
+#define MSGS 12
+
+static void report(const int passed, int *test, int *fail) {
+  if (passed) {
+    printf("    [*] Test #%d Passed.\n", ++*test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++*test);
+    (*fail)++;
+  }
+}
+
+/* compare kf_block_multi with kf_block_x on every block */
+static int matches(const kf_xctx *const *xs, const uint32_t *in,
+                   const size_t n, const int in_place) {
+  static uint32_t want[MAX_BLOCKS * 4];
+  static uint32_t got[MAX_BLOCKS * 4];
+
+  for (size_t i = 0; i < n; i++)
+    kf_block_x(in + 4 * i, want + 4 * i, xs[i]);
+
+  if (in_place) {
+    memcpy(got, in, n * BLOCK_SIZE);
+    kf_block_multi(xs, got, got, n);
+  } else {
+    kf_block_multi(xs, in, got, n);
+  }
+
+  return memcmp(want, got, n * BLOCK_SIZE) == 0;
+}
+
+/*
+ * every block and message must come out as it does under its own key alone,
+ * however the keys are mixed and in whatever runs they come.
+ */
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the multi-key functions.\n");
+
+  const char *passphrases[KEYS] = {"this is my password", "another password",
+                                   "a third password"};
+
+  static kf_key keys[KEYS];
+  static uint32_t in[MAX_BLOCKS * 4];
+  const kf_xctx *xs[MAX_BLOCKS];
+
+  for (int k = 0; k < KEYS; k++)
+    kf_key_init(&keys[k], passphrases[k]);
+
+  for (size_t i = 0; i < MAX_BLOCKS * 4; i++)
+    in[i] = (uint32_t)rand() ^ (uint32_t)rand() << 16;
+
+  const size_t counts[] = {0, 1, 7, 8, 9, 64, 65, MAX_BLOCKS};
+  int passed;
+
+  /* one key throughout */
+  passed = 1;
+  for (size_t i = 0; i < MAX_BLOCKS; i++)
+    xs[i] = &keys[0].x;
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    passed &= matches(xs, in, counts[c], 0);
+  report(passed, &test, &fail);
+
+  /* a different key on every block */
+  passed = 1;
+  for (size_t i = 0; i < MAX_BLOCKS; i++)
+    xs[i] = &keys[i % KEYS].x;
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    passed &= matches(xs, in, counts[c], 0);
+  report(passed, &test, &fail);
+
+  /* runs of every length, some long enough for the multi-block kernel */
+  passed = 1;
+  for (size_t i = 0, run = 1, k = 0; i < MAX_BLOCKS; run = run % 20 + 3) {
+    for (size_t j = 0; j < run && i < MAX_BLOCKS; j++, i++)
+      xs[i] = &keys[k].x;
+    k = (k + 1 + (size_t)rand() % 2) % KEYS;
+  }
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    passed &= matches(xs, in, counts[c], 0) && matches(xs, in, counts[c], 1);
+  report(passed, &test, &fail);
+
+  /* messages of every size agree with kf_ctr_x on each */
+  const size_t lens[MSGS] = {0, 1, 15, 16, 17, 100, 1023, 1024, 5000, 3, 64, 0};
+  static char ivs[MSGS][BLOCK_SIZE + 1];
+
+  static uint8_t plain[MSGS][5000];
+  static uint8_t want[MSGS][5000];
+  static uint8_t got[MSGS][5000];
+  kf_msg msgs[MSGS];
+
+  for (size_t m = 0; m < MSGS; m++) {
+    for (size_t i = 0; i < lens[m]; i++)
+      plain[m][i] = (uint8_t)(rand() % 26 + 65);
+
+    memcpy(ivs[m], "ABCDabcd1234EFGH", BLOCK_SIZE);
+    ivs[m][0] = (char)('A' + m);
+    kf_ctr_x(plain[m], want[m], lens[m], ivs[m], 0, &keys[m % KEYS].x);
+
+    msgs[m].x = &keys[m % KEYS].x;
+    msgs[m].iv = ivs[m];
+    msgs[m].in = plain[m];
+    msgs[m].out = got[m];
+    msgs[m].len = lens[m];
+  }
+
+  kf_ctr_multi(msgs, MSGS);
+
+  passed = 1;
+  for (size_t m = 0; m < MSGS; m++)
+    passed &= memcmp(want[m], got[m], lens[m]) == 0;
+  report(passed, &test, &fail);
+
+  /* in place, and back */
+  for (size_t m = 0; m < MSGS; m++)
+    msgs[m].in = got[m];
+
+  kf_ctr_multi(msgs, MSGS);
+
+  passed = 1;
+  for (size_t m = 0; m < MSGS; m++)
+    passed &= memcmp(plain[m], got[m], lens[m]) == 0;
+  report(passed, &test, &fail);
+
+  /* keys from a cache */
+  kf_key_cache *cache = kf_key_cache_create(KEYS);
+  const kf_key *cached[KEYS];
+
+  for (int k = 0; k < KEYS; k++)
+    cached[k] = kf_key_cache_acquire(cache, passphrases[k]);
+
+  for (size_t m = 0; m < MSGS; m++) {
+    msgs[m].x = &cached[m % KEYS]->x;
+    msgs[m].in = plain[m];
+  }
+
+  kf_ctr_multi(msgs, MSGS);
+
+  passed = 1;
+  for (size_t m = 0; m < MSGS; m++)
+    passed &= memcmp(want[m], got[m], lens[m]) == 0;
+  report(passed, &test, &fail);
+
+  for (int k = 0; k < KEYS; k++)
+    kf_key_cache_release(cache, cached[k]);
+  kf_key_cache_destroy(cache);
+
+  kf_wipe(keys, sizeof(keys));
+
+  if (fail == 0)
+    printf("[*] All multi-key tests passed.\n");
+
+  return fail;
+}
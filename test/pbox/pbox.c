@@ -37,6 +37,20 @@ int main(void) {
     printf("    [*] Test #1 Failed.\n");
   }
 
+  /* the permutation for this seed must never change */
+  const uint8_t expected[8] = {6, 5, 0, 3, 4, 7, 2, 1};
+
+  kf_init_pbox(pbox, 0xDEADBEEF);
+
+  const int same = memcmp(pbox, expected, sizeof(expected)) == 0;
+
+  if (same) {
+    printf("    [*] Test #2 Passed.\n");
+  } else {
+    printf("    [*] Test #2 Failed.\n");
+    fail = 1;
+  }
+
   if (fail == 0)
     printf("[*] All block tests passed.\n");
 
@@ -37,6 +37,21 @@ int main(void) {
     printf("    [*] Test #1 Failed.\n");
   }
 
+  /* the permutation for this seed must never change */
+  const uint8_t expected[16] = {0xBE, 0xAD, 0xE0, 0xF0, 0xE1, 0xC1, 0x1B, 0x94,
+                                0x44, 0x37, 0x1C, 0x8B, 0x3D, 0x9C, 0x14, 0x20};
+
+  kf_init_sbox(sbox, 0xDEADBEEF);
+
+  const int same = memcmp(sbox, expected, sizeof(expected)) == 0;
+
+  if (same) {
+    printf("    [*] Test #2 Passed.\n");
+  } else {
+    printf("    [*] Test #2 Failed.\n");
+    fail = 1;
+  }
+
   if (fail == 0)
     printf("[*] All block tests passed.\n");
 
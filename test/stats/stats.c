@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FILE_SIZE 5000
+
+static void report(const int passed, int *test, int *fail) {
+  if (passed) {
+    printf("    [*] Test #%d Passed.\n", ++*test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++*test);
+    (*fail)++;
+  }
+}
+
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the stats functions.\n");
+
+  char iv[] = "ABCDabcd1234EFGH";
+  char passphrase[] = "this is my password";
+
+  FILE *f = fopen("kf_test_plain.txt", "wb");
+  for (int i = 0; i < FILE_SIZE; i++) {
+    putc(rand() % 26 + 65, f);
+  }
+  fclose(f);
+
+  kf_opts opts = {1, KF_BUFFER_SIZE, KF_BACKEND_STDIO};
+  kf_stats s;
+
+  kf_stats_reset();
+  kf_stats_get(&s);
+
+  report(s.bytes_read == 0 && s.blocks == 0 && s.keys == 0, &test, &fail);
+
+  int status = kf_encrypt_file_ctr_ex("kf_test_plain.txt", "kf_test_enc.txt",
+                                      passphrase, iv, &opts);
+  kf_stats_get(&s);
+
+  if (kf_stats_enabled()) {
+    report(status == KF_OK && s.keys == 1, &test, &fail);
+    report(s.bytes_read == FILE_SIZE &&
+               s.bytes_written == FILE_SIZE + BLOCK_SIZE,
+           &test, &fail);
+    report(s.blocks == (FILE_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE, &test,
+           &fail);
+    report(s.reads >= 1 && s.writes >= 2 && s.maps == 0, &test, &fail);
+    report(s.key_ns > 0 && s.cipher_ns > 0, &test, &fail);
+  } else {
+    report(status == KF_OK && s.keys == 0 && s.blocks == 0, &test, &fail);
+  }
+
+  /* the aead mode counts the blocks of its counter mode once */
+  kf_stats_reset();
+  status = kf_encrypt_file_aead_ex("kf_test_plain.txt", "kf_test_enc.txt",
+                                   passphrase, iv, &opts);
+  kf_stats_get(&s);
+
+  if (kf_stats_enabled())
+    report(status == KF_OK &&
+               s.blocks == (FILE_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE + 2 &&
+               s.mac_ns > 0,
+           &test, &fail);
+  else
+    report(status == KF_OK && s.blocks == 0 && s.mac_ns == 0, &test, &fail);
+
+  /* the async backend counts the iv it writes and reads */
+  kf_opts async = {1, KF_BUFFER_SIZE, KF_BACKEND_THREADS};
+
+  kf_stats_reset();
+  status = kf_encrypt_file_ctr_ex("kf_test_plain.txt", "kf_test_enc.txt",
+                                  passphrase, iv, &async);
+  status |= kf_decrypt_file_ctr_ex("kf_test_enc.txt", "kf_test_dec.txt",
+                                   passphrase, &async);
+  kf_stats_get(&s);
+
+  if (kf_stats_enabled())
+    report(status == KF_OK && s.bytes_read == 2 * FILE_SIZE + BLOCK_SIZE &&
+               s.bytes_written == 2 * FILE_SIZE + BLOCK_SIZE,
+           &test, &fail);
+  else
+    report(status == KF_OK && s.bytes_written == 0, &test, &fail);
+
+  remove("kf_test_dec.txt");
+
+  kf_stats_reset();
+  kf_stats_get(&s);
+
+  report(s.bytes_read == 0 && s.blocks == 0 && s.cipher_ns == 0, &test,
+         &fail);
+
+  remove("kf_test_plain.txt");
+  remove("kf_test_enc.txt");
+
+  if (fail == 0)
+    printf("[*] All stats tests passed.\n");
+
+  return fail;
+}
@@ -0,0 +1,48 @@
+# shared by the test Makefiles, which set TARGET and include this file.
+# the library is built once in src/ and every test links against it.
+
+CC = gcc
+# CFLAGS as given, before the additions below, for the build of the library
+LIB_CFLAGS := $(CFLAGS)
+CFLAGS += -std=c99
+CFLAGS += -O3
+CFLAGS += -Wall
+CFLAGS += -Wextra
+CFLAGS += -Werror
+CFlags += -pedantic
+
+SRC = ../../src
+LIB = $(SRC)/libkf128.a
+
+.PHONY: default all clean FORCE
+
+default: $(TARGET)
+all: default
+
+OBJECTS = $(patsubst %.c, %.o, $(wildcard *.c))
+HEADERS = $(wildcard *.h) $(wildcard $(SRC)/*.h)
+
+%.o: %.c $(HEADERS)
+	$(CC) $(CFLAGS) -c $< -o $@
+
+.PRECIOUS: $(TARGET) $(OBJECTS)
+
+LIBS += -lpthread
+
+ifeq ($(ZLIB), 1)
+LIBS += -lz
+endif
+
+ifeq ($(OPENCL), 1)
+LIBS += -lOpenCL
+endif
+
+$(LIB): FORCE
+	CFLAGS='$(LIB_CFLAGS)' $(MAKE) -C $(SRC) lib
+
+$(TARGET): $(OBJECTS) $(LIB)
+	$(CC) $(OBJECTS) $(LIB) -Wall $(LIBS) -o $@
+
+clean:
+	-rm -f *.o
+	-rm -f $(TARGET)
@@ -8,13 +8,35 @@
 import subprocess
 
 tests = {
+    "lfsr" : "lfsr/test_lfsr",
     "pht"   :"pht/test_pht",
     "sbox" : "sbox/test_sbox",
     "pbox" : "pbox/test_pbox",
     "expand_passphrase" : "expand_passphrase/test_expand_passphrase",
     "invert_ctx" : "invert_ctx/test_invert_ctx",
     "block" :"block/test_block",
+    "block_n" : "block_n/test_block_n",
+    "block_x" : "block_x/test_block_x",
+    "block_simd" : "block_simd/test_block_simd",
+    "kernel" : "kernel/test_kernel",
     "encrypt_file_cbc" : "encrypt_file_cbc/test_encrypt_file_cbc",
+    "decrypt_file_cbc_ex" : "decrypt_file_cbc_ex/test_decrypt_file_cbc_ex",
+    "cbc_stream" : "cbc_stream/test_cbc_stream",
+    "key_cache" : "key_cache/test_key_cache",
+    "batch" : "batch/test_batch",
+    "stats" : "stats/test_stats",
+    "mmap" : "mmap/test_mmap",
+    "async" : "async/test_async",
+    "chunked" : "chunked/test_chunked",
+    "aead" : "aead/test_aead",
+    "xts" : "xts/test_xts",
+    "jit" : "jit/test_jit",
+    "multi" : "multi/test_multi",
+    "keyfile" : "keyfile/test_keyfile",
+    "ctr" : "ctr/test_ctr",
+    "iov" : "iov/test_iov",
+    "fd" : "fd/test_fd",
+    "gpu" : "gpu/test_gpu",
     }
 
 exit_codes = {}
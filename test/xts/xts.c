@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2018-2019, Michael Harper
+ *
+ * See LICENSE for licensing information */
+
+#include "../../src/kf128.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SECTORS 70
+#define MAX_SECTOR 4096
+
+static void report(const int passed, int *test, int *fail) {
+  if (passed) {
+    printf("    [*] Test #%d Passed.\n", ++*test);
+  } else {
+    printf("    [*] Test #%d Failed.\n", ++*test);
+    (*fail)++;
+  }
+}
+
+/* multiply a little endian 128-bit tweak by x */
+static void double_tweak(uint8_t t[BLOCK_SIZE]) {
+  const uint8_t carry = t[15] >> 7;
+  for (int i = 15; i > 0; i--)
+    t[i] = (uint8_t)(t[i] << 1 | t[i - 1] >> 7);
+  t[0] = (uint8_t)(t[0] << 1 ^ (carry ? 0x87 : 0));
+}
+
+/* encrypt one sector a block at a time with kf_block_x */
+static void reference(const kf_key *key, uint64_t sector, size_t size,
+                      const uint8_t *in, uint8_t *out) {
+  uint8_t t[BLOCK_SIZE] = {0};
+  uint8_t b[BLOCK_SIZE];
+  uint32_t w[4];
+
+  for (int i = 0; i < 8; i++)
+    t[i] = (uint8_t)(sector >> (8 * i));
+  memcpy(w, t, BLOCK_SIZE);
+  kf_block_x(w, w, &key->x);
+  memcpy(t, w, BLOCK_SIZE);
+  double_tweak(t);
+
+  for (size_t j = 0; j < size / BLOCK_SIZE; j++) {
+    for (int i = 0; i < BLOCK_SIZE; i++)
+      b[i] = in[BLOCK_SIZE * j + i] ^ t[i];
+    memcpy(w, b, BLOCK_SIZE);
+    kf_block_x(w, w, &key->x);
+    memcpy(b, w, BLOCK_SIZE);
+    for (int i = 0; i < BLOCK_SIZE; i++)
+      out[BLOCK_SIZE * j + i] = b[i] ^ t[i];
+    double_tweak(t);
+  }
+}
+
+/*
+ * every sector must encrypt on its own by its number, match a block by block
+ * reference, and decrypt back, however the sectors are split over calls.
+ */
+int main(void) {
+  int fail = 0;
+  int test = 0;
+
+  printf("[*] Testing the xts mode.\n");
+
+  char passphrase[] = "this is my password";
+
+  static kf_key key;
+  static uint8_t plain[SECTORS * MAX_SECTOR];
+  static uint8_t enc[SECTORS * MAX_SECTOR];
+  static uint8_t one[SECTORS * MAX_SECTOR];
+  static uint8_t back[SECTORS * MAX_SECTOR];
+
+  kf_key_init(&key, passphrase);
+
+  for (size_t i = 0; i < sizeof(plain); i++)
+    plain[i] = (uint8_t)(rand() % 26 + 65);
+
+  const size_t sizes[] = {16, 512, 4096};
+  const uint64_t firsts[] = {0, 1000, UINT64_MAX - SECTORS};
+
+  for (size_t z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++) {
+    const size_t size = sizes[z];
+    kf_xts xts;
+
+    int passed = kf_xts_init(&xts, &key, size) == KF_OK;
+
+    for (size_t f = 0; f < sizeof(firsts) / sizeof(firsts[0]); f++) {
+      /* one call on every sector, and one call per sector */
+      kf_xts_sectors(&xts, firsts[f], SECTORS, plain, enc, 1);
+      for (size_t s = 0; s < SECTORS; s++)
+        kf_xts_sectors(&xts, firsts[f] + s, 1, plain + s * size,
+                       one + s * size, 1);
+
+      kf_xts_sectors(&xts, firsts[f], SECTORS, enc, back, 0);
+
+      passed &= memcmp(enc, one, SECTORS * size) == 0 &&
+                memcmp(back, plain, SECTORS * size) == 0;
+
+      /* the first, the last and some sector in between */
+      const size_t picks[] = {0, 37, SECTORS - 1};
+      for (size_t p = 0; p < sizeof(picks) / sizeof(picks[0]); p++) {
+        reference(&key, firsts[f] + picks[p], size, plain + picks[p] * size,
+                  one);
+        passed &= memcmp(enc + picks[p] * size, one, size) == 0;
+      }
+    }
+
+    report(passed, &test, &fail);
+  }
+
+  kf_xts xts;
+  kf_xts_init(&xts, &key, 512);
+
+  /* the same plaintext encrypts differently in every sector and block */
+  memset(plain, 'a', 2 * 512);
+  kf_xts_sectors(&xts, 7, 2, plain, enc, 1);
+  report(memcmp(enc, enc + 512, 512) != 0 && memcmp(enc, enc + 16, 16) != 0,
+         &test, &fail);
+
+  /* a sector decrypts on its own, in place */
+  memcpy(back, enc + 512, 512);
+  kf_xts_sectors(&xts, 8, 1, back, back, 0);
+  report(memcmp(back, plain + 512, 512) == 0, &test, &fail);
+
+  /* a wrong sector number does not */
+  memcpy(back, enc + 512, 512);
+  kf_xts_sectors(&xts, 7, 1, back, back, 0);
+  report(memcmp(back, plain + 512, 512) != 0, &test, &fail);
+
+  /* a zero ciphertext block does not decrypt to s ^ E(s), the mask that
+   * block 0 would have with the exponent starting at 0 */
+  int passed = 1;
+  for (uint64_t s = 0; s < 64; s++) {
+    uint8_t t[BLOCK_SIZE] = {0};
+    uint32_t w[4];
+
+    for (int i = 0; i < 8; i++)
+      t[i] = (uint8_t)(s >> (8 * i));
+    memcpy(w, t, BLOCK_SIZE);
+    kf_block_x(w, w, &key.x);
+
+    uint8_t leak[BLOCK_SIZE];
+    memcpy(leak, w, BLOCK_SIZE);
+    for (int i = 0; i < BLOCK_SIZE; i++)
+      leak[i] ^= t[i];
+
+    memset(back, 0, 512);
+    kf_xts_sectors(&xts, s, 1, back, back, 0);
+    passed &= memcmp(back, leak, BLOCK_SIZE) != 0;
+  }
+  report(passed, &test, &fail);
+
+  /* a sector size that is not whole blocks is refused */
+  report(kf_xts_init(&xts, &key, 0) == KF_ERR_FORMAT &&
+             kf_xts_init(&xts, &key, 520) == KF_ERR_FORMAT,
+         &test, &fail);
+
+  kf_wipe(&key, sizeof(key));
+
+  if (fail == 0)
+    printf("[*] All xts tests passed.\n");
+
+  return fail;
+}